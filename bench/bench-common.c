@@ -0,0 +1,165 @@
+/*
+ * Common code for libgpiod benchmarks.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "bench-common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+uint64_t bench_clock_nsec(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+uint64_t bench_monotonic_nsec(void)
+{
+	return bench_clock_nsec(CLOCK_MONOTONIC);
+}
+
+void bench_sleep_until(uint64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / NSEC_PER_SEC;
+	ts.tv_nsec = deadline % NSEC_PER_SEC;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+			       &ts, NULL) == EINTR)
+		;
+}
+
+clockid_t bench_parse_clock(const char *str)
+{
+	if (strcmp(str, "realtime") == 0)
+		return CLOCK_REALTIME;
+	else if (strcmp(str, "monotonic") == 0)
+		return CLOCK_MONOTONIC;
+	else if (strcmp(str, "boottime") == 0)
+		return CLOCK_BOOTTIME;
+
+	die("invalid clock: %s", str);
+}
+
+struct gpiod_line * bench_get_line(const char *spec)
+{
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	unsigned long offset;
+	char *dev, *sep, *end;
+
+	dev = strdup(spec);
+	if (!dev)
+		die("out of memory");
+
+	sep = strrchr(dev, ':');
+	if (!sep)
+		die("invalid line: %s (expected <chip>:<offset>)", spec);
+
+	*sep = '\0';
+	offset = strtoul(sep + 1, &end, 10);
+	if (*end != '\0' || offset > INT_MAX)
+		die("invalid GPIO offset: %s", sep + 1);
+
+	chip = gpiod_chip_open_lookup(dev);
+	if (!chip)
+		die_perror("unable to open %s", dev);
+
+	line = gpiod_chip_get_line(chip, offset);
+	if (!line)
+		die_perror("unable to retrieve GPIO line from chip");
+
+	free(dev);
+
+	return line;
+}
+
+/* The debugfs directory was renamed in linux v4.16. */
+static const char *const mockup_dirs[] = {
+	"/sys/kernel/debug/gpio-mockup",
+	"/sys/kernel/debug/gpio-mockup-event",
+};
+
+int bench_mockup_open(struct gpiod_line *line)
+{
+	const char *chip = gpiod_chip_name(gpiod_line_get_chip(line));
+	char path[PATH_MAX];
+	unsigned int i;
+	int fd;
+
+	for (i = 0; i < ARRAY_SIZE(mockup_dirs); i++) {
+		snprintf(path, sizeof(path), "%s/%s/%u", mockup_dirs[i],
+			 chip, gpiod_line_offset(line));
+
+		fd = open(path, O_WRONLY | O_CLOEXEC);
+		if (fd >= 0)
+			return fd;
+	}
+
+	die("unable to open the gpio-mockup debugfs file for %s:%u: %s",
+	    chip, gpiod_line_offset(line), strerror(errno));
+}
+
+void bench_mockup_set(int fd, int value)
+{
+	ssize_t wr;
+
+	wr = pwrite(fd, value ? "1" : "0", 1, 0);
+	if (wr != 1)
+		die("unable to inject the line value: %s", strerror(errno));
+}
+
+void bench_report(const char *name, double value, const char *unit)
+{
+	printf("%-40s %16.3f %s\n", name, value, unit);
+}
+
+void bench_report_histogram(const char *name, const struct histogram *hist)
+{
+	static const struct {
+		const char *suffix;
+		double pct;
+	} pcts[] = {
+		{ "p50", 50.0 },
+		{ "p90", 90.0 },
+		{ "p99", 99.0 },
+		{ "p99.9", 99.9 },
+	};
+	char buf[128];
+	unsigned int i;
+
+	snprintf(buf, sizeof(buf), "%s.count", name);
+	bench_report(buf, hist->total, "");
+
+	if (!hist->total)
+		return;
+
+	snprintf(buf, sizeof(buf), "%s.min", name);
+	bench_report(buf, hist->min / 1000.0, "us");
+	snprintf(buf, sizeof(buf), "%s.mean", name);
+	bench_report(buf, (double)hist->sum / hist->total / 1000.0, "us");
+
+	for (i = 0; i < ARRAY_SIZE(pcts); i++) {
+		snprintf(buf, sizeof(buf), "%s.%s", name, pcts[i].suffix);
+		bench_report(buf, histogram_percentile(hist, pcts[i].pct) /
+				  1000.0, "us");
+	}
+
+	snprintf(buf, sizeof(buf), "%s.max", name);
+	bench_report(buf, hist->max / 1000.0, "us");
+}
@@ -0,0 +1,74 @@
+/*
+ * Common code for libgpiod benchmarks.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#ifndef __GPIOD_BENCH_COMMON_H__
+#define __GPIOD_BENCH_COMMON_H__
+
+/*
+ * Helpers shared by the benchmark programs.
+ *
+ * NOTE: This is not a stable interface - it's only to avoid duplicating
+ * common code.
+ */
+
+#include <gpiod.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "tools-common.h"
+#include "tools-histogram.h"
+
+#define NSEC_PER_SEC	1000000000ULL
+
+uint64_t bench_clock_nsec(clockid_t clock);
+uint64_t bench_monotonic_nsec(void);
+void bench_sleep_until(uint64_t deadline);
+clockid_t bench_parse_clock(const char *str);
+
+/*
+ * Retrieve a line given as <chip>:<offset>. The chip is opened for every
+ * call and must be closed by the caller.
+ */
+struct gpiod_line * bench_get_line(const char *spec);
+
+/*
+ * Values of gpio-mockup lines can be driven through debugfs which makes
+ * the kernel generate events as if the line was changed from outside.
+ * Returns a file descriptor to be passed to bench_mockup_set() or dies.
+ */
+int bench_mockup_open(struct gpiod_line *line);
+void bench_mockup_set(int fd, int value);
+
+/*
+ * Results are printed one per line as '<name> <value> <unit>' so that the
+ * output of two runs can be compared with diff or a simple script.
+ */
+void bench_report(const char *name, double value, const char *unit);
+void bench_report_histogram(const char *name, const struct histogram *hist);
+
+/*
+ * Optional perf_event_open() counters (cycles, instructions, cache misses,
+ * context switches and system calls) of the calling thread. Counters that
+ * can't be opened are skipped with a warning on stderr, bench_perf_open()
+ * returns NULL if none are supported at all - all other functions accept
+ * NULL and do nothing. bench_perf_report() divides every counter by the
+ * number of operations performed between start and stop and prints the
+ * results prefixed with the given name.
+ */
+struct bench_perf;
+
+struct bench_perf * bench_perf_open(void);
+void bench_perf_close(struct bench_perf *perf);
+void bench_perf_start(struct bench_perf *perf);
+void bench_perf_stop(struct bench_perf *perf);
+void bench_perf_report(struct bench_perf *perf, const char *prefix,
+		       unsigned long ops);
+
+#endif /* __GPIOD_BENCH_COMMON_H__ */
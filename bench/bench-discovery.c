@@ -0,0 +1,603 @@
+/*
+ * Scaling of chip and line discovery with the number of chips and lines.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "bench-common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MAX_GRID		32
+#define MAX_SAMPLES		1000
+#define MOCKUP_SETTLE_NSEC	(5 * NSEC_PER_SEC)
+
+enum {
+	OPT_MEASURE = 0x100,
+};
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "chips",		required_argument,	NULL,	'c' },
+	{ "lines",		required_argument,	NULL,	'l' },
+	{ "sim",		required_argument,	NULL,	's' },
+	{ "mockup",		no_argument,		NULL,	'm' },
+	{ "tools",		required_argument,	NULL,	't' },
+	{ "repeat",		required_argument,	NULL,	'r' },
+	{ "tool-repeat",	required_argument,	NULL,	'R' },
+	/* Used internally to measure a single configuration. */
+	{ "measure",		no_argument,		NULL,	OPT_MEASURE },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvc:l:s:mt:r:R:";
+
+static void print_help(void)
+{
+	printf("Usage: %s [OPTIONS]\n", get_progname());
+	printf("Measure how chip enumeration, line lookup and tool startup scale with the\n");
+	printf("number of chips and lines\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -c, --chips=LIST:\tcomma-separated numbers of chips to set up\n");
+	printf("\t\t\t(default: 1,2,4,8)\n");
+	printf("  -l, --lines=LIST:\tcomma-separated numbers of lines per chip to set up\n");
+	printf("\t\t\t(default: 8,32,128)\n");
+	printf("  -s, --sim=PATH:\tset up simulated chips using the gpiod-sim.so\n");
+	printf("\t\t\tlibrary at PATH\n");
+	printf("  -m, --mockup:\t\tset up the chips by reloading gpio-mockup (needs root)\n");
+	printf("  -t, --tools=DIR:\trun the tools from DIR instead of looking them up in PATH\n");
+	printf("  -r, --repeat=NUM:\tnumber of runs of every library call (default: 20)\n");
+	printf("  -R, --tool-repeat=NUM:\tnumber of runs of every tool (default: 5)\n");
+	printf("\n");
+	printf("Without --sim or --mockup the chips present in the system are measured.\n");
+	printf("One row is printed per configuration: number of chips, lines per chip and\n");
+	printf("the median time in microseconds of: iterating over all chips, reading the\n");
+	printf("info of all lines, gpiod_line_find_by_name() and gpiod_chip_open_lookup()\n");
+	printf("of the last line and chip found by the iterator, gpiodetect, gpioinfo,\n");
+	printf("gpiofind and gpioget. Unavailable results are printed as '-'.\n");
+}
+
+struct discovery {
+	unsigned int chips[MAX_GRID];
+	unsigned int num_chips;
+	unsigned int lines[MAX_GRID];
+	unsigned int num_lines;
+	const char *sim;
+	bool mockup;
+	const char *tools;
+	unsigned int repeat;
+	unsigned int tool_repeat;
+};
+
+/* Name of the last chip and line found by the iterator. */
+struct targets {
+	char chip[32];
+	char label[32];
+	char line[32];
+	unsigned int num_chips;
+	unsigned int num_lines;
+};
+
+static unsigned int parse_list(const char *str, unsigned int *list)
+{
+	unsigned int num = 0;
+	unsigned long val;
+	char *end;
+
+	for (;;) {
+		if (num == MAX_GRID)
+			die("at most %d values can be given", MAX_GRID);
+
+		val = strtoul(str, &end, 10);
+		if (end == str || !val || val > UINT_MAX ||
+		    (*end != ',' && *end != '\0'))
+			die("invalid list: %s", str);
+
+		list[num++] = val;
+		if (*end == '\0')
+			return num;
+
+		str = end + 1;
+	}
+}
+
+static void find_targets(struct targets *tgt)
+{
+	struct gpiod_chip_iter *iter;
+	struct gpiod_line_iter line_iter;
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	const char *name;
+
+	memset(tgt, 0, sizeof(*tgt));
+
+	iter = gpiod_chip_iter_new();
+	if (!iter)
+		die_perror("unable to access the gpiochips");
+
+	gpiod_foreach_chip(iter, chip) {
+		if (gpiod_chip_iter_err(iter))
+			continue;
+
+		tgt->num_chips++;
+		tgt->num_lines += gpiod_chip_num_lines(chip);
+		snprintf(tgt->chip, sizeof(tgt->chip), "%s",
+			 gpiod_chip_name(chip));
+		snprintf(tgt->label, sizeof(tgt->label), "%s",
+			 gpiod_chip_label(chip));
+
+		/* Unnamed lines make gpiod_line_find_by_name() scan it all. */
+		snprintf(tgt->line, sizeof(tgt->line), "gpiod-bench-missing");
+		gpiod_line_iter_init(&line_iter, chip);
+		gpiod_foreach_line(&line_iter, line) {
+			name = gpiod_line_name(line);
+			if (name)
+				snprintf(tgt->line, sizeof(tgt->line),
+					 "%s", name);
+		}
+	}
+
+	gpiod_chip_iter_free(iter);
+}
+
+static unsigned int count_chips(void)
+{
+	struct gpiod_chip_iter *iter;
+	struct gpiod_chip *chip;
+	unsigned int num = 0;
+
+	iter = gpiod_chip_iter_new();
+	if (!iter)
+		return 0;
+
+	gpiod_foreach_chip(iter, chip) {
+		if (chip)
+			num++;
+	}
+
+	gpiod_chip_iter_free(iter);
+
+	return num;
+}
+
+/* Operations return the number of chips or lines found. */
+static unsigned int op_chip_iter(const struct targets *tgt UNUSED)
+{
+	return count_chips();
+}
+
+static unsigned int op_line_info(const struct targets *tgt UNUSED)
+{
+	struct gpiod_chip_iter *iter;
+	struct gpiod_line_iter line_iter;
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	unsigned int num = 0;
+
+	iter = gpiod_chip_iter_new();
+	if (!iter)
+		die_perror("unable to access the gpiochips");
+
+	gpiod_foreach_chip(iter, chip) {
+		if (gpiod_chip_iter_err(iter))
+			continue;
+
+		gpiod_line_iter_init(&line_iter, chip);
+		gpiod_foreach_line(&line_iter, line) {
+			if (line)
+				num++;
+		}
+	}
+
+	gpiod_chip_iter_free(iter);
+
+	return num;
+}
+
+static unsigned int op_find_name(const struct targets *tgt)
+{
+	struct gpiod_line *line;
+
+	line = gpiod_line_find_by_name(tgt->line);
+	if (!line)
+		return 0;
+
+	gpiod_chip_close(gpiod_line_get_chip(line));
+
+	return 1;
+}
+
+static unsigned int op_open_label(const struct targets *tgt)
+{
+	struct gpiod_chip *chip;
+
+	chip = gpiod_chip_open_lookup(tgt->label);
+	if (!chip)
+		die_perror("unable to open the chip labeled %s", tgt->label);
+
+	gpiod_chip_close(chip);
+
+	return 1;
+}
+
+static const struct {
+	unsigned int (*func)(const struct targets *);
+} ops[] = {
+	{ op_chip_iter },
+	{ op_line_info },
+	{ op_find_name },
+	{ op_open_label },
+};
+
+static int cmp_u64(const void *p1, const void *p2)
+{
+	uint64_t v1 = *(const uint64_t *)p1, v2 = *(const uint64_t *)p2;
+
+	return v1 < v2 ? -1 : v1 > v2;
+}
+
+static double median_usec(uint64_t *samples, unsigned int num)
+{
+	qsort(samples, num, sizeof(*samples), cmp_u64);
+
+	return samples[num / 2] / 1000.0;
+}
+
+/* Returns false if the tool couldn't be executed. */
+static bool run_tool(const struct discovery *disc, char **argv)
+{
+	char path[PATH_MAX];
+	int status, fd;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		die_perror("fork");
+
+	if (pid == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+
+		if (disc->tools) {
+			snprintf(path, sizeof(path), "%s/%s",
+				 disc->tools, argv[0]);
+			execv(path, argv);
+		} else {
+			execvp(argv[0], argv);
+		}
+
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		die_perror("waitpid");
+
+	return !WIFEXITED(status) || WEXITSTATUS(status) != 127;
+}
+
+/*
+ * The chip and line counts are only printed when measuring the chips
+ * present in the system. For a grid row they're printed by the parent,
+ * as other chips present in the system would skew them.
+ */
+static void measure(const struct discovery *disc, bool print_size)
+{
+	static uint64_t samples[MAX_SAMPLES];
+	char offset[] = "0";
+	struct targets tgt;
+	char *tools[][4] = {
+		{ "gpiodetect", NULL },
+		{ "gpioinfo", NULL },
+		{ "gpiofind", tgt.line, NULL },
+		{ "gpioget", tgt.chip, offset, NULL },
+	};
+	unsigned int i, j;
+	uint64_t start;
+	bool ok;
+
+	find_targets(&tgt);
+	if (!tgt.num_chips)
+		die("no gpiochips found");
+
+	if (print_size)
+		printf("%6u %6u", tgt.num_chips,
+		       tgt.num_lines / tgt.num_chips);
+
+	for (i = 0; i < ARRAY_SIZE(ops); i++) {
+		/* Warm up the dentry and inode caches. */
+		ops[i].func(&tgt);
+
+		for (j = 0; j < disc->repeat; j++) {
+			start = bench_monotonic_nsec();
+			ops[i].func(&tgt);
+			samples[j] = bench_monotonic_nsec() - start;
+		}
+
+		printf(" %12.1f", median_usec(samples, disc->repeat));
+	}
+
+	for (i = 0; i < ARRAY_SIZE(tools); i++) {
+		ok = run_tool(disc, tools[i]);
+
+		for (j = 0; ok && j < disc->tool_repeat; j++) {
+			start = bench_monotonic_nsec();
+			ok = run_tool(disc, tools[i]);
+			samples[j] = bench_monotonic_nsec() - start;
+		}
+
+		if (ok)
+			printf(" %12.1f",
+			       median_usec(samples, disc->tool_repeat));
+		else
+			printf(" %12s", "-");
+	}
+
+	printf("\n");
+	fflush(stdout);
+}
+
+static void run_cmd(char **argv)
+{
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		die_perror("fork");
+
+	if (pid == 0) {
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		die_perror("waitpid");
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		die("%s failed", argv[0]);
+}
+
+static void mockup_unload(void)
+{
+	char *argv[] = { "modprobe", "-r", "gpio-mockup", NULL };
+
+	run_cmd(argv);
+}
+
+static void mockup_load(unsigned int num_chips, unsigned int num_lines)
+{
+	char *argv[] = { "modprobe", "gpio-mockup", NULL,
+			 "gpio_mockup_named_lines", NULL };
+	unsigned int base, i;
+	uint64_t deadline;
+	char *ranges;
+	size_t len;
+
+	base = count_chips();
+
+	len = num_chips * 16 + 32;
+	ranges = malloc(len);
+	if (!ranges)
+		die("out of memory");
+
+	strcpy(ranges, "gpio_mockup_ranges=");
+	for (i = 0; i < num_chips; i++)
+		snprintf(ranges + strlen(ranges), len - strlen(ranges),
+			 "%s-1,%u", i ? "," : "", num_lines);
+
+	argv[2] = ranges;
+	run_cmd(argv);
+	free(ranges);
+
+	/* The device files are created asynchronously by udev. */
+	deadline = bench_monotonic_nsec() + MOCKUP_SETTLE_NSEC;
+	while (count_chips() < base + num_chips) {
+		if (bench_monotonic_nsec() > deadline)
+			die("gpio-mockup chips didn't appear in time");
+
+		usleep(10000);
+	}
+}
+
+static void sim_write_config(char *path, unsigned int num_chips,
+			     unsigned int num_lines)
+{
+	unsigned int i, j;
+	FILE *fp;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		die_perror("unable to create the simulator config");
+
+	fp = fdopen(fd, "w");
+	if (!fp)
+		die_perror("fdopen");
+
+	for (i = 0; i < num_chips; i++) {
+		fprintf(fp, "chip gpiochip%u gpio-sim-%u %u\n",
+			i, i, num_lines);
+		for (j = 0; j < num_lines; j++)
+			fprintf(fp, "name %u sim-%u-%u\n", j, i, j);
+	}
+
+	if (fclose(fp))
+		die_perror("unable to write the simulator config");
+}
+
+static void run_child(char **argv)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0)
+		die_perror("fork");
+
+	if (pid == 0) {
+		execv("/proc/self/exe", argv);
+		die_perror("unable to re-execute %s", get_progname());
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		die_perror("waitpid");
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		die("measurement failed");
+}
+
+/*
+ * Every configuration is measured by a fresh instance of this program:
+ * the simulator reads its config only once and the library must not
+ * keep any state between configurations either. Rows are grouped by the
+ * number of lines per chip so that each group forms one curve when
+ * plotted against the number of chips.
+ */
+static void run_grid(const struct discovery *disc, char **argv)
+{
+	char config[] = "/tmp/gpiod-bench-discovery-XXXXXX";
+	unsigned int i, j;
+
+	for (i = 0; i < disc->num_lines; i++) {
+		for (j = 0; j < disc->num_chips; j++) {
+			if (disc->sim) {
+				strcpy(config + sizeof(config) - 7, "XXXXXX");
+				sim_write_config(config, disc->chips[j],
+						 disc->lines[i]);
+				setenv("GPIOD_SIM_CONFIG", config, 1);
+				setenv("LD_PRELOAD", disc->sim, 1);
+			} else {
+				mockup_unload();
+				mockup_load(disc->chips[j], disc->lines[i]);
+			}
+
+			printf("%6u %6u", disc->chips[j], disc->lines[i]);
+			run_child(argv);
+
+			if (disc->sim)
+				unlink(config);
+		}
+	}
+
+	if (disc->mockup)
+		mockup_unload();
+}
+
+int main(int argc, char **argv)
+{
+	struct discovery disc;
+	bool measure_only = false;
+	char **child_argv;
+	int optc, opti, i;
+	unsigned long val;
+	char *end;
+
+	set_progname(argv[0]);
+
+	memset(&disc, 0, sizeof(disc));
+	disc.num_chips = parse_list("1,2,4,8", disc.chips);
+	disc.num_lines = parse_list("8,32,128", disc.lines);
+	disc.repeat = 20;
+	disc.tool_repeat = 5;
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'c':
+			disc.num_chips = parse_list(optarg, disc.chips);
+			break;
+		case 'l':
+			disc.num_lines = parse_list(optarg, disc.lines);
+			break;
+		case 's':
+			disc.sim = optarg;
+			break;
+		case 'm':
+			disc.mockup = true;
+			break;
+		case 't':
+			disc.tools = optarg;
+			break;
+		case 'r':
+		case 'R':
+			val = strtoul(optarg, &end, 10);
+			if (*end != '\0' || !val || val > MAX_SAMPLES)
+				die("invalid number: %s", optarg);
+			if (optc == 'r')
+				disc.repeat = val;
+			else
+				disc.tool_repeat = val;
+			break;
+		case OPT_MEASURE:
+			measure_only = true;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	if (optind != argc)
+		die("too many arguments");
+
+	if (disc.sim && disc.mockup)
+		die("--sim and --mockup are mutually exclusive");
+
+	if (measure_only) {
+		measure(&disc, false);
+		return EXIT_SUCCESS;
+	}
+
+	printf("%-6s %6s %12s %12s %12s %12s %12s %12s %12s %12s\n",
+	       "#chips", "lines", "chip-iter", "line-info", "find-name",
+	       "open-label", "gpiodetect", "gpioinfo", "gpiofind", "gpioget");
+
+	if (!disc.sim && !disc.mockup) {
+		measure(&disc, true);
+		return EXIT_SUCCESS;
+	}
+
+	/* Pass all options on to the child and tell it to only measure. */
+	child_argv = calloc(argc + 2, sizeof(*child_argv));
+	if (!child_argv)
+		die("out of memory");
+
+	for (i = 0; i < argc; i++)
+		child_argv[i] = argv[i];
+	child_argv[argc] = "--measure";
+
+	run_grid(&disc, child_argv);
+
+	free(child_argv);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,328 @@
+/*
+ * Round-trip latency and jitter of an output-to-input GPIO loopback.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "bench-common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "iterations",		required_argument,	NULL,	'n' },
+	{ "warmup",		required_argument,	NULL,	'w' },
+	{ "mockup",		no_argument,		NULL,	'm' },
+	{ "period",		required_argument,	NULL,	'p' },
+	{ "clock",		required_argument,	NULL,	'C' },
+	{ "perf",		no_argument,		NULL,	'P' },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvn:w:mp:C:P";
+
+static void print_help(void)
+{
+	printf("Usage: %s [OPTIONS] <output chip:offset> <input chip:offset>\n",
+	       get_progname());
+	printf("Measure the time from setting an output line to receiving the edge on an input\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -n, --iterations=NUM:\tnumber of measured edges (default: 10000)\n");
+	printf("  -w, --warmup=NUM:\tnumber of edges not taken into account (default: 100)\n");
+	printf("  -m, --mockup:\t\tthe lines belong to gpio-mockup - inject the value into\n");
+	printf("\t\t\tthe input line through debugfs instead of using a jumper\n");
+	printf("  -p, --period=USEC:\ttoggle the output periodically and measure the\n");
+	printf("\t\t\tachieved frequency and jitter instead of ping-pong latency\n");
+	printf("  -C, --clock=CLOCK:\tclock used by the kernel for event timestamps:\n");
+	printf("\t\t\t'realtime' (default), 'monotonic' or 'boottime'\n");
+	printf("  -P, --perf:\t\talso report per-iteration hardware and software\n");
+	printf("\t\t\tperformance counters\n");
+}
+
+struct loopback {
+	struct gpiod_line *out;
+	struct gpiod_line *in;
+	int mockup_fd;
+	clockid_t clock;
+	unsigned long iterations;
+	unsigned long warmup;
+	uint64_t period_ns;
+	unsigned long lost;
+	int value;
+	struct bench_perf *perf;
+};
+
+static void toggle(struct loopback *lb)
+{
+	int status;
+
+	lb->value = !lb->value;
+
+	status = gpiod_line_set_value(lb->out, lb->value);
+	if (status < 0)
+		die_perror("error setting the output value");
+
+	/* With gpio-mockup the 'wire' between the lines is emulated. */
+	if (lb->mockup_fd >= 0)
+		bench_mockup_set(lb->mockup_fd, lb->value);
+}
+
+static int wait_edge(struct loopback *lb, uint64_t timeout_ns,
+		     struct gpiod_line_event *event)
+{
+	struct timespec timeout;
+	int status;
+
+	timeout.tv_sec = timeout_ns / NSEC_PER_SEC;
+	timeout.tv_nsec = timeout_ns % NSEC_PER_SEC;
+
+	status = gpiod_line_event_wait(lb->in, &timeout);
+	if (status < 0)
+		die_perror("error waiting for events");
+	else if (status == 0)
+		return 0;
+
+	status = gpiod_line_event_read(lb->in, event);
+	if (status < 0)
+		die_perror("error reading the line event");
+
+	return 1;
+}
+
+static uint64_t event_nsec(struct gpiod_line_event *event)
+{
+	return (uint64_t)event->ts.tv_sec * NSEC_PER_SEC + event->ts.tv_nsec;
+}
+
+/*
+ * Toggle the output, wait for the edge, repeat. Three intervals are
+ * measured, all starting right before the set ioctl(): its return, the
+ * kernel timestamp of the edge and the moment we read the event.
+ */
+static void run_pingpong(struct loopback *lb)
+{
+	static struct histogram hist_set, hist_edge, hist_read;
+	uint64_t start, start_ref, set_done, now;
+	struct gpiod_line_event event;
+	unsigned long i;
+
+	histogram_reset(&hist_set);
+	histogram_reset(&hist_edge);
+	histogram_reset(&hist_read);
+
+	bench_perf_start(lb->perf);
+
+	for (i = 0; i < lb->warmup + lb->iterations; i++) {
+		start_ref = bench_clock_nsec(lb->clock);
+		start = bench_monotonic_nsec();
+
+		toggle(lb);
+		set_done = bench_monotonic_nsec();
+
+		if (!wait_edge(lb, NSEC_PER_SEC, &event)) {
+			lb->lost++;
+			continue;
+		}
+
+		now = bench_monotonic_nsec();
+
+		if (i < lb->warmup)
+			continue;
+
+		histogram_add(&hist_set, set_done - start);
+		histogram_add(&hist_read, now - start);
+		if (event_nsec(&event) >= start_ref)
+			histogram_add(&hist_edge, event_nsec(&event) - start_ref);
+	}
+
+	bench_perf_stop(lb->perf);
+
+	bench_report_histogram("set.ioctl", &hist_set);
+	bench_report_histogram("set.to-timestamp", &hist_edge);
+	bench_report_histogram("set.to-read", &hist_read);
+	bench_report("edges.lost", lb->lost, "");
+	bench_perf_report(lb->perf, "iteration", lb->warmup + lb->iterations);
+}
+
+/*
+ * Toggle the output on a fixed grid of deadlines and look at the spacing
+ * of the edge timestamps on the input.
+ */
+static void run_periodic(struct loopback *lb)
+{
+	static struct histogram hist_jitter;
+	uint64_t deadline, now, prev_ts = 0, first_ts = 0, ts, interval;
+	unsigned long i, edges = 0, missed = 0;
+	struct gpiod_line_event event;
+
+	histogram_reset(&hist_jitter);
+
+	bench_perf_start(lb->perf);
+
+	deadline = bench_monotonic_nsec() + lb->period_ns;
+
+	for (i = 0; i < lb->warmup + lb->iterations; i++) {
+		bench_sleep_until(deadline);
+		toggle(lb);
+
+		deadline += lb->period_ns;
+
+		now = bench_monotonic_nsec();
+		if (now >= deadline) {
+			missed++;
+			deadline = now + lb->period_ns;
+		}
+
+		if (!wait_edge(lb, deadline - now, &event)) {
+			lb->lost++;
+			prev_ts = 0;
+			continue;
+		}
+
+		if (i < lb->warmup)
+			continue;
+
+		ts = event_nsec(&event);
+		if (!first_ts)
+			first_ts = ts;
+
+		if (prev_ts) {
+			interval = ts - prev_ts;
+			histogram_add(&hist_jitter,
+				      interval > lb->period_ns
+						? interval - lb->period_ns
+						: lb->period_ns - interval);
+		}
+
+		prev_ts = ts;
+		edges++;
+	}
+
+	bench_perf_stop(lb->perf);
+
+	bench_report("period.requested", lb->period_ns / 1000.0, "us");
+	if (edges > 1 && prev_ts > first_ts)
+		/* Two edges make up a full cycle. */
+		bench_report("frequency.achieved",
+			     (edges - 1) / 2.0 /
+			     ((prev_ts - first_ts) / (double)NSEC_PER_SEC),
+			     "Hz");
+	bench_report_histogram("edge.jitter", &hist_jitter);
+	bench_report("deadlines.missed", missed, "");
+	bench_report("edges.lost", lb->lost, "");
+	bench_perf_report(lb->perf, "iteration", lb->warmup + lb->iterations);
+}
+
+int main(int argc, char **argv)
+{
+	struct gpiod_line_evreq_config config;
+	bool mockup = false, use_perf = false;
+	int optc, opti, status;
+	struct loopback lb;
+	char *end;
+
+	set_progname(argv[0]);
+
+	memset(&lb, 0, sizeof(lb));
+	lb.iterations = 10000;
+	lb.warmup = 100;
+	lb.clock = CLOCK_REALTIME;
+	lb.mockup_fd = -1;
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'n':
+			lb.iterations = strtoul(optarg, &end, 10);
+			if (*end != '\0' || !lb.iterations)
+				die("invalid number: %s", optarg);
+			break;
+		case 'w':
+			lb.warmup = strtoul(optarg, &end, 10);
+			if (*end != '\0')
+				die("invalid number: %s", optarg);
+			break;
+		case 'm':
+			mockup = true;
+			break;
+		case 'p':
+			lb.period_ns = strtoul(optarg, &end, 10) * 1000ULL;
+			if (*end != '\0' || !lb.period_ns)
+				die("invalid period: %s", optarg);
+			break;
+		case 'C':
+			lb.clock = bench_parse_clock(optarg);
+			break;
+		case 'P':
+			use_perf = true;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2)
+		die("output and input lines must be specified");
+
+	lb.out = bench_get_line(argv[0]);
+	lb.in = bench_get_line(argv[1]);
+
+	status = gpiod_line_request_output(lb.out, "gpiod-bench", false, 0);
+	if (status < 0)
+		die_perror("unable to request the output line");
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-bench";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	status = gpiod_line_event_request(lb.in, &config);
+	if (status < 0)
+		die_perror("unable to request events on the input line");
+
+	if (mockup) {
+		lb.mockup_fd = bench_mockup_open(lb.in);
+		bench_mockup_set(lb.mockup_fd, 0);
+	}
+
+	if (use_perf)
+		lb.perf = bench_perf_open();
+
+	if (lb.period_ns)
+		run_periodic(&lb);
+	else
+		run_pingpong(&lb);
+
+	bench_perf_close(lb.perf);
+
+	if (lb.mockup_fd >= 0)
+		close(lb.mockup_fd);
+
+	gpiod_chip_close(gpiod_line_get_chip(lb.out));
+	gpiod_chip_close(gpiod_line_get_chip(lb.in));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,300 @@
+/*
+ * Cost of individual libgpiod line operations.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "bench-common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "iterations",		required_argument,	NULL,	'n' },
+	{ "warmup",		required_argument,	NULL,	'w' },
+	{ "ops",		required_argument,	NULL,	'o' },
+	{ "perf",		no_argument,		NULL,	'P' },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvn:w:o:P";
+
+struct ops_ctx {
+	struct gpiod_line_bulk bulk;
+	int values[GPIOD_REQUEST_MAX_LINES];
+};
+
+static void release(struct ops_ctx *ctx)
+{
+	gpiod_line_release_bulk(&ctx->bulk);
+}
+
+static void request_input(struct ops_ctx *ctx)
+{
+	if (gpiod_line_request_bulk_input(&ctx->bulk, "gpiod-bench", false))
+		die_perror("unable to request the lines as inputs");
+}
+
+static void request_output(struct ops_ctx *ctx)
+{
+	if (gpiod_line_request_bulk_output(&ctx->bulk, "gpiod-bench",
+					   false, ctx->values))
+		die_perror("unable to request the lines as outputs");
+}
+
+static void request_events(struct ops_ctx *ctx)
+{
+	struct gpiod_line_evreq_config config;
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-bench";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	if (gpiod_line_event_request_bulk(&ctx->bulk, &config))
+		die_perror("unable to request line events");
+}
+
+static void release_events(struct ops_ctx *ctx)
+{
+	gpiod_line_event_release_bulk(&ctx->bulk);
+}
+
+static void op_get_value(struct ops_ctx *ctx)
+{
+	if (gpiod_line_get_value(ctx->bulk.lines[0]) < 0)
+		die_perror("error reading the line value");
+}
+
+static void op_get_value_bulk(struct ops_ctx *ctx)
+{
+	if (gpiod_line_get_value_bulk(&ctx->bulk, ctx->values))
+		die_perror("error reading the line values");
+}
+
+static void op_set_value(struct ops_ctx *ctx)
+{
+	ctx->values[0] = !ctx->values[0];
+
+	if (gpiod_line_set_value(ctx->bulk.lines[0], ctx->values[0]))
+		die_perror("error setting the line value");
+}
+
+static void op_set_value_bulk(struct ops_ctx *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->bulk.num_lines; i++)
+		ctx->values[i] = !ctx->values[i];
+
+	if (gpiod_line_set_value_bulk(&ctx->bulk, ctx->values))
+		die_perror("error setting the line values");
+}
+
+static void op_line_update(struct ops_ctx *ctx)
+{
+	if (gpiod_line_update(ctx->bulk.lines[0]))
+		die_perror("error updating the line info");
+}
+
+static void op_request_release(struct ops_ctx *ctx)
+{
+	request_input(ctx);
+	release(ctx);
+}
+
+static void op_event_wait(struct ops_ctx *ctx)
+{
+	struct timespec ts = { 0, 0 };
+
+	if (gpiod_line_event_wait_bulk(&ctx->bulk, &ts, NULL) < 0)
+		die_perror("error waiting for events");
+}
+
+static const struct {
+	const char *name;
+	void (*setup)(struct ops_ctx *);
+	void (*run)(struct ops_ctx *);
+	void (*teardown)(struct ops_ctx *);
+} ops[] = {
+	{ "get-value",		request_input,	op_get_value,		release },
+	{ "get-value-bulk",	request_input,	op_get_value_bulk,	release },
+	{ "set-value",		request_output,	op_set_value,		release },
+	{ "set-value-bulk",	request_output,	op_set_value_bulk,	release },
+	{ "line-update",	NULL,		op_line_update,		NULL },
+	{ "request-release",	NULL,		op_request_release,	NULL },
+	{ "event-wait",		request_events,	op_event_wait,		release_events },
+};
+
+static void print_help(void)
+{
+	unsigned int i;
+
+	printf("Usage: %s [OPTIONS] <chip name/number> <offset 1> <offset 2> ...\n",
+	       get_progname());
+	printf("Measure the cost of single line operations (the first line is used by\n");
+	printf("single-line operations, all lines by the bulk ones)\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -n, --iterations=NUM:\tnumber of measured calls (default: 100000)\n");
+	printf("  -w, --warmup=NUM:\tnumber of calls not taken into account (default: 1000)\n");
+	printf("  -o, --ops=LIST:\tcomma-separated list of operations (default: all)\n");
+	printf("  -P, --perf:\t\talso report per-operation hardware and software\n");
+	printf("\t\t\tperformance counters\n");
+	printf("\n");
+	printf("Operations:\n");
+	for (i = 0; i < ARRAY_SIZE(ops); i++)
+		printf("  %s\n", ops[i].name);
+	printf("\n");
+	printf("WARNING: the set-value operations toggle the lines as fast as possible!\n");
+}
+
+static unsigned int parse_ops(char *list)
+{
+	unsigned int mask = 0, i;
+	char *name;
+
+	for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		for (i = 0; i < ARRAY_SIZE(ops); i++) {
+			if (strcmp(name, ops[i].name) == 0)
+				break;
+		}
+
+		if (i == ARRAY_SIZE(ops))
+			die("invalid operation: %s", name);
+
+		mask |= 1 << i;
+	}
+
+	return mask;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 100000, warmup = 1000, j;
+	unsigned int op_mask = 0, num_lines, offset, i;
+	struct bench_perf *perf = NULL;
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	struct ops_ctx ctx;
+	bool use_perf = false;
+	uint64_t start, elapsed;
+	int optc, opti;
+	char buf[128];
+	char *end;
+
+	set_progname(argv[0]);
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'n':
+			iterations = strtoul(optarg, &end, 10);
+			if (*end != '\0' || !iterations)
+				die("invalid number: %s", optarg);
+			break;
+		case 'w':
+			warmup = strtoul(optarg, &end, 10);
+			if (*end != '\0')
+				die("invalid number: %s", optarg);
+			break;
+		case 'o':
+			op_mask = parse_ops(optarg);
+			break;
+		case 'P':
+			use_perf = true;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1)
+		die("gpiochip must be specified");
+
+	if (argc < 2)
+		die("at least one gpio line offset must be specified");
+
+	num_lines = argc - 1;
+	if (num_lines > GPIOD_REQUEST_MAX_LINES)
+		die("at most %d lines can be used", GPIOD_REQUEST_MAX_LINES);
+
+	if (!op_mask)
+		op_mask = (1 << ARRAY_SIZE(ops)) - 1;
+
+	chip = gpiod_chip_open_lookup(argv[0]);
+	if (!chip)
+		die_perror("unable to open %s", argv[0]);
+
+	memset(&ctx, 0, sizeof(ctx));
+	gpiod_line_bulk_init(&ctx.bulk);
+
+	for (i = 0; i < num_lines; i++) {
+		offset = strtoul(argv[i + 1], &end, 10);
+		if (*end != '\0' || offset > INT_MAX)
+			die("invalid GPIO offset: %s", argv[i + 1]);
+
+		line = gpiod_chip_get_line(chip, offset);
+		if (!line)
+			die_perror("unable to retrieve GPIO line from chip");
+
+		gpiod_line_bulk_add(&ctx.bulk, line);
+	}
+
+	if (use_perf)
+		perf = bench_perf_open();
+
+	for (i = 0; i < ARRAY_SIZE(ops); i++) {
+		if (!(op_mask & (1 << i)))
+			continue;
+
+		if (ops[i].setup)
+			ops[i].setup(&ctx);
+
+		for (j = 0; j < warmup; j++)
+			ops[i].run(&ctx);
+
+		bench_perf_start(perf);
+		start = bench_monotonic_nsec();
+
+		for (j = 0; j < iterations; j++)
+			ops[i].run(&ctx);
+
+		elapsed = bench_monotonic_nsec() - start;
+		bench_perf_stop(perf);
+
+		snprintf(buf, sizeof(buf), "%s.time", ops[i].name);
+		bench_report(buf, (double)elapsed / iterations, "ns");
+		bench_perf_report(perf, ops[i].name, iterations);
+
+		if (ops[i].teardown)
+			ops[i].teardown(&ctx);
+	}
+
+	bench_perf_close(perf);
+	gpiod_chip_close(chip);
+
+	return EXIT_SUCCESS;
+}
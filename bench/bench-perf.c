@@ -0,0 +1,276 @@
+/*
+ * Hardware and software performance counters for libgpiod benchmarks.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "bench-common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+struct bench_perf_counter {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+	int fd;
+	bool user_only;
+	bool valid;
+	double value;
+};
+
+struct bench_perf {
+	struct bench_perf_counter counters[5];
+	unsigned int num_counters;
+};
+
+static const char *const tracefs_dirs[] = {
+	"/sys/kernel/tracing",
+	"/sys/kernel/debug/tracing",
+};
+
+static int tracepoint_id(const char *event, uint64_t *id)
+{
+	char path[256];
+	unsigned int i;
+	FILE *fp;
+	int status;
+
+	for (i = 0; i < ARRAY_SIZE(tracefs_dirs); i++) {
+		snprintf(path, sizeof(path), "%s/events/%s/id",
+			 tracefs_dirs[i], event);
+
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+
+		status = fscanf(fp, "%" SCNu64, id);
+		fclose(fp);
+		if (status == 1)
+			return 0;
+	}
+
+	return -1;
+}
+
+static int perf_event_open(struct perf_event_attr *attr)
+{
+	return syscall(__NR_perf_event_open, attr, 0, -1, -1,
+		       PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Count only the calling thread. Kernel-side cycles are what the ioctl()
+ * calls actually cost so try to include them first and fall back to user
+ * space only if perf_event_paranoid doesn't allow it.
+ */
+static void counter_open(struct bench_perf_counter *counter)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = counter->type;
+	attr.config = counter->config;
+	attr.disabled = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	counter->fd = perf_event_open(&attr);
+	if (counter->fd < 0 && (errno == EACCES || errno == EPERM) &&
+	    counter->type != PERF_TYPE_TRACEPOINT) {
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		counter->fd = perf_event_open(&attr);
+		counter->user_only = true;
+	}
+
+	if (counter->fd < 0)
+		fprintf(stderr, "%s: %s counter not available: %s\n",
+			get_progname(), counter->name, strerror(errno));
+}
+
+static void add_counter(struct bench_perf *perf, const char *name,
+			uint32_t type, uint64_t config)
+{
+	struct bench_perf_counter *counter;
+
+	counter = &perf->counters[perf->num_counters];
+	counter->name = name;
+	counter->type = type;
+	counter->config = config;
+
+	counter_open(counter);
+	if (counter->fd >= 0)
+		perf->num_counters++;
+}
+
+struct bench_perf * bench_perf_open(void)
+{
+	struct bench_perf *perf;
+	uint64_t id;
+
+	perf = malloc(sizeof(*perf));
+	if (!perf)
+		die("out of memory");
+
+	memset(perf, 0, sizeof(*perf));
+
+	add_counter(perf, "cycles", PERF_TYPE_HARDWARE,
+		    PERF_COUNT_HW_CPU_CYCLES);
+	add_counter(perf, "instructions", PERF_TYPE_HARDWARE,
+		    PERF_COUNT_HW_INSTRUCTIONS);
+	add_counter(perf, "cache-misses", PERF_TYPE_HARDWARE,
+		    PERF_COUNT_HW_CACHE_MISSES);
+	add_counter(perf, "context-switches", PERF_TYPE_SOFTWARE,
+		    PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+	if (tracepoint_id("raw_syscalls/sys_enter", &id) == 0)
+		add_counter(perf, "syscalls", PERF_TYPE_TRACEPOINT, id);
+	else
+		fprintf(stderr,
+			"%s: syscalls counter not available: no access to the raw_syscalls tracepoint\n",
+			get_progname());
+
+	if (!perf->num_counters) {
+		free(perf);
+		return NULL;
+	}
+
+	return perf;
+}
+
+void bench_perf_close(struct bench_perf *perf)
+{
+	unsigned int i;
+
+	if (!perf)
+		return;
+
+	for (i = 0; i < perf->num_counters; i++)
+		close(perf->counters[i].fd);
+
+	free(perf);
+}
+
+void bench_perf_start(struct bench_perf *perf)
+{
+	unsigned int i;
+
+	if (!perf)
+		return;
+
+	for (i = 0; i < perf->num_counters; i++) {
+		ioctl(perf->counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf->counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void bench_perf_stop(struct bench_perf *perf)
+{
+	struct bench_perf_counter *counter;
+	uint64_t buf[3];
+	unsigned int i;
+	ssize_t rd;
+
+	if (!perf)
+		return;
+
+	for (i = 0; i < perf->num_counters; i++)
+		ioctl(perf->counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+
+	for (i = 0; i < perf->num_counters; i++) {
+		counter = &perf->counters[i];
+
+		rd = read(counter->fd, buf, sizeof(buf));
+		/* Never scheduled in, e.g. all PMU counters were taken. */
+		counter->valid = rd == sizeof(buf) && buf[2] > 0;
+		if (!counter->valid)
+			continue;
+
+		/* Scale up if the counter was multiplexed with others. */
+		counter->value = buf[0];
+		if (buf[2] < buf[1])
+			counter->value *= (double)buf[1] / buf[2];
+	}
+}
+
+static const struct bench_perf_counter *
+find_counter(struct bench_perf *perf, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < perf->num_counters; i++) {
+		if (strcmp(perf->counters[i].name, name) == 0 &&
+		    perf->counters[i].valid)
+			return &perf->counters[i];
+	}
+
+	return NULL;
+}
+
+void bench_perf_report(struct bench_perf *perf, const char *prefix,
+		       unsigned long ops)
+{
+	const struct bench_perf_counter *counter, *cycles, *insns;
+	char buf[128];
+	unsigned int i;
+
+	if (!perf || !ops)
+		return;
+
+	for (i = 0; i < perf->num_counters; i++) {
+		counter = &perf->counters[i];
+		if (!counter->valid)
+			continue;
+
+		snprintf(buf, sizeof(buf), "%s.%s%s", prefix, counter->name,
+			 counter->user_only ? ":u" : "");
+		bench_report(buf, counter->value / ops, "");
+	}
+
+	cycles = find_counter(perf, "cycles");
+	insns = find_counter(perf, "instructions");
+	if (cycles && insns && cycles->value > 0 &&
+	    cycles->user_only == insns->user_only) {
+		snprintf(buf, sizeof(buf), "%s.ipc%s", prefix,
+			 cycles->user_only ? ":u" : "");
+		bench_report(buf, insns->value / cycles->value, "");
+	}
+}
+
+#else /* !HAVE_LINUX_PERF_EVENT_H */
+
+struct bench_perf * bench_perf_open(void)
+{
+	fprintf(stderr,
+		"%s: performance counters not supported by this build\n",
+		get_progname());
+
+	return NULL;
+}
+
+void bench_perf_close(struct bench_perf *perf UNUSED) { }
+void bench_perf_start(struct bench_perf *perf UNUSED) { }
+void bench_perf_stop(struct bench_perf *perf UNUSED) { }
+
+void bench_perf_report(struct bench_perf *perf UNUSED,
+		       const char *prefix UNUSED, unsigned long ops UNUSED)
+{
+}
+
+#endif /* HAVE_LINUX_PERF_EVENT_H */
@@ -0,0 +1,470 @@
+/*
+ * Event storm load test for the libgpiod event pipeline.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "bench-common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "rate",		required_argument,	NULL,	'r' },
+	{ "burst",		required_argument,	NULL,	'b' },
+	{ "duration",		required_argument,	NULL,	'd' },
+	{ "consumer",		required_argument,	NULL,	'c' },
+	{ "perf",		no_argument,		NULL,	'P' },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvr:b:d:c:P";
+
+static void print_help(void)
+{
+	printf("Usage: %s [OPTIONS] <chip name/number> <offset 1> <offset 2> ...\n",
+	       get_progname());
+	printf("Generate edges on gpio-mockup lines and measure how well a consumer keeps up\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -r, --rate=NUM:\tgenerate NUM edges per second in total (default: 10000)\n");
+	printf("  -b, --burst=NUM:\tgenerate NUM edges on each line back-to-back (default: 1)\n");
+	printf("  -d, --duration=SEC:\tlength of the test (default: 5)\n");
+	printf("  -c, --consumer=TYPE:\thow to consume the events:\n");
+	printf("\t\t\t'simple' - gpiod_simple_event_loop_multiple()\n");
+	printf("\t\t\t'wait-bulk' - gpiod_line_event_wait_bulk() and\n");
+	printf("\t\t\t\tgpiod_line_event_read() (default)\n");
+	printf("\t\t\t'batch' - ppoll() and gpiod_line_event_read_multiple()\n");
+	printf("  -P, --perf:\t\talso report per-event hardware and software\n");
+	printf("\t\t\tperformance counters of the consumer\n");
+}
+
+enum {
+	CONSUMER_SIMPLE,
+	CONSUMER_WAIT_BULK,
+	CONSUMER_BATCH,
+};
+
+struct storm {
+	const char *device;
+	unsigned int offsets[GPIOD_REQUEST_MAX_LINES];
+	unsigned int num_lines;
+	struct gpiod_line_bulk bulk;
+	int mockup_fds[GPIOD_REQUEST_MAX_LINES];
+	unsigned long rate;
+	unsigned long burst;
+	uint64_t duration_ns;
+	int consumer;
+	struct bench_perf *perf;
+
+	pthread_t generator;
+	bool gen_started;
+
+	/* Written by the generator, read after joining it. */
+	unsigned long generated[GPIOD_REQUEST_MAX_LINES];
+	uint64_t gen_start_ns;
+	uint64_t gen_end_ns;
+
+	/* Consumer state. */
+	unsigned long received[GPIOD_REQUEST_MAX_LINES];
+	unsigned long total_received;
+	bool gen_done;
+	uint64_t stop_ns;
+	unsigned long syscalls;
+};
+
+/*
+ * Every burst period toggle each line 'burst' times. Consecutive writes
+ * of different values always produce an edge on gpio-mockup.
+ */
+static void * generator_thread(void *data)
+{
+	int values[GPIOD_REQUEST_MAX_LINES];
+	struct storm *storm = data;
+	uint64_t period, deadline, end;
+	unsigned long i;
+	unsigned int j;
+
+	memset(values, 0, sizeof(values));
+
+	period = NSEC_PER_SEC * storm->burst * storm->num_lines / storm->rate;
+	deadline = bench_monotonic_nsec();
+	end = deadline + storm->duration_ns;
+	storm->gen_start_ns = deadline;
+
+	while (deadline < end) {
+		bench_sleep_until(deadline);
+
+		for (i = 0; i < storm->burst; i++) {
+			for (j = 0; j < storm->num_lines; j++) {
+				values[j] = !values[j];
+				bench_mockup_set(storm->mockup_fds[j],
+						 values[j]);
+				storm->generated[j]++;
+			}
+		}
+
+		deadline += period;
+	}
+
+	__atomic_store_n(&storm->gen_end_ns, bench_monotonic_nsec(),
+			 __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+/* Only start generating edges once the lines are requested. */
+static void start_generator(struct storm *storm)
+{
+	int status;
+
+	status = pthread_create(&storm->generator, NULL,
+				generator_thread, storm);
+	if (status)
+		die("unable to create the generator thread: %s",
+		    strerror(status));
+
+	storm->gen_started = true;
+}
+
+/* Keep consuming for a while after the generator is done to drain FIFOs. */
+static bool consumer_should_stop(struct storm *storm)
+{
+	uint64_t gen_end;
+
+	gen_end = __atomic_load_n(&storm->gen_end_ns, __ATOMIC_ACQUIRE);
+	if (!gen_end)
+		return false;
+
+	return bench_monotonic_nsec() >= gen_end + NSEC_PER_SEC / 10;
+}
+
+static unsigned int offset_index(struct storm *storm, unsigned int offset)
+{
+	unsigned int i;
+
+	for (i = 0; i < storm->num_lines; i++) {
+		if (storm->offsets[i] == offset)
+			return i;
+	}
+
+	return 0;
+}
+
+static int simple_callback(int evtype, unsigned int offset,
+			   const struct timespec *ts UNUSED, void *data)
+{
+	struct storm *storm = data;
+
+	/*
+	 * The loop requests the lines before it first waits for events, so
+	 * the first callback is a timeout with the lines already requested.
+	 */
+	if (!storm->gen_started)
+		start_generator(storm);
+
+	/* One wait for every callback and one read for every event. */
+	storm->syscalls++;
+
+	if (evtype != GPIOD_EVENT_CB_TIMEOUT) {
+		storm->received[offset_index(storm, offset)]++;
+		storm->total_received++;
+		storm->syscalls++;
+	}
+
+	return consumer_should_stop(storm) ? GPIOD_EVENT_CB_STOP
+					   : GPIOD_EVENT_CB_OK;
+}
+
+static void consume_simple(struct storm *storm)
+{
+	struct timespec timeout = { 0, 10000000 };
+	int status;
+
+	status = gpiod_simple_event_loop_multiple("gpiod-bench", storm->device,
+						  storm->offsets,
+						  storm->num_lines, false,
+						  GPIOD_EVENT_BOTH_EDGES,
+						  &timeout, simple_callback,
+						  storm);
+	if (status < 0)
+		die_perror("error in the event loop");
+}
+
+static void consume_wait_bulk(struct storm *storm)
+{
+	struct timespec timeout = { 0, 10000000 };
+	struct gpiod_line_event event;
+	struct gpiod_line *line;
+	unsigned int i;
+	int status;
+
+	while (!consumer_should_stop(storm)) {
+		status = gpiod_line_event_wait_bulk(&storm->bulk,
+						    &timeout, &line);
+		storm->syscalls++;
+		if (status < 0)
+			die_perror("error waiting for events");
+		else if (status == 0)
+			continue;
+
+		status = gpiod_line_event_read(line, &event);
+		storm->syscalls++;
+		if (status < 0)
+			die_perror("error reading the line event");
+
+		for (i = 0; i < storm->num_lines; i++) {
+			if (storm->bulk.lines[i] == line)
+				break;
+		}
+
+		storm->received[i]++;
+		storm->total_received++;
+	}
+}
+
+static void consume_batch(struct storm *storm)
+{
+	struct gpiod_line_event events[GPIOD_EVENT_READ_MAX];
+	struct timespec timeout = { 0, 10000000 };
+	struct pollfd fds[GPIOD_REQUEST_MAX_LINES];
+	unsigned int i;
+	int status, num;
+
+	memset(fds, 0, sizeof(fds));
+	for (i = 0; i < storm->num_lines; i++) {
+		fds[i].fd = gpiod_line_event_get_fd(storm->bulk.lines[i]);
+		fds[i].events = POLLIN | POLLPRI;
+	}
+
+	while (!consumer_should_stop(storm)) {
+		status = ppoll(fds, storm->num_lines, &timeout, NULL);
+		storm->syscalls++;
+		if (status < 0)
+			die("error waiting for events: %s", strerror(errno));
+
+		for (i = 0; i < storm->num_lines && status > 0; i++) {
+			if (!fds[i].revents)
+				continue;
+
+			num = gpiod_line_event_read_multiple(storm->bulk.lines[i],
+							     events,
+							     GPIOD_EVENT_READ_MAX);
+			storm->syscalls++;
+			if (num < 0)
+				die_perror("error reading line events");
+
+			storm->received[i] += num;
+			storm->total_received += num;
+			status--;
+		}
+	}
+}
+
+static void request_lines(struct storm *storm, struct gpiod_chip *chip)
+{
+	struct gpiod_line_evreq_config config;
+	unsigned int i;
+	int status;
+
+	gpiod_line_bulk_init(&storm->bulk);
+	for (i = 0; i < storm->num_lines; i++)
+		gpiod_line_bulk_add(&storm->bulk,
+				    gpiod_chip_get_line(chip,
+							storm->offsets[i]));
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-bench";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	status = gpiod_line_event_request_bulk(&storm->bulk, &config);
+	if (status < 0)
+		die_perror("unable to request line events");
+}
+
+static void report(struct storm *storm, uint64_t elapsed_ns, uint64_t cpu_ns)
+{
+	unsigned long generated = 0, lost = 0;
+	unsigned int i;
+	double secs;
+
+	for (i = 0; i < storm->num_lines; i++) {
+		generated += storm->generated[i];
+		if (storm->generated[i] > storm->received[i])
+			lost += storm->generated[i] - storm->received[i];
+	}
+
+	secs = elapsed_ns / (double)NSEC_PER_SEC;
+
+	bench_report("edges.generated", generated, "");
+	bench_report("edges.received", storm->total_received, "");
+	bench_report("edges.lost", lost, "");
+	bench_report("loss.rate", generated ? 100.0 * lost / generated : 0.0,
+		     "%");
+	bench_report("rate.generated", generated / secs, "edges/s");
+	bench_report("rate.received", storm->total_received / secs,
+		     "edges/s");
+	if (storm->total_received) {
+		bench_report("cpu.per-event",
+			     cpu_ns / 1000.0 / storm->total_received, "us");
+		bench_report("calls.per-event",
+			     (double)storm->syscalls / storm->total_received,
+			     "");
+		bench_perf_report(storm->perf, "event",
+				  storm->total_received);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t elapsed, cpu_start, cpu;
+	int optc, opti;
+	struct gpiod_chip *chip = NULL;
+	struct gpiod_line *line;
+	unsigned long duration;
+	bool use_perf = false;
+	struct storm storm;
+	unsigned int i;
+	char *end;
+
+	set_progname(argv[0]);
+
+	memset(&storm, 0, sizeof(storm));
+	storm.rate = 10000;
+	storm.burst = 1;
+	storm.duration_ns = 5 * NSEC_PER_SEC;
+	storm.consumer = CONSUMER_WAIT_BULK;
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'r':
+			storm.rate = strtoul(optarg, &end, 10);
+			if (*end != '\0' || !storm.rate)
+				die("invalid rate: %s", optarg);
+			break;
+		case 'b':
+			storm.burst = strtoul(optarg, &end, 10);
+			if (*end != '\0' || !storm.burst)
+				die("invalid burst size: %s", optarg);
+			break;
+		case 'd':
+			duration = strtoul(optarg, &end, 10);
+			if (*end != '\0' || !duration)
+				die("invalid duration: %s", optarg);
+			storm.duration_ns = duration * NSEC_PER_SEC;
+			break;
+		case 'c':
+			if (strcmp(optarg, "simple") == 0)
+				storm.consumer = CONSUMER_SIMPLE;
+			else if (strcmp(optarg, "wait-bulk") == 0)
+				storm.consumer = CONSUMER_WAIT_BULK;
+			else if (strcmp(optarg, "batch") == 0)
+				storm.consumer = CONSUMER_BATCH;
+			else
+				die("invalid consumer: %s", optarg);
+			break;
+		case 'P':
+			use_perf = true;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1)
+		die("gpiochip must be specified");
+
+	if (argc < 2)
+		die("at least one gpio line offset must be specified");
+
+	storm.device = argv[0];
+	storm.num_lines = argc - 1;
+	if (storm.num_lines > GPIOD_REQUEST_MAX_LINES)
+		die("at most %d lines can be used", GPIOD_REQUEST_MAX_LINES);
+
+	chip = gpiod_chip_open_lookup(storm.device);
+	if (!chip)
+		die_perror("unable to open %s", storm.device);
+
+	for (i = 0; i < storm.num_lines; i++) {
+		storm.offsets[i] = strtoul(argv[i + 1], &end, 10);
+		if (*end != '\0' || storm.offsets[i] > INT_MAX)
+			die("invalid GPIO offset: %s", argv[i + 1]);
+
+		line = gpiod_chip_get_line(chip, storm.offsets[i]);
+		if (!line)
+			die_perror("unable to retrieve GPIO line from chip");
+
+		storm.mockup_fds[i] = bench_mockup_open(line);
+		bench_mockup_set(storm.mockup_fds[i], 0);
+	}
+
+	/* The simple event loop requests the lines on its own. */
+	if (storm.consumer != CONSUMER_SIMPLE)
+		request_lines(&storm, chip);
+
+	if (use_perf)
+		storm.perf = bench_perf_open();
+
+	cpu_start = bench_clock_nsec(CLOCK_THREAD_CPUTIME_ID);
+	bench_perf_start(storm.perf);
+
+	/* The simple consumer starts the generator from its callback. */
+	if (storm.consumer != CONSUMER_SIMPLE)
+		start_generator(&storm);
+
+	switch (storm.consumer) {
+	case CONSUMER_SIMPLE:
+		consume_simple(&storm);
+		break;
+	case CONSUMER_WAIT_BULK:
+		consume_wait_bulk(&storm);
+		break;
+	case CONSUMER_BATCH:
+		consume_batch(&storm);
+		break;
+	}
+
+	bench_perf_stop(storm.perf);
+	cpu = bench_clock_nsec(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+	pthread_join(storm.generator, NULL);
+	elapsed = storm.gen_end_ns - storm.gen_start_ns;
+
+	report(&storm, elapsed, cpu);
+
+	for (i = 0; i < storm.num_lines; i++)
+		close(storm.mockup_fds[i]);
+
+	bench_perf_close(storm.perf);
+	gpiod_chip_close(chip);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,36 @@
+#
+# Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of version 2.1 of the GNU Lesser General Public License
+# as published by the Free Software Foundation.
+#
+
+# Plot the output of gpiod-bench-discovery:
+#
+#   gnuplot -e "data='results.txt'; lines='8 32 128'" gpiod-bench-discovery.gp
+#
+# Every result is plotted against the number of chips, with one curve per
+# number of lines per chip listed in 'lines'. The image is written to
+# discovery.png unless 'output' is set.
+
+if (!exists("output")) output = "discovery.png"
+
+set terminal pngcairo size 1600,800
+set output output
+set datafile missing "-"
+set multiplot layout 2,4
+set xlabel "chips"
+set ylabel "us"
+set key top left
+
+names = "chip-iter line-info find-name open-label gpiodetect gpioinfo gpiofind gpioget"
+
+do for [col = 3:10] {
+	set title word(names, col - 2)
+	plot for [m in lines] data \
+		using 1:($2 == m + 0 ? column(col) : NaN) \
+		with linespoints title m . " lines"
+}
+
+unset multiplot
@@ -31,6 +31,14 @@ extern "C" {
 struct gpiod_chip;
 struct gpiod_line;
 struct gpiod_chip_iter;
+struct gpiod_sched;
+struct gpiod_sampler;
+struct gpiod_publisher;
+struct gpiod_snapshot_reader;
+struct gpiod_fanout;
+struct gpiod_fanout_sub;
+struct gpiod_broker;
+struct gpiod_broker_lines;
 
 /**
  * @defgroup __common__ Common helper macros
@@ -249,6 +257,40 @@ int gpiod_simple_event_loop(const char *consumer, const char *device,
 			    const struct timespec *timeout,
 			    gpiod_event_cb callback, void *cbdata) GPIOD_API;
 
+/**
+ * @brief Simple multiple line event callback signature.
+ *
+ * The offset argument holds the offset of the line on which the event
+ * occurred. It's always 0 for GPIOD_EVENT_CB_TIMEOUT.
+ */
+typedef int (*gpiod_event_multiple_cb)(int, unsigned int,
+				       const struct timespec *, void *);
+
+/**
+ * @brief Wait for events on multiple GPIO lines.
+ * @param consumer Name of the consumer.
+ * @param device Name, path or number of the gpiochip.
+ * @param offsets Array of GPIO line offsets to monitor.
+ * @param num_lines Number of lines to monitor.
+ * @param active_low The active state of the lines - true if low.
+ * @param event_type Type of edge events to report: GPIOD_EVENT_RISING_EDGE,
+ *                   GPIOD_EVENT_FALLING_EDGE or GPIOD_EVENT_BOTH_EDGES.
+ * @param timeout Maximum wait time for each iteration.
+ * @param callback Callback function to call on event occurence.
+ * @param cbdata User data passed to the callback.
+ * @return 0 no errors were encountered, -1 if an error occured.
+ *
+ * The edge selection is passed to the kernel so the process is not woken
+ * up for the events it's not interested in.
+ */
+int gpiod_simple_event_loop_multiple(const char *consumer, const char *device,
+				     const unsigned int *offsets,
+				     unsigned int num_lines, bool active_low,
+				     int event_type,
+				     const struct timespec *timeout,
+				     gpiod_event_multiple_cb callback,
+				     void *cbdata) GPIOD_API;
+
 /**
  * @}
  *
@@ -291,6 +333,12 @@ enum {
 	/**< The line is an open-drain port. */
 	GPIOD_REQUEST_OPEN_SOURCE	= GPIOD_BIT(1),
 	/**< The line is an open-source port. */
+	GPIOD_REQUEST_POLLED		= GPIOD_BIT(2),
+	/**< Emulate events by polling the line values (event requests only). */
+	GPIOD_REQUEST_POLLED_FALLBACK	= GPIOD_BIT(3),
+	/**< Poll only if the line has no interrupt (event requests only). */
+	GPIOD_REQUEST_CACHE_VALUE	= GPIOD_BIT(4),
+	/**< Read the value from the last event read (event requests only). */
 };
 
 /**
@@ -594,6 +642,112 @@ int gpiod_line_set_value(struct gpiod_line *line, int value) GPIOD_API;
 int gpiod_line_set_value_bulk(struct gpiod_line_bulk *bulk,
 			      int *values) GPIOD_API;
 
+/**
+ * @brief Update a subset of the output values of a line request.
+ * @param line Any line of the request.
+ * @param mask Lines to update - bit n corresponds to the n-th line of the
+ *             request.
+ * @param values New values of the lines selected by mask.
+ * @return 0 is the operation succeeds. In case of an error this routine
+ *         returns -1 and sets the last error number.
+ *
+ * The library keeps a shadow of the values last written to every output
+ * request. The new values are merged into it and the remaining lines keep
+ * their last written values. If this doesn't change the shadow, no ioctl()
+ * is issued at all.
+ */
+int gpiod_line_set_value_mask(struct gpiod_line *line,
+			      unsigned long long mask,
+			      unsigned long long values) GPIOD_API;
+
+/**
+ * @brief Update the output value of a single GPIO line.
+ * @param line GPIO line object.
+ * @param value New value.
+ * @return 0 is the operation succeeds. In case of an error this routine
+ *         returns -1 and sets the last error number.
+ *
+ * Unlike gpiod_line_set_value(), this leaves the other lines of the request
+ * at their last written values and doesn't issue an ioctl() if the value
+ * doesn't change. See gpiod_line_set_value_mask().
+ */
+int gpiod_line_update_value(struct gpiod_line *line, int value) GPIOD_API;
+
+/**
+ * @brief Update the output values of a set of GPIO lines.
+ * @param bulk Set of GPIO lines to update. The lines must have been
+ *             requested together but can be any subset of the request in
+ *             any order.
+ * @param values An array holding line_bulk->num_lines new values for lines.
+ * @return 0 is the operation succeeds. In case of an error this routine
+ *         returns -1 and sets the last error number.
+ *
+ * See gpiod_line_set_value_mask().
+ */
+int gpiod_line_update_value_bulk(struct gpiod_line_bulk *bulk,
+				 const int *values) GPIOD_API;
+
+/**
+ * @brief Read the output values last written to a line request.
+ * @param line Any line of the request.
+ * @param values Buffer in which the values will be stored - bit n
+ *               corresponds to the n-th line of the request.
+ * @return 0 is the operation succeeds. In case of an error this routine
+ *         returns -1 and sets the last error number.
+ *
+ * This doesn't issue any ioctl(). Fails with EPERM if the line was not
+ * requested as output.
+ */
+int gpiod_line_get_shadow(struct gpiod_line *line,
+			  unsigned long long *values) GPIOD_API;
+
+/**
+ * @brief Timing characteristics of a GPIO chip used for pulse generation.
+ */
+struct gpiod_pulse_calib {
+	struct timespec ioctl_latency;
+	/**< Median duration of a set-values ioctl() call. */
+	struct timespec wakeup_latency;
+	/**< Worst observed overshoot of an absolute-deadline sleep. */
+};
+
+/**
+ * @brief Measure the timing characteristics of the chip owning given line.
+ * @param line GPIO line object. The line must be reserved as output.
+ * @param calib Buffer in which the measured values will be stored. Can be
+ *              NULL.
+ * @return 0 if the operation succeeds. In case of an error this routine
+ *         returns -1 and sets the last error number.
+ *
+ * This routine repeatedly writes the last written values of the lines
+ * requested together with the line (so the outputs don't change) and stores
+ * the results in the chip object. They're used by all subsequent calls to
+ * gpiod_line_pulse() on lines of this chip.
+ */
+int gpiod_line_pulse_calibrate(struct gpiod_line *line,
+			       struct gpiod_pulse_calib *calib) GPIOD_API;
+
+/**
+ * @brief Generate a single pulse on a GPIO line.
+ * @param line GPIO line object. The line must be reserved as output.
+ * @param width Requested width of the pulse.
+ * @param measured Buffer in which the measured width of the pulse will be
+ *                 stored. Can be NULL.
+ * @return 0 if the operation succeeds. In case of an error this routine
+ *         returns -1 and sets the last error number.
+ *
+ * The line is driven to the opposite of its last written value and back
+ * after the requested time, so the pulse goes away from whatever level the
+ * line idles at. Values are logical: an active-low line at its inactive
+ * value 0 gets a physically low pulse. The second
+ * ioctl() is issued at an absolute deadline corrected by the ioctl latency
+ * learned by gpiod_line_pulse_calibrate(). The routine sleeps until shortly
+ * before the deadline and busy-waits for the rest of the time. The measured
+ * width is the time between the completion of both ioctl() calls.
+ */
+int gpiod_line_pulse(struct gpiod_line *line, const struct timespec *width,
+		     struct timespec *measured) GPIOD_API;
+
 /**
  * @brief Find a GPIO line by its name.
  * @param name Name of the GPIO line.
@@ -665,6 +819,45 @@ struct gpiod_line_event {
 int gpiod_line_event_request(struct gpiod_line *line,
 			     struct gpiod_line_evreq_config *config) GPIOD_API;
 
+/**
+ * @brief Request event notifications for a set of lines.
+ * @param bulk Set of GPIO lines to request.
+ * @param config Event request configuration.
+ * @return 0 if the operation succeeds. In case of an error this routine
+ *         returns -1 and sets the last error number.
+ *
+ * If GPIOD_REQUEST_POLLED is set in config->line_flags, the lines are
+ * requested as inputs and their events are emulated by the library: all
+ * lines are sampled with a single ioctl() call from within
+ * ::gpiod_line_event_wait_bulk and ::gpiod_line_event_read and changes
+ * between consecutive samples are reported as edge events. With
+ * GPIOD_REQUEST_POLLED_FALLBACK the lines are polled only if the kernel
+ * can't deliver interrupts for them.
+ *
+ * Polled events are only as precise as the sampling period and pulses
+ * shorter than it can be missed entirely.
+ *
+ * If GPIOD_REQUEST_CACHE_VALUE is set, the library tracks the level of
+ * every line from the events read with ::gpiod_line_event_read and
+ * ::gpiod_line_event_read_multiple and ::gpiod_line_get_value and
+ * ::gpiod_line_get_value_bulk return it without making a system call. The
+ * values are thus consistent with the events read so far rather than with
+ * the current state of the lines. The kernel is only asked for the value
+ * of a line before the first event is read, after
+ * ::gpiod_line_event_sync_value and after events may have been lost: when
+ * two consecutive events are of the same type or when the kernel FIFO of
+ * GPIOD_EVENT_READ_MAX events was full. To detect the latter, the library
+ * always reads a full FIFO worth of events from the kernel and returns
+ * the events that don't fit into the user's buffer from subsequent reads.
+ * The event file descriptor isn't readable while such events are pending,
+ * so it shouldn't be polled directly - ::gpiod_line_event_wait and
+ * ::gpiod_line_event_wait_bulk take them into account. This flag requires
+ * GPIOD_EVENT_BOTH_EDGES. Events read with ::gpiod_line_event_read_fd
+ * don't update the cached values.
+ */
+int gpiod_line_event_request_bulk(struct gpiod_line_bulk *bulk,
+				  struct gpiod_line_evreq_config *config) GPIOD_API;
+
 /**
  * @brief Request rising edge event notifications on a single line.
  * @param line GPIO line object.
@@ -704,6 +897,12 @@ int gpiod_line_event_request_all(struct gpiod_line *line,
  */
 void gpiod_line_event_release(struct gpiod_line *line) GPIOD_API;
 
+/**
+ * @brief Stop listening for events on a set of lines and release them.
+ * @param bulk Set of GPIO lines to release.
+ */
+void gpiod_line_event_release_bulk(struct gpiod_line_bulk *bulk) GPIOD_API;
+
 /**
  * @brief Check if event notifications are configured on this line.
  * @param line GPIO line object.
@@ -711,6 +910,39 @@ void gpiod_line_event_release(struct gpiod_line *line) GPIOD_API;
  */
 bool gpiod_line_event_configured(struct gpiod_line *line) GPIOD_API;
 
+/**
+ * @brief Check if events on this line are emulated by polling.
+ * @param line GPIO line object.
+ * @return True if the line is polled. False otherwise.
+ */
+bool gpiod_line_event_is_polled(struct gpiod_line *line) GPIOD_API;
+
+/**
+ * @brief Read the value of an event line from the kernel.
+ * @param line GPIO line object.
+ * @return 0 or 1 if the operation succeeds, -1 on failure.
+ *
+ * If the value of the line is cached, the cache is updated with the value
+ * read. Events still pending in the kernel at this point will reveal
+ * themselves as lost events once read and cause another update.
+ */
+int gpiod_line_event_sync_value(struct gpiod_line *line) GPIOD_API;
+
+/**
+ * @brief Set the sampling period bounds of a polled line.
+ * @param line GPIO line object.
+ * @param min Sampling period used while the lines are changing.
+ * @param max Longest sampling period used when the lines are idle.
+ * @return 0 if the operation succeeds, -1 on failure.
+ *
+ * The period is reset to min after every change and doubled after every
+ * sample that didn't detect any, up to max. The defaults are 1ms and 50ms.
+ * The setting applies to all lines requested together with this one.
+ */
+int gpiod_line_event_set_poll_period(struct gpiod_line *line,
+				     const struct timespec *min,
+				     const struct timespec *max) GPIOD_API;
+
 /**
  * @brief Wait for an event on a single line.
  * @param line GPIO line object.
@@ -743,13 +975,35 @@ int gpiod_line_event_wait_bulk(struct gpiod_line_bulk *bulk,
 int gpiod_line_event_read(struct gpiod_line *line,
 			  struct gpiod_line_event *event) GPIOD_API;
 
+/**
+ * @brief Maximum number of events that can be read at once.
+ *
+ * This is the depth of the kernel event FIFO of a single line.
+ */
+#define GPIOD_EVENT_READ_MAX		16
+
+/**
+ * @brief Read up to num_events pending events from the GPIO line.
+ * @param line GPIO line object.
+ * @param events Buffer to which the event data will be copied.
+ * @param num_events Size of the buffer - at most GPIOD_EVENT_READ_MAX.
+ * @return Number of events read (at least one) or -1 on error.
+ *
+ * Blocks until at least one event is available, then returns all the
+ * queued events that fit into the buffer with a single system call.
+ */
+int gpiod_line_event_read_multiple(struct gpiod_line *line,
+				   struct gpiod_line_event *events,
+				   unsigned int num_events) GPIOD_API;
+
 /**
  * @brief Get the event file descriptor.
  * @param line GPIO line object.
  * @return Number of the event file descriptor or -1 on error.
  *
  * Users may want to poll the event file descriptor on their own. This routine
- * allows to access it.
+ * allows to access it. Polled lines have no event file descriptor and -1 is
+ * returned for them.
  */
 int gpiod_line_event_get_fd(struct gpiod_line *line) GPIOD_API;
 
@@ -765,6 +1019,16 @@ int gpiod_line_event_get_fd(struct gpiod_line *line) GPIOD_API;
  */
 int gpiod_line_event_read_fd(int fd, struct gpiod_line_event *event) GPIOD_API;
 
+/**
+ * @brief Read up to num_events GPIO events directly from a file descriptor.
+ * @param fd File descriptor.
+ * @param events Buffer to which the event data will be copied.
+ * @param num_events Size of the buffer - at most GPIOD_EVENT_READ_MAX.
+ * @return Number of events read (at least one) or -1 on error.
+ */
+int gpiod_line_event_read_fd_multiple(int fd, struct gpiod_line_event *events,
+				      unsigned int num_events) GPIOD_API;
+
 /**
  * @}
  *
@@ -1078,6 +1342,1028 @@ gpiod_line_iter_last_offset(const struct gpiod_line_iter *iter)
 	     !gpiod_line_iter_done(iter);				\
 	     (line) = gpiod_line_iter_next(iter))
 
+/**
+ * @}
+ *
+ * @defgroup __sched__ Timed output scheduler
+ * @{
+ *
+ * The scheduler allows to queue a large number of delayed value changes on
+ * requested output lines. Pending actions are stored in a hierarchical timer
+ * wheel and all actions that become due in the same tick and concern lines
+ * requested together are applied with a single bulk set.
+ *
+ * The scheduler is driven by a single timer file descriptor which can be
+ * added to an external event loop. Once it becomes readable, the user must
+ * call gpiod_sched_dispatch(). Scheduler objects are not thread-safe.
+ */
+
+/**
+ * @brief Create a new scheduler.
+ * @param tick Resolution of the scheduler. If NULL, one millisecond is used.
+ * @return New scheduler object or NULL if an error occurred.
+ */
+struct gpiod_sched * gpiod_sched_new(const struct timespec *tick) GPIOD_API;
+
+/**
+ * @brief Release all resources allocated for the scheduler.
+ * @param sched Scheduler object.
+ *
+ * All pending actions are discarded.
+ */
+void gpiod_sched_free(struct gpiod_sched *sched) GPIOD_API;
+
+/**
+ * @brief Get the file descriptor the scheduler is driven by.
+ * @param sched Scheduler object.
+ * @return File descriptor which becomes readable when there are actions
+ *         that need dispatching.
+ */
+int gpiod_sched_get_fd(struct gpiod_sched *sched) GPIOD_API;
+
+/**
+ * @brief Get the number of pending actions.
+ * @param sched Scheduler object.
+ * @return Number of actions that were not yet dispatched or cancelled.
+ */
+unsigned int gpiod_sched_num_pending(struct gpiod_sched *sched) GPIOD_API;
+
+/**
+ * @brief Schedule a value change on a GPIO line.
+ * @param sched Scheduler object.
+ * @param line GPIO line object. The line must be reserved.
+ * @param value New value.
+ * @param delay Time after which the value should be set. Rounded up to the
+ *        scheduler tick. NULL means: on the next dispatch.
+ * @return Positive action identifier which can be passed to
+ *         gpiod_sched_cancel() or -1 if an error occurred.
+ *
+ * The caller must cancel all pending actions concerning a line before
+ * releasing it.
+ */
+long gpiod_sched_add(struct gpiod_sched *sched, struct gpiod_line *line,
+		     int value, const struct timespec *delay) GPIOD_API;
+
+/**
+ * @brief Cancel a pending action.
+ * @param sched Scheduler object.
+ * @param id Action identifier returned by gpiod_sched_add().
+ * @return 0 if the action was cancelled, -1 if it doesn't exist (for
+ *         instance because it has already been dispatched).
+ */
+int gpiod_sched_cancel(struct gpiod_sched *sched, long id) GPIOD_API;
+
+/**
+ * @brief Wait until there are actions to dispatch.
+ * @param sched Scheduler object.
+ * @param timeout Wait time limit.
+ * @return 0 if wait timed out, -1 if an error occurred, 1 if
+ *         gpiod_sched_dispatch() should be called.
+ */
+int gpiod_sched_wait(struct gpiod_sched *sched,
+		     const struct timespec *timeout) GPIOD_API;
+
+/**
+ * @brief Execute all actions that are due.
+ * @param sched Scheduler object.
+ * @return Number of actions that were processed or -1 if setting any of
+ *         the values failed. In the latter case the remaining actions are
+ *         still executed and the last error number is set.
+ */
+int gpiod_sched_dispatch(struct gpiod_sched *sched) GPIOD_API;
+
+/**
+ * @}
+ *
+ * @defgroup __sampler__ Periodic input sampling
+ * @{
+ *
+ * A sampler reads the values of a set of requested lines at a fixed rate
+ * from a dedicated thread. Samples are taken on absolute deadlines, so the
+ * sampling period doesn't drift, and are stored in a lock-free ring buffer
+ * from which they can be read in batches.
+ *
+ * Only one thread may read samples from a single sampler at any time. The
+ * lines must not be released while the sampler is running.
+ */
+
+/**
+ * @brief Structure holding configuration of a sampler.
+ */
+struct gpiod_sampler_config {
+	struct timespec period;
+	/**< Sampling period. */
+	unsigned int ring_size;
+	/**< Number of samples the ring buffer can hold. Rounded up to the
+	 *   nearest power of two. If 0, a default of 1024 is used. */
+	unsigned int batch_size;
+	/**< The notification file descriptor becomes readable every
+	 *   batch_size samples. If 0, after every sample. */
+};
+
+/**
+ * @brief Structure holding a single sample.
+ */
+struct gpiod_sample {
+	struct timespec ts;
+	/**< Time when the sample was taken (CLOCK_MONOTONIC). */
+	unsigned long long values;
+	/**< Line values - bit n corresponds to the n-th line in the bulk. */
+};
+
+/**
+ * @brief Structure holding sampler statistics.
+ */
+struct gpiod_sampler_stats {
+	unsigned long long num_samples;
+	/**< Number of samples taken. */
+	unsigned long long missed_deadlines;
+	/**< Number of deadlines that were skipped because the sampling thread
+	 *   was late by more than a period. */
+	unsigned long long overruns;
+	/**< Number of samples dropped because the ring buffer was full. */
+	struct timespec jitter_max;
+	/**< Largest deviation of the interval between two consecutive
+	 *   samples from the sampling period, or from its multiple if
+	 *   deadlines were skipped in between. */
+	struct timespec jitter_mean;
+	/**< Mean deviation of the sampling interval from the period. */
+};
+
+/**
+ * @brief Create a new sampler.
+ * @param bulk Set of GPIO lines to sample. The lines must be requested
+ *             together, either as inputs or for events, before the sampler
+ *             is started.
+ * @param config Sampler configuration.
+ * @return New sampler object or NULL if an error occurred.
+ */
+struct gpiod_sampler *
+gpiod_sampler_new(struct gpiod_line_bulk *bulk,
+		  const struct gpiod_sampler_config *config) GPIOD_API;
+
+/**
+ * @brief Stop the sampler and release all associated resources.
+ * @param sampler Sampler object.
+ */
+void gpiod_sampler_free(struct gpiod_sampler *sampler) GPIOD_API;
+
+/**
+ * @brief Start the sampling thread.
+ * @param sampler Sampler object.
+ * @return 0 if the operation succeeds, -1 on error.
+ *
+ * The statistics are reset every time the sampler is started.
+ */
+int gpiod_sampler_start(struct gpiod_sampler *sampler) GPIOD_API;
+
+/**
+ * @brief Stop the sampling thread.
+ * @param sampler Sampler object.
+ *
+ * This routine may block for up to one sampling period. Samples that have
+ * not been read yet remain in the ring buffer. If the last batch is not
+ * complete, the notification file descriptor is signalled anyway.
+ */
+void gpiod_sampler_stop(struct gpiod_sampler *sampler) GPIOD_API;
+
+/**
+ * @brief Get the notification file descriptor of the sampler.
+ * @param sampler Sampler object.
+ * @return File descriptor which becomes readable when a batch of samples is
+ *         available or the sampling thread stopped due to an error.
+ */
+int gpiod_sampler_get_fd(struct gpiod_sampler *sampler) GPIOD_API;
+
+/**
+ * @brief Wait for a batch of samples.
+ * @param sampler Sampler object.
+ * @param timeout Wait time limit.
+ * @return 0 if wait timed out, -1 if an error occurred, 1 if samples are
+ *         available.
+ */
+int gpiod_sampler_wait(struct gpiod_sampler *sampler,
+		       const struct timespec *timeout) GPIOD_API;
+
+/**
+ * @brief Read samples from the ring buffer without blocking.
+ * @param sampler Sampler object.
+ * @param samples Buffer for the samples.
+ * @param num_samples Maximum number of samples to read.
+ * @return Number of samples read or -1 if the ring buffer is empty and the
+ *         sampling thread stopped because reading the line values failed.
+ *         In the latter case the last error number is set to the error that
+ *         stopped the thread.
+ */
+int gpiod_sampler_read(struct gpiod_sampler *sampler,
+		       struct gpiod_sample *samples,
+		       unsigned int num_samples) GPIOD_API;
+
+/**
+ * @brief Retrieve the sampler statistics.
+ * @param sampler Sampler object.
+ * @param stats Buffer in which the statistics will be stored.
+ */
+void gpiod_sampler_get_stats(struct gpiod_sampler *sampler,
+			     struct gpiod_sampler_stats *stats) GPIOD_API;
+
+/**
+ * @}
+ *
+ * @defgroup __snapshot__ Shared value snapshots
+ * @{
+ *
+ * A publisher keeps the current values of a set of lines, together with
+ * the time of the last change of each of them, in a POSIX shared memory
+ * object. Any number of processes can then read consistent snapshots of
+ * the values without making a single system call, no matter how often.
+ *
+ * The publisher updates the values from a dedicated thread, either from
+ * the edge events of lines requested for events or by sampling the lines
+ * periodically. The shared values are protected by a sequence counter:
+ * readers retry if they raced with an update, the publisher never waits
+ * for them.
+ *
+ * The lines must not be released while the publisher is running.
+ */
+
+/**
+ * @brief Structure holding configuration of a publisher.
+ */
+struct gpiod_publisher_config {
+	const char *name;
+	/**< Name of the shared memory object, see shm_open(). An existing
+	 *   object of the same name is replaced. */
+	struct timespec period;
+	/**< Sampling period. If zero, the values are updated from edge
+	 *   events and the lines must be requested for events on both
+	 *   edges. */
+	unsigned int mode;
+	/**< Permissions of the shared memory object. If 0, 0644 is used. */
+};
+
+/**
+ * @brief Structure holding a snapshot of published line values.
+ */
+struct gpiod_snapshot {
+	unsigned long long generation;
+	/**< Incremented every time any value changes. */
+	unsigned long long values;
+	/**< Line values - bit n corresponds to the n-th published line. */
+	struct timespec heartbeat;
+	/**< Last time (CLOCK_MONOTONIC) the publisher checked the values.
+	 *   The event-driven publisher refreshes it at least every 50ms, a
+	 *   sampling one after every sample. A heartbeat that stopped means
+	 *   the publisher is gone. */
+	struct timespec changed[GPIOD_REQUEST_MAX_LINES];
+	/**< Time of the last change of each line - the event timestamp
+	 *   (CLOCK_REALTIME) if updated from events or the CLOCK_MONOTONIC
+	 *   time of the sample. */
+};
+
+/**
+ * @brief Create a new publisher.
+ * @param bulk Set of GPIO lines to publish. The lines must be requested
+ *             together before the publisher is started.
+ * @param config Publisher configuration.
+ * @return New publisher object or NULL if an error occurred.
+ *
+ * The shared memory object is created immediately, the values are
+ * published once the publisher is started. If an object of the same name
+ * already exists - also one left behind by a publisher that didn't exit
+ * cleanly - the call fails with EEXIST. Such an object must be removed
+ * with shm_unlink() first.
+ */
+struct gpiod_publisher *
+gpiod_publisher_new(struct gpiod_line_bulk *bulk,
+		    const struct gpiod_publisher_config *config) GPIOD_API;
+
+/**
+ * @brief Stop the publisher, remove the shared memory object and release
+ *        all resources.
+ * @param pub Publisher object.
+ *
+ * Readers that have the object open can still read the last values.
+ */
+void gpiod_publisher_free(struct gpiod_publisher *pub) GPIOD_API;
+
+/**
+ * @brief Publish the current values and start the updating thread.
+ * @param pub Publisher object.
+ * @return 0 if the publisher was started, -1 on error.
+ */
+int gpiod_publisher_start(struct gpiod_publisher *pub) GPIOD_API;
+
+/**
+ * @brief Stop the updating thread.
+ * @param pub Publisher object.
+ */
+void gpiod_publisher_stop(struct gpiod_publisher *pub) GPIOD_API;
+
+/**
+ * @brief Check if the updating thread stopped because of an error.
+ * @param pub Publisher object.
+ * @return 0 or the number of the error that stopped the thread.
+ */
+int gpiod_publisher_error(struct gpiod_publisher *pub) GPIOD_API;
+
+/**
+ * @brief Open published line values.
+ * @param name Name of the shared memory object.
+ * @return New reader object or NULL if an error occurred.
+ *
+ * Fails with EPROTO if the object holds an invalid number of lines.
+ */
+struct gpiod_snapshot_reader *
+gpiod_snapshot_open(const char *name) GPIOD_API;
+
+/**
+ * @brief Close published line values.
+ * @param reader Reader object.
+ */
+void gpiod_snapshot_close(struct gpiod_snapshot_reader *reader) GPIOD_API;
+
+/**
+ * @brief Get the number of published lines.
+ * @param reader Reader object.
+ * @return Number of lines.
+ */
+unsigned int
+gpiod_snapshot_num_lines(struct gpiod_snapshot_reader *reader) GPIOD_API;
+
+/**
+ * @brief Get the offset of a published line.
+ * @param reader Reader object.
+ * @param index Index of the line - less than the number of lines.
+ * @return Offset of the line.
+ */
+unsigned int gpiod_snapshot_offset(struct gpiod_snapshot_reader *reader,
+				   unsigned int index) GPIOD_API;
+
+/**
+ * @brief Get the name of the chip the published lines belong to.
+ * @param reader Reader object.
+ * @return Name of the chip.
+ */
+const char *
+gpiod_snapshot_chip_name(struct gpiod_snapshot_reader *reader) GPIOD_API;
+
+/**
+ * @brief Read a consistent snapshot of the published values.
+ * @param reader Reader object.
+ * @param snapshot Buffer for the snapshot. Only as many change timestamps
+ *                 as there are lines are filled in.
+ * @return 0 if the snapshot was read, -1 on error.
+ *
+ * This function makes no system calls. It fails with EAGAIN if it keeps
+ * racing with the publisher, which can only happen if the publisher died
+ * in the middle of an update.
+ */
+int gpiod_snapshot_read(struct gpiod_snapshot_reader *reader,
+			struct gpiod_snapshot *snapshot) GPIOD_API;
+
+/**
+ * @}
+ *
+ * @defgroup __fanout__ Event fan-out
+ * @{
+ *
+ * Only a single process can request events on a line. A fan-out lets any
+ * number of other processes receive them too: a dedicated thread of the
+ * owner of the request drains the events in batches and copies them into
+ * a ring buffer in a POSIX shared memory object, from which every
+ * subscriber reads them at its own pace.
+ *
+ * The producer never waits for subscribers. A subscriber that falls more
+ * than the size of the ring behind loses the oldest events and can tell
+ * how many with gpiod_fanout_lost(). Subscribers map the ring read-only
+ * and sleep on a futex, the producer wakes them with a single system call
+ * per batch of events regardless of their number.
+ *
+ * The lines must not be released while the fan-out is running.
+ */
+
+/**
+ * @brief Structure holding configuration of a fan-out.
+ */
+struct gpiod_fanout_config {
+	const char *name;
+	/**< Name of the shared memory object, see shm_open(). An existing
+	 *   object of the same name is replaced. */
+	unsigned int ring_size;
+	/**< Number of events the ring can hold. Rounded up to the nearest
+	 *   power of two. If 0, a default of 4096 is used. */
+	unsigned int mode;
+	/**< Permissions of the shared memory object. If 0, 0644 is used. */
+};
+
+/**
+ * @brief Structure holding an event read from a fan-out ring.
+ */
+struct gpiod_fanout_event {
+	struct gpiod_line_event event;
+	/**< Timestamp and type of the event. */
+	unsigned int offset;
+	/**< Offset of the line on which the event occurred. */
+};
+
+/**
+ * @brief Create a new fan-out.
+ * @param bulk Set of GPIO lines whose events should be distributed. The
+ *             lines must be requested for events before the fan-out is
+ *             started.
+ * @param config Fan-out configuration.
+ * @return New fan-out object or NULL if an error occurred.
+ */
+struct gpiod_fanout *
+gpiod_fanout_new(struct gpiod_line_bulk *bulk,
+		 const struct gpiod_fanout_config *config) GPIOD_API;
+
+/**
+ * @brief Stop the fan-out, remove the shared memory object and release
+ *        all resources.
+ * @param fanout Fan-out object.
+ */
+void gpiod_fanout_free(struct gpiod_fanout *fanout) GPIOD_API;
+
+/**
+ * @brief Start distributing events.
+ * @param fanout Fan-out object.
+ * @return 0 if the fan-out was started, -1 on error.
+ */
+int gpiod_fanout_start(struct gpiod_fanout *fanout) GPIOD_API;
+
+/**
+ * @brief Stop distributing events.
+ * @param fanout Fan-out object.
+ */
+void gpiod_fanout_stop(struct gpiod_fanout *fanout) GPIOD_API;
+
+/**
+ * @brief Check if the distributing thread stopped because of an error.
+ * @param fanout Fan-out object.
+ * @return 0 or the number of the error that stopped the thread.
+ */
+int gpiod_fanout_error(struct gpiod_fanout *fanout) GPIOD_API;
+
+/**
+ * @brief Subscribe to the events of a fan-out.
+ * @param name Name of the shared memory object.
+ * @return New subscriber object or NULL if an error occurred.
+ *
+ * Only events distributed after subscribing are received.
+ */
+struct gpiod_fanout_sub * gpiod_fanout_subscribe(const char *name) GPIOD_API;
+
+/**
+ * @brief Stop receiving events and release all resources.
+ * @param sub Subscriber object.
+ */
+void gpiod_fanout_unsubscribe(struct gpiod_fanout_sub *sub) GPIOD_API;
+
+/**
+ * @brief Get the number of lines whose events are distributed.
+ * @param sub Subscriber object.
+ * @return Number of lines.
+ */
+unsigned int gpiod_fanout_num_lines(struct gpiod_fanout_sub *sub) GPIOD_API;
+
+/**
+ * @brief Get the offset of a line whose events are distributed.
+ * @param sub Subscriber object.
+ * @param index Index of the line - less than the number of lines.
+ * @return Offset of the line.
+ */
+unsigned int gpiod_fanout_offset(struct gpiod_fanout_sub *sub,
+				 unsigned int index) GPIOD_API;
+
+/**
+ * @brief Get the name of the chip the lines belong to.
+ * @param sub Subscriber object.
+ * @return Name of the chip.
+ */
+const char * gpiod_fanout_chip_name(struct gpiod_fanout_sub *sub) GPIOD_API;
+
+/**
+ * @brief Wait for events.
+ * @param sub Subscriber object.
+ * @param timeout Wait time limit or NULL to wait forever.
+ * @return 0 if wait timed out, -1 if an error occurred, 1 if there are
+ *         events to read.
+ */
+int gpiod_fanout_wait(struct gpiod_fanout_sub *sub,
+		      const struct timespec *timeout) GPIOD_API;
+
+/**
+ * @brief Read the pending events without blocking.
+ * @param sub Subscriber object.
+ * @param events Buffer for the events.
+ * @param num_events Size of the buffer.
+ * @return Number of events stored in the buffer, possibly 0.
+ *
+ * This function makes no system calls.
+ */
+int gpiod_fanout_read(struct gpiod_fanout_sub *sub,
+		      struct gpiod_fanout_event *events,
+		      unsigned int num_events) GPIOD_API;
+
+/**
+ * @brief Get the number of events this subscriber missed.
+ * @param sub Subscriber object.
+ * @return Number of events overwritten by the producer before this
+ *         subscriber could read them.
+ */
+unsigned long long gpiod_fanout_lost(struct gpiod_fanout_sub *sub) GPIOD_API;
+
+/**
+ * @}
+ *
+ * @defgroup __handover__ Request handover
+ * @{
+ *
+ * A line stays requested for as long as any process holds the file
+ * descriptor of its request. A process being replaced by a new version of
+ * itself can pass the descriptors of all requests made on a chip together
+ * with their configuration to its successor over a Unix domain socket. The
+ * successor gets a chip object with all lines in the same state as in the
+ * original process without making any new request, so outputs keep their
+ * values and no pending events are lost.
+ *
+ * Line handles, event requests and events emulated by polling are handed
+ * over. Statistics, flight recorder settings and any other per-process
+ * state are not.
+ */
+
+/**
+ * @brief Hand over all requests made on a chip to another process.
+ * @param sock Connected Unix domain socket.
+ * @param chip GPIO chip object.
+ * @return 0 if the requests were sent, -1 on error.
+ *
+ * The requests stay valid in the calling process. Once this function
+ * returns, closing the chip no longer releases the lines as the kernel
+ * keeps them requested for the receiving process. The caller must not use
+ * the lines after handing them over.
+ */
+int gpiod_handover_send(int sock, struct gpiod_chip *chip) GPIOD_API;
+
+/**
+ * @brief Take over the requests handed over by another process.
+ * @param sock Connected Unix domain socket.
+ * @return GPIO chip object with the lines of the handed over requests
+ *         already requested or NULL if an error occurred.
+ *
+ * The chip is opened by name, the requests are rebuilt from the received
+ * file descriptors without any request ioctl. If an error occurs, the
+ * lines received so far are released and the socket should be closed.
+ */
+struct gpiod_chip * gpiod_handover_receive(int sock) GPIOD_API;
+
+/**
+ * @}
+ *
+ * @defgroup __stats__ Performance statistics
+ * @{
+ *
+ * Statistics are disabled by default and must be enabled separately for
+ * every chip. Once enabled, the library counts the ioctl() calls it makes
+ * on behalf of the chip and of every line request subsequently made on it,
+ * measures how long they take and counts event reads and ppoll() calls.
+ *
+ * Every thread updates its own set of counters without taking any locks,
+ * so the statistics may be read at any time from any thread. With the
+ * statistics disabled the only overhead is a single pointer check per
+ * system call.
+ */
+
+/**
+ * @brief Types of ioctl() calls accounted for in statistics.
+ */
+enum {
+	GPIOD_STATS_IOCTL_LINEINFO = 0,
+	/**< Line info retrieval. */
+	GPIOD_STATS_IOCTL_LINEHANDLE,
+	/**< Line handle request. */
+	GPIOD_STATS_IOCTL_LINEEVENT,
+	/**< Line event request. */
+	GPIOD_STATS_IOCTL_GET_VALUES,
+	/**< Reading line values. */
+	GPIOD_STATS_IOCTL_SET_VALUES,
+	/**< Setting line values. */
+	GPIOD_STATS_NUM_IOCTLS,
+	/**< Number of ioctl() types. */
+};
+
+/**
+ * @brief Number of buckets in ioctl() latency histograms.
+ *
+ * Bucket n counts the calls that took between 2^n and 2^(n+1) - 1
+ * nanoseconds, the last bucket also counts all slower calls.
+ */
+#define GPIOD_STATS_HIST_BUCKETS	32
+
+/**
+ * @brief Statistics of a single ioctl() type.
+ */
+struct gpiod_ioctl_stats {
+	unsigned long long count;
+	/**< Number of calls. */
+	unsigned long long errors;
+	/**< Number of calls that failed. */
+	unsigned long long total_ns;
+	/**< Cumulative time spent in the calls. */
+	unsigned long long max_ns;
+	/**< Duration of the slowest call. */
+	unsigned long long hist[GPIOD_STATS_HIST_BUCKETS];
+	/**< Latency histogram. */
+};
+
+/**
+ * @brief Structure holding performance statistics.
+ */
+struct gpiod_stats {
+	struct gpiod_ioctl_stats ioctls[GPIOD_STATS_NUM_IOCTLS];
+	/**< Per-type ioctl() statistics. */
+	unsigned long long reads;
+	/**< Number of successful event reads. */
+	unsigned long long events_read;
+	/**< Number of events read. */
+	unsigned long long bytes_read;
+	/**< Number of bytes read from the kernel. Events emulated by polling
+	 *   don't count. */
+	unsigned long long polls;
+	/**< Number of ppoll() calls made while waiting for events. Only
+	 *   counted per chip. */
+	unsigned long long poll_timeouts;
+	/**< Number of ppoll() calls that timed out. Only counted per chip. */
+};
+
+/**
+ * @brief Start collecting statistics for a GPIO chip.
+ * @param chip The GPIO chip object.
+ * @return 0 if statistics were enabled, -1 on error.
+ *
+ * Per-request statistics are only kept for lines requested after this
+ * call. Calling this function again has no effect.
+ */
+int gpiod_chip_enable_stats(struct gpiod_chip *chip) GPIOD_API;
+
+/**
+ * @brief Read the statistics of a GPIO chip.
+ * @param chip The GPIO chip object.
+ * @param stats Buffer in which the statistics will be stored. Zeroed if
+ *              statistics are not enabled for this chip.
+ *
+ * Chip statistics include the activity of all its line requests. Events
+ * read with gpiod_line_event_read_fd() and
+ * gpiod_line_event_read_fd_multiple() can't be attributed to a chip and
+ * are not counted.
+ */
+void gpiod_chip_get_stats(struct gpiod_chip *chip,
+			  struct gpiod_stats *stats) GPIOD_API;
+
+/**
+ * @brief Read the statistics of the request a GPIO line belongs to.
+ * @param line GPIO line object.
+ * @param stats Buffer in which the statistics will be stored.
+ * @return 0 on success, -1 if the line is not requested or statistics
+ *         were not enabled for its chip when it was requested.
+ *
+ * All lines requested together share the same statistics.
+ */
+int gpiod_line_get_stats(struct gpiod_line *line,
+			 struct gpiod_stats *stats) GPIOD_API;
+
+/**
+ * @}
+ *
+ * @defgroup __recorder__ Flight recorder
+ * @{
+ *
+ * The flight recorder keeps the most recent line requests, releases, value
+ * reads and writes and event reads of the whole process in a fixed-size
+ * ring buffer, to be inspected after something went wrong. Recording takes
+ * no locks and costs a timestamp and a few stores per operation.
+ *
+ * The recorder can also be enabled without modifying the program by
+ * setting the GPIOD_RECORDER environment variable to the number of records
+ * to keep. If GPIOD_RECORDER_FILE is set too, the records are dumped to the
+ * file it names whenever the process receives SIGUSR2.
+ */
+
+/**
+ * @brief Types of flight recorder records.
+ */
+enum {
+	GPIOD_RECORD_REQUEST = 1,
+	/**< Lines requested. Values are the default output values. */
+	GPIOD_RECORD_RELEASE,
+	/**< Lines released. */
+	GPIOD_RECORD_EVENT_REQUEST,
+	/**< Line events requested. */
+	GPIOD_RECORD_EVENT_RELEASE,
+	/**< Line events released. */
+	GPIOD_RECORD_GET_VALUES,
+	/**< Line values read. */
+	GPIOD_RECORD_SET_VALUES,
+	/**< Line values set. */
+	GPIOD_RECORD_EVENT_READ,
+	/**< Events read. num_lines is the number of events, bit n of the
+	 *   values is set if event n was a rising edge. */
+};
+
+/**
+ * @brief Chip number of records not associated with any chip.
+ *
+ * Events read with gpiod_line_event_read_fd() and
+ * gpiod_line_event_read_fd_multiple() are recorded with this chip number
+ * and the file descriptor in place of the line offset.
+ */
+#define GPIOD_RECORD_NO_CHIP	(~0U)
+
+/**
+ * @brief Single flight recorder record.
+ */
+struct gpiod_record {
+	unsigned long long timestamp;
+	/**< CLOCK_MONOTONIC time of the operation in nanoseconds. */
+	unsigned long long values;
+	/**< Bit n holds the value of the n-th line of the operation. */
+	unsigned int chip;
+	/**< N of the gpiochipN the lines belong to. */
+	unsigned int offset;
+	/**< Offset of the first line of the operation. */
+	unsigned short type;
+	/**< Type of the record. */
+	unsigned short num_lines;
+	/**< Number of lines the operation concerned. */
+	int error;
+	/**< 0 if the operation succeeded, the error number otherwise. */
+};
+
+/**
+ * @brief Magic value at the beginning of flight recorder dump files.
+ */
+#define GPIOD_RECORDER_MAGIC	"GPIODREC"
+
+/**
+ * @brief Current version of the dump file format.
+ */
+#define GPIOD_RECORDER_VERSION	1
+
+/**
+ * @brief Header of a flight recorder dump file.
+ *
+ * The header is followed by the records, oldest first, in the byte order
+ * of the machine that wrote them.
+ */
+struct gpiod_recorder_header {
+	char magic[8];
+	/**< GPIOD_RECORDER_MAGIC without the terminating null byte. */
+	unsigned int version;
+	/**< GPIOD_RECORDER_VERSION. */
+	unsigned int record_size;
+	/**< Size of a single record. */
+};
+
+/**
+ * @brief Start recording library operations.
+ * @param num_records Number of most recent records to keep. Rounded up to
+ *                    the next power of two.
+ * @return 0 if the recorder was enabled, -1 on error.
+ *
+ * The ring buffer is allocated on the first call and kept until the
+ * process exits. Subsequent calls only resume recording and ignore the
+ * size.
+ */
+int gpiod_recorder_enable(unsigned int num_records) GPIOD_API;
+
+/**
+ * @brief Stop recording library operations.
+ *
+ * The records collected so far can still be dumped.
+ */
+void gpiod_recorder_disable(void) GPIOD_API;
+
+/**
+ * @brief Copy the most recent records.
+ * @param records Buffer for the records.
+ * @param max_records Size of the buffer.
+ * @return Number of records stored in the buffer, oldest first, or -1 if
+ *         the recorder was never enabled.
+ *
+ * Records that are overwritten while being copied are skipped.
+ */
+int gpiod_recorder_dump(struct gpiod_record *records,
+			unsigned int max_records) GPIOD_API;
+
+/**
+ * @brief Write all records to a file descriptor.
+ * @param fd File descriptor to write to.
+ * @return 0 on success, -1 on error.
+ *
+ * The data is written in the dump file format, starting with a
+ * ::gpiod_recorder_header. This function is async-signal-safe.
+ */
+int gpiod_recorder_dump_fd(int fd) GPIOD_API;
+
+/**
+ * @brief Dump the records to a file whenever a signal is received.
+ * @param signum Signal number.
+ * @param path File to (over)write.
+ * @return 0 on success, -1 on error.
+ *
+ * The previously installed handler of the signal is called after the dump.
+ * If there was none and the signal indicates a crash (SIGSEGV, SIGBUS,
+ * SIGILL, SIGFPE or SIGABRT), the signal is raised again with the default
+ * action restored so that the process still terminates and dumps core.
+ */
+int gpiod_recorder_dump_on_signal(int signum, const char *path) GPIOD_API;
+
+/**
+ * @}
+ *
+ * @defgroup __broker__ Broker client
+ * @{
+ *
+ * The gpiobroker daemon keeps line requests open on behalf of its clients
+ * and serves them over a unix socket. Several processes can thus share the
+ * same lines and short-lived ones don't pay for opening the chip, looking
+ * it up and requesting the lines on every run - the broker keeps all of
+ * that around for as long as any client holds the lines.
+ *
+ * Identical requests of different clients (same chip, offsets and
+ * configuration) share a single kernel request. Conflicting ones fail
+ * with GPIOD_ELINEBUSY or EBUSY just like two direct requests would.
+ *
+ * Every operation is a single round trip to the broker. Value changes that
+ * don't need to be waited for can be queued with
+ * gpiod_broker_set_value_bulk_async(): they are sent in batches and their
+ * replies are collected by gpiod_broker_sync() or by the next synchronous
+ * call. Broker objects are not thread-safe.
+ */
+
+/**
+ * @brief Default path of the broker socket.
+ */
+#define GPIOD_BROKER_SOCKET	"/run/gpiobroker.sock"
+
+/**
+ * @brief Structure holding an event forwarded by the broker.
+ */
+struct gpiod_broker_event {
+	struct gpiod_line_event event;
+	/**< Timestamp and type of the event. */
+	struct gpiod_broker_lines *lines;
+	/**< Subscription the event belongs to. */
+	unsigned int offset;
+	/**< Offset of the line on which the event occurred. */
+};
+
+/**
+ * @brief Connect to the broker.
+ * @param path Path of the broker socket or NULL for GPIOD_BROKER_SOCKET.
+ * @return New broker object or NULL if an error occurred.
+ */
+struct gpiod_broker * gpiod_broker_connect(const char *path) GPIOD_API;
+
+/**
+ * @brief Close the connection to the broker.
+ * @param broker Broker object.
+ *
+ * All lines held through this connection are released and the line
+ * objects are freed.
+ */
+void gpiod_broker_close(struct gpiod_broker *broker) GPIOD_API;
+
+/**
+ * @brief Get the socket file descriptor of the broker connection.
+ * @param broker Broker object.
+ * @return File descriptor which becomes readable when events arrive.
+ */
+int gpiod_broker_get_fd(struct gpiod_broker *broker) GPIOD_API;
+
+/**
+ * @brief Request a set of lines through the broker.
+ * @param broker Broker object.
+ * @param device Name, path, number or label of the gpiochip.
+ * @param offsets Offsets of the lines to request.
+ * @param num_lines Number of lines - at most GPIOD_REQUEST_MAX_LINES.
+ * @param config Request options.
+ * @param default_vals Initial values of output lines. Can be NULL.
+ * @return New line set object or NULL if an error occurred.
+ *
+ * If the broker already holds an identical request, the lines are shared
+ * and the default values are ignored: the lines keep the values they
+ * currently have. Check them with gpiod_broker_get_value_bulk() if it
+ * matters.
+ */
+struct gpiod_broker_lines *
+gpiod_broker_request(struct gpiod_broker *broker, const char *device,
+		     const unsigned int *offsets, unsigned int num_lines,
+		     const struct gpiod_line_request_config *config,
+		     const int *default_vals) GPIOD_API;
+
+/**
+ * @brief Subscribe to events on a set of lines through the broker.
+ * @param broker Broker object.
+ * @param device Name, path, number or label of the gpiochip.
+ * @param offsets Offsets of the lines to monitor.
+ * @param num_lines Number of lines - at most GPIOD_REQUEST_MAX_LINES.
+ * @param config Event request configuration. Polled requests are not
+ *               supported.
+ * @return New line set object or NULL if an error occurred.
+ *
+ * All clients subscribed to the same lines with the same configuration
+ * receive every event.
+ */
+struct gpiod_broker_lines *
+gpiod_broker_subscribe(struct gpiod_broker *broker, const char *device,
+		       const unsigned int *offsets, unsigned int num_lines,
+		       const struct gpiod_line_evreq_config *config) GPIOD_API;
+
+/**
+ * @brief Release lines requested or subscribed to through the broker.
+ * @param lines Line set object. It's freed by this function.
+ *
+ * The broker releases the lines once no client holds them anymore.
+ */
+void gpiod_broker_release(struct gpiod_broker_lines *lines) GPIOD_API;
+
+/**
+ * @brief Read the value of a single line held through the broker.
+ * @param lines Line set object containing exactly one line.
+ * @return 0 or 1 if the operation succeeds, -1 on error.
+ */
+int gpiod_broker_get_value(struct gpiod_broker_lines *lines) GPIOD_API;
+
+/**
+ * @brief Read the values of a set of lines held through the broker.
+ * @param lines Line set object.
+ * @param values An array big enough to hold the values of all lines.
+ * @return 0 if the operation succeeds, -1 on error.
+ */
+int gpiod_broker_get_value_bulk(struct gpiod_broker_lines *lines,
+				int *values) GPIOD_API;
+
+/**
+ * @brief Set the value of a single line held through the broker.
+ * @param lines Line set object containing exactly one line.
+ * @param value New value.
+ * @return 0 if the operation succeeds, -1 on error.
+ */
+int gpiod_broker_set_value(struct gpiod_broker_lines *lines,
+			   int value) GPIOD_API;
+
+/**
+ * @brief Set the values of a set of lines held through the broker.
+ * @param lines Line set object.
+ * @param values An array holding the new values of all lines.
+ * @return 0 if the operation succeeds, -1 on error.
+ */
+int gpiod_broker_set_value_bulk(struct gpiod_broker_lines *lines,
+				const int *values) GPIOD_API;
+
+/**
+ * @brief Queue a value change without waiting for its completion.
+ * @param lines Line set object.
+ * @param values An array holding the new values of all lines.
+ * @return 0 if the change was queued, -1 on error.
+ *
+ * Errors of the change itself are reported by gpiod_broker_sync().
+ */
+int gpiod_broker_set_value_bulk_async(struct gpiod_broker_lines *lines,
+				      const int *values) GPIOD_API;
+
+/**
+ * @brief Wait until all queued operations are completed.
+ * @param broker Broker object.
+ * @return 0 if all of them succeeded. Otherwise -1 and the last error is
+ *         set to the error of the first one that failed.
+ */
+int gpiod_broker_sync(struct gpiod_broker *broker) GPIOD_API;
+
+/**
+ * @brief Wait for an event forwarded by the broker.
+ * @param broker Broker object.
+ * @param timeout Wait time limit or NULL to wait forever.
+ * @return 0 if wait timed out, -1 if an error occurred, 1 if an event
+ *         is available.
+ */
+int gpiod_broker_event_wait(struct gpiod_broker *broker,
+			    const struct timespec *timeout) GPIOD_API;
+
+/**
+ * @brief Read the next event forwarded by the broker.
+ * @param broker Broker object.
+ * @param event Buffer to which the event data will be copied.
+ * @return 0 if the event was read correctly, -1 on error.
+ *
+ * Blocks until an event is available.
+ */
+int gpiod_broker_event_read(struct gpiod_broker *broker,
+			    struct gpiod_broker_event *event) GPIOD_API;
+
 /**
  * @}
  *
@@ -0,0 +1,1343 @@
+/*
+ * GPIO character device simulator to be loaded with LD_PRELOAD.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+/*
+ * The simulator interposes open(), ioctl(), read(), write(), close() and
+ * the directory listing functions and serves /dev/<chip> for every chip
+ * defined in the file pointed to by GPIOD_SIM_CONFIG. All other files are
+ * passed through to the C library untouched.
+ *
+ * Every simulated chip, line handle and line event request is backed by a
+ * real file descriptor so that poll(), ppoll(), select() and epoll work on
+ * them without being interposed: event requests are pipes into which edge
+ * events are written in the kernel's gpioevent_data format, everything
+ * else is an eventfd that never becomes readable.
+ *
+ * Simulated descriptors passed with SCM_RIGHTS through sendmsg() and
+ * recvmsg() stay simulated as long as they are received by the same
+ * process, in the order in which they were sent. The lines of a request
+ * are released when the last descriptor referring to it is closed.
+ *
+ * Configuration file syntax (one directive per line, '#' starts a comment,
+ * times are in microseconds):
+ *
+ *   chip <name> <label> <num lines>	- add a chip, served as /dev/<name>
+ *   name <offset> <line name>		- name a line of the last chip
+ *   wire <chip>:<offset> <chip>:<offset>
+ *					- values set on the first (output) line
+ *					  are driven onto the second one
+ *   latency <ioctl> <usec>		- busy-wait in every call to given ioctl:
+ *					  chipinfo, lineinfo, linehandle,
+ *					  lineevent, get, set or all
+ *   clock realtime|monotonic		- event timestamp clock (default:
+ *					  realtime like 4.x kernels)
+ *   at <usec> <chip>:<offset> 0|1|toggle
+ *					- set an input value at given time
+ *   every <usec> <chip>:<offset> [<count>]
+ *					- toggle an input periodically
+ *
+ * Script times are relative to the moment the first simulated chip is
+ * opened. Values of simulated lines can also be driven through the debugfs
+ * interface of gpio-mockup (/sys/kernel/debug/gpio-mockup/<chip>/<offset>)
+ * so that programs written for the mockup module work unmodified.
+ *
+ * Without GPIOD_SIM_CONFIG a single chip - gpiochip0 labeled 'gpio-sim'
+ * with 8 lines - is simulated.
+ */
+
+/* The fortified wrappers would clash with the definitions below. */
+#undef _FORTIFY_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+
+#define EXPORT		__attribute__((visibility("default")))
+#define UNUSED		__attribute__((unused))
+
+#define NSEC_PER_SEC	1000000000ULL
+#define NSEC_PER_USEC	1000ULL
+
+/* Descriptors above this number are never simulated. */
+#define SIM_MAX_FDS	4096
+/* Same as the kernel's per-request event FIFO. */
+#define SIM_EVENT_FIFO	16
+/* Simulated descriptors sent with SCM_RIGHTS and not yet received. */
+#define SIM_MAX_INFLIGHT	256
+
+static const char dev_dir[] = "/dev/";
+
+static const char *const mockup_dirs[] = {
+	"/sys/kernel/debug/gpio-mockup/",
+	"/sys/kernel/debug/gpio-mockup-event/",
+};
+
+enum {
+	SIM_IOCTL_CHIPINFO = 0,
+	SIM_IOCTL_LINEINFO,
+	SIM_IOCTL_LINEHANDLE,
+	SIM_IOCTL_LINEEVENT,
+	SIM_IOCTL_GET,
+	SIM_IOCTL_SET,
+	SIM_IOCTL_MAX,
+};
+
+static const char *const ioctl_names[] = {
+	"chipinfo",
+	"lineinfo",
+	"linehandle",
+	"lineevent",
+	"get",
+	"set",
+};
+
+enum {
+	SIM_FD_CHIP = 1,
+	SIM_FD_HANDLE,
+	SIM_FD_EVENT,
+	SIM_FD_MOCKUP,
+};
+
+struct sim_request;
+
+struct sim_line {
+	char name[GPIO_MAX_NAME_SIZE];
+	/* Physical value. */
+	int value;
+	struct sim_request *req;
+	struct sim_line *wire;
+};
+
+struct sim_chip {
+	char name[GPIO_MAX_NAME_SIZE];
+	char label[GPIO_MAX_NAME_SIZE];
+	unsigned int num_lines;
+	struct sim_line *lines;
+	struct sim_chip *next;
+};
+
+struct sim_request {
+	int type;
+	/* Number of descriptors and in-flight messages referring to it. */
+	int refcount;
+	struct sim_chip *chip;
+	unsigned int num_lines;
+	unsigned int offsets[GPIOHANDLES_MAX];
+	uint32_t flags;
+	uint32_t eventflags;
+	char consumer[GPIO_MAX_NAME_SIZE];
+	/* Write end of the event pipe. */
+	int event_fd;
+	unsigned int pending;
+	/* Line driven through the gpio-mockup debugfs file. */
+	struct sim_line *mockup_line;
+};
+
+struct sim_action {
+	uint64_t due_ns;
+	uint64_t period_ns;
+	unsigned long count;
+	struct sim_line *line;
+	/* -1 means toggle. */
+	int value;
+	struct sim_action *next;
+};
+
+struct sim_dir {
+	DIR *dir;
+	struct sim_chip *next_chip;
+	struct dirent dentry;
+	struct sim_dir *next;
+};
+
+static struct {
+	int (*open)(const char *, int, ...);
+	int (*ioctl)(int, unsigned long, ...);
+	ssize_t (*read)(int, void *, size_t);
+	ssize_t (*write)(int, const void *, size_t);
+	ssize_t (*pwrite)(int, const void *, size_t, off_t);
+	int (*close)(int);
+	ssize_t (*sendmsg)(int, const struct msghdr *, int);
+	ssize_t (*recvmsg)(int, struct msghdr *, int);
+	DIR * (*opendir)(const char *);
+	struct dirent * (*readdir)(DIR *);
+	int (*closedir)(DIR *);
+} real;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sim_init_once = PTHREAD_ONCE_INIT;
+static pthread_once_t sim_script_once = PTHREAD_ONCE_INIT;
+
+static struct sim_chip *sim_chips;
+static struct sim_action *sim_actions;
+static struct sim_dir *sim_dirs;
+static struct sim_request *sim_fds[SIM_MAX_FDS];
+static struct sim_request *sim_inflight[SIM_MAX_INFLIGHT];
+static unsigned int sim_inflight_head, sim_inflight_tail;
+static uint64_t sim_latency_ns[SIM_IOCTL_MAX];
+static clockid_t sim_clock = CLOCK_REALTIME;
+
+static void sim_die(const char *fmt, ...)
+{
+	va_list va;
+
+	va_start(va, fmt);
+	fprintf(stderr, "gpiod-sim: ");
+	vfprintf(stderr, fmt, va);
+	fprintf(stderr, "\n");
+	va_end(va);
+
+	exit(EXIT_FAILURE);
+}
+
+static void * sim_zalloc(size_t size)
+{
+	void *ptr;
+
+	ptr = calloc(1, size);
+	if (!ptr)
+		sim_die("out of memory");
+
+	return ptr;
+}
+
+static uint64_t clock_nsec(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* The latency is spent on the CPU just like a slow driver would. */
+static void sim_delay(int ioctl_type)
+{
+	uint64_t end;
+
+	if (!sim_latency_ns[ioctl_type])
+		return;
+
+	end = clock_nsec(CLOCK_MONOTONIC) + sim_latency_ns[ioctl_type];
+	while (clock_nsec(CLOCK_MONOTONIC) < end)
+		;
+}
+
+static struct sim_chip * sim_find_chip(const char *name)
+{
+	struct sim_chip *chip;
+
+	for (chip = sim_chips; chip; chip = chip->next) {
+		if (strcmp(chip->name, name) == 0)
+			return chip;
+	}
+
+	return NULL;
+}
+
+static struct sim_chip * sim_add_chip(const char *name, const char *label,
+				      unsigned int num_lines)
+{
+	struct sim_chip *chip, **tail;
+
+	chip = sim_zalloc(sizeof(*chip));
+	strncpy(chip->name, name, sizeof(chip->name) - 1);
+	strncpy(chip->label, label, sizeof(chip->label) - 1);
+	chip->num_lines = num_lines;
+	chip->lines = sim_zalloc(num_lines * sizeof(*chip->lines));
+
+	/* Keep the order from the config file for directory listings. */
+	for (tail = &sim_chips; *tail; tail = &(*tail)->next)
+		;
+	*tail = chip;
+
+	return chip;
+}
+
+/* Parse <chip><sep><offset>. */
+static struct sim_line * sim_parse_line(const char *spec, char sep)
+{
+	char name[GPIO_MAX_NAME_SIZE];
+	struct sim_chip *chip;
+	unsigned int offset;
+	const char *colon;
+	char *end;
+
+	colon = strrchr(spec, sep);
+	if (!colon || (size_t)(colon - spec) >= sizeof(name))
+		return NULL;
+
+	memcpy(name, spec, colon - spec);
+	name[colon - spec] = '\0';
+
+	chip = sim_find_chip(name);
+	if (!chip)
+		return NULL;
+
+	offset = strtoul(colon + 1, &end, 10);
+	if (*end != '\0' || offset >= chip->num_lines)
+		return NULL;
+
+	return &chip->lines[offset];
+}
+
+static void sim_add_action(struct sim_action *action)
+{
+	struct sim_action *new;
+
+	new = sim_zalloc(sizeof(*new));
+	*new = *action;
+	new->next = sim_actions;
+	sim_actions = new;
+}
+
+static void sim_parse_config(const char *path)
+{
+	char buf[256], *argv[5], *saveptr, *tok, *end;
+	struct sim_chip *chip = NULL;
+	struct sim_action action;
+	unsigned long num;
+	unsigned int i;
+	int argc, lineno = 0;
+	FILE *fp;
+
+	fp = fopen(path, "re");
+	if (!fp)
+		sim_die("unable to open %s: %s", path, strerror(errno));
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		lineno++;
+
+		tok = strchr(buf, '#');
+		if (tok)
+			*tok = '\0';
+
+		for (argc = 0, tok = strtok_r(buf, " \t\n", &saveptr);
+		     tok && argc < 5;
+		     tok = strtok_r(NULL, " \t\n", &saveptr))
+			argv[argc++] = tok;
+
+		if (!argc)
+			continue;
+
+		memset(&action, 0, sizeof(action));
+
+		if (strcmp(argv[0], "chip") == 0 && argc == 4) {
+			num = strtoul(argv[3], &end, 10);
+			if (*end != '\0' || !num || num > 1024)
+				goto invalid;
+			if (sim_find_chip(argv[1]))
+				goto invalid;
+
+			chip = sim_add_chip(argv[1], argv[2], num);
+		} else if (strcmp(argv[0], "name") == 0 && argc == 3) {
+			num = strtoul(argv[1], &end, 10);
+			if (!chip || *end != '\0' || num >= chip->num_lines)
+				goto invalid;
+
+			strncpy(chip->lines[num].name, argv[2],
+				sizeof(chip->lines[num].name) - 1);
+		} else if (strcmp(argv[0], "wire") == 0 && argc == 3) {
+			action.line = sim_parse_line(argv[1], ':');
+			if (!action.line)
+				goto invalid;
+
+			action.line->wire = sim_parse_line(argv[2], ':');
+			if (!action.line->wire)
+				goto invalid;
+		} else if (strcmp(argv[0], "latency") == 0 && argc == 3) {
+			num = strtoul(argv[2], &end, 10);
+			if (*end != '\0')
+				goto invalid;
+
+			for (i = 0; i < SIM_IOCTL_MAX; i++) {
+				if (strcmp(argv[1], "all") == 0 ||
+				    strcmp(argv[1], ioctl_names[i]) == 0)
+					sim_latency_ns[i] = num * NSEC_PER_USEC;
+			}
+		} else if (strcmp(argv[0], "clock") == 0 && argc == 2) {
+			if (strcmp(argv[1], "realtime") == 0)
+				sim_clock = CLOCK_REALTIME;
+			else if (strcmp(argv[1], "monotonic") == 0)
+				sim_clock = CLOCK_MONOTONIC;
+			else
+				goto invalid;
+		} else if (strcmp(argv[0], "at") == 0 && argc == 4) {
+			action.due_ns = strtoull(argv[1], &end, 10);
+			if (*end != '\0')
+				goto invalid;
+			action.due_ns *= NSEC_PER_USEC;
+
+			action.line = sim_parse_line(argv[2], ':');
+			if (!action.line)
+				goto invalid;
+
+			if (strcmp(argv[3], "toggle") == 0)
+				action.value = -1;
+			else if (strcmp(argv[3], "0") == 0 ||
+				 strcmp(argv[3], "1") == 0)
+				action.value = argv[3][0] - '0';
+			else
+				goto invalid;
+
+			action.count = 1;
+			sim_add_action(&action);
+		} else if (strcmp(argv[0], "every") == 0 &&
+			   (argc == 3 || argc == 4)) {
+			action.period_ns = strtoull(argv[1], &end, 10);
+			if (*end != '\0' || !action.period_ns)
+				goto invalid;
+			action.period_ns *= NSEC_PER_USEC;
+			action.due_ns = action.period_ns;
+
+			action.line = sim_parse_line(argv[2], ':');
+			if (!action.line)
+				goto invalid;
+
+			if (argc == 4) {
+				action.count = strtoul(argv[3], &end, 10);
+				if (*end != '\0' || !action.count)
+					goto invalid;
+			}
+
+			action.value = -1;
+			sim_add_action(&action);
+		} else {
+			goto invalid;
+		}
+	}
+
+	fclose(fp);
+	return;
+
+invalid:
+	sim_die("%s:%d: invalid directive", path, lineno);
+}
+
+static void * sim_sym(const char *name)
+{
+	void *sym;
+
+	sym = dlsym(RTLD_NEXT, name);
+	if (!sym)
+		sim_die("unable to resolve %s: %s", name, dlerror());
+
+	return sym;
+}
+
+static void sim_init(void)
+{
+	const char *path;
+
+	real.open = sim_sym("open");
+	real.ioctl = sim_sym("ioctl");
+	real.read = sim_sym("read");
+	real.write = sim_sym("write");
+	real.pwrite = sim_sym("pwrite");
+	real.close = sim_sym("close");
+	real.sendmsg = sim_sym("sendmsg");
+	real.recvmsg = sim_sym("recvmsg");
+	real.opendir = sim_sym("opendir");
+	real.readdir = sim_sym("readdir");
+	real.closedir = sim_sym("closedir");
+
+	path = getenv("GPIOD_SIM_CONFIG");
+	if (path)
+		sim_parse_config(path);
+	else
+		sim_add_chip("gpiochip0", "gpio-sim", 8);
+}
+
+static void sim_ensure_init(void)
+{
+	pthread_once(&sim_init_once, sim_init);
+}
+
+static struct sim_request * sim_get_fd(int fd)
+{
+	if (fd < 0 || fd >= SIM_MAX_FDS)
+		return NULL;
+
+	return __atomic_load_n(&sim_fds[fd], __ATOMIC_ACQUIRE);
+}
+
+/* Closes fd on failure. Returns fd or -1 with errno set. */
+static int sim_install_fd(int fd, struct sim_request *req)
+{
+	if (fd >= SIM_MAX_FDS) {
+		real.close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+
+	__atomic_add_fetch(&req->refcount, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&sim_fds[fd], req, __ATOMIC_RELEASE);
+
+	return fd;
+}
+
+static int sim_new_fd(int type, struct sim_chip *chip,
+		      struct sim_line *mockup_line)
+{
+	struct sim_request *req;
+	int fd;
+
+	fd = eventfd(0, EFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	req = sim_zalloc(sizeof(*req));
+	req->type = type;
+	req->chip = chip;
+	req->mockup_line = mockup_line;
+	req->event_fd = -1;
+
+	fd = sim_install_fd(fd, req);
+	if (fd < 0)
+		free(req);
+
+	return fd;
+}
+
+/* Called with sim_lock held. */
+static void sim_push_event(struct sim_request *req, int rising)
+{
+	struct gpioevent_data event;
+
+	if (rising && !(req->eventflags & GPIOEVENT_REQUEST_RISING_EDGE))
+		return;
+	if (!rising && !(req->eventflags & GPIOEVENT_REQUEST_FALLING_EDGE))
+		return;
+
+	/* The kernel drops events when the FIFO is full. */
+	if (req->pending >= SIM_EVENT_FIFO)
+		return;
+
+	memset(&event, 0, sizeof(event));
+	event.timestamp = clock_nsec(sim_clock);
+	event.id = rising ? GPIOEVENT_EVENT_RISING_EDGE
+			  : GPIOEVENT_EVENT_FALLING_EDGE;
+
+	if (real.write(req->event_fd, &event, sizeof(event)) == sizeof(event))
+		req->pending++;
+}
+
+/* Called with sim_lock held. Value -1 toggles the line. */
+static void sim_set_line(struct sim_line *line, int value)
+{
+	if (value < 0)
+		value = !line->value;
+
+	if (line->value == value)
+		return;
+
+	line->value = value;
+
+	if (line->req && line->req->type == SIM_FD_EVENT)
+		sim_push_event(line->req, value);
+
+	if (line->wire)
+		sim_set_line(line->wire, value);
+}
+
+static void * sim_script_thread(void *data UNUSED)
+{
+	struct sim_action *action, *next;
+	uint64_t start, now;
+	struct timespec ts;
+
+	start = clock_nsec(CLOCK_MONOTONIC);
+
+	for (;;) {
+		pthread_mutex_lock(&sim_lock);
+
+		next = NULL;
+		for (action = sim_actions; action; action = action->next) {
+			if (action->line && (!next ||
+					     action->due_ns < next->due_ns))
+				next = action;
+		}
+
+		pthread_mutex_unlock(&sim_lock);
+
+		if (!next)
+			return NULL;
+
+		ts.tv_sec = (start + next->due_ns) / NSEC_PER_SEC;
+		ts.tv_nsec = (start + next->due_ns) % NSEC_PER_SEC;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &ts, NULL) == EINTR)
+			;
+
+		pthread_mutex_lock(&sim_lock);
+
+		sim_set_line(next->line, next->value);
+
+		/* A count of 0 means forever. */
+		if (next->count && --next->count == 0) {
+			next->line = NULL;
+		} else {
+			next->due_ns += next->period_ns;
+
+			/* Don't try to catch up if we've fallen behind. */
+			now = clock_nsec(CLOCK_MONOTONIC) - start;
+			if (next->due_ns < now)
+				next->due_ns = now;
+		}
+
+		pthread_mutex_unlock(&sim_lock);
+	}
+}
+
+static void sim_start_script(void)
+{
+	pthread_t thread;
+
+	if (!sim_actions)
+		return;
+
+	if (pthread_create(&thread, NULL, sim_script_thread, NULL))
+		sim_die("unable to start the script thread");
+
+	pthread_detach(thread);
+}
+
+/*
+ * Returns the new descriptor, -1 on error or -2 if the path isn't
+ * simulated.
+ */
+static int sim_open_path(const char *path)
+{
+	struct sim_line *line;
+	struct sim_chip *chip;
+	unsigned int i;
+	size_t len;
+
+	if (strncmp(path, dev_dir, sizeof(dev_dir) - 1) == 0) {
+		chip = sim_find_chip(path + sizeof(dev_dir) - 1);
+		if (!chip)
+			return -2;
+
+		pthread_once(&sim_script_once, sim_start_script);
+
+		return sim_new_fd(SIM_FD_CHIP, chip, NULL);
+	}
+
+	for (i = 0; i < sizeof(mockup_dirs) / sizeof(*mockup_dirs); i++) {
+		len = strlen(mockup_dirs[i]);
+		if (strncmp(path, mockup_dirs[i], len) == 0) {
+			line = sim_parse_line(path + len, '/');
+			if (!line)
+				return -2;
+
+			return sim_new_fd(SIM_FD_MOCKUP, NULL, line);
+		}
+	}
+
+	return -2;
+}
+
+static int sim_chipinfo(struct sim_request *chip_req, struct gpiochip_info *info)
+{
+	struct sim_chip *chip = chip_req->chip;
+
+	memset(info, 0, sizeof(*info));
+	memcpy(info->name, chip->name, sizeof(info->name));
+	memcpy(info->label, chip->label, sizeof(info->label));
+	info->lines = chip->num_lines;
+
+	return 0;
+}
+
+static int sim_lineinfo(struct sim_request *chip_req,
+			struct gpioline_info *info)
+{
+	struct sim_chip *chip = chip_req->chip;
+	struct sim_request *req;
+	struct sim_line *line;
+	unsigned int offset;
+
+	offset = info->line_offset;
+	if (offset >= chip->num_lines) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	line = &chip->lines[offset];
+	req = line->req;
+
+	memset(info, 0, sizeof(*info));
+	info->line_offset = offset;
+	memcpy(info->name, line->name, sizeof(info->name));
+
+	if (req) {
+		info->flags |= GPIOLINE_FLAG_KERNEL;
+		memcpy(info->consumer, req->consumer, sizeof(info->consumer));
+
+		if (req->flags & GPIOHANDLE_REQUEST_OUTPUT)
+			info->flags |= GPIOLINE_FLAG_IS_OUT;
+		if (req->flags & GPIOHANDLE_REQUEST_ACTIVE_LOW)
+			info->flags |= GPIOLINE_FLAG_ACTIVE_LOW;
+		if (req->flags & GPIOHANDLE_REQUEST_OPEN_DRAIN)
+			info->flags |= GPIOLINE_FLAG_OPEN_DRAIN;
+		if (req->flags & GPIOHANDLE_REQUEST_OPEN_SOURCE)
+			info->flags |= GPIOLINE_FLAG_OPEN_SOURCE;
+	}
+
+	return 0;
+}
+
+/* Validate the offsets and mark the lines as requested. */
+static int sim_take_lines(struct sim_request *req, const uint32_t *offsets,
+			  unsigned int num_lines, const char *consumer)
+{
+	struct sim_chip *chip = req->chip;
+	unsigned int i;
+
+	if (!num_lines || num_lines > GPIOHANDLES_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < num_lines; i++) {
+		if (offsets[i] >= chip->num_lines) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (chip->lines[offsets[i]].req) {
+			errno = EBUSY;
+			return -1;
+		}
+	}
+
+	req->num_lines = num_lines;
+	strncpy(req->consumer, consumer, sizeof(req->consumer) - 1);
+
+	for (i = 0; i < num_lines; i++) {
+		req->offsets[i] = offsets[i];
+		chip->lines[offsets[i]].req = req;
+	}
+
+	return 0;
+}
+
+static void sim_release_lines(struct sim_request *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < req->num_lines; i++)
+		req->chip->lines[req->offsets[i]].req = NULL;
+}
+
+/* Drop a reference. Called with sim_lock held. */
+static void sim_put_request(struct sim_request *req)
+{
+	if (__atomic_sub_fetch(&req->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	if (req->type == SIM_FD_HANDLE || req->type == SIM_FD_EVENT)
+		sim_release_lines(req);
+	if (req->event_fd >= 0)
+		real.close(req->event_fd);
+
+	free(req);
+}
+
+static int sim_linehandle(struct sim_request *chip_req,
+			  struct gpiohandle_request *hreq)
+{
+	struct sim_request *req;
+	unsigned int i;
+	int fd, value;
+
+	if ((hreq->flags & GPIOHANDLE_REQUEST_INPUT) &&
+	    (hreq->flags & GPIOHANDLE_REQUEST_OUTPUT)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	req = sim_zalloc(sizeof(*req));
+	req->type = SIM_FD_HANDLE;
+	req->chip = chip_req->chip;
+	req->flags = hreq->flags;
+	req->event_fd = -1;
+
+	if (sim_take_lines(req, hreq->lineoffsets, hreq->lines,
+			   hreq->consumer_label) < 0) {
+		free(req);
+		return -1;
+	}
+
+	fd = eventfd(0, EFD_CLOEXEC);
+	if (fd < 0) {
+		sim_release_lines(req);
+		free(req);
+		return -1;
+	}
+
+	if (req->flags & GPIOHANDLE_REQUEST_OUTPUT) {
+		for (i = 0; i < req->num_lines; i++) {
+			value = !!hreq->default_values[i];
+			if (req->flags & GPIOHANDLE_REQUEST_ACTIVE_LOW)
+				value = !value;
+
+			sim_set_line(&req->chip->lines[req->offsets[i]], value);
+		}
+	}
+
+	hreq->fd = sim_install_fd(fd, req);
+	if (hreq->fd < 0) {
+		sim_release_lines(req);
+		free(req);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int sim_lineevent(struct sim_request *chip_req,
+			 struct gpioevent_request *ereq)
+{
+	struct sim_request *req;
+	int fds[2];
+
+	if (ereq->handleflags & GPIOHANDLE_REQUEST_OUTPUT) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	req = sim_zalloc(sizeof(*req));
+	req->type = SIM_FD_EVENT;
+	req->chip = chip_req->chip;
+	req->flags = ereq->handleflags;
+	req->eventflags = ereq->eventflags;
+
+	if (sim_take_lines(req, &ereq->lineoffset, 1,
+			   ereq->consumer_label) < 0) {
+		free(req);
+		return -1;
+	}
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		sim_release_lines(req);
+		free(req);
+		return -1;
+	}
+
+	req->event_fd = fds[1];
+
+	ereq->fd = sim_install_fd(fds[0], req);
+	if (ereq->fd < 0) {
+		sim_release_lines(req);
+		real.close(fds[1]);
+		free(req);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int sim_get_values(struct sim_request *req, struct gpiohandle_data *data)
+{
+	unsigned int i;
+	int value;
+
+	memset(data, 0, sizeof(*data));
+
+	for (i = 0; i < req->num_lines; i++) {
+		value = req->chip->lines[req->offsets[i]].value;
+		if (req->flags & GPIOHANDLE_REQUEST_ACTIVE_LOW)
+			value = !value;
+
+		data->values[i] = value;
+	}
+
+	return 0;
+}
+
+static int sim_set_values(struct sim_request *req, struct gpiohandle_data *data)
+{
+	unsigned int i;
+	int value;
+
+	if (!(req->flags & GPIOHANDLE_REQUEST_OUTPUT)) {
+		errno = EPERM;
+		return -1;
+	}
+
+	for (i = 0; i < req->num_lines; i++) {
+		value = !!data->values[i];
+		if (req->flags & GPIOHANDLE_REQUEST_ACTIVE_LOW)
+			value = !value;
+
+		sim_set_line(&req->chip->lines[req->offsets[i]], value);
+	}
+
+	return 0;
+}
+
+static int sim_ioctl(struct sim_request *req, unsigned long request, void *arg)
+{
+	int status, type;
+
+	switch (request) {
+	case GPIO_GET_CHIPINFO_IOCTL:
+		type = SIM_IOCTL_CHIPINFO;
+		break;
+	case GPIO_GET_LINEINFO_IOCTL:
+		type = SIM_IOCTL_LINEINFO;
+		break;
+	case GPIO_GET_LINEHANDLE_IOCTL:
+		type = SIM_IOCTL_LINEHANDLE;
+		break;
+	case GPIO_GET_LINEEVENT_IOCTL:
+		type = SIM_IOCTL_LINEEVENT;
+		break;
+	case GPIOHANDLE_GET_LINE_VALUES_IOCTL:
+		type = SIM_IOCTL_GET;
+		break;
+	case GPIOHANDLE_SET_LINE_VALUES_IOCTL:
+		type = SIM_IOCTL_SET;
+		break;
+	default:
+		errno = ENOTTY;
+		return -1;
+	}
+
+	if (type <= SIM_IOCTL_LINEEVENT && req->type != SIM_FD_CHIP) {
+		errno = ENOTTY;
+		return -1;
+	}
+
+	if (type == SIM_IOCTL_GET && req->type != SIM_FD_HANDLE &&
+	    req->type != SIM_FD_EVENT) {
+		errno = ENOTTY;
+		return -1;
+	}
+
+	if (type == SIM_IOCTL_SET && req->type != SIM_FD_HANDLE) {
+		errno = ENOTTY;
+		return -1;
+	}
+
+	sim_delay(type);
+
+	pthread_mutex_lock(&sim_lock);
+
+	switch (type) {
+	case SIM_IOCTL_CHIPINFO:
+		status = sim_chipinfo(req, arg);
+		break;
+	case SIM_IOCTL_LINEINFO:
+		status = sim_lineinfo(req, arg);
+		break;
+	case SIM_IOCTL_LINEHANDLE:
+		status = sim_linehandle(req, arg);
+		break;
+	case SIM_IOCTL_LINEEVENT:
+		status = sim_lineevent(req, arg);
+		break;
+	case SIM_IOCTL_GET:
+		status = sim_get_values(req, arg);
+		break;
+	default:
+		status = sim_set_values(req, arg);
+		break;
+	}
+
+	pthread_mutex_unlock(&sim_lock);
+
+	return status;
+}
+
+/*
+ * The functions below replace the C library ones. Everything that doesn't
+ * concern a simulated chip is forwarded to the original implementation.
+ */
+
+static int sim_open(const char *path, int flags, mode_t mode)
+{
+	int fd;
+
+	sim_ensure_init();
+
+	if (path) {
+		pthread_mutex_lock(&sim_lock);
+		fd = sim_open_path(path);
+		pthread_mutex_unlock(&sim_lock);
+
+		if (fd != -2)
+			return fd;
+	}
+
+	return real.open(path, flags, mode);
+}
+
+static mode_t sim_open_mode(int flags, va_list va)
+{
+	if (flags & (O_CREAT | O_TMPFILE))
+		return va_arg(va, mode_t);
+
+	return 0;
+}
+
+EXPORT int open(const char *path, int flags, ...)
+{
+	mode_t mode;
+	va_list va;
+
+	va_start(va, flags);
+	mode = sim_open_mode(flags, va);
+	va_end(va);
+
+	return sim_open(path, flags, mode);
+}
+
+EXPORT int open64(const char *path, int flags, ...)
+{
+	mode_t mode;
+	va_list va;
+
+	va_start(va, flags);
+	mode = sim_open_mode(flags, va);
+	va_end(va);
+
+	return sim_open(path, flags | O_LARGEFILE, mode);
+}
+
+EXPORT int __open_2(const char *path, int flags)
+{
+	return sim_open(path, flags, 0);
+}
+
+EXPORT int __open64_2(const char *path, int flags)
+{
+	return sim_open(path, flags | O_LARGEFILE, 0);
+}
+
+EXPORT int ioctl(int fd, unsigned long request, ...)
+{
+	struct sim_request *req;
+	va_list va;
+	void *arg;
+
+	sim_ensure_init();
+
+	va_start(va, request);
+	arg = va_arg(va, void *);
+	va_end(va);
+
+	req = sim_get_fd(fd);
+	if (!req)
+		return real.ioctl(fd, request, arg);
+
+	return sim_ioctl(req, request, arg);
+}
+
+EXPORT ssize_t read(int fd, void *buf, size_t count)
+{
+	struct sim_request *req;
+	char val[2];
+	ssize_t rd;
+
+	sim_ensure_init();
+
+	req = sim_get_fd(fd);
+	if (!req)
+		return real.read(fd, buf, count);
+
+	if (req->type == SIM_FD_MOCKUP) {
+		if (!count)
+			return 0;
+
+		pthread_mutex_lock(&sim_lock);
+		val[0] = '0' + req->mockup_line->value;
+		pthread_mutex_unlock(&sim_lock);
+		val[1] = '\n';
+
+		rd = count < sizeof(val) ? count : sizeof(val);
+		memcpy(buf, val, rd);
+
+		return rd;
+	}
+
+	if (req->type != SIM_FD_EVENT) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Like the kernel, only hand out whole events. */
+	count -= count % sizeof(struct gpioevent_data);
+	if (!count) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	rd = real.read(fd, buf, count);
+	if (rd > 0) {
+		pthread_mutex_lock(&sim_lock);
+		req->pending -= rd / sizeof(struct gpioevent_data);
+		pthread_mutex_unlock(&sim_lock);
+	}
+
+	return rd;
+}
+
+static ssize_t sim_mockup_write(struct sim_request *req,
+				const void *buf, size_t count)
+{
+	const char *str = buf;
+
+	if (req->type != SIM_FD_MOCKUP || !count ||
+	    (str[0] != '0' && str[0] != '1')) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&sim_lock);
+	sim_set_line(req->mockup_line, str[0] - '0');
+	pthread_mutex_unlock(&sim_lock);
+
+	return count;
+}
+
+EXPORT ssize_t write(int fd, const void *buf, size_t count)
+{
+	struct sim_request *req;
+
+	sim_ensure_init();
+
+	req = sim_get_fd(fd);
+	if (!req)
+		return real.write(fd, buf, count);
+
+	return sim_mockup_write(req, buf, count);
+}
+
+EXPORT ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+	struct sim_request *req;
+
+	sim_ensure_init();
+
+	req = sim_get_fd(fd);
+	if (!req)
+		return real.pwrite(fd, buf, count, offset);
+
+	return sim_mockup_write(req, buf, count);
+}
+
+EXPORT int close(int fd)
+{
+	struct sim_request *req;
+
+	sim_ensure_init();
+
+	req = sim_get_fd(fd);
+	if (req) {
+		pthread_mutex_lock(&sim_lock);
+		__atomic_store_n(&sim_fds[fd], NULL, __ATOMIC_RELEASE);
+		sim_put_request(req);
+		pthread_mutex_unlock(&sim_lock);
+	}
+
+	return real.close(fd);
+}
+
+/* Calls fn on every descriptor passed as SCM_RIGHTS in the message. */
+static void sim_for_each_right(const struct msghdr *msg,
+			       void (*fn)(int))
+{
+	struct cmsghdr *cmsg;
+	unsigned int i;
+	int fd;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg;
+	     cmsg = CMSG_NXTHDR((struct msghdr *)msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		for (i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		     i++) {
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int),
+			       sizeof(int));
+			fn(fd);
+		}
+	}
+}
+
+/* Called with sim_lock held. */
+static void sim_right_sent(int fd)
+{
+	struct sim_request *req = sim_get_fd(fd);
+
+	if (!req || sim_inflight_tail - sim_inflight_head >= SIM_MAX_INFLIGHT)
+		return;
+
+	__atomic_add_fetch(&req->refcount, 1, __ATOMIC_RELAXED);
+	sim_inflight[sim_inflight_tail++ % SIM_MAX_INFLIGHT] = req;
+}
+
+/* Called with sim_lock held. */
+static void sim_right_received(int fd)
+{
+	struct sim_request *req;
+
+	if (sim_inflight_head == sim_inflight_tail)
+		return;
+
+	req = sim_inflight[sim_inflight_head++ % SIM_MAX_INFLIGHT];
+	/* The descriptor takes over the reference of the message. */
+	if (sim_install_fd(fd, req) >= 0)
+		__atomic_sub_fetch(&req->refcount, 1, __ATOMIC_RELAXED);
+	else
+		sim_put_request(req);
+}
+
+EXPORT ssize_t sendmsg(int sock, const struct msghdr *msg, int flags)
+{
+	ssize_t rv;
+
+	sim_ensure_init();
+
+	rv = real.sendmsg(sock, msg, flags);
+	if (rv >= 0 && msg->msg_controllen) {
+		pthread_mutex_lock(&sim_lock);
+		sim_for_each_right(msg, sim_right_sent);
+		pthread_mutex_unlock(&sim_lock);
+	}
+
+	return rv;
+}
+
+EXPORT ssize_t recvmsg(int sock, struct msghdr *msg, int flags)
+{
+	ssize_t rv;
+
+	sim_ensure_init();
+
+	rv = real.recvmsg(sock, msg, flags);
+	if (rv >= 0 && msg->msg_controllen) {
+		pthread_mutex_lock(&sim_lock);
+		sim_for_each_right(msg, sim_right_received);
+		pthread_mutex_unlock(&sim_lock);
+	}
+
+	return rv;
+}
+
+/*
+ * Simulated chips are appended to listings of /dev so that chip iterators
+ * find them. Real devices shadowed by a simulated chip are hidden.
+ */
+
+EXPORT DIR * opendir(const char *path)
+{
+	struct sim_dir *sdir;
+	DIR *dir;
+
+	sim_ensure_init();
+
+	dir = real.opendir(path);
+	if (!dir || (strcmp(path, "/dev") != 0 && strcmp(path, dev_dir) != 0))
+		return dir;
+
+	sdir = sim_zalloc(sizeof(*sdir));
+	sdir->dir = dir;
+	sdir->next_chip = sim_chips;
+
+	pthread_mutex_lock(&sim_lock);
+	sdir->next = sim_dirs;
+	sim_dirs = sdir;
+	pthread_mutex_unlock(&sim_lock);
+
+	return dir;
+}
+
+static struct sim_dir * sim_find_dir(DIR *dir, bool unlink)
+{
+	struct sim_dir *sdir, **prev;
+
+	for (prev = &sim_dirs, sdir = sim_dirs;
+	     sdir;
+	     prev = &sdir->next, sdir = sdir->next) {
+		if (sdir->dir == dir) {
+			if (unlink)
+				*prev = sdir->next;
+
+			return sdir;
+		}
+	}
+
+	return NULL;
+}
+
+EXPORT struct dirent * readdir(DIR *dir)
+{
+	struct dirent *dentry;
+	struct sim_dir *sdir;
+
+	sim_ensure_init();
+
+	pthread_mutex_lock(&sim_lock);
+	sdir = sim_find_dir(dir, false);
+	pthread_mutex_unlock(&sim_lock);
+
+	if (!sdir)
+		return real.readdir(dir);
+
+	while ((dentry = real.readdir(dir))) {
+		if (!sim_find_chip(dentry->d_name))
+			return dentry;
+	}
+
+	if (!sdir->next_chip)
+		return NULL;
+
+	memset(&sdir->dentry, 0, sizeof(sdir->dentry));
+	sdir->dentry.d_type = DT_CHR;
+	sdir->dentry.d_reclen = sizeof(sdir->dentry);
+	strncpy(sdir->dentry.d_name, sdir->next_chip->name,
+		sizeof(sdir->dentry.d_name) - 1);
+	sdir->next_chip = sdir->next_chip->next;
+
+	return &sdir->dentry;
+}
+
+EXPORT int closedir(DIR *dir)
+{
+	struct sim_dir *sdir;
+
+	sim_ensure_init();
+
+	pthread_mutex_lock(&sim_lock);
+	sdir = sim_find_dir(dir, true);
+	pthread_mutex_unlock(&sim_lock);
+
+	free(sdir);
+
+	return real.closedir(dir);
+}
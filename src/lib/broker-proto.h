@@ -0,0 +1,97 @@
+/*
+ * Wire protocol of the GPIO broker.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#ifndef __GPIOD_BROKER_PROTO_H__
+#define __GPIOD_BROKER_PROTO_H__
+
+/*
+ * Messages exchanged between gpiobroker and the client code in libgpiod.
+ *
+ * NOTE: This is not a stable interface. Both sides are built from the same
+ * tree and talk over a local socket so all fields use the host byte order.
+ *
+ * Every message starts with struct broker_hdr followed by size bytes of
+ * payload. Clients may send any number of requests without waiting for
+ * the replies. The broker handles them in order and sends exactly one
+ * BROKER_OP_REPLY carrying the same tag for each of them. BROKER_OP_EVENT
+ * messages with a zero tag can be interleaved with the replies at any time.
+ */
+
+#include <stdint.h>
+
+#define BROKER_DEVICE_MAX	64
+#define BROKER_CONSUMER_MAX	32
+#define BROKER_MSG_MAX		(sizeof(struct broker_hdr) + \
+				 sizeof(struct broker_request))
+
+enum {
+	BROKER_OP_REQUEST = 1,
+	/* struct broker_request - reply carries the new handle */
+	BROKER_OP_RELEASE,
+	/* struct broker_values - values are ignored */
+	BROKER_OP_GET,
+	/* struct broker_values - reply carries the values */
+	BROKER_OP_SET,
+	/* struct broker_values */
+	BROKER_OP_REPLY,
+	/* struct broker_reply */
+	BROKER_OP_EVENT,
+	/* struct broker_event */
+};
+
+enum {
+	BROKER_REQUEST_VALUES = 1,
+	BROKER_REQUEST_EVENTS,
+};
+
+struct broker_hdr {
+	uint32_t tag;
+	uint16_t size;
+	uint8_t op;
+	uint8_t padding;
+};
+
+struct broker_request {
+	uint32_t type;
+	/* Direction for value requests, event type for event requests. */
+	int32_t mode;
+	int32_t active_state;
+	int32_t flags;
+	uint64_t default_vals;
+	char device[BROKER_DEVICE_MAX];
+	char consumer[BROKER_CONSUMER_MAX];
+	uint32_t num_lines;
+	uint32_t offsets[GPIOD_REQUEST_MAX_LINES];
+};
+
+/* Bit i of values is the value of the i-th line of the request. */
+struct broker_values {
+	uint32_t handle;
+	uint32_t padding;
+	uint64_t values;
+};
+
+struct broker_reply {
+	/* 0 or an errno or libgpiod error number. */
+	int32_t error;
+	uint32_t handle;
+	uint64_t values;
+};
+
+struct broker_event {
+	uint32_t handle;
+	uint32_t offset;
+	int32_t event_type;
+	uint32_t padding;
+	int64_t sec;
+	int64_t nsec;
+};
+
+#endif /* __GPIOD_BROKER_PROTO_H__ */
@@ -0,0 +1,703 @@
+/*
+ * GPIO broker client for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "internal.h"
+#include "broker-proto.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Queued requests are sent once there's this much of them. */
+#define BROKER_FLUSH_THRESHOLD	4096
+#define BROKER_RX_SIZE		4096
+
+struct gpiod_broker_lines {
+	struct gpiod_broker *broker;
+	struct gpiod_broker_lines *next;
+	uint32_t handle;
+	unsigned int num_lines;
+};
+
+struct gpiod_broker {
+	int fd;
+	struct gpiod_broker_lines *lines;
+
+	/*
+	 * Replies arrive in the order of the requests, so the tag of the last
+	 * reply tells how many requests are still in flight.
+	 */
+	uint32_t last_tag;
+	uint32_t last_reply;
+	uint32_t wait_tag;
+	struct broker_reply reply;
+	int async_error;
+
+	char *tx;
+	size_t tx_len;
+	size_t tx_size;
+
+	char rx[BROKER_RX_SIZE];
+	size_t rx_len;
+
+	/* Events received while waiting for replies. */
+	struct gpiod_broker_event *events;
+	unsigned int ev_first;
+	unsigned int ev_last;
+	unsigned int ev_size;
+};
+
+static uint64_t values_to_mask(const int *values, unsigned int num_lines)
+{
+	uint64_t mask = 0;
+	unsigned int i;
+
+	for (i = 0; i < num_lines; i++) {
+		if (values[i])
+			mask |= 1ULL << i;
+	}
+
+	return mask;
+}
+
+static void mask_to_values(uint64_t mask, int *values,
+			   unsigned int num_lines)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_lines; i++)
+		values[i] = !!(mask & (1ULL << i));
+}
+
+static struct gpiod_broker_lines *
+broker_find_lines(struct gpiod_broker *broker, uint32_t handle)
+{
+	struct gpiod_broker_lines *lines;
+
+	for (lines = broker->lines; lines; lines = lines->next) {
+		if (lines->handle == handle)
+			return lines;
+	}
+
+	return NULL;
+}
+
+static int broker_push_event(struct gpiod_broker *broker,
+			     const struct broker_event *msg)
+{
+	struct gpiod_broker_event *event, *tmp;
+	struct gpiod_broker_lines *lines;
+	unsigned int size;
+
+	/* Events may still arrive for lines that were just released. */
+	lines = broker_find_lines(broker, msg->handle);
+	if (!lines)
+		return 0;
+
+	if (broker->ev_last == broker->ev_size) {
+		if (broker->ev_first) {
+			memmove(broker->events,
+				broker->events + broker->ev_first,
+				(broker->ev_last - broker->ev_first) *
+						sizeof(*broker->events));
+			broker->ev_last -= broker->ev_first;
+			broker->ev_first = 0;
+		} else {
+			size = broker->ev_size ? broker->ev_size * 2 : 16;
+			tmp = realloc(broker->events, size * sizeof(*tmp));
+			if (!tmp) {
+				set_last_error(ENOMEM);
+				return -1;
+			}
+
+			broker->events = tmp;
+			broker->ev_size = size;
+		}
+	}
+
+	event = &broker->events[broker->ev_last++];
+	event->event.ts.tv_sec = msg->sec;
+	event->event.ts.tv_nsec = msg->nsec;
+	event->event.event_type = msg->event_type;
+	event->lines = lines;
+	event->offset = msg->offset;
+
+	return 0;
+}
+
+static int broker_handle_msg(struct gpiod_broker *broker,
+			     const struct broker_hdr *hdr, const void *payload)
+{
+	const struct broker_reply *reply = payload;
+
+	switch (hdr->op) {
+	case BROKER_OP_REPLY:
+		if (hdr->size != sizeof(*reply))
+			break;
+
+		broker->last_reply = hdr->tag;
+		if (hdr->tag == broker->wait_tag)
+			broker->reply = *reply;
+		else if (reply->error && !broker->async_error)
+			broker->async_error = reply->error;
+
+		return 0;
+	case BROKER_OP_EVENT:
+		if (hdr->size != sizeof(struct broker_event))
+			break;
+
+		return broker_push_event(broker, payload);
+	}
+
+	set_last_error(EPROTO);
+	return -1;
+}
+
+/* Read whatever is available and handle all complete messages. */
+static int broker_receive(struct gpiod_broker *broker)
+{
+	struct broker_hdr hdr;
+	size_t pos, msg_size;
+	ssize_t rd;
+	int status;
+
+	rd = read(broker->fd, broker->rx + broker->rx_len,
+		  sizeof(broker->rx) - broker->rx_len);
+	if (rd < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+
+		last_error_from_errno();
+		return -1;
+	} else if (rd == 0) {
+		set_last_error(ECONNRESET);
+		return -1;
+	}
+
+	broker->rx_len += rd;
+
+	for (pos = 0; broker->rx_len - pos >= sizeof(hdr); pos += msg_size) {
+		memcpy(&hdr, broker->rx + pos, sizeof(hdr));
+		if (hdr.size > BROKER_MSG_MAX - sizeof(hdr)) {
+			set_last_error(EPROTO);
+			return -1;
+		}
+
+		msg_size = sizeof(hdr) + hdr.size;
+		if (broker->rx_len - pos < msg_size)
+			break;
+
+		status = broker_handle_msg(broker, &hdr,
+					   broker->rx + pos + sizeof(hdr));
+		if (status < 0)
+			return -1;
+	}
+
+	memmove(broker->rx, broker->rx + pos, broker->rx_len - pos);
+	broker->rx_len -= pos;
+
+	return 0;
+}
+
+/*
+ * Send all queued requests. Keep reading while doing it: the broker stops
+ * reading from us once it can't get rid of the replies.
+ */
+static int broker_flush(struct gpiod_broker *broker)
+{
+	struct pollfd pfd;
+	ssize_t wr;
+	int status;
+
+	pfd.fd = broker->fd;
+	pfd.events = POLLIN | POLLOUT;
+
+	while (broker->tx_len) {
+		wr = send(broker->fd, broker->tx, broker->tx_len,
+			  MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (wr > 0) {
+			memmove(broker->tx, broker->tx + wr,
+				broker->tx_len - wr);
+			broker->tx_len -= wr;
+			continue;
+		} else if (wr < 0 && errno != EAGAIN && errno != EINTR) {
+			last_error_from_errno();
+			return -1;
+		}
+
+		status = poll(&pfd, 1, -1);
+		if (status < 0) {
+			if (errno == EINTR)
+				continue;
+
+			last_error_from_errno();
+			return -1;
+		}
+
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+			status = broker_receive(broker);
+			if (status < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int broker_wait_readable(struct gpiod_broker *broker,
+				const struct timespec *timeout)
+{
+	struct pollfd pfd;
+	int status;
+
+	pfd.fd = broker->fd;
+	pfd.events = POLLIN;
+
+	status = ppoll(&pfd, 1, timeout, NULL);
+	if (status < 0) {
+		if (errno == EINTR)
+			return 0;
+
+		last_error_from_errno();
+		return -1;
+	}
+
+	return status;
+}
+
+/* Returns the tag of the queued request or 0 on error. */
+static uint32_t broker_queue(struct gpiod_broker *broker, uint8_t op,
+			     const void *payload, size_t size)
+{
+	struct broker_hdr hdr;
+	size_t new_size;
+	char *tmp;
+
+	if (broker->tx_size - broker->tx_len < sizeof(hdr) + size) {
+		new_size = broker->tx_size ? broker->tx_size * 2
+					   : BROKER_FLUSH_THRESHOLD * 2;
+		tmp = realloc(broker->tx, new_size);
+		if (!tmp) {
+			set_last_error(ENOMEM);
+			return 0;
+		}
+
+		broker->tx = tmp;
+		broker->tx_size = new_size;
+	}
+
+	/* Zero is reserved for events. */
+	if (++broker->last_tag == 0)
+		broker->last_tag = 1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.tag = broker->last_tag;
+	hdr.size = size;
+	hdr.op = op;
+
+	memcpy(broker->tx + broker->tx_len, &hdr, sizeof(hdr));
+	memcpy(broker->tx + broker->tx_len + sizeof(hdr), payload, size);
+	broker->tx_len += sizeof(hdr) + size;
+
+	return hdr.tag;
+}
+
+/* Send a request and wait for its reply. */
+static int broker_transact(struct gpiod_broker *broker, uint8_t op,
+			   const void *payload, size_t size,
+			   struct broker_reply *reply)
+{
+	int status;
+
+	broker->wait_tag = broker_queue(broker, op, payload, size);
+	if (!broker->wait_tag)
+		return -1;
+
+	status = broker_flush(broker);
+	if (status < 0)
+		goto out;
+
+	while (broker->last_reply != broker->wait_tag) {
+		status = broker_wait_readable(broker, NULL);
+		if (status < 0)
+			goto out;
+
+		status = broker_receive(broker);
+		if (status < 0)
+			goto out;
+	}
+
+	*reply = broker->reply;
+	if (reply->error) {
+		set_last_error(reply->error);
+		status = -1;
+	}
+
+out:
+	broker->wait_tag = 0;
+	return status;
+}
+
+struct gpiod_broker * gpiod_broker_connect(const char *path)
+{
+	struct gpiod_broker *broker;
+	struct sockaddr_un addr;
+	int status, flags;
+
+	if (!path)
+		path = GPIOD_BROKER_SOCKET;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		set_last_error(ENAMETOOLONG);
+		return NULL;
+	}
+
+	broker = zalloc(sizeof(*broker));
+	if (!broker)
+		return NULL;
+
+	broker->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (broker->fd < 0) {
+		last_error_from_errno();
+		goto err_free;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	status = connect(broker->fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (status < 0) {
+		last_error_from_errno();
+		goto err_close;
+	}
+
+	/* From now on we never block in read() or write(). */
+	flags = fcntl(broker->fd, F_GETFL);
+	status = fcntl(broker->fd, F_SETFL, flags | O_NONBLOCK);
+	if (flags < 0 || status < 0) {
+		last_error_from_errno();
+		goto err_close;
+	}
+
+	return broker;
+
+err_close:
+	close(broker->fd);
+err_free:
+	free(broker);
+
+	return NULL;
+}
+
+void gpiod_broker_close(struct gpiod_broker *broker)
+{
+	struct gpiod_broker_lines *lines, *next;
+
+	/* The broker drops everything we held once it notices. */
+	close(broker->fd);
+
+	for (lines = broker->lines; lines; lines = next) {
+		next = lines->next;
+		free(lines);
+	}
+
+	free(broker->events);
+	free(broker->tx);
+	free(broker);
+}
+
+int gpiod_broker_get_fd(struct gpiod_broker *broker)
+{
+	return broker->fd;
+}
+
+static struct gpiod_broker_lines *
+broker_request(struct gpiod_broker *broker, struct broker_request *req,
+	       const char *device, const char *consumer,
+	       const unsigned int *offsets, unsigned int num_lines)
+{
+	struct gpiod_broker_lines *lines;
+	struct broker_reply reply;
+	unsigned int i;
+	int status;
+
+	if (num_lines > GPIOD_REQUEST_MAX_LINES) {
+		set_last_error(GPIOD_ELINEMAX);
+		return NULL;
+	} else if (!num_lines || strlen(device) >= sizeof(req->device)) {
+		set_last_error(EINVAL);
+		return NULL;
+	}
+
+	strcpy(req->device, device);
+	if (consumer)
+		strncpy(req->consumer, consumer, sizeof(req->consumer) - 1);
+
+	req->num_lines = num_lines;
+	for (i = 0; i < num_lines; i++)
+		req->offsets[i] = offsets[i];
+
+	lines = zalloc(sizeof(*lines));
+	if (!lines)
+		return NULL;
+
+	/* Only send the offsets that are actually used. */
+	status = broker_transact(broker, BROKER_OP_REQUEST, req,
+				 offsetof(struct broker_request, offsets) +
+				 num_lines * sizeof(req->offsets[0]), &reply);
+	if (status < 0) {
+		free(lines);
+		return NULL;
+	}
+
+	lines->broker = broker;
+	lines->handle = reply.handle;
+	lines->num_lines = num_lines;
+	lines->next = broker->lines;
+	broker->lines = lines;
+
+	return lines;
+}
+
+struct gpiod_broker_lines *
+gpiod_broker_request(struct gpiod_broker *broker, const char *device,
+		     const unsigned int *offsets, unsigned int num_lines,
+		     const struct gpiod_line_request_config *config,
+		     const int *default_vals)
+{
+	struct broker_request req;
+
+	memset(&req, 0, sizeof(req));
+	req.type = BROKER_REQUEST_VALUES;
+	req.mode = config->direction;
+	req.active_state = config->active_state;
+	req.flags = config->flags;
+	if (default_vals && num_lines <= GPIOD_REQUEST_MAX_LINES)
+		req.default_vals = values_to_mask(default_vals, num_lines);
+
+	return broker_request(broker, &req, device, config->consumer,
+			      offsets, num_lines);
+}
+
+struct gpiod_broker_lines *
+gpiod_broker_subscribe(struct gpiod_broker *broker, const char *device,
+		       const unsigned int *offsets, unsigned int num_lines,
+		       const struct gpiod_line_evreq_config *config)
+{
+	struct broker_request req;
+
+	memset(&req, 0, sizeof(req));
+	req.type = BROKER_REQUEST_EVENTS;
+	req.mode = config->event_type;
+	req.active_state = config->active_state;
+	req.flags = config->line_flags;
+
+	return broker_request(broker, &req, device, config->consumer,
+			      offsets, num_lines);
+}
+
+void gpiod_broker_release(struct gpiod_broker_lines *lines)
+{
+	struct gpiod_broker *broker = lines->broker;
+	struct gpiod_broker_lines **ptr;
+	struct broker_values msg;
+	struct broker_reply reply;
+	unsigned int i, num;
+
+	for (ptr = &broker->lines; *ptr; ptr = &(*ptr)->next) {
+		if (*ptr == lines) {
+			*ptr = lines->next;
+			break;
+		}
+	}
+
+	/* Drop the events of these lines that weren't read yet. */
+	for (i = num = broker->ev_first; i < broker->ev_last; i++) {
+		if (broker->events[i].lines != lines)
+			broker->events[num++] = broker->events[i];
+	}
+	broker->ev_last = num;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.handle = lines->handle;
+
+	/* Nothing useful can be done if this fails. */
+	broker_transact(broker, BROKER_OP_RELEASE, &msg, sizeof(msg), &reply);
+
+	free(lines);
+}
+
+int gpiod_broker_get_value(struct gpiod_broker_lines *lines)
+{
+	int value, status;
+
+	if (lines->num_lines != 1) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	status = gpiod_broker_get_value_bulk(lines, &value);
+	if (status < 0)
+		return -1;
+
+	return value;
+}
+
+int gpiod_broker_get_value_bulk(struct gpiod_broker_lines *lines,
+				int *values)
+{
+	struct broker_values msg;
+	struct broker_reply reply;
+	int status;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.handle = lines->handle;
+
+	status = broker_transact(lines->broker, BROKER_OP_GET,
+				 &msg, sizeof(msg), &reply);
+	if (status < 0)
+		return -1;
+
+	mask_to_values(reply.values, values, lines->num_lines);
+
+	return 0;
+}
+
+int gpiod_broker_set_value(struct gpiod_broker_lines *lines, int value)
+{
+	if (lines->num_lines != 1) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	return gpiod_broker_set_value_bulk(lines, &value);
+}
+
+int gpiod_broker_set_value_bulk(struct gpiod_broker_lines *lines,
+				const int *values)
+{
+	struct broker_values msg;
+	struct broker_reply reply;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.handle = lines->handle;
+	msg.values = values_to_mask(values, lines->num_lines);
+
+	return broker_transact(lines->broker, BROKER_OP_SET,
+			       &msg, sizeof(msg), &reply);
+}
+
+int gpiod_broker_set_value_bulk_async(struct gpiod_broker_lines *lines,
+				      const int *values)
+{
+	struct gpiod_broker *broker = lines->broker;
+	struct broker_values msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.handle = lines->handle;
+	msg.values = values_to_mask(values, lines->num_lines);
+
+	if (!broker_queue(broker, BROKER_OP_SET, &msg, sizeof(msg)))
+		return -1;
+
+	if (broker->tx_len >= BROKER_FLUSH_THRESHOLD)
+		return broker_flush(broker);
+
+	return 0;
+}
+
+int gpiod_broker_sync(struct gpiod_broker *broker)
+{
+	int status;
+
+	status = broker_flush(broker);
+	if (status < 0)
+		return -1;
+
+	while (broker->last_reply != broker->last_tag) {
+		status = broker_wait_readable(broker, NULL);
+		if (status < 0)
+			return -1;
+
+		status = broker_receive(broker);
+		if (status < 0)
+			return -1;
+	}
+
+	if (broker->async_error) {
+		set_last_error(broker->async_error);
+		broker->async_error = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+int gpiod_broker_event_wait(struct gpiod_broker *broker,
+			    const struct timespec *timeout)
+{
+	uint64_t deadline = 0, now;
+	struct timespec ts;
+	int status;
+
+	status = broker_flush(broker);
+	if (status < 0)
+		return -1;
+
+	if (timeout)
+		deadline = monotonic_nsec() + timespec_to_nsec(timeout);
+
+	/* Replies wake us up too, so keep waiting until the deadline. */
+	while (broker->ev_first == broker->ev_last) {
+		if (timeout) {
+			now = monotonic_nsec();
+			if (now >= deadline)
+				return 0;
+
+			nsec_to_timespec(deadline - now, &ts);
+		}
+
+		status = broker_wait_readable(broker, timeout ? &ts : NULL);
+		if (status < 0)
+			return -1;
+		else if (status == 0)
+			continue;
+
+		status = broker_receive(broker);
+		if (status < 0)
+			return -1;
+	}
+
+	return 1;
+}
+
+int gpiod_broker_event_read(struct gpiod_broker *broker,
+			    struct gpiod_broker_event *event)
+{
+	int status;
+
+	status = gpiod_broker_event_wait(broker, NULL);
+	if (status < 0)
+		return -1;
+
+	*event = broker->events[broker->ev_first++];
+	if (broker->ev_first == broker->ev_last)
+		broker->ev_first = broker->ev_last = 0;
+
+	return 0;
+}
@@ -9,11 +9,11 @@
  */
 
 #include <gpiod.h>
+#include "internal.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <stdint.h>
 #include <errno.h>
 #include <dirent.h>
 #include <ctype.h>
@@ -21,37 +21,6 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <poll.h>
-#include <linux/gpio.h>
-
-#define MALLOC __attribute__((malloc))
-
-struct gpiod_chip {
-	int fd;
-	struct gpiochip_info cinfo;
-	struct gpiod_line *lines;
-};
-
-enum {
-	LINE_FREE = 0,
-	LINE_TAKEN,
-	LINE_EVENT,
-};
-
-struct handle_data {
-	struct gpiohandle_request request;
-	int refcount;
-};
-
-struct gpiod_line {
-	int state;
-	bool up_to_date;
-	struct gpiod_chip *chip;
-	struct gpioline_info info;
-	union {
-		struct handle_data *handle;
-		struct gpioevent_request event;
-	};
-};
 
 enum {
 	CHIP_ITER_INIT = 0,
@@ -66,6 +35,38 @@ struct gpiod_chip_iter {
 	char *failed_chip;
 };
 
+/*
+ * Events emulated for lines without interrupt support and events read ahead
+ * from the kernel for lines with cached values are stored in small per-line
+ * queues as deep as the kernel FIFO.
+ */
+#define EVENT_QUEUE_SIZE		GPIOD_EVENT_READ_MAX
+#define POLLER_DEFAULT_MIN_NS		1000000ULL
+#define POLLER_DEFAULT_MAX_NS		50000000ULL
+
+struct event_queue {
+	struct gpiod_line_event events[EVENT_QUEUE_SIZE];
+	unsigned int head;
+	unsigned int tail;
+	/* Set if events following the queued ones may have been dropped. */
+	bool overrun;
+};
+
+struct line_poller {
+	struct gpiohandle_request request;
+	struct gpiod_chip *chip;
+	struct stats_block *stats;
+	int refcount;
+	int event_type;
+	bool primed;
+	uint64_t last_values;
+	uint64_t period_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t next_ns;
+	struct event_queue queues[GPIOD_REQUEST_MAX_LINES];
+};
+
 static const char dev_dir[] = "/dev/";
 static const char cdev_prefix[] = "gpiochip";
 
@@ -87,17 +88,17 @@ static const char *const error_descr[] = {
 	"number of lines in the request exceeds limit",
 };
 
-static void set_last_error(int errnum)
+void set_last_error(int errnum)
 {
 	last_error = errnum;
 }
 
-static void last_error_from_errno(void)
+void last_error_from_errno(void)
 {
 	last_error = errno;
 }
 
-static MALLOC void * zalloc(size_t size)
+MALLOC void * zalloc(size_t size)
 {
 	void *ptr;
 
@@ -119,23 +120,49 @@ static bool is_unsigned_int(const char *str)
 	return *str == '\0';
 }
 
-static void nsec_to_timespec(uint64_t nsec, struct timespec *ts)
+void nsec_to_timespec(uint64_t nsec, struct timespec *ts)
 {
-	ts->tv_sec = nsec / 1000000000ULL;
-	ts->tv_nsec = (nsec % 1000000000ULL);
+	ts->tv_sec = nsec / NSEC_PER_SEC;
+	ts->tv_nsec = (nsec % NSEC_PER_SEC);
+}
+
+uint64_t timespec_to_nsec(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+uint64_t monotonic_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_nsec(&ts);
 }
 
-static int gpio_ioctl(int fd, unsigned long request, void *data)
+int gpio_ioctl(struct gpiod_chip *chip, struct stats_block *req_stats,
+	       int fd, unsigned long request, void *data)
 {
+	uint64_t start = 0;
 	int status;
 
+	PROBE(ioctl__entry, chip->cinfo.name, fd, request);
+
+	if (chip->stats)
+		start = monotonic_nsec();
+
 	status = ioctl(fd, request, data);
-	if (status < 0) {
+	if (status < 0)
 		last_error_from_errno();
-		return -1;
-	}
 
-	return 0;
+	if (chip->stats)
+		stats_add_ioctl(chip->stats, req_stats, request, status < 0,
+				monotonic_nsec() - start);
+
+	PROBE(ioctl__return, chip->cinfo.name, fd, request,
+	      status < 0 ? -last_error : 0);
+
+	return status < 0 ? -1 : 0;
 }
 
 int gpiod_errno(void)
@@ -268,37 +295,65 @@ int gpiod_simple_set_value_multiple(const char *consumer, const char *device,
 	return 0;
 }
 
-int gpiod_simple_event_loop(const char *consumer, const char *device,
-			    unsigned int offset, bool active_low,
-			    const struct timespec *timeout,
-			    gpiod_event_cb callback, void *cbdata)
+int gpiod_simple_event_loop_multiple(const char *consumer, const char *device,
+				     const unsigned int *offsets,
+				     unsigned int num_lines, bool active_low,
+				     int event_type,
+				     const struct timespec *timeout,
+				     gpiod_event_multiple_cb callback,
+				     void *cbdata)
 {
+	struct gpiod_line_evreq_config config;
 	struct gpiod_line_event event;
+	struct gpiod_line_bulk bulk;
 	struct gpiod_chip *chip;
 	struct gpiod_line *line;
+	unsigned int offset, i;
 	int status, evtype;
 
+	if (num_lines > GPIOD_REQUEST_MAX_LINES) {
+		set_last_error(GPIOD_ELINEMAX);
+		return -1;
+	}
+
 	chip = gpiod_chip_open_lookup(device);
 	if (!chip)
 		return -1;
 
-	line = gpiod_chip_get_line(chip, offset);
-	if (!line) {
-		gpiod_chip_close(chip);
-		return -1;
+	gpiod_line_bulk_init(&bulk);
+
+	for (i = 0; i < num_lines; i++) {
+		line = gpiod_chip_get_line(chip, offsets[i]);
+		if (!line) {
+			gpiod_chip_close(chip);
+			return -1;
+		}
+
+		gpiod_line_bulk_add(&bulk, line);
 	}
 
-	status = gpiod_line_event_request_all(line, consumer, active_low);
+	memset(&config, 0, sizeof(config));
+	config.consumer = consumer;
+	config.event_type = event_type;
+	config.active_state = active_low ? GPIOD_ACTIVE_STATE_LOW
+					 : GPIOD_ACTIVE_STATE_HIGH;
+
+	/* Let the kernel drop the edges the caller isn't interested in. */
+	status = gpiod_line_event_request_bulk(&bulk, &config);
 	if (status < 0) {
 		gpiod_chip_close(chip);
 		return -1;
 	}
 
 	for (;;) {
-		status = gpiod_line_event_wait(line, timeout);
+		memset(&event, 0, sizeof(event));
+		offset = 0;
+
+		status = gpiod_line_event_wait_bulk(&bulk, timeout, &line);
 		if (status < 0) {
+			/* Give the callback a chance to stop on signals. */
 			if (gpiod_errno() == EINTR)
-				return evtype = GPIOD_EVENT_CB_TIMEOUT;
+				evtype = GPIOD_EVENT_CB_TIMEOUT;
 			else
 				goto out;
 		} else if (status == 0) {
@@ -308,23 +363,56 @@ int gpiod_simple_event_loop(const char *consumer, const char *device,
 			if (status < 0)
 				goto out;
 
+			offset = gpiod_line_offset(line);
 			evtype = event.event_type == GPIOD_EVENT_RISING_EDGE
 						? GPIOD_EVENT_CB_RISING_EDGE
 						: GPIOD_EVENT_CB_FALLING_EDGE;
 		}
 
-		status = callback(evtype, &event.ts, cbdata);
-		if (status == GPIOD_EVENT_CB_STOP)
+		status = callback(evtype, offset, &event.ts, cbdata);
+		if (status == GPIOD_EVENT_CB_STOP) {
+			status = 0;
 			goto out;
+		}
 	}
 
 out:
-	gpiod_line_event_release(line);
+	gpiod_line_event_release_bulk(&bulk);
 	gpiod_chip_close(chip);
 
 	return status;
 }
 
+struct simple_event_data {
+	gpiod_event_cb callback;
+	void *cbdata;
+};
+
+static int simple_event_callback(int evtype, unsigned int offset UNUSED,
+				 const struct timespec *ts, void *data)
+{
+	struct simple_event_data *evdata = data;
+
+	return evdata->callback(evtype, ts, evdata->cbdata);
+}
+
+int gpiod_simple_event_loop(const char *consumer, const char *device,
+			    unsigned int offset, bool active_low,
+			    const struct timespec *timeout,
+			    gpiod_event_cb callback, void *cbdata)
+{
+	struct simple_event_data evdata = {
+		.callback = callback,
+		.cbdata = cbdata,
+	};
+
+	return gpiod_simple_event_loop_multiple(consumer, device, &offset, 1,
+						active_low,
+						GPIOD_EVENT_BOTH_EDGES,
+						timeout, simple_event_callback,
+						&evdata);
+}
+
 static void line_set_offset(struct gpiod_line *line, unsigned int offset)
 {
 	line->info.line_offset = offset;
@@ -370,11 +458,110 @@ static void line_remove_handle(struct gpiod_line *line)
 	line->handle = NULL;
 	handle->refcount--;
 	if (handle->refcount <= 0) {
+		PROBE(line__release, line->chip->cinfo.name,
+		      handle->request.lines, handle->request.lineoffsets);
+		if (recorder_enabled())
+			recorder_add(GPIOD_RECORD_RELEASE, line->chip,
+				     handle->request.lineoffsets[0],
+				     handle->request.lines, 0, 0);
+
 		close(handle->request.fd);
+		stats_free(handle->stats);
 		free(handle);
 	}
 }
 
+void line_handle_get_bulk(struct gpiod_line *line,
+			  struct gpiod_line_bulk *bulk)
+{
+	struct gpiohandle_request *req = &line->handle->request;
+	struct gpiod_chip *chip = gpiod_line_get_chip(line);
+	unsigned int i;
+
+	gpiod_line_bulk_init(bulk);
+
+	for (i = 0; i < req->lines; i++)
+		gpiod_line_bulk_add(bulk, &chip->lines[req->lineoffsets[i]]);
+}
+
+unsigned int line_handle_index(struct gpiod_line *line)
+{
+	struct gpiohandle_request *req = &line->handle->request;
+	unsigned int i, offset = gpiod_line_offset(line);
+
+	for (i = 0; i < req->lines; i++) {
+		if (req->lineoffsets[i] == offset)
+			break;
+	}
+
+	return i;
+}
+
+void handle_load_shadow(struct handle_data *handle,
+			struct gpiohandle_data *data)
+{
+	unsigned int i;
+
+	memset(data, 0, sizeof(*data));
+
+	for (i = 0; i < handle->request.lines; i++)
+		data->values[i] = (handle->shadow >> i) & 1;
+}
+
+void handle_store_shadow(struct handle_data *handle,
+			 const struct gpiohandle_data *data)
+{
+	unsigned int i;
+
+	handle->shadow = 0;
+
+	for (i = 0; i < handle->request.lines; i++) {
+		if (data->values[i])
+			handle->shadow |= 1ULL << i;
+	}
+
+	handle->shadow_valid = true;
+}
+
+/*
+ * The kernel drives output lines to their default values when they're
+ * requested, which gives us the initial state of the shadow.
+ */
+static void handle_init_shadow(struct handle_data *handle)
+{
+	struct gpiohandle_data data;
+
+	if (!(handle->request.flags & GPIOHANDLE_REQUEST_OUTPUT))
+		return;
+
+	memcpy(data.values, handle->request.default_values,
+	       sizeof(data.values));
+	handle_store_shadow(handle, &data);
+}
+
+/* Offsets of all lines of the request given line belongs to. */
+static inline const uint32_t * line_request_offsets(struct gpiod_line *line)
+{
+	if (line->poller)
+		return line->poller->request.lineoffsets;
+	if (line_get_state(line) == LINE_TAKEN)
+		return line->handle->request.lineoffsets;
+
+	return &line->info.line_offset;
+}
+
+struct stats_block * line_request_stats(struct gpiod_line *line)
+{
+	switch (line_get_state(line)) {
+	case LINE_TAKEN:
+		return line->handle->stats;
+	case LINE_EVENT:
+		return line->poller ? line->poller->stats : line->stats;
+	default:
+		return NULL;
+	}
+}
+
 unsigned int gpiod_line_offset(struct gpiod_line *line)
 {
 	return (unsigned int)line->info.line_offset;
@@ -437,7 +624,7 @@ static void line_maybe_update(struct gpiod_line *line)
 		line_set_needs_update(line);
 }
 
-static bool line_bulk_is_reserved(struct gpiod_line_bulk *bulk)
+bool line_bulk_is_reserved(struct gpiod_line_bulk *bulk)
 {
 	unsigned int i;
 
@@ -449,7 +636,7 @@ static bool line_bulk_is_reserved(struct gpiod_line_bulk *bulk)
 	return true;
 }
 
-static bool line_bulk_is_event_configured(struct gpiod_line_bulk *bulk)
+bool line_bulk_is_event_configured(struct gpiod_line_bulk *bulk)
 {
 	unsigned int i;
 
@@ -478,7 +665,8 @@ int gpiod_line_update(struct gpiod_line *line)
 	chip = gpiod_line_get_chip(line);
 	fd = chip->fd;
 
-	status = gpio_ioctl(fd, GPIO_GET_LINEINFO_IOCTL, &line->info);
+	status = gpio_ioctl(chip, NULL, fd,
+			    GPIO_GET_LINEINFO_IOCTL, &line->info);
 	if (status < 0)
 		return -1;
 
@@ -597,9 +785,30 @@ int gpiod_line_request_bulk(struct gpiod_line_bulk *bulk,
 	chip = gpiod_line_get_chip(bulk->lines[0]);
 	fd = chip->fd;
 
-	status = gpio_ioctl(fd, GPIO_GET_LINEHANDLE_IOCTL, req);
-	if (status < 0)
+	if (chip->stats) {
+		handle->stats = stats_new();
+		if (!handle->stats) {
+			free(handle);
+			return -1;
+		}
+	}
+
+	status = gpio_ioctl(chip, handle->stats, fd,
+			    GPIO_GET_LINEHANDLE_IOCTL, req);
+	PROBE(line__request, chip->cinfo.name, req->lines, req->lineoffsets,
+	      req->flags, status);
+	if (recorder_enabled())
+		recorder_add_bulk(GPIOD_RECORD_REQUEST, bulk,
+				  config->direction == GPIOD_DIRECTION_OUTPUT
+						? default_vals : NULL,
+				  status);
+	if (status < 0) {
+		stats_free(handle->stats);
+		free(handle);
 		return -1;
+	}
+
+	handle_init_shadow(handle);
 
 	for (i = 0; i < bulk->num_lines; i++) {
 		line = bulk->lines[i];
@@ -639,6 +848,42 @@ int gpiod_line_request_bulk_output(struct gpiod_line_bulk *bulk,
 	return gpiod_line_request_bulk(bulk, &config, default_vals);
 }
 
+int line_adopt_handle(struct gpiod_line_bulk *bulk,
+		      const struct gpiohandle_request *req)
+{
+	struct handle_data *handle;
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	unsigned int i;
+
+	handle = zalloc(sizeof(*handle));
+	if (!handle)
+		return -1;
+
+	handle->request = *req;
+	/* The default values are the ones at the time of the handover. */
+	handle_init_shadow(handle);
+
+	chip = gpiod_line_get_chip(bulk->lines[0]);
+	if (chip->stats) {
+		handle->stats = stats_new();
+		if (!handle->stats) {
+			free(handle);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		line = bulk->lines[i];
+
+		line_set_handle(line, handle);
+		line_set_state(line, LINE_TAKEN);
+		line_maybe_update(line);
+	}
+
+	return 0;
+}
+
 void gpiod_line_release(struct gpiod_line *line)
 {
 	struct gpiod_line_bulk bulk;
@@ -688,10 +933,120 @@ int gpiod_line_get_value(struct gpiod_line *line)
 	return value;
 }
 
-int gpiod_line_get_value_bulk(struct gpiod_line_bulk *bulk, int *values)
+/* Read the value of an event line from its own file descriptor. */
+static int line_event_get_value(struct gpiod_line *line)
 {
 	struct gpiohandle_data data;
-	struct gpiod_line *first;
+	int status;
+
+	memset(&data, 0, sizeof(data));
+
+	status = gpio_ioctl(line->chip, line_request_stats(line),
+			    line_get_event_fd(line),
+			    GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data);
+	if (status < 0)
+		return -1;
+
+	/* Polled lines share a line handle. */
+	return data.values[line->poller ? line->poll_index : 0];
+}
+
+static int line_event_sync_value(struct gpiod_line *line)
+{
+	int value;
+
+	value = line_event_get_value(line);
+	if (value < 0)
+		return -1;
+
+	__atomic_store_n(&line->cached_value, value, __ATOMIC_RELAXED);
+
+	return value;
+}
+
+/*
+ * Lines requested for events separately - every line requested for
+ * interrupts has its own file descriptor - must be read one by one.
+ */
+static bool line_bulk_is_split_event(struct gpiod_line_bulk *bulk)
+{
+	int fd = line_get_event_fd(bulk->lines[0]);
+	unsigned int i;
+
+	if (gpiod_line_is_reserved(bulk->lines[0]))
+		return false;
+
+	for (i = 1; i < bulk->num_lines; i++) {
+		if (line_get_event_fd(bulk->lines[i]) != fd)
+			return true;
+	}
+
+	return false;
+}
+
+static int line_event_get_value_bulk(struct gpiod_line_bulk *bulk,
+				     int *values,
+				     struct gpiohandle_data *data)
+{
+	unsigned int i;
+	int value;
+
+	memset(data, 0, sizeof(*data));
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		value = line_event_get_value(bulk->lines[i]);
+		if (value < 0)
+			return -1;
+
+		values[i] = data->values[i] = value;
+	}
+
+	return 0;
+}
+
+static bool line_bulk_is_value_cached(struct gpiod_line_bulk *bulk)
+{
+	unsigned int i;
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		if (line_get_state(bulk->lines[i]) != LINE_EVENT ||
+		    !bulk->lines[i]->cache_value)
+			return false;
+	}
+
+	return true;
+}
+
+static int line_get_cached_value_bulk(struct gpiod_line_bulk *bulk,
+				      int *values,
+				      struct gpiohandle_data *data)
+{
+	struct gpiod_line *line;
+	unsigned int i;
+	int value;
+
+	memset(data, 0, sizeof(*data));
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		line = bulk->lines[i];
+
+		value = __atomic_load_n(&line->cached_value, __ATOMIC_RELAXED);
+		if (value < 0) {
+			value = line_event_sync_value(line);
+			if (value < 0)
+				return -1;
+		}
+
+		values[i] = data->values[i] = value;
+	}
+
+	return 0;
+}
+
+static int line_get_value_bulk(struct gpiod_line_bulk *bulk, int *values,
+			       struct gpiohandle_data *data)
+{
+	struct gpiod_line *first, *line;
 	unsigned int i;
 	int status, fd;
 
@@ -703,23 +1058,52 @@ int gpiod_line_get_value_bulk(struct gpiod_line_bulk *bulk, int *values)
 		return -1;
 	}
 
-	memset(&data, 0, sizeof(data));
+	if (line_bulk_is_value_cached(bulk))
+		return line_get_cached_value_bulk(bulk, values, data);
+
+	if (line_bulk_is_split_event(bulk))
+		return line_event_get_value_bulk(bulk, values, data);
+
+	memset(data, 0, sizeof(*data));
 
 	if (gpiod_line_is_reserved(first))
 		fd = line_get_handle_fd(first);
 	else
 		fd = line_get_event_fd(first);
 
-	status = gpio_ioctl(fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data);
+	status = gpio_ioctl(first->chip, line_request_stats(first), fd,
+			    GPIOHANDLE_GET_LINE_VALUES_IOCTL, data);
 	if (status < 0)
 		return -1;
 
-	for (i = 0; i < bulk->num_lines; i++)
-		values[i] = data.values[i];
+	/* Polled lines hold their place in the handle of the poller. */
+	for (i = 0; i < bulk->num_lines; i++) {
+		line = bulk->lines[i];
+		values[i] = data->values[line->poller ? line->poll_index : i];
+	}
 
 	return 0;
 }
 
+int gpiod_line_get_value_bulk(struct gpiod_line_bulk *bulk, int *values)
+{
+	struct gpiod_line *first = bulk->lines[0];
+	struct gpiohandle_data data;
+	int status;
+
+	PROBE(get_values__entry, first->chip->cinfo.name, bulk->num_lines);
+
+	status = line_get_value_bulk(bulk, values, &data);
+
+	PROBE(get_values__return, first->chip->cinfo.name, bulk->num_lines,
+	      line_request_offsets(first), data.values, status);
+	if (recorder_enabled())
+		recorder_add_bulk(GPIOD_RECORD_GET_VALUES, bulk,
+				  status < 0 ? NULL : values, status);
+
+	return status;
+}
+
 int gpiod_line_set_value(struct gpiod_line *line, int value)
 {
 	struct gpiod_line_bulk bulk;
@@ -730,10 +1114,9 @@ int gpiod_line_set_value(struct gpiod_line *line, int value)
 	return gpiod_line_set_value_bulk(&bulk, &value);
 }
 
-int gpiod_line_set_value_bulk(struct gpiod_line_bulk *bulk, int *values)
+static int line_set_value_bulk(struct gpiod_line_bulk *bulk,
+			       struct gpiohandle_data *data)
 {
-	struct gpiohandle_data data;
-	unsigned int i;
 	int status;
 
 	if (!line_bulk_is_reserved(bulk)) {
@@ -741,20 +1124,127 @@ int gpiod_line_set_value_bulk(struct gpiod_line_bulk *bulk, int *values)
 		return -1;
 	}
 
-	memset(&data, 0, sizeof(data));
-
-	for (i = 0; i < bulk->num_lines; i++)
-		data.values[i] = (uint8_t)!!values[i];
-
-	status = gpio_ioctl(line_get_handle_fd(bulk->lines[0]),
-			    GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+	status = gpio_ioctl(bulk->lines[0]->chip,
+			    line_request_stats(bulk->lines[0]),
+			    line_get_handle_fd(bulk->lines[0]),
+			    GPIOHANDLE_SET_LINE_VALUES_IOCTL, data);
 	if (status < 0)
 		return -1;
 
 	return 0;
 }
 
-struct gpiod_line * gpiod_line_find_by_name(const char *name)
+int gpiod_line_set_value_bulk(struct gpiod_line_bulk *bulk, int *values)
+{
+	struct gpiod_line *first = bulk->lines[0];
+	struct gpiohandle_data data;
+	unsigned int i;
+	int status;
+
+	memset(&data, 0, sizeof(data));
+
+	for (i = 0; i < bulk->num_lines; i++)
+		data.values[i] = (uint8_t)!!values[i];
+
+	PROBE(set_values__entry, first->chip->cinfo.name, bulk->num_lines,
+	      line_request_offsets(first), data.values);
+
+	status = line_set_value_bulk(bulk, &data);
+	if (status == 0)
+		handle_store_shadow(first->handle, &data);
+
+	PROBE(set_values__return, first->chip->cinfo.name, status);
+	if (recorder_enabled())
+		recorder_add_bulk(GPIOD_RECORD_SET_VALUES, bulk, values, status);
+
+	return status;
+}
+
+int gpiod_line_set_value_mask(struct gpiod_line *line,
+			      unsigned long long mask,
+			      unsigned long long values)
+{
+	int vals[GPIOD_REQUEST_MAX_LINES];
+	struct handle_data *handle;
+	struct gpiod_line_bulk bulk;
+	unsigned int i;
+	uint64_t new;
+
+	if (!gpiod_line_is_reserved(line)) {
+		set_last_error(GPIOD_EREQUEST);
+		return -1;
+	}
+
+	handle = line->handle;
+	if (handle->request.lines < 64)
+		mask &= (1ULL << handle->request.lines) - 1;
+
+	new = (handle->shadow & ~mask) | (values & mask);
+	if (handle->shadow_valid && new == handle->shadow)
+		return 0;
+
+	line_handle_get_bulk(line, &bulk);
+	for (i = 0; i < bulk.num_lines; i++)
+		vals[i] = (new >> i) & 1;
+
+	return gpiod_line_set_value_bulk(&bulk, vals);
+}
+
+int gpiod_line_update_value(struct gpiod_line *line, int value)
+{
+	struct gpiod_line_bulk bulk;
+
+	gpiod_line_bulk_init(&bulk);
+	gpiod_line_bulk_add(&bulk, line);
+
+	return gpiod_line_update_value_bulk(&bulk, &value);
+}
+
+int gpiod_line_update_value_bulk(struct gpiod_line_bulk *bulk,
+				 const int *values)
+{
+	struct gpiod_line *first = bulk->lines[0];
+	unsigned long long mask = 0, vals = 0;
+	unsigned int i, index;
+
+	if (!line_bulk_is_reserved(bulk)) {
+		set_last_error(GPIOD_EREQUEST);
+		return -1;
+	}
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		if (bulk->lines[i]->handle != first->handle) {
+			set_last_error(EINVAL);
+			return -1;
+		}
+
+		index = line_handle_index(bulk->lines[i]);
+		mask |= 1ULL << index;
+		if (values[i])
+			vals |= 1ULL << index;
+	}
+
+	return gpiod_line_set_value_mask(first, mask, vals);
+}
+
+int gpiod_line_get_shadow(struct gpiod_line *line, unsigned long long *values)
+{
+	if (!gpiod_line_is_reserved(line)) {
+		set_last_error(GPIOD_EREQUEST);
+		return -1;
+	}
+
+	if (!line->handle->shadow_valid) {
+		set_last_error(EPERM);
+		return -1;
+	}
+
+	*values = line->handle->shadow;
+
+	return 0;
+}
+
+struct gpiod_line * gpiod_line_find_by_name(const char *name)
 {
 	struct gpiod_chip_iter *chip_iter;
 	struct gpiod_line_iter line_iter;
@@ -791,8 +1281,8 @@ struct gpiod_line * gpiod_line_find_by_name(const char *name)
 	return NULL;
 }
 
-int gpiod_line_event_request(struct gpiod_line *line,
-			     struct gpiod_line_evreq_config *config)
+static int line_event_request_irq(struct gpiod_line *line,
+				  struct gpiod_line_evreq_config *config)
 {
 	struct gpioevent_request *req;
 	struct gpiod_chip *chip;
@@ -829,15 +1319,400 @@ int gpiod_line_event_request(struct gpiod_line *line,
 	chip = gpiod_line_get_chip(line);
 	fd = chip->fd;
 
-	status = gpio_ioctl(fd, GPIO_GET_LINEEVENT_IOCTL, req);
+	line->stats = NULL;
+	if (chip->stats) {
+		line->stats = stats_new();
+		if (!line->stats)
+			return -1;
+	}
+
+	status = gpio_ioctl(chip, line->stats, fd,
+			    GPIO_GET_LINEEVENT_IOCTL, req);
+	PROBE(event__request, chip->cinfo.name, 1, &line->info.line_offset,
+	      req->handleflags, status);
+	if (status < 0) {
+		stats_free(line->stats);
+		line->stats = NULL;
+		return -1;
+	}
+
+	line->poller = NULL;
+	line_set_state(line, LINE_EVENT);
+
+	return 0;
+}
+
+static void event_queue_push(struct event_queue *queue,
+			     int event_type, const struct timespec *ts)
+{
+	struct gpiod_line_event *event;
+
+	/* Same as the kernel FIFO: drop new events if the queue is full. */
+	if (queue->head - queue->tail >= EVENT_QUEUE_SIZE) {
+		queue->overrun = true;
+		return;
+	}
+
+	event = &queue->events[queue->head++ % EVENT_QUEUE_SIZE];
+	event->event_type = event_type;
+	event->ts = *ts;
+}
+
+static bool event_queue_empty(struct event_queue *queue)
+{
+	return queue->head == queue->tail;
+}
+
+static bool poller_event_wanted(struct line_poller *poller, int event_type)
+{
+	return poller->event_type == GPIOD_EVENT_BOTH_EDGES ||
+	       poller->event_type == event_type;
+}
+
+/*
+ * Read the values of all lines of the poller with a single ioctl() and
+ * generate events for the lines whose value changed since the last sample.
+ */
+static int poller_sample(struct line_poller *poller)
+{
+	struct timespec before, after, ts;
+	struct gpiohandle_data data;
+	uint64_t values = 0, changed;
+	unsigned int i;
+	int status, event_type;
+
+	memset(&data, 0, sizeof(data));
+
+	clock_gettime(CLOCK_REALTIME, &before);
+	status = gpio_ioctl(poller->chip, poller->stats, poller->request.fd,
+			    GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data);
+	if (status < 0)
+		return -1;
+	clock_gettime(CLOCK_REALTIME, &after);
+
+	/*
+	 * Kernel event timestamps come from the realtime clock - use the
+	 * same one and stamp the sample in the middle of the ioctl().
+	 */
+	nsec_to_timespec(timespec_to_nsec(&before) +
+			 (timespec_to_nsec(&after) -
+			  timespec_to_nsec(&before)) / 2, &ts);
+
+	for (i = 0; i < poller->request.lines; i++) {
+		if (data.values[i])
+			values |= 1ULL << i;
+	}
+
+	changed = poller->primed ? values ^ poller->last_values : 0;
+	poller->last_values = values;
+	poller->primed = true;
+
+	/*
+	 * Sample at the highest rate while the lines are active and back off
+	 * exponentially when nothing happens.
+	 */
+	if (changed) {
+		poller->period_ns = poller->min_ns;
+	} else if (poller->period_ns < poller->max_ns) {
+		poller->period_ns *= 2;
+		if (poller->period_ns > poller->max_ns)
+			poller->period_ns = poller->max_ns;
+	}
+
+	poller->next_ns = monotonic_nsec() + poller->period_ns;
+
+	for (i = 0; changed; i++, changed >>= 1) {
+		if (!(changed & 1))
+			continue;
+
+		event_type = values & (1ULL << i) ? GPIOD_EVENT_RISING_EDGE
+						  : GPIOD_EVENT_FALLING_EDGE;
+		if (poller_event_wanted(poller, event_type))
+			event_queue_push(&poller->queues[i], event_type, &ts);
+	}
+
+	return 0;
+}
+
+static void line_remove_poller(struct gpiod_line *line)
+{
+	struct line_poller *poller = line->poller;
+
+	line->poller = NULL;
+	poller->refcount--;
+	if (poller->refcount <= 0) {
+		close(poller->request.fd);
+		stats_free(poller->stats);
+		free(poller);
+	}
+}
+
+/*
+ * Attach a poller holding a line handle to all lines of the bulk. The bulk
+ * must contain the lines in the order of the handle request.
+ */
+static int poller_attach(struct line_poller *poller,
+			 struct gpiod_line_bulk *bulk)
+{
+	struct gpiod_line *line;
+	unsigned int i;
+	int status;
+
+	poller->period_ns = poller->min_ns;
+
+	/* The first sample only establishes the initial state. */
+	status = poller_sample(poller);
 	if (status < 0)
 		return -1;
 
+	for (i = 0; i < bulk->num_lines; i++) {
+		line = bulk->lines[i];
+
+		memset(&line->event, 0, sizeof(line->event));
+		/* Allows to read the line values just like for IRQ events. */
+		line->event.fd = poller->request.fd;
+		line->poller = poller;
+		line->poll_index = i;
+		poller->refcount++;
+
+		line_set_state(line, LINE_EVENT);
+		line_maybe_update(line);
+	}
+
+	return 0;
+}
+
+static int line_event_request_polled(struct gpiod_line_bulk *bulk,
+				     struct gpiod_line_evreq_config *config)
+{
+	struct gpiohandle_request *req;
+	struct line_poller *poller;
+	struct gpiod_chip *chip;
+	unsigned int i;
+	int status;
+
+	poller = zalloc(sizeof(*poller));
+	if (!poller)
+		return -1;
+
+	req = &poller->request;
+
+	req->flags |= GPIOHANDLE_REQUEST_INPUT;
+	if (config->line_flags & GPIOD_REQUEST_OPEN_DRAIN)
+		req->flags |= GPIOHANDLE_REQUEST_OPEN_DRAIN;
+	if (config->line_flags & GPIOD_REQUEST_OPEN_SOURCE)
+		req->flags |= GPIOHANDLE_REQUEST_OPEN_SOURCE;
+	if (config->active_state == GPIOD_ACTIVE_STATE_LOW)
+		req->flags |= GPIOHANDLE_REQUEST_ACTIVE_LOW;
+
+	req->lines = bulk->num_lines;
+	for (i = 0; i < bulk->num_lines; i++)
+		req->lineoffsets[i] = gpiod_line_offset(bulk->lines[i]);
+
+	strncpy(req->consumer_label, config->consumer,
+		sizeof(req->consumer_label) - 1);
+
+	chip = gpiod_line_get_chip(bulk->lines[0]);
+	poller->chip = chip;
+
+	if (chip->stats) {
+		poller->stats = stats_new();
+		if (!poller->stats) {
+			free(poller);
+			return -1;
+		}
+	}
+
+	status = gpio_ioctl(chip, poller->stats, chip->fd,
+			    GPIO_GET_LINEHANDLE_IOCTL, req);
+	PROBE(event__request, chip->cinfo.name, req->lines, req->lineoffsets,
+	      req->flags, status);
+	if (status < 0) {
+		stats_free(poller->stats);
+		free(poller);
+		return -1;
+	}
+
+	poller->event_type = config->event_type;
+	poller->min_ns = POLLER_DEFAULT_MIN_NS;
+	poller->max_ns = POLLER_DEFAULT_MAX_NS;
+
+	status = poller_attach(poller, bulk);
+	if (status < 0) {
+		close(req->fd);
+		stats_free(poller->stats);
+		free(poller);
+		return -1;
+	}
+
+	return 0;
+}
+
+int line_adopt_poller(struct gpiod_line_bulk *bulk,
+		      const struct gpiohandle_request *req, int event_type,
+		      uint64_t min_ns, uint64_t max_ns)
+{
+	struct line_poller *poller;
+	struct gpiod_chip *chip;
+	int status;
+
+	poller = zalloc(sizeof(*poller));
+	if (!poller)
+		return -1;
+
+	chip = gpiod_line_get_chip(bulk->lines[0]);
+	poller->chip = chip;
+	poller->request = *req;
+	poller->event_type = event_type;
+	poller->min_ns = min_ns;
+	poller->max_ns = max_ns;
+
+	if (chip->stats) {
+		poller->stats = stats_new();
+		if (!poller->stats) {
+			free(poller);
+			return -1;
+		}
+	}
+
+	status = poller_attach(poller, bulk);
+	if (status < 0) {
+		stats_free(poller->stats);
+		free(poller);
+		return -1;
+	}
+
+	return 0;
+}
+
+const struct gpiohandle_request *
+line_poller_request(struct gpiod_line *line, int *event_type,
+		    uint64_t *min_ns, uint64_t *max_ns)
+{
+	struct line_poller *poller = line->poller;
+
+	if (!poller)
+		return NULL;
+
+	*event_type = poller->event_type;
+	*min_ns = poller->min_ns;
+	*max_ns = poller->max_ns;
+
+	return &poller->request;
+}
+
+int line_adopt_event(struct gpiod_line *line,
+		     const struct gpioevent_request *req)
+{
+	struct gpiod_chip *chip = gpiod_line_get_chip(line);
+
+	line->stats = NULL;
+	if (chip->stats) {
+		line->stats = stats_new();
+		if (!line->stats)
+			return -1;
+	}
+
+	line->event = *req;
+	line->poller = NULL;
 	line_set_state(line, LINE_EVENT);
+	line_maybe_update(line);
 
 	return 0;
 }
 
+static int line_event_request_bulk(struct gpiod_line_bulk *bulk,
+				   struct gpiod_line_evreq_config *config)
+{
+	unsigned int i, j;
+	int status, error;
+
+	if (!verify_line_bulk(bulk))
+		return -1;
+
+	if (config->line_flags & GPIOD_REQUEST_POLLED)
+		return line_event_request_polled(bulk, config);
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		status = line_event_request_irq(bulk->lines[i], config);
+		if (status < 0)
+			break;
+	}
+
+	if (i == bulk->num_lines)
+		return 0;
+
+	error = gpiod_errno();
+
+	for (j = 0; j < i; j++)
+		gpiod_line_event_release(bulk->lines[j]);
+
+	/* The kernel returns ENODEV if the line can't be mapped to an IRQ. */
+	if ((config->line_flags & GPIOD_REQUEST_POLLED_FALLBACK) &&
+	    error == ENODEV)
+		return line_event_request_polled(bulk, config);
+
+	set_last_error(error);
+	return -1;
+}
+
+int line_cache_enable(struct gpiod_line *line)
+{
+	if (!line->poller) {
+		line->queue = zalloc(sizeof(*line->queue));
+		if (!line->queue)
+			return -1;
+	}
+
+	line->cached_value = -1;
+	line->cache_value = true;
+
+	return 0;
+}
+
+int gpiod_line_event_request_bulk(struct gpiod_line_bulk *bulk,
+				  struct gpiod_line_evreq_config *config)
+{
+	bool cache = config->line_flags & GPIOD_REQUEST_CACHE_VALUE;
+	unsigned int i;
+	int status;
+
+	/* The level can only be tracked if events come for both edges. */
+	if (cache && config->event_type != GPIOD_EVENT_BOTH_EDGES) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	status = line_event_request_bulk(bulk, config);
+	if (recorder_enabled())
+		recorder_add_bulk(GPIOD_RECORD_EVENT_REQUEST, bulk,
+				  NULL, status);
+
+	if (status < 0 || !cache)
+		return status;
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		if (line_cache_enable(bulk->lines[i]) < 0) {
+			gpiod_line_event_release_bulk(bulk);
+			set_last_error(ENOMEM);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int gpiod_line_event_request(struct gpiod_line *line,
+			     struct gpiod_line_evreq_config *config)
+{
+	struct gpiod_line_bulk bulk;
+
+	gpiod_line_bulk_init(&bulk);
+	gpiod_line_bulk_add(&bulk, line);
+
+	return gpiod_line_event_request_bulk(&bulk, config);
+}
+
 static int line_event_request_type(struct gpiod_line *line,
 				   const char *consumer,
 				   bool active_low, int type)
@@ -875,10 +1750,86 @@ int gpiod_line_event_request_all(struct gpiod_line *line,
 
 void gpiod_line_event_release(struct gpiod_line *line)
 {
-	close(line_get_event_fd(line));
+	PROBE(event__release, line->chip->cinfo.name, 1,
+	      &line->info.line_offset);
+	if (recorder_enabled())
+		recorder_add(GPIOD_RECORD_EVENT_RELEASE, line->chip,
+			     gpiod_line_offset(line), 1, 0, 0);
+
+	if (line->poller) {
+		line_remove_poller(line);
+	} else {
+		close(line_get_event_fd(line));
+		stats_free(line->stats);
+		line->stats = NULL;
+	}
+
+	free(line->queue);
+	line->queue = NULL;
+	line->cache_value = false;
 	line_set_state(line, LINE_FREE);
 }
 
+void gpiod_line_event_release_bulk(struct gpiod_line_bulk *bulk)
+{
+	unsigned int i;
+
+	for (i = 0; i < bulk->num_lines; i++)
+		gpiod_line_event_release(bulk->lines[i]);
+}
+
+bool line_event_is_both_edges(struct gpiod_line *line)
+{
+	if (line->poller)
+		return line->poller->event_type == GPIOD_EVENT_BOTH_EDGES;
+
+	return (line->event.eventflags & GPIOEVENT_REQUEST_BOTH_EDGES) ==
+	       GPIOEVENT_REQUEST_BOTH_EDGES;
+}
+
+bool gpiod_line_event_is_polled(struct gpiod_line *line)
+{
+	return gpiod_line_event_configured(line) && line->poller;
+}
+
+int gpiod_line_event_sync_value(struct gpiod_line *line)
+{
+	if (!gpiod_line_event_configured(line)) {
+		set_last_error(GPIOD_EEVREQUEST);
+		return -1;
+	}
+
+	return line_event_sync_value(line);
+}
+
+int gpiod_line_event_set_poll_period(struct gpiod_line *line,
+				     const struct timespec *min,
+				     const struct timespec *max)
+{
+	struct line_poller *poller;
+	uint64_t min_ns, max_ns;
+
+	if (!gpiod_line_event_is_polled(line)) {
+		set_last_error(GPIOD_EEVREQUEST);
+		return -1;
+	}
+
+	min_ns = timespec_to_nsec(min);
+	max_ns = timespec_to_nsec(max);
+	if (!min_ns || max_ns < min_ns) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	poller = line->poller;
+	poller->min_ns = min_ns;
+	poller->max_ns = max_ns;
+	poller->period_ns = min_ns;
+	poller->next_ns = monotonic_nsec() + min_ns;
+
+	return 0;
+}
+
 bool gpiod_line_event_configured(struct gpiod_line *line)
 {
 	return line_get_state(line) == LINE_EVENT;
@@ -895,20 +1846,149 @@ int gpiod_line_event_wait(struct gpiod_line *line,
 	return gpiod_line_event_wait_bulk(&bulk, timeout, NULL);
 }
 
-int gpiod_line_event_wait_bulk(struct gpiod_line_bulk *bulk,
-			       const struct timespec *timeout,
-			       struct gpiod_line **line)
+static bool line_bulk_has_polled(struct gpiod_line_bulk *bulk)
 {
+	unsigned int i;
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		if (bulk->lines[i]->poller)
+			return true;
+	}
+
+	return false;
+}
+
+static struct event_queue * line_poller_queue(struct gpiod_line *line)
+{
+	return &line->poller->queues[line->poll_index];
+}
+
+/*
+ * Wait for events on a set of lines some of which are polled: sleep in
+ * ppoll() on the event file descriptors of the remaining lines until the
+ * next sample is due and check the event queues after each sample.
+ */
+static int line_event_wait_polled(struct gpiod_line_bulk *bulk,
+				  const struct timespec *timeout,
+				  struct gpiod_line_bulk *ready)
+{
+	struct gpiod_chip *chip = bulk->lines[0]->chip;
 	struct pollfd fds[GPIOD_REQUEST_MAX_LINES];
+	uint64_t deadline = 0, now, next;
 	struct gpiod_line *linetmp;
+	struct timespec ts;
 	unsigned int i;
 	int status;
 
+	if (timeout)
+		deadline = monotonic_nsec() + timespec_to_nsec(timeout);
+
+	memset(fds, 0, sizeof(fds));
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		linetmp = bulk->lines[i];
+
+		/* Negative descriptors are ignored by ppoll(). */
+		fds[i].fd = linetmp->poller ? -1 : line_get_event_fd(linetmp);
+		fds[i].events = POLLIN | POLLPRI;
+	}
+
+	for (;;) {
+		now = monotonic_nsec();
+
+		/*
+		 * Take every sample that's due before looking at the queues.
+		 * Lines sharing a poller are sampled only once as sampling
+		 * moves the poller's deadline into the future.
+		 */
+		for (i = 0; i < bulk->num_lines; i++) {
+			linetmp = bulk->lines[i];
+			if (!linetmp->poller || linetmp->poller->next_ns > now)
+				continue;
+
+			status = poller_sample(linetmp->poller);
+			if (status < 0)
+				return -1;
+		}
+
+		next = UINT64_MAX;
+
+		for (i = 0; i < bulk->num_lines; i++) {
+			linetmp = bulk->lines[i];
+			if (!linetmp->poller)
+				continue;
+
+			if (!event_queue_empty(line_poller_queue(linetmp)))
+				gpiod_line_bulk_add(ready, linetmp);
+
+			if (linetmp->poller->next_ns < next)
+				next = linetmp->poller->next_ns;
+		}
+
+		if (ready->num_lines)
+			return 1;
+
+		if (timeout) {
+			if (now >= deadline)
+				return 0;
+
+			if (deadline < next)
+				next = deadline;
+		}
+
+		nsec_to_timespec(next - now, &ts);
+
+		status = ppoll(fds, bulk->num_lines, &ts, NULL);
+		if (chip->stats)
+			stats_add_poll(chip->stats, status == 0);
+		if (status < 0) {
+			last_error_from_errno();
+			return -1;
+		} else if (status > 0) {
+			for (i = 0; i < bulk->num_lines; i++) {
+				if (fds[i].revents)
+					gpiod_line_bulk_add(ready,
+							    bulk->lines[i]);
+			}
+
+			return 1;
+		}
+	}
+}
+
+int line_event_wait_all(struct gpiod_line_bulk *bulk,
+			const struct timespec *timeout,
+			struct gpiod_line_bulk *ready)
+{
+	struct pollfd fds[GPIOD_REQUEST_MAX_LINES];
+	struct timespec zero = { 0, 0 };
+	struct gpiod_line *linetmp;
+	struct gpiod_chip *chip;
+	unsigned int i;
+	int status;
+
+	gpiod_line_bulk_init(ready);
+
 	if (!line_bulk_is_event_configured(bulk)) {
 		set_last_error(GPIOD_EEVREQUEST);
 		return -1;
 	}
 
+	/* Events read ahead don't make the file descriptor readable. */
+	for (i = 0; i < bulk->num_lines; i++) {
+		linetmp = bulk->lines[i];
+
+		if (linetmp->queue && !event_queue_empty(linetmp->queue))
+			gpiod_line_bulk_add(ready, linetmp);
+	}
+
+	if (line_bulk_has_polled(bulk)) {
+		if (ready->num_lines)
+			return 1;
+
+		return line_event_wait_polled(bulk, timeout, ready);
+	}
+
 	memset(fds, 0, sizeof(fds));
 
 	for (i = 0; i < bulk->num_lines; i++) {
@@ -916,66 +1996,311 @@ int gpiod_line_event_wait_bulk(struct gpiod_line_bulk *bulk,
 
 		fds[i].fd = line_get_event_fd(linetmp);
 		fds[i].events = POLLIN | POLLPRI;
+
+		/* Lines with queued events are already reported. */
+		if (linetmp->queue && !event_queue_empty(linetmp->queue))
+			fds[i].fd = -1;
 	}
 
-	status = ppoll(fds, bulk->num_lines, timeout, NULL);
+	/* Only look for other ready lines if there's something queued. */
+	status = ppoll(fds, bulk->num_lines,
+		       ready->num_lines ? &zero : timeout, NULL);
 	if (status < 0) {
 		last_error_from_errno();
 		return -1;
-	} else if (status == 0) {
-		return 0;
 	}
 
-	for (i = 0; !fds[i].revents; i++);
-	if (line)
-		*line = bulk->lines[i];
+	chip = gpiod_line_get_chip(bulk->lines[0]);
+	if (chip->stats)
+		stats_add_poll(chip->stats, status == 0);
+
+	for (i = 0; status > 0 && i < bulk->num_lines; i++) {
+		if (fds[i].revents)
+			gpiod_line_bulk_add(ready, bulk->lines[i]);
+	}
+
+	return ready->num_lines ? 1 : 0;
+}
+
+static int line_event_wait_bulk(struct gpiod_line_bulk *bulk,
+				const struct timespec *timeout,
+				struct gpiod_line **line)
+{
+	struct gpiod_line_bulk ready;
+	int status;
+
+	status = line_event_wait_all(bulk, timeout, &ready);
+	if (status > 0 && line)
+		*line = ready.lines[0];
 
-	return 1;
+	return status;
+}
+
+int gpiod_line_event_wait_bulk(struct gpiod_line_bulk *bulk,
+			       const struct timespec *timeout,
+			       struct gpiod_line **line)
+{
+	struct gpiod_chip *chip = gpiod_line_get_chip(bulk->lines[0]);
+	int status;
+
+	PROBE(event_wait__entry, chip->cinfo.name, bulk->num_lines,
+	      timeout ? (int64_t)timespec_to_nsec(timeout) : -1);
+
+	status = line_event_wait_bulk(bulk, timeout, line);
+
+	PROBE(event_wait__return, chip->cinfo.name, status);
+
+	return status;
+}
+
+/* Block until an event is available just like read() on an event fd. */
+static int line_event_read_polled(struct gpiod_line *line,
+				  struct gpiod_line_event *events,
+				  unsigned int num_events)
+{
+	struct event_queue *queue = line_poller_queue(line);
+	unsigned int i;
+	int status;
+
+	while (event_queue_empty(queue)) {
+		status = gpiod_line_event_wait(line, NULL);
+		if (status < 0)
+			return -1;
+	}
+
+	for (i = 0; i < num_events && !event_queue_empty(queue); i++)
+		events[i] = queue->events[queue->tail++ % EVENT_QUEUE_SIZE];
+
+	return i;
 }
 
 int gpiod_line_event_read(struct gpiod_line *line,
 			  struct gpiod_line_event *event)
 {
-	int fd;
+	int status;
+
+	status = gpiod_line_event_read_multiple(line, event, 1);
+	if (status < 0)
+		return -1;
+
+	return 0;
+}
+
+static int line_event_read_fd_probed(int fd, struct gpiod_line_event *events,
+				     unsigned int num_events);
+
+/* Bit n is set if events[n] is a rising edge. */
+static uint64_t events_rising_mask(struct gpiod_line_event *events,
+				   int num_events)
+{
+	uint64_t mask = 0;
+	int i;
+
+	for (i = 0; i < num_events; i++) {
+		if (events[i].event_type == GPIOD_EVENT_RISING_EDGE)
+			mask |= 1ULL << i;
+	}
+
+	return mask;
+}
+
+static void record_event_read(struct gpiod_chip *chip, unsigned int offset,
+			      struct gpiod_line_event *events, int status)
+{
+	recorder_add(GPIOD_RECORD_EVENT_READ, chip, offset,
+		     status > 0 ? status : 0,
+		     events_rising_mask(events, status),
+		     status < 0 ? gpiod_errno() : 0);
+}
+
+/*
+ * Lines with cached values are read from the kernel a full FIFO at a time,
+ * whatever the number of events the user asks for. A read returning a full
+ * FIFO means that newer events may have been dropped.
+ */
+static int line_event_read_queued(struct gpiod_line *line,
+				  struct gpiod_line_event *events,
+				  unsigned int num_events)
+{
+	struct gpiod_line_event buf[EVENT_QUEUE_SIZE];
+	struct event_queue *queue = line->queue;
+	unsigned int i;
+	int status;
+
+	if (!num_events || num_events > GPIOD_EVENT_READ_MAX) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	if (event_queue_empty(queue)) {
+		status = line_event_read_fd_probed(line_get_event_fd(line),
+						   buf, EVENT_QUEUE_SIZE);
+		if (status < 0)
+			return -1;
+
+		if (line->chip->stats)
+			stats_add_read(line->chip->stats, line->stats, status,
+				       status * sizeof(struct gpioevent_data));
+
+		for (i = 0; i < (unsigned int)status; i++)
+			event_queue_push(queue, buf[i].event_type, &buf[i].ts);
+
+		if (status == EVENT_QUEUE_SIZE)
+			queue->overrun = true;
+	}
+
+	for (i = 0; i < num_events && !event_queue_empty(queue); i++)
+		events[i] = queue->events[queue->tail++ % EVENT_QUEUE_SIZE];
+
+	return i;
+}
+
+/*
+ * With both edges reported, events alternate between rising and falling.
+ * Two events of the same type in a row mean that the events in between
+ * were dropped because the FIFO was full and the level can't be trusted.
+ * Newest events dropped from a full FIFO leave no such trace, so the level
+ * is considered unknown once the events queued before the drop are read.
+ */
+static void line_cache_events(struct gpiod_line *line,
+			      struct gpiod_line_event *events, int num_events)
+{
+	struct event_queue *queue;
+	int i, level, value;
+	bool lost = false;
+
+	queue = line->poller ? line_poller_queue(line) : line->queue;
+	value = __atomic_load_n(&line->cached_value, __ATOMIC_RELAXED);
+
+	for (i = 0; i < num_events; i++) {
+		level = events[i].event_type == GPIOD_EVENT_RISING_EDGE;
+		if (level == value)
+			lost = true;
+
+		value = level;
+	}
+
+	if (queue->overrun && event_queue_empty(queue)) {
+		queue->overrun = false;
+		lost = true;
+	}
+
+	__atomic_store_n(&line->cached_value, lost ? -1 : value,
+			 __ATOMIC_RELAXED);
+}
+
+int gpiod_line_event_read_multiple(struct gpiod_line *line,
+				   struct gpiod_line_event *events,
+				   unsigned int num_events)
+{
+	int status;
 
 	if (!gpiod_line_event_configured(line)) {
 		set_last_error(GPIOD_EEVREQUEST);
 		return -1;
 	}
 
-	fd = line_get_event_fd(line);
+	if (line->poller) {
+		status = line_event_read_polled(line, events, num_events);
+		if (status > 0 && line->chip->stats)
+			stats_add_read(line->chip->stats, line->poller->stats,
+				       status, 0);
+	} else if (line->queue) {
+		status = line_event_read_queued(line, events, num_events);
+	} else {
+		status = line_event_read_fd_probed(line_get_event_fd(line),
+						   events, num_events);
+		if (status > 0 && line->chip->stats)
+			stats_add_read(line->chip->stats, line->stats, status,
+				       status * sizeof(struct gpioevent_data));
+	}
+
+	if (status > 0 && line->cache_value)
+		line_cache_events(line, events, status);
 
-	return gpiod_line_event_read_fd(fd, event);
+	if (recorder_enabled())
+		record_event_read(line->chip, gpiod_line_offset(line),
+				  events, status);
+
+	return status;
 }
 
 int gpiod_line_event_get_fd(struct gpiod_line *line)
 {
-	return line_get_state(line) == LINE_EVENT
+	return line_get_state(line) == LINE_EVENT && !line->poller
 				? line_get_event_fd(line) : -1;
 }
 
 int gpiod_line_event_read_fd(int fd, struct gpiod_line_event *event)
 {
-	struct gpioevent_data evdata;
+	int status;
+
+	status = gpiod_line_event_read_fd_multiple(fd, event, 1);
+	if (status < 0)
+		return -1;
+
+	return 0;
+}
+
+static int line_event_read_fd(int fd, struct gpiod_line_event *events,
+			      unsigned int num_events)
+{
+	struct gpioevent_data evdata[GPIOD_EVENT_READ_MAX];
+	unsigned int i;
 	ssize_t rd;
 
-	memset(&evdata, 0, sizeof(evdata));
+	if (!num_events || num_events > GPIOD_EVENT_READ_MAX) {
+		set_last_error(EINVAL);
+		return -1;
+	}
 
-	rd = read(fd, &evdata, sizeof(evdata));
+	memset(evdata, 0, sizeof(*evdata) * num_events);
+
+	/* The kernel copies as many queued events as fit into the buffer. */
+	rd = read(fd, evdata, sizeof(*evdata) * num_events);
 	if (rd < 0) {
 		last_error_from_errno();
 		return -1;
-	} else if (rd != sizeof(evdata)) {
+	} else if (!rd || rd % sizeof(*evdata)) {
 		set_last_error(EIO);
 		return -1;
 	}
 
-	event->event_type = evdata.id == GPIOEVENT_EVENT_RISING_EDGE
-						? GPIOD_EVENT_RISING_EDGE
-						: GPIOD_EVENT_FALLING_EDGE;
-	nsec_to_timespec(evdata.timestamp, &event->ts);
+	for (i = 0; i < rd / sizeof(*evdata); i++) {
+		events[i].event_type =
+			evdata[i].id == GPIOEVENT_EVENT_RISING_EDGE
+					? GPIOD_EVENT_RISING_EDGE
+					: GPIOD_EVENT_FALLING_EDGE;
+		nsec_to_timespec(evdata[i].timestamp, &events[i].ts);
+	}
 
-	return 0;
+	return i;
+}
+
+static int line_event_read_fd_probed(int fd, struct gpiod_line_event *events,
+				     unsigned int num_events)
+{
+	int status;
+
+	PROBE(event_read__entry, fd, num_events);
+
+	status = line_event_read_fd(fd, events, num_events);
+
+	PROBE(event_read__return, fd, status);
+
+	return status;
+}
+
+int gpiod_line_event_read_fd_multiple(int fd, struct gpiod_line_event *events,
+				      unsigned int num_events)
+{
+	int status;
+
+	status = line_event_read_fd_probed(fd, events, num_events);
+	if (recorder_enabled())
+		record_event_read(NULL, fd, events, status);
+
+	return status;
 }
 
 struct gpiod_chip * gpiod_chip_open(const char *path)
@@ -997,7 +2322,8 @@ struct gpiod_chip * gpiod_chip_open(const char *path)
 
 	chip->fd = fd;
 
-	status = gpio_ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &chip->cinfo);
+	status = gpio_ioctl(chip, NULL, fd, GPIO_GET_CHIPINFO_IOCTL,
+			    &chip->cinfo);
 	if (status < 0) {
 		close(chip->fd);
 		free(chip);
@@ -1011,6 +2337,9 @@ struct gpiod_chip * gpiod_chip_open(const char *path)
 		return NULL;
 	}
 
+	if (sscanf(chip->cinfo.name, "gpiochip%u", &chip->num) != 1)
+		chip->num = GPIOD_RECORD_NO_CHIP;
+
 	return chip;
 }
 
@@ -1108,6 +2437,7 @@ void gpiod_chip_close(struct gpiod_chip *chip)
 	}
 
 	close(chip->fd);
+	stats_free(chip->stats);
 	free(chip->lines);
 	free(chip);
 }
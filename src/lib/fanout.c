@@ -0,0 +1,501 @@
+/*
+ * Event fan-out to multiple processes for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define FANOUT_MAGIC		"GPIODFAN"
+#define FANOUT_VERSION		1
+#define FANOUT_CACHE_LINE	64
+#define FANOUT_CHIP_NAME_MAX	32
+#define FANOUT_DEFAULT_RING_SIZE	4096
+#define FANOUT_MAX_RING_SIZE		(1U << 24)
+/* How often the producer checks if it should stop. */
+#define FANOUT_IDLE_NS		50000000ULL
+
+enum {
+	FANOUT_STOPPED = 0,
+	FANOUT_RUNNING,
+};
+
+/*
+ * Every slot carries the sequence number of the event it holds: odd while
+ * the producer is writing event n to it (2n + 1), even once it's done
+ * (2n + 2). A subscriber expecting event n that finds any other sequence
+ * number knows it was lapped by the producer.
+ */
+struct fanout_slot {
+	uint64_t seq;
+	int64_t sec;
+	int64_t nsec;
+	uint32_t offset;
+	int32_t event_type;
+};
+
+struct fanout_shm {
+	char magic[8];
+	uint32_t version;
+	uint32_t ring_size;
+	uint32_t num_lines;
+	char chip[FANOUT_CHIP_NAME_MAX];
+	uint32_t offsets[GPIOD_REQUEST_MAX_LINES];
+
+	/* Number of events published so far. */
+	uint64_t head __attribute__((aligned(FANOUT_CACHE_LINE)));
+
+	/* Bumped after every batch, subscribers sleep on it. */
+	uint32_t futex __attribute__((aligned(FANOUT_CACHE_LINE)));
+
+	struct fanout_slot slots[]
+			__attribute__((aligned(FANOUT_CACHE_LINE)));
+};
+
+struct gpiod_fanout {
+	struct gpiod_line_bulk bulk;
+	char *name;
+	int fd;
+	size_t size;
+	struct fanout_shm *shm;
+	pthread_t thread;
+	int state;
+	bool stop;
+	int error;
+};
+
+struct gpiod_fanout_sub {
+	int fd;
+	size_t size;
+	const struct fanout_shm *shm;
+	uint64_t cursor;
+	unsigned long long lost;
+};
+
+static size_t fanout_shm_size(unsigned int ring_size)
+{
+	return sizeof(struct fanout_shm) +
+	       ring_size * sizeof(struct fanout_slot);
+}
+
+static long futex(const uint32_t *uaddr, int op, uint32_t val,
+		  const struct timespec *timeout)
+{
+	/* Not FUTEX_PRIVATE_FLAG - the word is shared between processes. */
+	return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+static void fanout_push(struct gpiod_fanout *fanout, uint64_t idx,
+			struct gpiod_line *line,
+			const struct gpiod_line_event *event)
+{
+	struct fanout_shm *shm = fanout->shm;
+	struct fanout_slot *slot;
+
+	slot = &shm->slots[idx & (shm->ring_size - 1)];
+
+	__atomic_store_n(&slot->seq, idx * 2 + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->sec = event->ts.tv_sec;
+	slot->nsec = event->ts.tv_nsec;
+	slot->offset = gpiod_line_offset(line);
+	slot->event_type = event->event_type;
+
+	__atomic_store_n(&slot->seq, idx * 2 + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Make the events visible and wake up the subscribers. Subscribers map the
+ * ring read-only and can't announce that they sleep, so this costs one
+ * system call per batch no matter how many of them there are.
+ */
+static void fanout_publish(struct gpiod_fanout *fanout, uint64_t head)
+{
+	struct fanout_shm *shm = fanout->shm;
+
+	__atomic_store_n(&shm->head, head, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&shm->futex, 1, __ATOMIC_RELEASE);
+
+	futex(&shm->futex, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+static void * fanout_thread(void *data)
+{
+	struct gpiod_line_event events[GPIOD_EVENT_READ_MAX];
+	struct gpiod_fanout *fanout = data;
+	struct gpiod_line_bulk ready;
+	struct timespec idle;
+	unsigned int i;
+	uint64_t head;
+	int num, j;
+
+	nsec_to_timespec(FANOUT_IDLE_NS, &idle);
+	head = fanout->shm->head;
+
+	while (!__atomic_load_n(&fanout->stop, __ATOMIC_ACQUIRE)) {
+		/*
+		 * Every ready line is drained in each round so that a storm
+		 * on one of them can't starve the others.
+		 */
+		num = line_event_wait_all(&fanout->bulk, &idle, &ready);
+
+		for (i = 0; num > 0 && i < ready.num_lines; i++) {
+			/* Drain everything that's queued with a single read. */
+			num = gpiod_line_event_read_multiple(ready.lines[i],
+						events, GPIOD_EVENT_READ_MAX);
+
+			for (j = 0; j < num; j++)
+				fanout_push(fanout, head++,
+					    ready.lines[i], &events[j]);
+		}
+
+		if (num < 0) {
+			__atomic_store_n(&fanout->error, gpiod_errno(),
+					 __ATOMIC_RELEASE);
+			break;
+		}
+
+		if (ready.num_lines)
+			fanout_publish(fanout, head);
+	}
+
+	return NULL;
+}
+
+struct gpiod_fanout *
+gpiod_fanout_new(struct gpiod_line_bulk *bulk,
+		 const struct gpiod_fanout_config *config)
+{
+	struct gpiod_fanout *fanout;
+	unsigned int i, ring_size;
+	struct gpiod_chip *chip;
+	mode_t mode;
+	int status;
+
+	ring_size = config->ring_size ? config->ring_size
+				      : FANOUT_DEFAULT_RING_SIZE;
+	if (!bulk->num_lines || !config->name ||
+	    ring_size > FANOUT_MAX_RING_SIZE) {
+		set_last_error(EINVAL);
+		return NULL;
+	}
+
+	fanout = zalloc(sizeof(*fanout));
+	if (!fanout)
+		return NULL;
+
+	fanout->name = strdup(config->name);
+	if (!fanout->name) {
+		set_last_error(ENOMEM);
+		goto err_free;
+	}
+
+	for (i = 1; i < ring_size; i <<= 1)
+		;
+	ring_size = i;
+	fanout->size = fanout_shm_size(ring_size);
+
+	/* Subscribers of a previous instance keep the old ring. */
+	shm_unlink(config->name);
+
+	mode = config->mode ? config->mode : 0644;
+	fanout->fd = shm_open(config->name,
+			      O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+	if (fanout->fd < 0) {
+		last_error_from_errno();
+		goto err_free_name;
+	}
+
+	status = ftruncate(fanout->fd, fanout->size);
+	if (status < 0) {
+		last_error_from_errno();
+		goto err_unlink;
+	}
+
+	fanout->shm = mmap(NULL, fanout->size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED, fanout->fd, 0);
+	if (fanout->shm == MAP_FAILED) {
+		last_error_from_errno();
+		goto err_unlink;
+	}
+
+	memcpy(&fanout->bulk, bulk, sizeof(*bulk));
+
+	chip = gpiod_line_get_chip(bulk->lines[0]);
+	strncpy(fanout->shm->chip, gpiod_chip_name(chip),
+		sizeof(fanout->shm->chip) - 1);
+	fanout->shm->num_lines = bulk->num_lines;
+	for (i = 0; i < bulk->num_lines; i++)
+		fanout->shm->offsets[i] = gpiod_line_offset(bulk->lines[i]);
+	fanout->shm->ring_size = ring_size;
+	fanout->shm->version = FANOUT_VERSION;
+
+	/* Subscribers check the magic last. */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(fanout->shm->magic, FANOUT_MAGIC, sizeof(fanout->shm->magic));
+
+	return fanout;
+
+err_unlink:
+	shm_unlink(fanout->name);
+	close(fanout->fd);
+err_free_name:
+	free(fanout->name);
+err_free:
+	free(fanout);
+
+	return NULL;
+}
+
+void gpiod_fanout_free(struct gpiod_fanout *fanout)
+{
+	gpiod_fanout_stop(fanout);
+
+	munmap(fanout->shm, fanout->size);
+	shm_unlink(fanout->name);
+	close(fanout->fd);
+	free(fanout->name);
+	free(fanout);
+}
+
+int gpiod_fanout_start(struct gpiod_fanout *fanout)
+{
+	int status;
+
+	if (fanout->state == FANOUT_RUNNING) {
+		set_last_error(EBUSY);
+		return -1;
+	}
+
+	if (!line_bulk_is_event_configured(&fanout->bulk)) {
+		set_last_error(GPIOD_EEVREQUEST);
+		return -1;
+	}
+
+	fanout->stop = false;
+	fanout->error = 0;
+
+	status = pthread_create(&fanout->thread, NULL, fanout_thread, fanout);
+	if (status) {
+		set_last_error(status);
+		return -1;
+	}
+
+	fanout->state = FANOUT_RUNNING;
+
+	return 0;
+}
+
+void gpiod_fanout_stop(struct gpiod_fanout *fanout)
+{
+	if (fanout->state != FANOUT_RUNNING)
+		return;
+
+	__atomic_store_n(&fanout->stop, true, __ATOMIC_RELEASE);
+	pthread_join(fanout->thread, NULL);
+
+	fanout->state = FANOUT_STOPPED;
+}
+
+int gpiod_fanout_error(struct gpiod_fanout *fanout)
+{
+	return __atomic_load_n(&fanout->error, __ATOMIC_ACQUIRE);
+}
+
+struct gpiod_fanout_sub * gpiod_fanout_subscribe(const char *name)
+{
+	const struct fanout_shm *shm;
+	struct gpiod_fanout_sub *sub;
+	struct stat st;
+	int status;
+
+	sub = zalloc(sizeof(*sub));
+	if (!sub)
+		return NULL;
+
+	sub->fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (sub->fd < 0) {
+		last_error_from_errno();
+		goto err_free;
+	}
+
+	status = fstat(sub->fd, &st);
+	if (status < 0) {
+		last_error_from_errno();
+		goto err_close;
+	}
+
+	if ((size_t)st.st_size < sizeof(*shm)) {
+		set_last_error(EINVAL);
+		goto err_close;
+	}
+
+	sub->size = st.st_size;
+	shm = mmap(NULL, sub->size, PROT_READ, MAP_SHARED, sub->fd, 0);
+	if (shm == MAP_FAILED) {
+		last_error_from_errno();
+		goto err_close;
+	}
+
+	if (memcmp(shm->magic, FANOUT_MAGIC, sizeof(shm->magic)) != 0 ||
+	    shm->version != FANOUT_VERSION ||
+	    fanout_shm_size(shm->ring_size) > sub->size) {
+		munmap((void *)shm, sub->size);
+		set_last_error(EINVAL);
+		goto err_close;
+	}
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	sub->shm = shm;
+	/* Only events published from now on are delivered. */
+	sub->cursor = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+
+	return sub;
+
+err_close:
+	close(sub->fd);
+err_free:
+	free(sub);
+
+	return NULL;
+}
+
+void gpiod_fanout_unsubscribe(struct gpiod_fanout_sub *sub)
+{
+	munmap((void *)sub->shm, sub->size);
+	close(sub->fd);
+	free(sub);
+}
+
+unsigned int gpiod_fanout_num_lines(struct gpiod_fanout_sub *sub)
+{
+	return sub->shm->num_lines;
+}
+
+unsigned int gpiod_fanout_offset(struct gpiod_fanout_sub *sub,
+				 unsigned int index)
+{
+	return sub->shm->offsets[index];
+}
+
+const char * gpiod_fanout_chip_name(struct gpiod_fanout_sub *sub)
+{
+	return sub->shm->chip;
+}
+
+static bool fanout_pending(struct gpiod_fanout_sub *sub)
+{
+	return __atomic_load_n(&sub->shm->head, __ATOMIC_ACQUIRE) !=
+	       sub->cursor;
+}
+
+int gpiod_fanout_wait(struct gpiod_fanout_sub *sub,
+		      const struct timespec *timeout)
+{
+	const struct fanout_shm *shm = sub->shm;
+	uint64_t deadline = 0, now;
+	struct timespec ts;
+	uint32_t val;
+	long status;
+
+	if (timeout)
+		deadline = monotonic_nsec() + timespec_to_nsec(timeout);
+
+	while (!fanout_pending(sub)) {
+		if (timeout) {
+			now = monotonic_nsec();
+			if (now >= deadline)
+				return 0;
+
+			nsec_to_timespec(deadline - now, &ts);
+		}
+
+		/*
+		 * The head is published before the futex word is bumped: if
+		 * the word didn't change since we checked the head, the
+		 * kernel puts us to sleep, otherwise we check again.
+		 */
+		val = __atomic_load_n(&shm->futex, __ATOMIC_ACQUIRE);
+		status = 0;
+		if (!fanout_pending(sub))
+			status = futex(&shm->futex, FUTEX_WAIT, val,
+				       timeout ? &ts : NULL);
+
+		if (status < 0 && errno != EAGAIN && errno != EINTR &&
+		    errno != ETIMEDOUT) {
+			last_error_from_errno();
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+int gpiod_fanout_read(struct gpiod_fanout_sub *sub,
+		      struct gpiod_fanout_event *events,
+		      unsigned int num_events)
+{
+	const struct fanout_shm *shm = sub->shm;
+	const struct fanout_slot *slot;
+	struct gpiod_fanout_event *event;
+	unsigned int num = 0;
+	uint64_t head, seq;
+
+	head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+
+	while (num < num_events && sub->cursor < head) {
+		/* Skip what the producer already overwrote. */
+		if (head - sub->cursor > shm->ring_size) {
+			sub->lost += head - shm->ring_size - sub->cursor;
+			sub->cursor = head - shm->ring_size;
+		}
+
+		slot = &shm->slots[sub->cursor & (shm->ring_size - 1)];
+		event = &events[num];
+
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq == sub->cursor * 2 + 2) {
+			event->event.ts.tv_sec = slot->sec;
+			event->event.ts.tv_nsec = slot->nsec;
+			event->event.event_type = slot->event_type;
+			event->offset = slot->offset;
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->seq,
+					    __ATOMIC_RELAXED) == seq)
+				num++;
+			else
+				sub->lost++;
+		} else {
+			/* Lapped while we were reading. */
+			sub->lost++;
+		}
+
+		sub->cursor++;
+	}
+
+	return num;
+}
+
+unsigned long long gpiod_fanout_lost(struct gpiod_fanout_sub *sub)
+{
+	return sub->lost;
+}
@@ -0,0 +1,508 @@
+/*
+ * Handing over line requests to another process for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define HANDOVER_MAGIC		"GPIODHND"
+#define HANDOVER_VERSION	2
+#define HANDOVER_CHIP_NAME_MAX	32
+#define HANDOVER_CONSUMER_MAX	32
+
+/*
+ * The handover starts with a header naming the chip, followed by one record
+ * per request. Every record is sent with a single sendmsg() carrying the
+ * file descriptor of the request as SCM_RIGHTS ancillary data. Both sides
+ * run on the same machine so all fields use the host byte order.
+ */
+struct handover_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_records;
+	char chip[HANDOVER_CHIP_NAME_MAX];
+};
+
+enum {
+	HANDOVER_HANDLE = 1,
+	HANDOVER_EVENT,
+	HANDOVER_POLLED,
+};
+
+#define HANDOVER_CACHE_VALUE	0x1
+
+struct handover_record {
+	uint32_t type;
+	uint32_t num_lines;
+	uint32_t handleflags;
+	uint32_t eventflags;
+	/* Only used for events emulated by polling. */
+	int32_t event_type;
+	/* HANDOVER_CACHE_VALUE for event lines with cached values. */
+	uint32_t flags;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint32_t offsets[GPIOD_REQUEST_MAX_LINES];
+	/* Values of line handles at the time of the handover. */
+	uint8_t values[GPIOD_REQUEST_MAX_LINES];
+	char consumer[HANDOVER_CONSUMER_MAX];
+};
+
+static int handover_send_msg(int sock, const void *buf, size_t len, int fd)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t rv;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (fd >= 0) {
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	while (iov.iov_len > 0) {
+		rv = sendmsg(sock, &msg, MSG_NOSIGNAL);
+		if (rv < 0) {
+			if (errno == EINTR)
+				continue;
+
+			last_error_from_errno();
+			return -1;
+		}
+
+		/* The descriptor went out with the first part. */
+		msg.msg_control = NULL;
+		msg.msg_controllen = 0;
+		iov.iov_base = (char *)iov.iov_base + rv;
+		iov.iov_len -= rv;
+	}
+
+	return 0;
+}
+
+/*
+ * Receive exactly len bytes. If fd is not NULL, exactly one descriptor must
+ * arrive with the data.
+ */
+static int handover_recv_msg(int sock, void *buf, size_t len, int *fd)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int received = -1;
+	unsigned int i;
+	bool bad = false;
+	ssize_t rv;
+	int tmp;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+
+	while (iov.iov_len > 0) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		rv = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+		if (rv < 0) {
+			if (errno == EINTR)
+				continue;
+
+			last_error_from_errno();
+			goto err_close;
+		} else if (rv == 0) {
+			set_last_error(ECONNRESET);
+			goto err_close;
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET ||
+			    cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+
+			for (i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) /
+					sizeof(int); i++) {
+				memcpy(&tmp, CMSG_DATA(cmsg) + i * sizeof(int),
+				       sizeof(int));
+				if (!fd || received >= 0) {
+					close(tmp);
+					bad = true;
+				} else {
+					received = tmp;
+				}
+			}
+		}
+
+		if (msg.msg_flags & MSG_CTRUNC)
+			bad = true;
+
+		iov.iov_base = (char *)iov.iov_base + rv;
+		iov.iov_len -= rv;
+	}
+
+	if (bad || (fd && received < 0)) {
+		set_last_error(EPROTO);
+		goto err_close;
+	}
+
+	if (fd)
+		*fd = received;
+
+	return 0;
+
+err_close:
+	if (received >= 0)
+		close(received);
+
+	return -1;
+}
+
+static bool handover_seen(const void **seen, unsigned int num_seen,
+			  const void *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_seen; i++) {
+		if (seen[i] == req)
+			return true;
+	}
+
+	return false;
+}
+
+static int handover_record_handle(struct gpiod_line *line,
+				  struct handover_record *rec)
+{
+	struct gpiohandle_request *req = &line->handle->request;
+	struct gpiohandle_data data;
+	unsigned int i;
+	int status;
+
+	memset(&data, 0, sizeof(data));
+	status = gpio_ioctl(line->chip, line->handle->stats, req->fd,
+			    GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data);
+	if (status < 0)
+		return -1;
+
+	rec->type = HANDOVER_HANDLE;
+	rec->num_lines = req->lines;
+	rec->handleflags = req->flags;
+	memcpy(rec->consumer, req->consumer_label, sizeof(rec->consumer));
+
+	for (i = 0; i < req->lines; i++) {
+		rec->offsets[i] = req->lineoffsets[i];
+		rec->values[i] = data.values[i];
+	}
+
+	return req->fd;
+}
+
+static int handover_record_event(struct gpiod_line *line,
+				 struct handover_record *rec)
+{
+	struct gpioevent_request *req = &line->event;
+
+	rec->type = HANDOVER_EVENT;
+	rec->num_lines = 1;
+	rec->handleflags = req->handleflags;
+	rec->eventflags = req->eventflags;
+	rec->offsets[0] = req->lineoffset;
+	memcpy(rec->consumer, req->consumer_label, sizeof(rec->consumer));
+
+	return req->fd;
+}
+
+static int handover_record_polled(const struct gpiohandle_request *req,
+				  int event_type, uint64_t min_ns,
+				  uint64_t max_ns, struct handover_record *rec)
+{
+	unsigned int i;
+
+	rec->type = HANDOVER_POLLED;
+	rec->num_lines = req->lines;
+	rec->handleflags = req->flags;
+	rec->event_type = event_type;
+	rec->min_ns = min_ns;
+	rec->max_ns = max_ns;
+	memcpy(rec->consumer, req->consumer_label, sizeof(rec->consumer));
+
+	for (i = 0; i < req->lines; i++)
+		rec->offsets[i] = req->lineoffsets[i];
+
+	return req->fd;
+}
+
+int gpiod_handover_send(int sock, struct gpiod_chip *chip)
+{
+	const struct gpiohandle_request *polled;
+	unsigned int i, num_records = 0;
+	struct handover_record *records;
+	struct handover_hdr hdr;
+	struct gpiod_line *line;
+	uint64_t min_ns, max_ns;
+	const void **seen;
+	int status, *fds;
+	int event_type;
+	const void *req;
+
+	records = zalloc(chip->cinfo.lines * sizeof(*records));
+	fds = zalloc(chip->cinfo.lines * sizeof(*fds));
+	seen = zalloc(chip->cinfo.lines * sizeof(*seen));
+	if (!records || !fds || !seen) {
+		status = -1;
+		goto out;
+	}
+
+	for (i = 0; i < chip->cinfo.lines; i++) {
+		line = &chip->lines[i];
+
+		if (line->state == LINE_TAKEN) {
+			req = line->handle;
+			if (handover_seen(seen, num_records, req))
+				continue;
+
+			status = handover_record_handle(line,
+							&records[num_records]);
+		} else if (line->state == LINE_EVENT) {
+			polled = line_poller_request(line, &event_type,
+						     &min_ns, &max_ns);
+			if (polled) {
+				req = polled;
+				if (handover_seen(seen, num_records, req))
+					continue;
+
+				status = handover_record_polled(polled,
+						event_type, min_ns, max_ns,
+						&records[num_records]);
+			} else {
+				req = line;
+				status = handover_record_event(line,
+							&records[num_records]);
+			}
+		} else {
+			continue;
+		}
+
+		if (status < 0)
+			goto out;
+
+		/* Lines sharing a poller were requested with the same flags. */
+		if (line->state == LINE_EVENT && line->cache_value)
+			records[num_records].flags |= HANDOVER_CACHE_VALUE;
+
+		fds[num_records] = status;
+		seen[num_records] = req;
+		num_records++;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, HANDOVER_MAGIC, sizeof(hdr.magic));
+	hdr.version = HANDOVER_VERSION;
+	hdr.num_records = num_records;
+	memcpy(hdr.chip, chip->cinfo.name, sizeof(hdr.chip) - 1);
+
+	status = handover_send_msg(sock, &hdr, sizeof(hdr), -1);
+	if (status < 0)
+		goto out;
+
+	for (i = 0; i < num_records; i++) {
+		status = handover_send_msg(sock, &records[i],
+					   sizeof(records[i]), fds[i]);
+		if (status < 0)
+			goto out;
+	}
+
+out:
+	free(seen);
+	free(fds);
+	free(records);
+
+	return status < 0 ? -1 : 0;
+}
+
+static int handover_get_lines(struct gpiod_chip *chip,
+			      const struct handover_record *rec,
+			      struct gpiod_line_bulk *bulk)
+{
+	struct gpiod_line *line;
+	unsigned int i;
+
+	if (rec->num_lines == 0 || rec->num_lines > GPIOD_REQUEST_MAX_LINES ||
+	    (rec->type == HANDOVER_EVENT && rec->num_lines != 1)) {
+		set_last_error(EPROTO);
+		return -1;
+	}
+
+	gpiod_line_bulk_init(bulk);
+
+	for (i = 0; i < rec->num_lines; i++) {
+		line = gpiod_chip_get_line(chip, rec->offsets[i]);
+		if (!line)
+			return -1;
+
+		if (!gpiod_line_is_free(line)) {
+			set_last_error(GPIOD_ELINEBUSY);
+			return -1;
+		}
+
+		gpiod_line_bulk_add(bulk, line);
+	}
+
+	return 0;
+}
+
+static int handover_adopt_request(struct gpiod_line_bulk *bulk,
+				  const struct handover_record *rec, int fd)
+{
+	struct gpiohandle_request handle;
+	struct gpioevent_request event;
+	unsigned int i;
+
+	switch (rec->type) {
+	case HANDOVER_HANDLE:
+	case HANDOVER_POLLED:
+		memset(&handle, 0, sizeof(handle));
+		handle.lines = rec->num_lines;
+		handle.flags = rec->handleflags;
+		handle.fd = fd;
+		memcpy(handle.consumer_label, rec->consumer,
+		       sizeof(handle.consumer_label) - 1);
+
+		for (i = 0; i < rec->num_lines; i++) {
+			handle.lineoffsets[i] = rec->offsets[i];
+			handle.default_values[i] = rec->values[i];
+		}
+
+		if (rec->type == HANDOVER_HANDLE)
+			return line_adopt_handle(bulk, &handle);
+
+		return line_adopt_poller(bulk, &handle, rec->event_type,
+					 rec->min_ns, rec->max_ns);
+	case HANDOVER_EVENT:
+		memset(&event, 0, sizeof(event));
+		event.lineoffset = rec->offsets[0];
+		event.handleflags = rec->handleflags;
+		event.eventflags = rec->eventflags;
+		event.fd = fd;
+		memcpy(event.consumer_label, rec->consumer,
+		       sizeof(event.consumer_label) - 1);
+
+		return line_adopt_event(bulk->lines[0], &event);
+	default:
+		set_last_error(EPROTO);
+		return -1;
+	}
+}
+
+/*
+ * The descriptor is closed if the request can't be adopted. Once it is, the
+ * descriptor belongs to the lines and is closed together with the chip.
+ */
+static int handover_adopt(struct gpiod_chip *chip,
+			  const struct handover_record *rec, int fd)
+{
+	struct gpiod_line_bulk bulk;
+	unsigned int i;
+	int status;
+
+	status = handover_get_lines(chip, rec, &bulk);
+	if (status < 0)
+		goto err_close;
+
+	status = handover_adopt_request(&bulk, rec, fd);
+	if (status < 0)
+		goto err_close;
+
+	if (!(rec->flags & HANDOVER_CACHE_VALUE))
+		return 0;
+
+	/*
+	 * Events the sender read ahead are gone, so the values start out
+	 * unknown and are read from the kernel on first use.
+	 */
+	for (i = 0; i < bulk.num_lines; i++) {
+		status = line_cache_enable(bulk.lines[i]);
+		if (status < 0)
+			return -1;
+	}
+
+	return 0;
+
+err_close:
+	close(fd);
+
+	return -1;
+}
+
+struct gpiod_chip * gpiod_handover_receive(int sock)
+{
+	struct handover_record rec;
+	struct gpiod_chip *chip;
+	struct handover_hdr hdr;
+	unsigned int i;
+	int status, fd;
+
+	status = handover_recv_msg(sock, &hdr, sizeof(hdr), NULL);
+	if (status < 0)
+		return NULL;
+
+	if (memcmp(hdr.magic, HANDOVER_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != HANDOVER_VERSION ||
+	    hdr.chip[sizeof(hdr.chip) - 1] != '\0') {
+		set_last_error(EPROTO);
+		return NULL;
+	}
+
+	chip = gpiod_chip_open_by_name(hdr.chip);
+	if (!chip)
+		return NULL;
+
+	for (i = 0; i < hdr.num_records; i++) {
+		status = handover_recv_msg(sock, &rec, sizeof(rec), &fd);
+		if (status < 0)
+			goto err_close;
+
+		status = handover_adopt(chip, &rec, fd);
+		if (status < 0)
+			goto err_close;
+	}
+
+	return chip;
+
+err_close:
+	status = gpiod_errno();
+	gpiod_chip_close(chip);
+	set_last_error(status);
+
+	return NULL;
+}
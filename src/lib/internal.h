@@ -0,0 +1,219 @@
+/*
+ * Internal libgpiod declarations.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#ifndef __GPIOD_INTERNAL_H__
+#define __GPIOD_INTERNAL_H__
+
+/*
+ * Data structures and helpers shared between the library source files.
+ *
+ * NOTE: Nothing declared here is part of the public API. The library is
+ * built with -fvisibility=hidden so none of these symbols are exported.
+ */
+
+#include <gpiod.h>
+
+#include <stdint.h>
+#include <linux/gpio.h>
+
+#define MALLOC __attribute__((malloc))
+#define UNUSED __attribute__((unused))
+
+#define NSEC_PER_SEC	1000000000ULL
+
+/*
+ * Static tracepoints for SystemTap, perf and bpftrace. All probes belong to
+ * the 'libgpiod' provider. Without --enable-sdt they compile to nothing.
+ */
+#ifdef WITH_SDT
+#include <sys/sdt.h>
+#define PROBE(name, ...)	STAP_PROBEV(libgpiod, name, ##__VA_ARGS__)
+#else
+/* Keep the arguments referenced so that disabling probes adds no warnings. */
+static inline void probe_args(int dummy UNUSED, ...) { }
+#define PROBE(name, ...)						\
+	do {								\
+		if (0)							\
+			probe_args(0, ##__VA_ARGS__);			\
+	} while (0)
+#endif
+
+struct stats_block;
+
+struct gpiod_chip {
+	int fd;
+	struct gpiochip_info cinfo;
+	struct gpiod_line *lines;
+	uint64_t pulse_ioctl_ns;
+	uint64_t pulse_spin_ns;
+	/* NULL unless statistics were enabled. */
+	struct stats_block *stats;
+	/* N of gpiochipN, identifies the chip in flight recorder records. */
+	unsigned int num;
+};
+
+enum {
+	LINE_FREE = 0,
+	LINE_TAKEN,
+	LINE_EVENT,
+};
+
+struct line_poller;
+
+struct handle_data {
+	struct gpiohandle_request request;
+	int refcount;
+	struct stats_block *stats;
+	/*
+	 * Last values written to the lines of an output request - bit n
+	 * corresponds to the n-th line of the request.
+	 */
+	uint64_t shadow;
+	bool shadow_valid;
+};
+
+struct gpiod_line {
+	int state;
+	bool up_to_date;
+	struct gpiod_chip *chip;
+	struct gpioline_info info;
+	union {
+		struct handle_data *handle;
+		struct gpioevent_request event;
+	};
+	/* Only set for lines whose events are emulated by polling. */
+	struct line_poller *poller;
+	unsigned int poll_index;
+	/* Statistics of the line's event request. */
+	struct stats_block *stats;
+	/* Set if the line's value is tracked from the events read. */
+	bool cache_value;
+	/* Level implied by the last event read or -1 if unknown. */
+	int cached_value;
+	/*
+	 * Events read ahead from the kernel for lines with cached values
+	 * which aren't polled.
+	 */
+	struct event_queue *queue;
+};
+
+void set_last_error(int errnum);
+void last_error_from_errno(void);
+MALLOC void * zalloc(size_t size);
+/*
+ * The chip and request statistics are updated if the chip has statistics
+ * enabled. The request statistics may be NULL.
+ */
+int gpio_ioctl(struct gpiod_chip *chip, struct stats_block *req_stats,
+	       int fd, unsigned long request, void *data);
+
+void nsec_to_timespec(uint64_t nsec, struct timespec *ts);
+uint64_t timespec_to_nsec(const struct timespec *ts);
+uint64_t monotonic_nsec(void);
+
+bool line_bulk_is_reserved(struct gpiod_line_bulk *bulk);
+bool line_bulk_is_event_configured(struct gpiod_line_bulk *bulk);
+
+/*
+ * Fill the bulk object with all lines that were requested together with
+ * given line, in the order in which they were passed to the kernel.
+ */
+void line_handle_get_bulk(struct gpiod_line *line,
+			  struct gpiod_line_bulk *bulk);
+
+/*
+ * Index of the line in its request handle. The line must be reserved with
+ * a handle.
+ */
+unsigned int line_handle_index(struct gpiod_line *line);
+
+/*
+ * Convert between the output shadow of a request handle and the data of
+ * GPIOHANDLE_SET_LINE_VALUES_IOCTL. Storing marks the shadow as valid and
+ * must only be done once the data was successfully written.
+ */
+void handle_load_shadow(struct handle_data *handle,
+			struct gpiohandle_data *data);
+void handle_store_shadow(struct handle_data *handle,
+			 const struct gpiohandle_data *data);
+
+/*
+ * Take over requests made by another process. The request structures must
+ * carry the file descriptors of the requests, which are owned by the lines
+ * on success. The lines must be free and, for line handles, in the order
+ * of the request offsets.
+ */
+int line_adopt_handle(struct gpiod_line_bulk *bulk,
+		      const struct gpiohandle_request *req);
+int line_adopt_event(struct gpiod_line *line,
+		     const struct gpioevent_request *req);
+int line_adopt_poller(struct gpiod_line_bulk *bulk,
+		      const struct gpiohandle_request *req, int event_type,
+		      uint64_t min_ns, uint64_t max_ns);
+
+/*
+ * Line handle used to emulate events on given line together with the
+ * poller settings or NULL if the line's events are not polled.
+ */
+const struct gpiohandle_request *
+line_poller_request(struct gpiod_line *line, int *event_type,
+		    uint64_t *min_ns, uint64_t *max_ns);
+
+/*
+ * Track the value of an event line from the events read from it. The line
+ * must be requested for both edges.
+ */
+int line_cache_enable(struct gpiod_line *line);
+
+/* Check if the event line reports both rising and falling edges. */
+bool line_event_is_both_edges(struct gpiod_line *line);
+
+/*
+ * Wait for events on a set of lines like gpiod_line_event_wait_bulk() but
+ * store every line that has events pending in ready, so that callers can
+ * serve all of them and a busy line doesn't starve the ones after it.
+ */
+int line_event_wait_all(struct gpiod_line_bulk *bulk,
+			const struct timespec *timeout,
+			struct gpiod_line_bulk *ready);
+
+/* Statistics of the request the line belongs to or NULL. */
+struct stats_block * line_request_stats(struct gpiod_line *line);
+
+struct stats_block * stats_new(void);
+void stats_free(struct stats_block *stats);
+void stats_add_ioctl(struct stats_block *chip_stats,
+		     struct stats_block *req_stats,
+		     unsigned long request, bool error, uint64_t ns);
+void stats_add_read(struct stats_block *chip_stats,
+		    struct stats_block *req_stats,
+		    unsigned int num_events, size_t bytes);
+void stats_add_poll(struct stats_block *chip_stats, bool timeout);
+
+/*
+ * The flight recorder is checked on every operation, so the check is a
+ * single load of a global flag.
+ */
+extern bool recorder_active;
+
+static inline bool recorder_enabled(void)
+{
+	return __atomic_load_n(&recorder_active, __ATOMIC_RELAXED);
+}
+
+/* Only to be called if recorder_enabled() returned true. */
+void recorder_add(unsigned int type, struct gpiod_chip *chip,
+		  unsigned int offset, unsigned int num_lines,
+		  uint64_t values, int error);
+/* Bit n of the recorded values is set if values[n] is non-zero. */
+void recorder_add_bulk(unsigned int type, struct gpiod_line_bulk *bulk,
+		       const int *values, int status);
+
+#endif /* __GPIOD_INTERNAL_H__ */
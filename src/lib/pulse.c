@@ -0,0 +1,215 @@
+/*
+ * Pulse generation for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define PULSE_CALIB_IOCTL_SAMPLES	64
+#define PULSE_CALIB_SLEEP_SAMPLES	16
+#define PULSE_CALIB_SLEEP_NS		200000ULL
+
+/*
+ * How long before the deadline we stop sleeping and start spinning if the
+ * chip was not calibrated and the bounds for the calibrated value.
+ */
+#define PULSE_SPIN_DEFAULT_NS		100000ULL
+#define PULSE_SPIN_MIN_NS		10000ULL
+#define PULSE_SPIN_MAX_NS		2000000ULL
+
+/*
+ * Prepare the data for GPIOHANDLE_SET_LINE_VALUES_IOCTL so that only the
+ * value of given line changes and return its index in the request. The
+ * other lines keep the values last written to them.
+ */
+static int pulse_prepare(struct gpiod_line *line,
+			 struct gpiohandle_data *data, unsigned int *index)
+{
+	if (!gpiod_line_is_reserved(line)) {
+		set_last_error(GPIOD_EREQUEST);
+		return -1;
+	}
+
+	if (!line->handle->shadow_valid) {
+		set_last_error(EPERM);
+		return -1;
+	}
+
+	handle_load_shadow(line->handle, data);
+	*index = line_handle_index(line);
+
+	return 0;
+}
+
+static void pulse_record(struct gpiod_line *line,
+			 struct gpiohandle_data *data, int status)
+{
+	struct gpiohandle_request *req = &line->handle->request;
+	uint64_t values = 0;
+	unsigned int i;
+
+	for (i = 0; i < req->lines; i++) {
+		if (data->values[i])
+			values |= 1ULL << i;
+	}
+
+	recorder_add(GPIOD_RECORD_SET_VALUES, line->chip, req->lineoffsets[0],
+		     req->lines, values, status < 0 ? gpiod_errno() : 0);
+}
+
+static void pulse_wait_until(uint64_t deadline, uint64_t spin_ns)
+{
+	struct timespec ts;
+	int status;
+
+	if (monotonic_nsec() + spin_ns < deadline) {
+		nsec_to_timespec(deadline - spin_ns, &ts);
+
+		do {
+			status = clock_nanosleep(CLOCK_MONOTONIC,
+						 TIMER_ABSTIME, &ts, NULL);
+		} while (status == EINTR);
+	}
+
+	while (monotonic_nsec() < deadline)
+		;
+}
+
+static int compare_u64(const void *p1, const void *p2)
+{
+	uint64_t v1 = *(const uint64_t *)p1, v2 = *(const uint64_t *)p2;
+
+	return v1 < v2 ? -1 : v1 > v2;
+}
+
+int gpiod_line_pulse_calibrate(struct gpiod_line *line,
+			       struct gpiod_pulse_calib *calib)
+{
+	uint64_t samples[PULSE_CALIB_IOCTL_SAMPLES], start, deadline, over;
+	struct gpiohandle_data data;
+	struct gpiod_chip *chip;
+	unsigned int i, index;
+	struct timespec ts;
+	int status, fd;
+
+	status = pulse_prepare(line, &data, &index);
+	if (status < 0)
+		return -1;
+
+	fd = line->handle->request.fd;
+
+	for (i = 0; i < PULSE_CALIB_IOCTL_SAMPLES; i++) {
+		start = monotonic_nsec();
+		status = gpio_ioctl(line->chip, line->handle->stats, fd,
+				    GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+		if (status < 0)
+			return -1;
+
+		samples[i] = monotonic_nsec() - start;
+	}
+
+	qsort(samples, PULSE_CALIB_IOCTL_SAMPLES,
+	      sizeof(*samples), compare_u64);
+
+	for (i = 0, over = 0; i < PULSE_CALIB_SLEEP_SAMPLES; i++) {
+		deadline = monotonic_nsec() + PULSE_CALIB_SLEEP_NS;
+		nsec_to_timespec(deadline, &ts);
+
+		do {
+			status = clock_nanosleep(CLOCK_MONOTONIC,
+						 TIMER_ABSTIME, &ts, NULL);
+		} while (status == EINTR);
+		if (status) {
+			set_last_error(status);
+			return -1;
+		}
+
+		start = monotonic_nsec() - deadline;
+		if (start > over)
+			over = start;
+	}
+
+	chip = gpiod_line_get_chip(line);
+	chip->pulse_ioctl_ns = samples[PULSE_CALIB_IOCTL_SAMPLES / 2];
+	chip->pulse_spin_ns = over;
+	if (chip->pulse_spin_ns < PULSE_SPIN_MIN_NS)
+		chip->pulse_spin_ns = PULSE_SPIN_MIN_NS;
+	else if (chip->pulse_spin_ns > PULSE_SPIN_MAX_NS)
+		chip->pulse_spin_ns = PULSE_SPIN_MAX_NS;
+
+	if (calib) {
+		nsec_to_timespec(chip->pulse_ioctl_ns, &calib->ioctl_latency);
+		nsec_to_timespec(over, &calib->wakeup_latency);
+	}
+
+	return 0;
+}
+
+int gpiod_line_pulse(struct gpiod_line *line, const struct timespec *width,
+		     struct timespec *measured)
+{
+	uint64_t start, end, deadline, width_ns, spin_ns, lat_ns;
+	struct gpiohandle_data data;
+	struct gpiod_chip *chip;
+	unsigned int index;
+	int status, fd;
+	__u8 idle;
+
+	status = pulse_prepare(line, &data, &index);
+	if (status < 0)
+		return -1;
+
+	chip = gpiod_line_get_chip(line);
+	fd = line->handle->request.fd;
+	width_ns = timespec_to_nsec(width);
+	spin_ns = chip->pulse_spin_ns ? chip->pulse_spin_ns
+				      : PULSE_SPIN_DEFAULT_NS;
+	lat_ns = chip->pulse_ioctl_ns < width_ns ? chip->pulse_ioctl_ns : 0;
+
+	/* The pulse goes away from whatever level the line idles at. */
+	idle = data.values[index];
+	data.values[index] = !idle;
+	status = gpio_ioctl(chip, line->handle->stats, fd,
+			    GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+	start = monotonic_nsec();
+	/* Recording the first edge is absorbed by waiting for the second. */
+	if (recorder_enabled())
+		pulse_record(line, &data, status);
+	if (status < 0)
+		return -1;
+
+	handle_store_shadow(line->handle, &data);
+
+	/*
+	 * Both edges are assumed to happen when the respective ioctl()
+	 * completes, so start the second one early by its expected duration.
+	 */
+	deadline = start + width_ns - lat_ns;
+	pulse_wait_until(deadline, spin_ns);
+
+	data.values[index] = idle;
+	status = gpio_ioctl(chip, line->handle->stats, fd,
+			    GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+	end = monotonic_nsec();
+	if (recorder_enabled())
+		pulse_record(line, &data, status);
+	if (status < 0)
+		return -1;
+
+	handle_store_shadow(line->handle, &data);
+
+	if (measured)
+		nsec_to_timespec(end - start, measured);
+
+	return 0;
+}
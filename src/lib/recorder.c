@@ -0,0 +1,371 @@
+/*
+ * Flight recorder for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+
+#define RECORDER_MAX_RECORDS	(1U << 24)
+#define RECORDER_CACHE_LINE	64
+#define RECORDER_CHUNK		64
+
+/*
+ * Writers claim a slot by incrementing the head and publish the record by
+ * storing its sequence number after filling it in. The sequence is odd
+ * while the record is being written. Readers copy a record and check that
+ * its sequence didn't change in the meantime, which tells them whether
+ * the slot was reused by a writer that wrapped around.
+ */
+struct recorder_slot {
+	uint64_t seq;
+	struct gpiod_record record;
+};
+
+struct recorder {
+	struct recorder_slot *slots;
+	uint64_t mask;
+	uint64_t head __attribute__((aligned(RECORDER_CACHE_LINE)));
+};
+
+/* Never freed: other threads may still be writing after disabling it. */
+static struct recorder *recorder;
+bool recorder_active;
+
+static struct {
+	char path[PATH_MAX];
+	struct sigaction old;
+	bool installed;
+} dump_signals[NSIG];
+
+static uint64_t slot_seq(uint64_t idx, bool done)
+{
+	return idx * 2 + (done ? 2 : 1);
+}
+
+void recorder_add(unsigned int type, struct gpiod_chip *chip,
+		  unsigned int offset, unsigned int num_lines,
+		  uint64_t values, int error)
+{
+	struct recorder *rec = __atomic_load_n(&recorder, __ATOMIC_ACQUIRE);
+	struct recorder_slot *slot;
+	uint64_t idx;
+
+	idx = __atomic_fetch_add(&rec->head, 1, __ATOMIC_RELAXED);
+	slot = &rec->slots[idx & rec->mask];
+
+	__atomic_store_n(&slot->seq, slot_seq(idx, false), __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->record.timestamp = monotonic_nsec();
+	slot->record.values = values;
+	slot->record.chip = chip ? chip->num : GPIOD_RECORD_NO_CHIP;
+	slot->record.offset = offset;
+	slot->record.type = type;
+	slot->record.num_lines = num_lines;
+	slot->record.error = error;
+
+	__atomic_store_n(&slot->seq, slot_seq(idx, true), __ATOMIC_RELEASE);
+}
+
+void recorder_add_bulk(unsigned int type, struct gpiod_line_bulk *bulk,
+		       const int *values, int status)
+{
+	uint64_t mask = 0;
+	unsigned int i;
+
+	if (!bulk->num_lines)
+		return;
+
+	for (i = 0; values && i < bulk->num_lines; i++) {
+		if (values[i])
+			mask |= 1ULL << i;
+	}
+
+	recorder_add(type, bulk->lines[0]->chip,
+		     gpiod_line_offset(bulk->lines[0]), bulk->num_lines,
+		     mask, status < 0 ? gpiod_errno() : 0);
+}
+
+/*
+ * Copy the records with sequence numbers in [first, first + num) that are
+ * still intact. Must stay async-signal-safe.
+ */
+static unsigned int recorder_copy(struct recorder *rec,
+				  struct gpiod_record *records,
+				  uint64_t first, unsigned int num)
+{
+	struct recorder_slot *slot;
+	unsigned int copied = 0;
+	uint64_t idx, seq;
+
+	for (idx = first; idx < first + num; idx++) {
+		slot = &rec->slots[idx & rec->mask];
+
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq != slot_seq(idx, true))
+			/* Still being written or already reused. */
+			continue;
+
+		records[copied] = slot->record;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+			copied++;
+	}
+
+	return copied;
+}
+
+/* Index of the oldest record that may still be in the ring. */
+static uint64_t recorder_first(struct recorder *rec, uint64_t head)
+{
+	return head > rec->mask + 1 ? head - rec->mask - 1 : 0;
+}
+
+static int write_all(int fd, const void *buf, size_t size)
+{
+	const char *ptr = buf;
+	ssize_t wr;
+
+	while (size) {
+		wr = write(fd, ptr, size);
+		if (wr < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		ptr += wr;
+		size -= wr;
+	}
+
+	return 0;
+}
+
+/* Async-signal-safe, sets errno on failure. */
+static int recorder_write(struct recorder *rec, int fd)
+{
+	struct gpiod_recorder_header hdr;
+	struct gpiod_record buf[RECORDER_CHUNK];
+	uint64_t head, idx;
+	unsigned int num, copied;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, GPIOD_RECORDER_MAGIC, sizeof(hdr.magic));
+	hdr.version = GPIOD_RECORDER_VERSION;
+	hdr.record_size = sizeof(struct gpiod_record);
+
+	if (write_all(fd, &hdr, sizeof(hdr)))
+		return -1;
+
+	head = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+
+	/* Copy in chunks so that no allocation is needed. */
+	for (idx = recorder_first(rec, head); idx < head; idx += num) {
+		num = head - idx < RECORDER_CHUNK ? head - idx
+						  : RECORDER_CHUNK;
+
+		copied = recorder_copy(rec, buf, idx, num);
+		if (write_all(fd, buf, copied * sizeof(*buf)))
+			return -1;
+	}
+
+	return 0;
+}
+
+int gpiod_recorder_enable(unsigned int num_records)
+{
+	struct recorder *rec, *expected = NULL;
+	unsigned int size;
+	int status;
+
+	if (__atomic_load_n(&recorder, __ATOMIC_ACQUIRE))
+		goto out;
+
+	if (!num_records || num_records > RECORDER_MAX_RECORDS) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	for (size = 1; size < num_records; size <<= 1)
+		;
+
+	status = posix_memalign((void **)&rec, RECORDER_CACHE_LINE,
+				sizeof(*rec));
+	if (status) {
+		set_last_error(status);
+		return -1;
+	}
+
+	memset(rec, 0, sizeof(*rec));
+	rec->mask = size - 1;
+
+	rec->slots = zalloc(size * sizeof(*rec->slots));
+	if (!rec->slots) {
+		free(rec);
+		return -1;
+	}
+
+	/* Another thread may have been faster. */
+	if (!__atomic_compare_exchange_n(&recorder, &expected, rec, false,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(rec->slots);
+		free(rec);
+	}
+
+out:
+	__atomic_store_n(&recorder_active, true, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void gpiod_recorder_disable(void)
+{
+	__atomic_store_n(&recorder_active, false, __ATOMIC_RELEASE);
+}
+
+int gpiod_recorder_dump(struct gpiod_record *records,
+			unsigned int max_records)
+{
+	struct recorder *rec;
+	uint64_t head, first;
+
+	rec = __atomic_load_n(&recorder, __ATOMIC_ACQUIRE);
+	if (!rec) {
+		set_last_error(ENODATA);
+		return -1;
+	}
+
+	head = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+	first = recorder_first(rec, head);
+	if (head - first > max_records)
+		first = head - max_records;
+
+	return recorder_copy(rec, records, first, head - first);
+}
+
+int gpiod_recorder_dump_fd(int fd)
+{
+	struct recorder *rec;
+
+	rec = __atomic_load_n(&recorder, __ATOMIC_ACQUIRE);
+	if (!rec) {
+		set_last_error(ENODATA);
+		return -1;
+	}
+
+	if (recorder_write(rec, fd)) {
+		last_error_from_errno();
+		return -1;
+	}
+
+	return 0;
+}
+
+static bool signal_is_fatal(int signum)
+{
+	return signum == SIGSEGV || signum == SIGBUS || signum == SIGILL ||
+	       signum == SIGFPE || signum == SIGABRT;
+}
+
+static void dump_signal_handler(int signum, siginfo_t *info, void *ctx)
+{
+	struct sigaction *old = &dump_signals[signum].old;
+	struct recorder *rec;
+	int fd, saved_errno;
+
+	saved_errno = errno;
+
+	rec = __atomic_load_n(&recorder, __ATOMIC_ACQUIRE);
+	if (rec) {
+		fd = open(dump_signals[signum].path,
+			  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd >= 0) {
+			recorder_write(rec, fd);
+			close(fd);
+		}
+	}
+
+	errno = saved_errno;
+
+	/* Let whoever handled the signal before us do their job. */
+	if (old->sa_flags & SA_SIGINFO) {
+		old->sa_sigaction(signum, info, ctx);
+	} else if (old->sa_handler == SIG_DFL && signal_is_fatal(signum)) {
+		sigaction(signum, old, NULL);
+		raise(signum);
+	} else if (old->sa_handler != SIG_DFL && old->sa_handler != SIG_IGN) {
+		old->sa_handler(signum);
+	}
+}
+
+int gpiod_recorder_dump_on_signal(int signum, const char *path)
+{
+	struct sigaction sa;
+	int status;
+
+	if (signum <= 0 || signum >= NSIG ||
+	    strlen(path) >= sizeof(dump_signals[signum].path)) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	strcpy(dump_signals[signum].path, path);
+	if (dump_signals[signum].installed)
+		return 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = dump_signal_handler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+
+	status = sigaction(signum, &sa, &dump_signals[signum].old);
+	if (status < 0) {
+		last_error_from_errno();
+		return -1;
+	}
+
+	dump_signals[signum].installed = true;
+
+	return 0;
+}
+
+/*
+ * Allow enabling the recorder in unmodified programs:
+ *
+ *   GPIOD_RECORDER=<number of records>
+ *   GPIOD_RECORDER_FILE=<path> - dump the records to path on SIGUSR2
+ */
+static void __attribute__((constructor)) recorder_init_from_env(void)
+{
+	const char *size, *path;
+	unsigned long num;
+	char *end;
+
+	size = getenv("GPIOD_RECORDER");
+	if (!size)
+		return;
+
+	num = strtoul(size, &end, 10);
+	if (*end != '\0' || num > UINT_MAX ||
+	    gpiod_recorder_enable(num) < 0)
+		return;
+
+	path = getenv("GPIOD_RECORDER_FILE");
+	if (path)
+		gpiod_recorder_dump_on_signal(SIGUSR2, path);
+}
@@ -0,0 +1,368 @@
+/*
+ * Periodic input sampling for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#define SAMPLER_DEFAULT_RING_SIZE	1024
+
+enum {
+	SAMPLER_STOPPED = 0,
+	SAMPLER_RUNNING,
+};
+
+/*
+ * Statistics are written by the sampling thread only and read with relaxed
+ * atomic loads by the user.
+ */
+struct sampler_stats {
+	uint64_t num_samples;
+	uint64_t missed_deadlines;
+	uint64_t overruns;
+	uint64_t jitter_max_ns;
+	uint64_t jitter_sum_ns;
+};
+
+struct gpiod_sampler {
+	struct gpiod_line_bulk bulk;
+	uint64_t period_ns;
+	unsigned int batch_size;
+	int evfd;
+	pthread_t thread;
+	int state;
+	bool stop;
+	int error;
+
+	/*
+	 * Single-producer, single-consumer ring. The head is only written by
+	 * the sampling thread, the tail only by the consumer.
+	 */
+	struct gpiod_sample *ring;
+	unsigned int ring_mask;
+	unsigned int head;
+	unsigned int tail;
+
+	struct sampler_stats stats;
+};
+
+static unsigned int round_up_pow2(unsigned int val)
+{
+	unsigned int ret = 1;
+
+	while (ret < val)
+		ret <<= 1;
+
+	return ret;
+}
+
+static void stat_add(uint64_t *stat, uint64_t val)
+{
+	__atomic_store_n(stat, *stat + val, __ATOMIC_RELAXED);
+}
+
+static uint64_t stat_get(uint64_t *stat)
+{
+	return __atomic_load_n(stat, __ATOMIC_RELAXED);
+}
+
+static void sampler_notify(struct gpiod_sampler *sampler)
+{
+	uint64_t val = 1;
+	ssize_t wr;
+
+	wr = write(sampler->evfd, &val, sizeof(val));
+	/* The counter can only overflow if nobody ever reads it. */
+	(void)wr;
+}
+
+static void sampler_push(struct gpiod_sampler *sampler,
+			 const int *values, uint64_t ts_ns)
+{
+	struct gpiod_sample *sample;
+	unsigned int head, tail, i;
+
+	head = sampler->head;
+	tail = __atomic_load_n(&sampler->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail > sampler->ring_mask) {
+		stat_add(&sampler->stats.overruns, 1);
+		return;
+	}
+
+	sample = &sampler->ring[head & sampler->ring_mask];
+	nsec_to_timespec(ts_ns, &sample->ts);
+	sample->values = 0;
+	for (i = 0; i < sampler->bulk.num_lines; i++) {
+		if (values[i])
+			sample->values |= 1ULL << i;
+	}
+
+	__atomic_store_n(&sampler->head, head + 1, __ATOMIC_RELEASE);
+
+	if (((head + 1) % sampler->batch_size) == 0)
+		sampler_notify(sampler);
+}
+
+static void * sampler_thread(void *data)
+{
+	uint64_t deadline, before, ts, prev_ts = 0, missed = 0, jitter;
+	uint64_t expected;
+	struct gpiod_sampler *sampler = data;
+	int values[GPIOD_REQUEST_MAX_LINES];
+	struct timespec deadline_ts;
+	int status;
+
+	deadline = monotonic_nsec();
+
+	while (!__atomic_load_n(&sampler->stop, __ATOMIC_ACQUIRE)) {
+		nsec_to_timespec(deadline, &deadline_ts);
+
+		do {
+			status = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						 &deadline_ts, NULL);
+		} while (status == EINTR);
+
+		before = monotonic_nsec();
+		status = gpiod_line_get_value_bulk(&sampler->bulk, values);
+		if (status < 0) {
+			__atomic_store_n(&sampler->error, gpiod_errno(),
+					 __ATOMIC_RELEASE);
+			sampler_notify(sampler);
+			break;
+		}
+
+		/* Timestamp the sample in the middle of the ioctl() call. */
+		ts = before + (monotonic_nsec() - before) / 2;
+		sampler_push(sampler, values, ts);
+
+		if (prev_ts) {
+			/* Skipped deadlines are counted separately. */
+			expected = (missed + 1) * sampler->period_ns;
+			jitter = ts - prev_ts;
+			jitter = jitter > expected ? jitter - expected
+						   : expected - jitter;
+
+			stat_add(&sampler->stats.jitter_sum_ns, jitter);
+			if (jitter > sampler->stats.jitter_max_ns)
+				__atomic_store_n(&sampler->stats.jitter_max_ns,
+						 jitter, __ATOMIC_RELAXED);
+		}
+
+		prev_ts = ts;
+		stat_add(&sampler->stats.num_samples, 1);
+
+		/*
+		 * Stay on the original grid of deadlines. If we're late by
+		 * more than a period, skip the deadlines that already passed
+		 * instead of trying to catch up with a burst of samples.
+		 */
+		deadline += sampler->period_ns;
+		before = monotonic_nsec();
+		missed = 0;
+		if (before > deadline) {
+			missed = (before - deadline) / sampler->period_ns;
+			if (missed) {
+				deadline += missed * sampler->period_ns;
+				stat_add(&sampler->stats.missed_deadlines,
+					 missed);
+			}
+		}
+	}
+
+	/* Don't leave a consumer waiting for the rest of a batch. */
+	if (sampler->head % sampler->batch_size)
+		sampler_notify(sampler);
+
+	return NULL;
+}
+
+struct gpiod_sampler *
+gpiod_sampler_new(struct gpiod_line_bulk *bulk,
+		  const struct gpiod_sampler_config *config)
+{
+	struct gpiod_sampler *sampler;
+	unsigned int ring_size;
+
+	if (!bulk->num_lines || !timespec_to_nsec(&config->period)) {
+		set_last_error(EINVAL);
+		return NULL;
+	}
+
+	sampler = zalloc(sizeof(*sampler));
+	if (!sampler)
+		return NULL;
+
+	ring_size = round_up_pow2(config->ring_size ? config->ring_size
+						    : SAMPLER_DEFAULT_RING_SIZE);
+
+	sampler->ring = zalloc(ring_size * sizeof(*sampler->ring));
+	if (!sampler->ring) {
+		free(sampler);
+		return NULL;
+	}
+
+	sampler->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (sampler->evfd < 0) {
+		last_error_from_errno();
+		free(sampler->ring);
+		free(sampler);
+		return NULL;
+	}
+
+	memcpy(&sampler->bulk, bulk, sizeof(*bulk));
+	sampler->period_ns = timespec_to_nsec(&config->period);
+	sampler->batch_size = config->batch_size ? config->batch_size : 1;
+	sampler->ring_mask = ring_size - 1;
+
+	return sampler;
+}
+
+void gpiod_sampler_free(struct gpiod_sampler *sampler)
+{
+	gpiod_sampler_stop(sampler);
+
+	close(sampler->evfd);
+	free(sampler->ring);
+	free(sampler);
+}
+
+int gpiod_sampler_start(struct gpiod_sampler *sampler)
+{
+	int status;
+
+	if (sampler->state == SAMPLER_RUNNING) {
+		set_last_error(EBUSY);
+		return -1;
+	}
+
+	if (!line_bulk_is_reserved(&sampler->bulk) &&
+	    !line_bulk_is_event_configured(&sampler->bulk)) {
+		set_last_error(GPIOD_EREQUEST);
+		return -1;
+	}
+
+	sampler->stop = false;
+	sampler->error = 0;
+	memset(&sampler->stats, 0, sizeof(sampler->stats));
+
+	status = pthread_create(&sampler->thread, NULL,
+				sampler_thread, sampler);
+	if (status) {
+		set_last_error(status);
+		return -1;
+	}
+
+	sampler->state = SAMPLER_RUNNING;
+
+	return 0;
+}
+
+void gpiod_sampler_stop(struct gpiod_sampler *sampler)
+{
+	if (sampler->state != SAMPLER_RUNNING)
+		return;
+
+	__atomic_store_n(&sampler->stop, true, __ATOMIC_RELEASE);
+	pthread_join(sampler->thread, NULL);
+
+	sampler->state = SAMPLER_STOPPED;
+}
+
+int gpiod_sampler_get_fd(struct gpiod_sampler *sampler)
+{
+	return sampler->evfd;
+}
+
+int gpiod_sampler_wait(struct gpiod_sampler *sampler,
+		       const struct timespec *timeout)
+{
+	struct pollfd pfd;
+	uint64_t val;
+	ssize_t rd;
+	int status;
+
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.fd = sampler->evfd;
+	pfd.events = POLLIN;
+
+	status = ppoll(&pfd, 1, timeout, NULL);
+	if (status < 0) {
+		last_error_from_errno();
+		return -1;
+	} else if (status == 0) {
+		return 0;
+	}
+
+	rd = read(sampler->evfd, &val, sizeof(val));
+	if (rd < 0 && errno != EAGAIN) {
+		last_error_from_errno();
+		return -1;
+	}
+
+	return 1;
+}
+
+int gpiod_sampler_read(struct gpiod_sampler *sampler,
+		       struct gpiod_sample *samples, unsigned int num_samples)
+{
+	unsigned int head, tail, count, i;
+	int error;
+
+	tail = sampler->tail;
+	head = __atomic_load_n(&sampler->head, __ATOMIC_ACQUIRE);
+
+	count = head - tail;
+	if (count > num_samples)
+		count = num_samples;
+
+	if (!count) {
+		error = __atomic_load_n(&sampler->error, __ATOMIC_ACQUIRE);
+		if (error) {
+			set_last_error(error);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	for (i = 0; i < count; i++)
+		samples[i] = sampler->ring[(tail + i) & sampler->ring_mask];
+
+	__atomic_store_n(&sampler->tail, tail + count, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+void gpiod_sampler_get_stats(struct gpiod_sampler *sampler,
+			     struct gpiod_sampler_stats *stats)
+{
+	uint64_t num_samples;
+
+	memset(stats, 0, sizeof(*stats));
+
+	num_samples = stat_get(&sampler->stats.num_samples);
+
+	stats->num_samples = num_samples;
+	stats->missed_deadlines = stat_get(&sampler->stats.missed_deadlines);
+	stats->overruns = stat_get(&sampler->stats.overruns);
+	nsec_to_timespec(stat_get(&sampler->stats.jitter_max_ns),
+			 &stats->jitter_max);
+	if (num_samples > 1)
+		nsec_to_timespec(stat_get(&sampler->stats.jitter_sum_ns) /
+				 (num_samples - 1), &stats->jitter_mean);
+}
@@ -0,0 +1,640 @@
+/*
+ * Timed output scheduler for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+
+/*
+ * Pending actions are kept in a hierarchical timer wheel: SCHED_LEVELS
+ * levels of SCHED_SLOTS slots each. Level 0 has a resolution of a single
+ * tick, every next level is SCHED_SLOTS times coarser. Entries from higher
+ * levels are cascaded down every time the lower level wraps around. Actions
+ * further in the future than the wheel can represent are parked in the last
+ * slot of the top level and re-examined on each cascade.
+ */
+#define SCHED_LEVEL_BITS	6
+#define SCHED_SLOTS		(1 << SCHED_LEVEL_BITS)
+#define SCHED_SLOT_MASK		(SCHED_SLOTS - 1)
+#define SCHED_LEVELS		4
+#define SCHED_MAX_TICKS		((1ULL << (SCHED_LEVELS * SCHED_LEVEL_BITS)) - 1)
+
+/*
+ * Action identifiers returned to the user encode the index of the action in
+ * the internal array and a generation counter protecting against cancelling
+ * a slot that has been recycled in the meantime.
+ */
+#define SCHED_IDX_BITS		20
+#define SCHED_IDX_MASK		((1L << SCHED_IDX_BITS) - 1)
+#define SCHED_GEN_MASK		((1UL << (sizeof(long) * 8 - SCHED_IDX_BITS - 1)) - 1)
+#define SCHED_MAX_ACTIONS	(1 << SCHED_IDX_BITS)
+
+#define SCHED_NONE		-1
+#define SCHED_DISARMED		UINT64_MAX
+
+#define SCHED_DEFAULT_TICK_NS	1000000ULL
+
+/*
+ * Number of request handles whose values are collected before they're
+ * written out during a single tick. If a tick touches more handles, the
+ * collected values are written out and the collection starts over.
+ */
+#define SCHED_MAX_GROUPS	64
+
+struct sched_action {
+	uint64_t expires;
+	struct gpiod_line *line;
+	int value;
+	unsigned long gen;
+	int slot;
+	int next;
+	int prev;
+};
+
+/*
+ * Lines sharing a single request handle whose values will be set with one
+ * ioctl() during a single tick.
+ */
+struct sched_group {
+	struct gpiod_line *line;
+	unsigned long long mask;
+	unsigned long long values;
+};
+
+struct gpiod_sched {
+	int timerfd;
+	uint64_t tick_ns;
+	uint64_t start_ns;
+	uint64_t now;
+	uint64_t cascaded;
+	uint64_t armed;
+	unsigned int num_pending;
+	int slots[SCHED_LEVELS * SCHED_SLOTS];
+	struct sched_action *actions;
+	unsigned int num_actions;
+	int free_list;
+	struct sched_group groups[SCHED_MAX_GROUPS];
+	unsigned int num_groups;
+};
+
+static uint64_t sched_current_tick(struct gpiod_sched *sched)
+{
+	return (monotonic_nsec() - sched->start_ns) / sched->tick_ns;
+}
+
+static long sched_action_id(struct gpiod_sched *sched, int idx)
+{
+	return (long)((sched->actions[idx].gen << SCHED_IDX_BITS) | idx);
+}
+
+static void sched_slot_link(struct gpiod_sched *sched, int idx, int slot)
+{
+	struct sched_action *action = &sched->actions[idx];
+
+	action->slot = slot;
+	action->prev = SCHED_NONE;
+	action->next = sched->slots[slot];
+	if (action->next != SCHED_NONE)
+		sched->actions[action->next].prev = idx;
+	sched->slots[slot] = idx;
+}
+
+static void sched_slot_unlink(struct gpiod_sched *sched, int idx)
+{
+	struct sched_action *action = &sched->actions[idx];
+
+	if (action->prev != SCHED_NONE)
+		sched->actions[action->prev].next = action->next;
+	else
+		sched->slots[action->slot] = action->next;
+
+	if (action->next != SCHED_NONE)
+		sched->actions[action->next].prev = action->prev;
+
+	action->slot = SCHED_NONE;
+}
+
+static void sched_wheel_add(struct gpiod_sched *sched, int idx)
+{
+	struct sched_action *action = &sched->actions[idx];
+	uint64_t expires = action->expires, delta;
+	unsigned int level, shift;
+
+	if (expires < sched->now)
+		expires = sched->now;
+
+	delta = expires - sched->now;
+	if (delta > SCHED_MAX_TICKS) {
+		delta = SCHED_MAX_TICKS;
+		expires = sched->now + delta;
+	}
+
+	for (level = 0; level < SCHED_LEVELS - 1; level++) {
+		if (delta < (1ULL << ((level + 1) * SCHED_LEVEL_BITS)))
+			break;
+	}
+
+	shift = level * SCHED_LEVEL_BITS;
+	sched_slot_link(sched, idx, level * SCHED_SLOTS +
+			((expires >> shift) & SCHED_SLOT_MASK));
+}
+
+/* Move all entries from given slot one or more levels down the wheel. */
+static unsigned int sched_cascade(struct gpiod_sched *sched,
+				  unsigned int level)
+{
+	unsigned int index;
+	int idx, next;
+
+	index = (sched->now >> (level * SCHED_LEVEL_BITS)) & SCHED_SLOT_MASK;
+
+	idx = sched->slots[level * SCHED_SLOTS + index];
+	sched->slots[level * SCHED_SLOTS + index] = SCHED_NONE;
+
+	for (; idx != SCHED_NONE; idx = next) {
+		next = sched->actions[idx].next;
+		sched_wheel_add(sched, idx);
+	}
+
+	return index;
+}
+
+/*
+ * If the current tick starts a new round of the lowest level, move the
+ * entries due in this round down from the upper levels. This is done at most
+ * once per tick.
+ */
+static void sched_cascade_now(struct gpiod_sched *sched)
+{
+	unsigned int index, level;
+
+	if ((sched->now & SCHED_SLOT_MASK) || sched->cascaded == sched->now)
+		return;
+
+	for (index = 0, level = 1; !index && level < SCHED_LEVELS; level++)
+		index = sched_cascade(sched, level);
+
+	sched->cascaded = sched->now;
+}
+
+/* Earliest expiry tick of the actions in given slot. */
+static uint64_t sched_slot_min_expiry(struct gpiod_sched *sched,
+				      unsigned int slot)
+{
+	uint64_t min = UINT64_MAX;
+	int idx;
+
+	for (idx = sched->slots[slot]; idx != SCHED_NONE;
+	     idx = sched->actions[idx].next) {
+		if (sched->actions[idx].expires < min)
+			min = sched->actions[idx].expires;
+	}
+
+	return min;
+}
+
+static int sched_alloc_action(struct gpiod_sched *sched)
+{
+	struct sched_action *actions;
+	unsigned int num, i;
+	int idx;
+
+	if (sched->free_list == SCHED_NONE) {
+		if (sched->num_actions >= SCHED_MAX_ACTIONS) {
+			set_last_error(ENOSPC);
+			return -1;
+		}
+
+		num = sched->num_actions ? sched->num_actions * 2 : 64;
+		if (num > SCHED_MAX_ACTIONS)
+			num = SCHED_MAX_ACTIONS;
+
+		actions = realloc(sched->actions, num * sizeof(*actions));
+		if (!actions) {
+			set_last_error(ENOMEM);
+			return -1;
+		}
+
+		memset(&actions[sched->num_actions], 0,
+		       (num - sched->num_actions) * sizeof(*actions));
+
+		for (i = sched->num_actions; i < num; i++) {
+			actions[i].gen = 1;
+			actions[i].slot = SCHED_NONE;
+			actions[i].next = i + 1 < num ? (int)i + 1 : SCHED_NONE;
+		}
+
+		sched->free_list = sched->num_actions;
+		sched->actions = actions;
+		sched->num_actions = num;
+	}
+
+	idx = sched->free_list;
+	sched->free_list = sched->actions[idx].next;
+
+	return idx;
+}
+
+static void sched_free_action(struct gpiod_sched *sched, int idx)
+{
+	struct sched_action *action = &sched->actions[idx];
+
+	/* Generation 0 is never used so that valid identifiers are positive. */
+	action->gen = (action->gen + 1) & SCHED_GEN_MASK;
+	if (!action->gen)
+		action->gen = 1;
+	action->line = NULL;
+	action->slot = SCHED_NONE;
+	action->next = sched->free_list;
+	sched->free_list = idx;
+}
+
+static int sched_arm(struct gpiod_sched *sched, uint64_t tick)
+{
+	struct itimerspec its;
+	int status;
+
+	if (tick == sched->armed)
+		return 0;
+
+	memset(&its, 0, sizeof(its));
+	if (tick != SCHED_DISARMED)
+		nsec_to_timespec(sched->start_ns + tick * sched->tick_ns,
+				 &its.it_value);
+
+	status = timerfd_settime(sched->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+	if (status < 0) {
+		last_error_from_errno();
+		return -1;
+	}
+
+	sched->armed = tick;
+
+	return 0;
+}
+
+/*
+ * Figure out when the timerfd must fire next, which is the tick at which the
+ * earliest pending action expires.
+ *
+ * Entries of the lowest level expire at the tick of their slot. Slots of the
+ * upper levels are visited in the order in which they'll be cascaded, so the
+ * first non-empty slot of each level holds the earliest entries of that
+ * level. The wheel is cascaded first if the current tick starts a new round
+ * so that no level holds entries due in the current round of the level below
+ * it.
+ */
+static uint64_t sched_next_tick(struct gpiod_sched *sched)
+{
+	unsigned int level, index, shift, i;
+	uint64_t next = UINT64_MAX, min;
+
+	if (!sched->num_pending)
+		return SCHED_DISARMED;
+
+	sched_cascade_now(sched);
+
+	index = sched->now & SCHED_SLOT_MASK;
+	for (i = 0; i < SCHED_SLOTS; i++) {
+		if (sched->slots[(index + i) & SCHED_SLOT_MASK] != SCHED_NONE) {
+			next = sched->now + i;
+			break;
+		}
+	}
+
+	for (level = 1; level < SCHED_LEVELS; level++) {
+		shift = level * SCHED_LEVEL_BITS;
+		index = (sched->now >> shift) & SCHED_SLOT_MASK;
+
+		for (i = 1; i <= SCHED_SLOTS; i++) {
+			min = sched_slot_min_expiry(sched, level * SCHED_SLOTS +
+					((index + i) & SCHED_SLOT_MASK));
+			if (min == UINT64_MAX)
+				continue;
+
+			if (min < next)
+				next = min;
+			break;
+		}
+	}
+
+	return next < sched->now ? sched->now : next;
+}
+
+/*
+ * Write out the values collected for all groups. Lines we don't touch keep
+ * their last written values and groups which don't change anything don't
+ * cost an ioctl().
+ */
+static void sched_flush_groups(struct gpiod_sched *sched, int *error)
+{
+	struct sched_group *group;
+	unsigned int i;
+	int status;
+
+	for (i = 0; i < sched->num_groups; i++) {
+		group = &sched->groups[i];
+
+		status = gpiod_line_set_value_mask(group->line, group->mask,
+						   group->values);
+		if (status < 0)
+			*error = gpiod_errno();
+	}
+
+	sched->num_groups = 0;
+}
+
+static struct sched_group * sched_find_group(struct gpiod_sched *sched,
+					     struct gpiod_line *line,
+					     int *error)
+{
+	struct sched_group *group;
+	unsigned int i;
+
+	for (i = 0; i < sched->num_groups; i++) {
+		if (sched->groups[i].line->handle == line->handle)
+			return &sched->groups[i];
+	}
+
+	if (sched->num_groups >= SCHED_MAX_GROUPS)
+		sched_flush_groups(sched, error);
+
+	group = &sched->groups[sched->num_groups++];
+	group->line = line;
+	group->mask = 0;
+	group->values = 0;
+
+	return group;
+}
+
+static void sched_group_set(struct sched_group *group,
+			    struct gpiod_line *line, int value)
+{
+	unsigned long long bit = 1ULL << line_handle_index(line);
+
+	group->mask |= bit;
+	if (value)
+		group->values |= bit;
+	else
+		group->values &= ~bit;
+}
+
+/*
+ * Execute all actions due in a single tick, coalescing the ones which
+ * operate on the same request handle into one bulk set.
+ */
+static int sched_run_list(struct gpiod_sched *sched, int idx, int *error)
+{
+	struct sched_action *action;
+	struct sched_group *group;
+	int next, count = 0;
+
+	for (; idx != SCHED_NONE; idx = next) {
+		action = &sched->actions[idx];
+		next = action->next;
+
+		if (!gpiod_line_is_reserved(action->line)) {
+			*error = GPIOD_EREQUEST;
+		} else {
+			group = sched_find_group(sched, action->line, error);
+			sched_group_set(group, action->line, action->value);
+		}
+
+		sched_free_action(sched, idx);
+		sched->num_pending--;
+		count++;
+	}
+
+	sched_flush_groups(sched, error);
+
+	return count;
+}
+
+/*
+ * Actions are pushed onto the slot lists at the head, so reverse the list to
+ * execute actions which went straight to the lowest level of the wheel in
+ * the order in which they were added.
+ */
+static int sched_reverse_list(struct gpiod_sched *sched, int idx)
+{
+	int prev = SCHED_NONE, next;
+
+	for (; idx != SCHED_NONE; idx = next) {
+		next = sched->actions[idx].next;
+		sched->actions[idx].next = prev;
+		prev = idx;
+	}
+
+	return prev;
+}
+
+struct gpiod_sched * gpiod_sched_new(const struct timespec *tick)
+{
+	struct gpiod_sched *sched;
+	unsigned int i;
+
+	sched = zalloc(sizeof(*sched));
+	if (!sched)
+		return NULL;
+
+	sched->tick_ns = tick ? timespec_to_nsec(tick) : SCHED_DEFAULT_TICK_NS;
+	if (sched->tick_ns == 0) {
+		set_last_error(EINVAL);
+		free(sched);
+		return NULL;
+	}
+
+	sched->timerfd = timerfd_create(CLOCK_MONOTONIC,
+					TFD_NONBLOCK | TFD_CLOEXEC);
+	if (sched->timerfd < 0) {
+		last_error_from_errno();
+		free(sched);
+		return NULL;
+	}
+
+	for (i = 0; i < SCHED_LEVELS * SCHED_SLOTS; i++)
+		sched->slots[i] = SCHED_NONE;
+
+	sched->free_list = SCHED_NONE;
+	sched->cascaded = SCHED_DISARMED;
+	sched->armed = SCHED_DISARMED;
+	sched->start_ns = monotonic_nsec();
+
+	return sched;
+}
+
+void gpiod_sched_free(struct gpiod_sched *sched)
+{
+	close(sched->timerfd);
+	free(sched->actions);
+	free(sched);
+}
+
+int gpiod_sched_get_fd(struct gpiod_sched *sched)
+{
+	return sched->timerfd;
+}
+
+unsigned int gpiod_sched_num_pending(struct gpiod_sched *sched)
+{
+	return sched->num_pending;
+}
+
+long gpiod_sched_add(struct gpiod_sched *sched, struct gpiod_line *line,
+		     int value, const struct timespec *delay)
+{
+	struct sched_action *action;
+	uint64_t ticks, now, next;
+	int idx;
+
+	if (!gpiod_line_is_reserved(line)) {
+		set_last_error(GPIOD_EREQUEST);
+		return -1;
+	}
+
+	idx = sched_alloc_action(sched);
+	if (idx < 0)
+		return -1;
+
+	/* Round up - actions must never fire early. */
+	now = monotonic_nsec() - sched->start_ns;
+	ticks = now + (delay ? timespec_to_nsec(delay) : 0);
+	ticks = (ticks + sched->tick_ns - 1) / sched->tick_ns;
+
+	/* Nothing in the wheel - fast-forward it to the current tick. */
+	if (!sched->num_pending)
+		sched->now = now / sched->tick_ns;
+
+	action = &sched->actions[idx];
+	action->expires = ticks;
+	action->line = line;
+	action->value = !!value;
+
+	sched_wheel_add(sched, idx);
+	sched->num_pending++;
+
+	next = sched_next_tick(sched);
+	if (next < sched->armed && sched_arm(sched, next) < 0) {
+		sched_slot_unlink(sched, idx);
+		sched_free_action(sched, idx);
+		sched->num_pending--;
+		return -1;
+	}
+
+	return sched_action_id(sched, idx);
+}
+
+int gpiod_sched_cancel(struct gpiod_sched *sched, long id)
+{
+	struct sched_action *action;
+	unsigned long gen;
+	int idx;
+
+	idx = id & SCHED_IDX_MASK;
+	gen = (unsigned long)id >> SCHED_IDX_BITS;
+
+	if (id < 0 || (unsigned int)idx >= sched->num_actions) {
+		set_last_error(EINVAL);
+		return -1;
+	}
+
+	action = &sched->actions[idx];
+	if (action->gen != gen || action->slot == SCHED_NONE) {
+		set_last_error(ENOENT);
+		return -1;
+	}
+
+	sched_slot_unlink(sched, idx);
+	sched_free_action(sched, idx);
+	sched->num_pending--;
+
+	/*
+	 * Failing to re-arm the timer is not fatal - at worst we'll get one
+	 * spurious wakeup.
+	 */
+	sched_arm(sched, sched_next_tick(sched));
+
+	return 0;
+}
+
+int gpiod_sched_wait(struct gpiod_sched *sched, const struct timespec *timeout)
+{
+	struct pollfd pfd;
+	int status;
+
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.fd = sched->timerfd;
+	pfd.events = POLLIN;
+
+	status = ppoll(&pfd, 1, timeout, NULL);
+	if (status < 0) {
+		last_error_from_errno();
+		return -1;
+	}
+
+	return status > 0 ? 1 : 0;
+}
+
+int gpiod_sched_dispatch(struct gpiod_sched *sched)
+{
+	uint64_t target, expirations;
+	unsigned int index;
+	int idx, count = 0, error = 0;
+	ssize_t rd;
+
+	rd = read(sched->timerfd, &expirations, sizeof(expirations));
+	if (rd < 0 && errno != EAGAIN) {
+		last_error_from_errno();
+		return -1;
+	}
+
+	/* The timer has fired, it's no longer armed. */
+	sched->armed = SCHED_DISARMED;
+
+	target = sched_current_tick(sched);
+
+	if (!sched->num_pending) {
+		sched->now = target + 1;
+		return 0;
+	}
+
+	while (sched->now <= target && sched->num_pending) {
+		sched_cascade_now(sched);
+
+		index = sched->now & SCHED_SLOT_MASK;
+		idx = sched->slots[index];
+		sched->slots[index] = SCHED_NONE;
+		sched->now++;
+
+		if (idx != SCHED_NONE)
+			count += sched_run_list(sched,
+						sched_reverse_list(sched, idx),
+						&error);
+	}
+
+	if (!sched->num_pending)
+		sched->now = target + 1;
+
+	if (sched_arm(sched, sched_next_tick(sched)) < 0)
+		return -1;
+
+	if (error) {
+		set_last_error(error);
+		return -1;
+	}
+
+	return count;
+}
@@ -0,0 +1,546 @@
+/*
+ * Shared memory snapshots of line values for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC		"GPIODSNP"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_CACHE_LINE	64
+#define SNAPSHOT_CHIP_NAME_MAX	32
+/* How often the event-driven publisher refreshes the heartbeat. */
+#define SNAPSHOT_IDLE_NS	50000000ULL
+#define SNAPSHOT_READ_RETRIES	1000
+
+enum {
+	PUBLISHER_STOPPED = 0,
+	PUBLISHER_RUNNING,
+};
+
+/*
+ * Layout of the shared memory object. The description of the lines never
+ * changes after creation. The values and change timestamps are protected
+ * by the sequence counter which is odd while the publisher is updating
+ * them. The heartbeat lives in its own cache line so that refreshing it
+ * doesn't invalidate the values cached by the readers.
+ */
+struct snapshot_shm {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_lines;
+	char chip[SNAPSHOT_CHIP_NAME_MAX];
+	uint32_t offsets[GPIOD_REQUEST_MAX_LINES];
+
+	uint64_t heartbeat __attribute__((aligned(SNAPSHOT_CACHE_LINE)));
+
+	uint64_t seq __attribute__((aligned(SNAPSHOT_CACHE_LINE)));
+	uint64_t values;
+	uint64_t changed[GPIOD_REQUEST_MAX_LINES];
+};
+
+struct gpiod_publisher {
+	struct gpiod_line_bulk bulk;
+	uint64_t period_ns;
+	char *name;
+	int fd;
+	struct snapshot_shm *shm;
+	pthread_t thread;
+	int state;
+	bool stop;
+	int error;
+};
+
+struct gpiod_snapshot_reader {
+	int fd;
+	const struct snapshot_shm *shm;
+	/* Checked once - the object can be written by anyone. */
+	unsigned int num_lines;
+};
+
+static void publisher_heartbeat(struct gpiod_publisher *pub)
+{
+	__atomic_store_n(&pub->shm->heartbeat, monotonic_nsec(),
+			 __ATOMIC_RELEASE);
+}
+
+/*
+ * Store the values of the lines that changed or are in force. The
+ * timestamp of the change of line i is timestamps[i].
+ */
+static void publisher_update(struct gpiod_publisher *pub, uint64_t values,
+			     const uint64_t *timestamps, uint64_t force)
+{
+	struct snapshot_shm *shm = pub->shm;
+	uint64_t seq, changed;
+	unsigned int i;
+
+	changed = (values ^ shm->values) | force;
+	if (!changed)
+		return;
+
+	seq = shm->seq;
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	shm->values = values;
+	for (i = 0; i < shm->num_lines; i++) {
+		if (changed & (1ULL << i))
+			shm->changed[i] = timestamps[i];
+	}
+
+	__atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static int publisher_read_values(struct gpiod_publisher *pub,
+				 uint64_t *mask)
+{
+	int values[GPIOD_REQUEST_MAX_LINES];
+	unsigned int i;
+	int status;
+
+	status = gpiod_line_get_value_bulk(&pub->bulk, values);
+	if (status < 0)
+		return -1;
+
+	*mask = 0;
+	for (i = 0; i < pub->bulk.num_lines; i++) {
+		if (values[i])
+			*mask |= 1ULL << i;
+	}
+
+	return 0;
+}
+
+static int publisher_sample(struct gpiod_publisher *pub)
+{
+	uint64_t timestamps[GPIOD_REQUEST_MAX_LINES];
+	uint64_t before, ts, values;
+	unsigned int i;
+	int status;
+
+	before = monotonic_nsec();
+	status = publisher_read_values(pub, &values);
+	if (status < 0)
+		return -1;
+
+	/* Timestamp the sample in the middle of the ioctl() call. */
+	ts = before + (monotonic_nsec() - before) / 2;
+	for (i = 0; i < pub->bulk.num_lines; i++)
+		timestamps[i] = ts;
+
+	publisher_update(pub, values, timestamps, 0);
+	publisher_heartbeat(pub);
+
+	return 0;
+}
+
+static void publisher_run_sampled(struct gpiod_publisher *pub)
+{
+	struct timespec deadline_ts;
+	uint64_t deadline, now;
+	int status;
+
+	deadline = monotonic_nsec();
+
+	while (!__atomic_load_n(&pub->stop, __ATOMIC_ACQUIRE)) {
+		nsec_to_timespec(deadline, &deadline_ts);
+
+		do {
+			status = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						 &deadline_ts, NULL);
+		} while (status == EINTR);
+
+		status = publisher_sample(pub);
+		if (status < 0) {
+			__atomic_store_n(&pub->error, gpiod_errno(),
+					 __ATOMIC_RELEASE);
+			return;
+		}
+
+		/* Skip the deadlines that already passed. */
+		deadline += pub->period_ns;
+		now = monotonic_nsec();
+		if (now > deadline)
+			deadline += (now - deadline) / pub->period_ns *
+				    pub->period_ns + pub->period_ns;
+	}
+}
+
+/* Fold the events of one line into the values about to be published. */
+static int publisher_read_events(struct gpiod_publisher *pub,
+				 struct gpiod_line *line, uint64_t *values,
+				 uint64_t *timestamps)
+{
+	struct gpiod_line_event events[GPIOD_EVENT_READ_MAX];
+	unsigned int i;
+	uint64_t bit;
+	int num;
+
+	for (i = 0; i < pub->bulk.num_lines; i++) {
+		if (pub->bulk.lines[i] == line)
+			break;
+	}
+
+	num = gpiod_line_event_read_multiple(line, events,
+					     GPIOD_EVENT_READ_MAX);
+	if (num < 0)
+		return -1;
+
+	/* Only the last event matters - it gives the current value. */
+	bit = 1ULL << i;
+	*values &= ~bit;
+	if (events[num - 1].event_type == GPIOD_EVENT_RISING_EDGE)
+		*values |= bit;
+
+	timestamps[i] = timespec_to_nsec(&events[num - 1].ts);
+
+	return 0;
+}
+
+static void publisher_run_events(struct gpiod_publisher *pub)
+{
+	uint64_t timestamps[GPIOD_REQUEST_MAX_LINES];
+	struct gpiod_line_bulk ready;
+	struct timespec idle;
+	uint64_t values;
+	unsigned int i;
+	int status;
+
+	nsec_to_timespec(SNAPSHOT_IDLE_NS, &idle);
+
+	while (!__atomic_load_n(&pub->stop, __ATOMIC_ACQUIRE)) {
+		/* Every ready line is served so that none of them starves. */
+		status = line_event_wait_all(&pub->bulk, &idle, &ready);
+		values = pub->shm->values;
+
+		for (i = 0; status > 0 && i < ready.num_lines; i++)
+			status = publisher_read_events(pub, ready.lines[i],
+						       &values, timestamps);
+		if (status < 0) {
+			__atomic_store_n(&pub->error, gpiod_errno(),
+					 __ATOMIC_RELEASE);
+			return;
+		}
+
+		publisher_update(pub, values, timestamps, 0);
+		publisher_heartbeat(pub);
+	}
+}
+
+static void * publisher_thread(void *data)
+{
+	struct gpiod_publisher *pub = data;
+
+	if (pub->period_ns)
+		publisher_run_sampled(pub);
+	else
+		publisher_run_events(pub);
+
+	return NULL;
+}
+
+struct gpiod_publisher *
+gpiod_publisher_new(struct gpiod_line_bulk *bulk,
+		    const struct gpiod_publisher_config *config)
+{
+	struct gpiod_publisher *pub;
+	struct gpiod_chip *chip;
+	unsigned int i;
+	mode_t mode;
+	int status;
+
+	if (!bulk->num_lines || !config->name) {
+		set_last_error(EINVAL);
+		return NULL;
+	}
+
+	pub = zalloc(sizeof(*pub));
+	if (!pub)
+		return NULL;
+
+	pub->name = strdup(config->name);
+	if (!pub->name) {
+		set_last_error(ENOMEM);
+		goto err_free;
+	}
+
+	/* Never take over the object of another publisher. */
+	mode = config->mode ? config->mode : 0644;
+	pub->fd = shm_open(config->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+			   mode);
+	if (pub->fd < 0) {
+		last_error_from_errno();
+		goto err_free_name;
+	}
+
+	status = ftruncate(pub->fd, sizeof(*pub->shm));
+	if (status < 0) {
+		last_error_from_errno();
+		goto err_unlink;
+	}
+
+	pub->shm = mmap(NULL, sizeof(*pub->shm), PROT_READ | PROT_WRITE,
+			MAP_SHARED, pub->fd, 0);
+	if (pub->shm == MAP_FAILED) {
+		last_error_from_errno();
+		goto err_unlink;
+	}
+
+	memcpy(&pub->bulk, bulk, sizeof(*bulk));
+	pub->period_ns = timespec_to_nsec(&config->period);
+
+	chip = gpiod_line_get_chip(bulk->lines[0]);
+	strncpy(pub->shm->chip, gpiod_chip_name(chip),
+		sizeof(pub->shm->chip) - 1);
+	pub->shm->num_lines = bulk->num_lines;
+	for (i = 0; i < bulk->num_lines; i++)
+		pub->shm->offsets[i] = gpiod_line_offset(bulk->lines[i]);
+	pub->shm->version = SNAPSHOT_VERSION;
+
+	/* Readers check the magic last. */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(pub->shm->magic, SNAPSHOT_MAGIC, sizeof(pub->shm->magic));
+
+	return pub;
+
+err_unlink:
+	shm_unlink(pub->name);
+	close(pub->fd);
+err_free_name:
+	free(pub->name);
+err_free:
+	free(pub);
+
+	return NULL;
+}
+
+void gpiod_publisher_free(struct gpiod_publisher *pub)
+{
+	gpiod_publisher_stop(pub);
+
+	munmap(pub->shm, sizeof(*pub->shm));
+	shm_unlink(pub->name);
+	close(pub->fd);
+	free(pub->name);
+	free(pub);
+}
+
+int gpiod_publisher_start(struct gpiod_publisher *pub)
+{
+	uint64_t timestamps[GPIOD_REQUEST_MAX_LINES];
+	uint64_t values, now;
+	struct timespec ts;
+	unsigned int i;
+	int status;
+
+	if (pub->state == PUBLISHER_RUNNING) {
+		set_last_error(EBUSY);
+		return -1;
+	}
+
+	if (pub->period_ns) {
+		if (!line_bulk_is_reserved(&pub->bulk) &&
+		    !line_bulk_is_event_configured(&pub->bulk)) {
+			set_last_error(GPIOD_EREQUEST);
+			return -1;
+		}
+	} else if (!line_bulk_is_event_configured(&pub->bulk)) {
+		set_last_error(GPIOD_EEVREQUEST);
+		return -1;
+	} else {
+		/* The level can only be tracked if events come for both edges. */
+		for (i = 0; i < pub->bulk.num_lines; i++) {
+			if (!line_event_is_both_edges(pub->bulk.lines[i])) {
+				set_last_error(EINVAL);
+				return -1;
+			}
+		}
+	}
+
+	/* Events only tell what changed - start from the current values. */
+	status = publisher_read_values(pub, &values);
+	if (status < 0)
+		return -1;
+
+	/*
+	 * Changes seen by the event-driven publisher are timestamped with the
+	 * event clock which is CLOCK_REALTIME, also for polled lines.
+	 */
+	if (pub->period_ns) {
+		now = monotonic_nsec();
+	} else {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		now = timespec_to_nsec(&ts);
+	}
+
+	for (i = 0; i < pub->bulk.num_lines; i++)
+		timestamps[i] = now;
+
+	publisher_update(pub, values, timestamps, ~0ULL);
+	publisher_heartbeat(pub);
+
+	pub->stop = false;
+	pub->error = 0;
+
+	status = pthread_create(&pub->thread, NULL, publisher_thread, pub);
+	if (status) {
+		set_last_error(status);
+		return -1;
+	}
+
+	pub->state = PUBLISHER_RUNNING;
+
+	return 0;
+}
+
+void gpiod_publisher_stop(struct gpiod_publisher *pub)
+{
+	if (pub->state != PUBLISHER_RUNNING)
+		return;
+
+	__atomic_store_n(&pub->stop, true, __ATOMIC_RELEASE);
+	pthread_join(pub->thread, NULL);
+
+	pub->state = PUBLISHER_STOPPED;
+}
+
+int gpiod_publisher_error(struct gpiod_publisher *pub)
+{
+	return __atomic_load_n(&pub->error, __ATOMIC_ACQUIRE);
+}
+
+struct gpiod_snapshot_reader * gpiod_snapshot_open(const char *name)
+{
+	struct gpiod_snapshot_reader *reader;
+	const struct snapshot_shm *shm;
+	struct stat st;
+	int status;
+
+	reader = zalloc(sizeof(*reader));
+	if (!reader)
+		return NULL;
+
+	reader->fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (reader->fd < 0) {
+		last_error_from_errno();
+		goto err_free;
+	}
+
+	status = fstat(reader->fd, &st);
+	if (status < 0) {
+		last_error_from_errno();
+		goto err_close;
+	}
+
+	if ((size_t)st.st_size < sizeof(*shm)) {
+		set_last_error(EINVAL);
+		goto err_close;
+	}
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, reader->fd, 0);
+	if (shm == MAP_FAILED) {
+		last_error_from_errno();
+		goto err_close;
+	}
+
+	if (memcmp(shm->magic, SNAPSHOT_MAGIC, sizeof(shm->magic)) != 0 ||
+	    shm->version != SNAPSHOT_VERSION) {
+		munmap((void *)shm, sizeof(*shm));
+		set_last_error(EINVAL);
+		goto err_close;
+	}
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	reader->num_lines = shm->num_lines;
+	if (!reader->num_lines ||
+	    reader->num_lines > GPIOD_REQUEST_MAX_LINES) {
+		munmap((void *)shm, sizeof(*shm));
+		set_last_error(EPROTO);
+		goto err_close;
+	}
+
+	reader->shm = shm;
+
+	return reader;
+
+err_close:
+	close(reader->fd);
+err_free:
+	free(reader);
+
+	return NULL;
+}
+
+void gpiod_snapshot_close(struct gpiod_snapshot_reader *reader)
+{
+	munmap((void *)reader->shm, sizeof(*reader->shm));
+	close(reader->fd);
+	free(reader);
+}
+
+unsigned int gpiod_snapshot_num_lines(struct gpiod_snapshot_reader *reader)
+{
+	return reader->num_lines;
+}
+
+unsigned int gpiod_snapshot_offset(struct gpiod_snapshot_reader *reader,
+				   unsigned int index)
+{
+	return reader->shm->offsets[index];
+}
+
+const char * gpiod_snapshot_chip_name(struct gpiod_snapshot_reader *reader)
+{
+	return reader->shm->chip;
+}
+
+int gpiod_snapshot_read(struct gpiod_snapshot_reader *reader,
+			struct gpiod_snapshot *snapshot)
+{
+	const struct snapshot_shm *shm = reader->shm;
+	unsigned int i, retries;
+	uint64_t seq;
+
+	for (retries = 0; retries < SNAPSHOT_READ_RETRIES; retries++) {
+		seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		snapshot->values = shm->values;
+		for (i = 0; i < reader->num_lines; i++)
+			nsec_to_timespec(shm->changed[i],
+					 &snapshot->changed[i]);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		snapshot->generation = seq / 2;
+		nsec_to_timespec(__atomic_load_n(&shm->heartbeat,
+						 __ATOMIC_ACQUIRE),
+				 &snapshot->heartbeat);
+
+		return 0;
+	}
+
+	/* The publisher is either very busy or died while updating. */
+	set_last_error(EAGAIN);
+	return -1;
+}
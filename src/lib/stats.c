@@ -0,0 +1,254 @@
+/*
+ * Performance statistics for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Counters are split into cache line aligned shards. Threads are assigned
+ * shards round-robin on their first update, so up to STATS_NUM_SHARDS
+ * threads never touch each other's counters. Threads sharing a shard still
+ * get correct results since all updates are atomic.
+ */
+#define STATS_NUM_SHARDS	8
+#define STATS_CACHE_LINE	64
+
+struct stats_shard {
+	struct {
+		uint64_t count;
+		uint64_t errors;
+		uint64_t total_ns;
+		uint64_t max_ns;
+		uint64_t hist[GPIOD_STATS_HIST_BUCKETS];
+	} ioctls[GPIOD_STATS_NUM_IOCTLS];
+	uint64_t reads;
+	uint64_t events_read;
+	uint64_t bytes_read;
+	uint64_t polls;
+	uint64_t poll_timeouts;
+} __attribute__((aligned(STATS_CACHE_LINE)));
+
+struct stats_block {
+	struct stats_shard shards[STATS_NUM_SHARDS];
+};
+
+static unsigned int next_shard;
+static __thread int thread_shard = -1;
+
+static struct stats_shard * stats_shard(struct stats_block *stats)
+{
+	if (thread_shard < 0)
+		thread_shard = __atomic_fetch_add(&next_shard, 1,
+						  __ATOMIC_RELAXED) %
+			       STATS_NUM_SHARDS;
+
+	return &stats->shards[thread_shard];
+}
+
+static void stat_add(uint64_t *stat, uint64_t val)
+{
+	__atomic_fetch_add(stat, val, __ATOMIC_RELAXED);
+}
+
+static uint64_t stat_get(uint64_t *stat)
+{
+	return __atomic_load_n(stat, __ATOMIC_RELAXED);
+}
+
+static void stat_max(uint64_t *stat, uint64_t val)
+{
+	uint64_t cur = stat_get(stat);
+
+	while (val > cur &&
+	       !__atomic_compare_exchange_n(stat, &cur, val, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static int stats_ioctl_type(unsigned long request)
+{
+	switch (request) {
+	case GPIO_GET_LINEINFO_IOCTL:
+		return GPIOD_STATS_IOCTL_LINEINFO;
+	case GPIO_GET_LINEHANDLE_IOCTL:
+		return GPIOD_STATS_IOCTL_LINEHANDLE;
+	case GPIO_GET_LINEEVENT_IOCTL:
+		return GPIOD_STATS_IOCTL_LINEEVENT;
+	case GPIOHANDLE_GET_LINE_VALUES_IOCTL:
+		return GPIOD_STATS_IOCTL_GET_VALUES;
+	case GPIOHANDLE_SET_LINE_VALUES_IOCTL:
+		return GPIOD_STATS_IOCTL_SET_VALUES;
+	default:
+		return -1;
+	}
+}
+
+static unsigned int stats_hist_bucket(uint64_t ns)
+{
+	unsigned int bucket;
+
+	bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+
+	return bucket < GPIOD_STATS_HIST_BUCKETS
+			? bucket : GPIOD_STATS_HIST_BUCKETS - 1;
+}
+
+struct stats_block * stats_new(void)
+{
+	struct stats_block *stats;
+	int status;
+
+	status = posix_memalign((void **)&stats, STATS_CACHE_LINE,
+				sizeof(*stats));
+	if (status) {
+		set_last_error(status);
+		return NULL;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+
+	return stats;
+}
+
+void stats_free(struct stats_block *stats)
+{
+	free(stats);
+}
+
+static void stats_add_ioctl_one(struct stats_block *stats, int type,
+				bool error, uint64_t ns)
+{
+	struct stats_shard *shard = stats_shard(stats);
+
+	stat_add(&shard->ioctls[type].count, 1);
+	if (error)
+		stat_add(&shard->ioctls[type].errors, 1);
+	stat_add(&shard->ioctls[type].total_ns, ns);
+	stat_max(&shard->ioctls[type].max_ns, ns);
+	stat_add(&shard->ioctls[type].hist[stats_hist_bucket(ns)], 1);
+}
+
+void stats_add_ioctl(struct stats_block *chip_stats,
+		     struct stats_block *req_stats,
+		     unsigned long request, bool error, uint64_t ns)
+{
+	int type;
+
+	type = stats_ioctl_type(request);
+	if (type < 0)
+		return;
+
+	stats_add_ioctl_one(chip_stats, type, error, ns);
+	if (req_stats)
+		stats_add_ioctl_one(req_stats, type, error, ns);
+}
+
+static void stats_add_read_one(struct stats_block *stats,
+			       unsigned int num_events, size_t bytes)
+{
+	struct stats_shard *shard = stats_shard(stats);
+
+	stat_add(&shard->reads, 1);
+	stat_add(&shard->events_read, num_events);
+	stat_add(&shard->bytes_read, bytes);
+}
+
+void stats_add_read(struct stats_block *chip_stats,
+		    struct stats_block *req_stats,
+		    unsigned int num_events, size_t bytes)
+{
+	stats_add_read_one(chip_stats, num_events, bytes);
+	if (req_stats)
+		stats_add_read_one(req_stats, num_events, bytes);
+}
+
+void stats_add_poll(struct stats_block *chip_stats, bool timeout)
+{
+	struct stats_shard *shard = stats_shard(chip_stats);
+
+	stat_add(&shard->polls, 1);
+	if (timeout)
+		stat_add(&shard->poll_timeouts, 1);
+}
+
+static void stats_collect(struct stats_block *stats, struct gpiod_stats *out)
+{
+	struct gpiod_ioctl_stats *ioctl;
+	struct stats_shard *shard;
+	unsigned int i, j, k;
+	uint64_t max;
+
+	memset(out, 0, sizeof(*out));
+
+	for (i = 0; i < STATS_NUM_SHARDS; i++) {
+		shard = &stats->shards[i];
+
+		for (j = 0; j < GPIOD_STATS_NUM_IOCTLS; j++) {
+			ioctl = &out->ioctls[j];
+
+			ioctl->count += stat_get(&shard->ioctls[j].count);
+			ioctl->errors += stat_get(&shard->ioctls[j].errors);
+			ioctl->total_ns += stat_get(&shard->ioctls[j].total_ns);
+
+			max = stat_get(&shard->ioctls[j].max_ns);
+			if (max > ioctl->max_ns)
+				ioctl->max_ns = max;
+
+			for (k = 0; k < GPIOD_STATS_HIST_BUCKETS; k++)
+				ioctl->hist[k] +=
+					stat_get(&shard->ioctls[j].hist[k]);
+		}
+
+		out->reads += stat_get(&shard->reads);
+		out->events_read += stat_get(&shard->events_read);
+		out->bytes_read += stat_get(&shard->bytes_read);
+		out->polls += stat_get(&shard->polls);
+		out->poll_timeouts += stat_get(&shard->poll_timeouts);
+	}
+}
+
+int gpiod_chip_enable_stats(struct gpiod_chip *chip)
+{
+	if (chip->stats)
+		return 0;
+
+	chip->stats = stats_new();
+	if (!chip->stats)
+		return -1;
+
+	return 0;
+}
+
+void gpiod_chip_get_stats(struct gpiod_chip *chip, struct gpiod_stats *stats)
+{
+	if (!chip->stats) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	stats_collect(chip->stats, stats);
+}
+
+int gpiod_line_get_stats(struct gpiod_line *line, struct gpiod_stats *stats)
+{
+	struct stats_block *req_stats;
+
+	req_stats = line_request_stats(line);
+	if (!req_stats) {
+		set_last_error(GPIOD_EREQUEST);
+		return -1;
+	}
+
+	stats_collect(req_stats, stats);
+
+	return 0;
+}
@@ -0,0 +1,886 @@
+/*
+ * Hold GPIO line requests on behalf of other processes.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "tools-common.h"
+#include "broker-proto.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Stop reading requests from clients that don't read their replies. */
+#define CLIENT_TX_MAX		(1024 * 1024)
+#define CLIENT_RX_SIZE		8192
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "socket",		required_argument,	NULL,	's' },
+	{ "background",		no_argument,		NULL,	'b' },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvs:b";
+
+static void print_help(void)
+{
+	printf("Usage: %s [OPTIONS]\n", get_progname());
+	printf("Keep GPIO lines requested on behalf of clients connecting over a unix socket\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -s, --socket=PATH:\tlisten on PATH (defaults to %s)\n",
+	       GPIOD_BROKER_SOCKET);
+	printf("  -b, --background:\tdetach from the controlling terminal once listening\n");
+	printf("\n");
+	printf("Clients use the gpiod_broker_*() functions of libgpiod. Identical requests\n");
+	printf("share the same lines, which stay requested until the last client holding\n");
+	printf("them releases them or disconnects.\n");
+}
+
+struct chip_entry {
+	char *descr;
+	struct gpiod_chip *chip;
+	/* Entries for other names of an already open chip don't own it. */
+	bool owner;
+};
+
+struct handle {
+	struct gpiod_chip *chip;
+	struct broker_request req;
+	struct gpiod_line_bulk bulk;
+	unsigned int refcount;
+};
+
+struct client {
+	int fd;
+	bool dead;
+
+	char rx[CLIENT_RX_SIZE];
+	size_t rx_len;
+
+	char *tx;
+	size_t tx_len;
+	size_t tx_size;
+
+	/* One entry per reference, the same handle can appear many times. */
+	uint32_t *handles;
+	unsigned int num_handles;
+	unsigned int handles_size;
+};
+
+struct broker {
+	int listen_fd;
+	int sigfd;
+
+	struct chip_entry *chips;
+	unsigned int num_chips;
+
+	/* Handle n lives at index n - 1, NULL slots are free. */
+	struct handle **handles;
+	unsigned int num_handles;
+
+	struct client **clients;
+	unsigned int num_clients;
+};
+
+enum {
+	SRC_SIGNAL,
+	SRC_LISTEN,
+	SRC_CLIENT,
+	SRC_EVENT,
+};
+
+struct poll_src {
+	int type;
+	struct client *client;
+	uint32_t handle;
+	struct gpiod_line *line;
+};
+
+static void * xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr)
+		die("out of memory");
+
+	return ptr;
+}
+
+static struct gpiod_chip * broker_get_chip(struct broker *broker,
+					   const char *descr)
+{
+	struct gpiod_chip *chip;
+	struct chip_entry *entry;
+	bool owner = true;
+	unsigned int i;
+
+	for (i = 0; i < broker->num_chips; i++) {
+		if (strcmp(broker->chips[i].descr, descr) == 0)
+			return broker->chips[i].chip;
+	}
+
+	chip = gpiod_chip_open_lookup(descr);
+	if (!chip)
+		return NULL;
+
+	/* The same chip may be known under its name, number or label. */
+	for (i = 0; i < broker->num_chips; i++) {
+		if (strcmp(gpiod_chip_name(broker->chips[i].chip),
+			   gpiod_chip_name(chip)) == 0) {
+			gpiod_chip_close(chip);
+			chip = broker->chips[i].chip;
+			owner = false;
+			break;
+		}
+	}
+
+	broker->chips = xrealloc(broker->chips, (broker->num_chips + 1) *
+						sizeof(*broker->chips));
+	entry = &broker->chips[broker->num_chips++];
+	entry->descr = strdup(descr);
+	if (!entry->descr)
+		die("out of memory");
+	entry->chip = chip;
+	entry->owner = owner;
+
+	return chip;
+}
+
+/*
+ * The default values are deliberately not compared: they only apply when
+ * the lines get requested, a client joining an existing request finds
+ * them at whatever values they currently have. A client that passed no
+ * default values can't be told apart from one that asked for zeroes, so
+ * refusing mismatches would make sharing output lines impossible.
+ */
+static bool handle_matches(struct handle *handle, struct gpiod_chip *chip,
+			   const struct broker_request *req)
+{
+	return handle->chip == chip &&
+	       handle->req.type == req->type &&
+	       handle->req.mode == req->mode &&
+	       handle->req.active_state == req->active_state &&
+	       handle->req.flags == req->flags &&
+	       handle->req.num_lines == req->num_lines &&
+	       memcmp(handle->req.offsets, req->offsets,
+		      req->num_lines * sizeof(req->offsets[0])) == 0;
+}
+
+static struct handle * broker_find_handle(struct broker *broker,
+					  uint32_t id)
+{
+	if (id == 0 || id > broker->num_handles)
+		return NULL;
+
+	return broker->handles[id - 1];
+}
+
+static int handle_request_lines(struct handle *handle)
+{
+	struct gpiod_line_request_config config;
+	struct gpiod_line_evreq_config evconfig;
+	const struct broker_request *req = &handle->req;
+	int values[GPIOD_REQUEST_MAX_LINES];
+	const char *consumer;
+	unsigned int i;
+
+	consumer = req->consumer[0] ? req->consumer : get_progname();
+
+	if (req->type == BROKER_REQUEST_EVENTS) {
+		/* Polled lines have no descriptor we could wait on. */
+		if (req->flags & (GPIOD_REQUEST_POLLED |
+				  GPIOD_REQUEST_POLLED_FALLBACK))
+			return EOPNOTSUPP;
+
+		memset(&evconfig, 0, sizeof(evconfig));
+		evconfig.consumer = consumer;
+		evconfig.event_type = req->mode;
+		evconfig.active_state = req->active_state;
+		evconfig.line_flags = req->flags;
+
+		if (gpiod_line_event_request_bulk(&handle->bulk, &evconfig))
+			return gpiod_errno();
+
+		return 0;
+	}
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = consumer;
+	config.direction = req->mode;
+	config.active_state = req->active_state;
+	config.flags = req->flags;
+
+	for (i = 0; i < req->num_lines; i++)
+		values[i] = !!(req->default_vals & (1ULL << i));
+
+	if (gpiod_line_request_bulk(&handle->bulk, &config, values))
+		return gpiod_errno();
+
+	return 0;
+}
+
+static void handle_release_lines(struct handle *handle)
+{
+	if (handle->req.type == BROKER_REQUEST_EVENTS)
+		gpiod_line_event_release_bulk(&handle->bulk);
+	else
+		gpiod_line_release_bulk(&handle->bulk);
+}
+
+static void client_add_handle(struct client *client, uint32_t id)
+{
+	if (client->num_handles == client->handles_size) {
+		client->handles_size = client->handles_size * 2 ?: 8;
+		client->handles = xrealloc(client->handles,
+					   client->handles_size *
+					   sizeof(*client->handles));
+	}
+
+	client->handles[client->num_handles++] = id;
+}
+
+static bool client_holds(struct client *client, uint32_t id)
+{
+	unsigned int i;
+
+	for (i = 0; i < client->num_handles; i++) {
+		if (client->handles[i] == id)
+			return true;
+	}
+
+	return false;
+}
+
+static int broker_request(struct broker *broker, struct client *client,
+			  struct broker_request *req, uint32_t *id)
+{
+	struct handle *handle;
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	unsigned int i, slot;
+	int error;
+
+	if (req->type != BROKER_REQUEST_VALUES &&
+	    req->type != BROKER_REQUEST_EVENTS)
+		return EINVAL;
+
+	if (!req->num_lines || req->num_lines > GPIOD_REQUEST_MAX_LINES)
+		return GPIOD_ELINEMAX;
+
+	req->device[sizeof(req->device) - 1] = '\0';
+	req->consumer[sizeof(req->consumer) - 1] = '\0';
+
+	chip = broker_get_chip(broker, req->device);
+	if (!chip)
+		return gpiod_errno();
+
+	for (i = 0; i < broker->num_handles; i++) {
+		handle = broker->handles[i];
+		if (handle && handle_matches(handle, chip, req)) {
+			handle->refcount++;
+			*id = i + 1;
+			client_add_handle(client, *id);
+			return 0;
+		}
+	}
+
+	handle = malloc(sizeof(*handle));
+	if (!handle)
+		die("out of memory");
+
+	memset(handle, 0, sizeof(*handle));
+	handle->chip = chip;
+	handle->req = *req;
+	handle->refcount = 1;
+
+	for (i = 0; i < req->num_lines; i++) {
+		line = gpiod_chip_get_line(chip, req->offsets[i]);
+		if (!line) {
+			error = gpiod_errno();
+			free(handle);
+			return error;
+		}
+
+		gpiod_line_bulk_add(&handle->bulk, line);
+	}
+
+	error = handle_request_lines(handle);
+	if (error) {
+		free(handle);
+		return error;
+	}
+
+	for (slot = 0; slot < broker->num_handles; slot++) {
+		if (!broker->handles[slot])
+			break;
+	}
+
+	if (slot == broker->num_handles) {
+		broker->handles = xrealloc(broker->handles,
+					   (broker->num_handles + 1) *
+					   sizeof(*broker->handles));
+		broker->num_handles++;
+	}
+
+	broker->handles[slot] = handle;
+	*id = slot + 1;
+	client_add_handle(client, *id);
+
+	return 0;
+}
+
+static int broker_release(struct broker *broker, struct client *client,
+			  uint32_t id)
+{
+	struct handle *handle;
+	unsigned int i;
+
+	for (i = 0; i < client->num_handles; i++) {
+		if (client->handles[i] == id)
+			break;
+	}
+
+	if (i == client->num_handles)
+		return GPIOD_EREQUEST;
+
+	client->handles[i] = client->handles[--client->num_handles];
+
+	handle = broker_find_handle(broker, id);
+	if (--handle->refcount == 0) {
+		handle_release_lines(handle);
+		free(handle);
+		broker->handles[id - 1] = NULL;
+	}
+
+	return 0;
+}
+
+static int broker_get(struct broker *broker, struct client *client,
+		      uint32_t id, uint64_t *mask)
+{
+	int values[GPIOD_REQUEST_MAX_LINES];
+	struct handle *handle;
+	unsigned int i;
+
+	if (!client_holds(client, id))
+		return GPIOD_EREQUEST;
+
+	handle = broker_find_handle(broker, id);
+	if (gpiod_line_get_value_bulk(&handle->bulk, values))
+		return gpiod_errno();
+
+	*mask = 0;
+	for (i = 0; i < handle->bulk.num_lines; i++) {
+		if (values[i])
+			*mask |= 1ULL << i;
+	}
+
+	return 0;
+}
+
+static int broker_set(struct broker *broker, struct client *client,
+		      uint32_t id, uint64_t mask)
+{
+	int values[GPIOD_REQUEST_MAX_LINES];
+	struct handle *handle;
+	unsigned int i;
+
+	if (!client_holds(client, id))
+		return GPIOD_EREQUEST;
+
+	handle = broker_find_handle(broker, id);
+	for (i = 0; i < handle->bulk.num_lines; i++)
+		values[i] = !!(mask & (1ULL << i));
+
+	if (gpiod_line_set_value_bulk(&handle->bulk, values))
+		return gpiod_errno();
+
+	return 0;
+}
+
+static void client_send(struct client *client, uint32_t tag, uint8_t op,
+			const void *payload, size_t size)
+{
+	struct broker_hdr hdr;
+	size_t need;
+
+	need = client->tx_len + sizeof(hdr) + size;
+	if (need > client->tx_size) {
+		client->tx_size = client->tx_size * 2 ?: 4096;
+		if (client->tx_size < need)
+			client->tx_size = need;
+		client->tx = xrealloc(client->tx, client->tx_size);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.tag = tag;
+	hdr.size = size;
+	hdr.op = op;
+
+	memcpy(client->tx + client->tx_len, &hdr, sizeof(hdr));
+	memcpy(client->tx + client->tx_len + sizeof(hdr), payload, size);
+	client->tx_len += sizeof(hdr) + size;
+}
+
+static void client_flush(struct client *client)
+{
+	ssize_t wr;
+
+	while (client->tx_len && !client->dead) {
+		wr = send(client->fd, client->tx, client->tx_len,
+			  MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (wr < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				client->dead = true;
+
+			return;
+		}
+
+		memmove(client->tx, client->tx + wr, client->tx_len - wr);
+		client->tx_len -= wr;
+	}
+}
+
+static void broker_handle_msg(struct broker *broker, struct client *client,
+			      const struct broker_hdr *hdr,
+			      const void *payload)
+{
+	struct broker_request req;
+	struct broker_values msg;
+	struct broker_reply reply;
+
+	memset(&reply, 0, sizeof(reply));
+
+	switch (hdr->op) {
+	case BROKER_OP_REQUEST:
+		/* Clients only send the offsets they use. */
+		memset(&req, 0, sizeof(req));
+		memcpy(&req, payload, hdr->size < sizeof(req) ? hdr->size
+							       : sizeof(req));
+		if (hdr->size < offsetof(struct broker_request, offsets) +
+				req.num_lines * sizeof(req.offsets[0]))
+			reply.error = EINVAL;
+		else
+			reply.error = broker_request(broker, client,
+						     &req, &reply.handle);
+		break;
+	case BROKER_OP_RELEASE:
+	case BROKER_OP_GET:
+	case BROKER_OP_SET:
+		if (hdr->size != sizeof(msg)) {
+			reply.error = EINVAL;
+			break;
+		}
+
+		memcpy(&msg, payload, sizeof(msg));
+		reply.handle = msg.handle;
+
+		if (hdr->op == BROKER_OP_RELEASE)
+			reply.error = broker_release(broker, client,
+						     msg.handle);
+		else if (hdr->op == BROKER_OP_GET)
+			reply.error = broker_get(broker, client, msg.handle,
+						 &reply.values);
+		else
+			reply.error = broker_set(broker, client, msg.handle,
+						 msg.values);
+		break;
+	default:
+		reply.error = EOPNOTSUPP;
+		break;
+	}
+
+	client_send(client, hdr->tag, BROKER_OP_REPLY, &reply, sizeof(reply));
+}
+
+/* Handle all complete requests, the replies are sent with a single write. */
+static void client_read(struct broker *broker, struct client *client)
+{
+	struct broker_hdr hdr;
+	size_t pos, msg_size;
+	ssize_t rd;
+
+	rd = read(client->fd, client->rx + client->rx_len,
+		  sizeof(client->rx) - client->rx_len);
+	if (rd < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			client->dead = true;
+		return;
+	} else if (rd == 0) {
+		client->dead = true;
+		return;
+	}
+
+	client->rx_len += rd;
+
+	for (pos = 0; client->rx_len - pos >= sizeof(hdr); pos += msg_size) {
+		memcpy(&hdr, client->rx + pos, sizeof(hdr));
+		if (hdr.size > BROKER_MSG_MAX - sizeof(hdr)) {
+			client->dead = true;
+			return;
+		}
+
+		msg_size = sizeof(hdr) + hdr.size;
+		if (client->rx_len - pos < msg_size)
+			break;
+
+		broker_handle_msg(broker, client, &hdr,
+				  client->rx + pos + sizeof(hdr));
+	}
+
+	memmove(client->rx, client->rx + pos, client->rx_len - pos);
+	client->rx_len -= pos;
+
+	client_flush(client);
+}
+
+static void broker_read_events(struct broker *broker, uint32_t id,
+			       struct gpiod_line *line)
+{
+	struct gpiod_line_event events[GPIOD_EVENT_READ_MAX];
+	struct broker_event msg;
+	struct client *client;
+	unsigned int i, j;
+	int num;
+
+	num = gpiod_line_event_read_multiple(line, events, ARRAY_SIZE(events));
+	if (num < 0)
+		return;
+
+	for (i = 0; i < broker->num_clients; i++) {
+		client = broker->clients[i];
+		if (client->dead || !client_holds(client, id))
+			continue;
+
+		/* Clients that can't keep up with their events are dropped. */
+		if (client->tx_len > CLIENT_TX_MAX) {
+			client->dead = true;
+			continue;
+		}
+
+		for (j = 0; j < (unsigned int)num; j++) {
+			memset(&msg, 0, sizeof(msg));
+			msg.handle = id;
+			msg.offset = gpiod_line_offset(line);
+			msg.event_type = events[j].event_type;
+			msg.sec = events[j].ts.tv_sec;
+			msg.nsec = events[j].ts.tv_nsec;
+
+			client_send(client, 0, BROKER_OP_EVENT,
+				    &msg, sizeof(msg));
+		}
+
+		client_flush(client);
+	}
+}
+
+static void broker_accept(struct broker *broker)
+{
+	struct client *client;
+	int fd;
+
+	fd = accept4(broker->listen_fd, NULL, NULL,
+		     SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	client = malloc(sizeof(*client));
+	if (!client)
+		die("out of memory");
+
+	memset(client, 0, sizeof(*client));
+	client->fd = fd;
+
+	broker->clients = xrealloc(broker->clients, (broker->num_clients + 1) *
+						    sizeof(*broker->clients));
+	broker->clients[broker->num_clients++] = client;
+}
+
+static void broker_reap_clients(struct broker *broker)
+{
+	struct client *client;
+	unsigned int i;
+
+	for (i = 0; i < broker->num_clients; i++) {
+		client = broker->clients[i];
+		if (!client->dead)
+			continue;
+
+		while (client->num_handles)
+			broker_release(broker, client, client->handles[0]);
+
+		close(client->fd);
+		free(client->handles);
+		free(client->tx);
+		free(client);
+
+		broker->clients[i--] = broker->clients[--broker->num_clients];
+	}
+}
+
+static unsigned int broker_poll_fds(struct broker *broker,
+				    struct pollfd **pfds,
+				    struct poll_src **srcs)
+{
+	unsigned int i, j, num = 2, size = 2 + broker->num_clients;
+	struct client *client;
+	struct handle *handle;
+
+	for (i = 0; i < broker->num_handles; i++) {
+		handle = broker->handles[i];
+		if (handle && handle->req.type == BROKER_REQUEST_EVENTS)
+			size += handle->bulk.num_lines;
+	}
+
+	*pfds = xrealloc(*pfds, size * sizeof(**pfds));
+	*srcs = xrealloc(*srcs, size * sizeof(**srcs));
+	memset(*pfds, 0, size * sizeof(**pfds));
+	memset(*srcs, 0, size * sizeof(**srcs));
+
+	(*pfds)[0].fd = broker->sigfd;
+	(*pfds)[0].events = POLLIN;
+	(*srcs)[0].type = SRC_SIGNAL;
+	(*pfds)[1].fd = broker->listen_fd;
+	(*pfds)[1].events = POLLIN;
+	(*srcs)[1].type = SRC_LISTEN;
+
+	for (i = 0; i < broker->num_clients; i++) {
+		client = broker->clients[i];
+
+		(*pfds)[num].fd = client->fd;
+		if (client->tx_len <= CLIENT_TX_MAX)
+			(*pfds)[num].events |= POLLIN;
+		if (client->tx_len)
+			(*pfds)[num].events |= POLLOUT;
+		(*srcs)[num].type = SRC_CLIENT;
+		(*srcs)[num].client = client;
+		num++;
+	}
+
+	for (i = 0; i < broker->num_handles; i++) {
+		handle = broker->handles[i];
+		if (!handle || handle->req.type != BROKER_REQUEST_EVENTS)
+			continue;
+
+		for (j = 0; j < handle->bulk.num_lines; j++) {
+			(*pfds)[num].fd = gpiod_line_event_get_fd(
+							handle->bulk.lines[j]);
+			(*pfds)[num].events = POLLIN | POLLPRI;
+			(*srcs)[num].type = SRC_EVENT;
+			(*srcs)[num].handle = i + 1;
+			(*srcs)[num].line = handle->bulk.lines[j];
+			num++;
+		}
+	}
+
+	return num;
+}
+
+static void broker_run(struct broker *broker)
+{
+	struct poll_src *srcs = NULL, *src;
+	struct pollfd *pfds = NULL;
+	bool accept_pending;
+	unsigned int i, num;
+	int status;
+
+	for (;;) {
+		num = broker_poll_fds(broker, &pfds, &srcs);
+
+		status = poll(pfds, num, -1);
+		if (status < 0) {
+			if (errno == EINTR)
+				continue;
+
+			die("poll: %s", strerror(errno));
+		}
+
+		if (pfds[0].revents)
+			break;
+
+		accept_pending = pfds[1].revents & POLLIN;
+
+		/*
+		 * Forward events before handling requests which may release
+		 * the lines and reuse their handles.
+		 */
+		for (i = 2; i < num; i++) {
+			src = &srcs[i];
+			if (src->type == SRC_EVENT && pfds[i].revents)
+				broker_read_events(broker, src->handle,
+						   src->line);
+		}
+
+		for (i = 2; i < num; i++) {
+			src = &srcs[i];
+			if (src->type != SRC_CLIENT || src->client->dead)
+				continue;
+
+			if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				client_read(broker, src->client);
+			else if (pfds[i].revents & POLLOUT)
+				client_flush(src->client);
+		}
+
+		broker_reap_clients(broker);
+
+		if (accept_pending)
+			broker_accept(broker);
+	}
+
+	free(pfds);
+	free(srcs);
+}
+
+static void broker_cleanup(struct broker *broker)
+{
+	unsigned int i;
+
+	for (i = 0; i < broker->num_clients; i++)
+		broker->clients[i]->dead = true;
+
+	broker_reap_clients(broker);
+
+	for (i = 0; i < broker->num_chips; i++) {
+		if (broker->chips[i].owner)
+			gpiod_chip_close(broker->chips[i].chip);
+		free(broker->chips[i].descr);
+	}
+
+	free(broker->chips);
+	free(broker->handles);
+	free(broker->clients);
+}
+
+static int make_signalfd(void)
+{
+	sigset_t sigmask;
+	int sigfd, status;
+
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGINT);
+
+	status = sigprocmask(SIG_BLOCK, &sigmask, NULL);
+	if (status < 0)
+		die("error blocking signals: %s", strerror(errno));
+
+	sigfd = signalfd(-1, &sigmask, 0);
+	if (sigfd < 0)
+		die("error creating signalfd: %s", strerror(errno));
+
+	return sigfd;
+}
+
+static int make_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd, status;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		die("socket path too long: %s", path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		die("error creating socket: %s", strerror(errno));
+
+	/* Only remove the socket if nobody's listening on it anymore. */
+	status = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (status == 0)
+		die("another broker is already listening on %s", path);
+
+	unlink(path);
+
+	status = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (status < 0)
+		die("error binding to %s: %s", path, strerror(errno));
+
+	status = listen(fd, SOMAXCONN);
+	if (status < 0)
+		die("error listening on %s: %s", path, strerror(errno));
+
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = GPIOD_BROKER_SOCKET;
+	struct broker broker;
+	bool daemonize = false;
+	int optc, opti, status;
+
+	set_progname(argv[0]);
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 's':
+			path = optarg;
+			break;
+		case 'b':
+			daemonize = true;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 0)
+		die("unexpected argument: %s", argv[0]);
+
+	memset(&broker, 0, sizeof(broker));
+	broker.sigfd = make_signalfd();
+	broker.listen_fd = make_socket(path);
+
+	if (daemonize) {
+		status = daemon(0, 0);
+		if (status < 0)
+			die("unable to daemonize: %s", strerror(errno));
+	}
+
+	broker_run(&broker);
+
+	broker_cleanup(&broker);
+	close(broker.listen_fd);
+	close(broker.sigfd);
+	unlink(path);
+
+	return EXIT_SUCCESS;
+}
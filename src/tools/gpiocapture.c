@@ -0,0 +1,447 @@
+/*
+ * Capture the state of GPIO lines like a logic analyzer.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "tools-common.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <ctype.h>
+#include <sys/mman.h>
+
+#define DEFAULT_NUM_SAMPLES	1000000UL
+#define DEFAULT_RING_SIZE	(1UL << 20)
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "active-low",		no_argument,		NULL,	'l' },
+	{ "num-samples",	required_argument,	NULL,	'n' },
+	{ "trigger",		required_argument,	NULL,	't' },
+	{ "pre-trigger",	required_argument,	NULL,	'p' },
+	{ "buffer-size",	required_argument,	NULL,	'b' },
+	{ "output",		required_argument,	NULL,	'o' },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvln:t:p:b:o:";
+
+static void print_help(void)
+{
+	printf("Usage: %s [OPTIONS] <chip name/number> [<offset 1> <offset 2> ...]\n",
+	       get_progname());
+	printf("Sample GPIO lines as fast as possible and store the changes in VCD format\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -l, --active-low:\tset the line active state to low\n");
+	printf("  -n, --num-samples=NUM:\n");
+	printf("\t\t\tstop after taking NUM samples past the trigger\n");
+	printf("\t\t\t(default: %lu)\n", DEFAULT_NUM_SAMPLES);
+	printf("  -t, --trigger=MASK:VALUE:\n");
+	printf("\t\t\tstart the capture once the lines selected by MASK\n");
+	printf("\t\t\thave the state given by VALUE\n");
+	printf("  -p, --pre-trigger=NUM:\n");
+	printf("\t\t\tkeep up to NUM changes from before the trigger\n");
+	printf("  -b, --buffer-size=NUM:\n");
+	printf("\t\t\tstore up to NUM changes (default: %lu)\n",
+	       DEFAULT_RING_SIZE);
+	printf("  -o, --output=FILE:\twrite the VCD data to FILE instead of stdout\n");
+	printf("\n");
+	printf("If no offsets are given, all lines of the chip are captured (up to %d).\n",
+	       GPIOD_REQUEST_MAX_LINES);
+	printf("Bit N of MASK and VALUE corresponds to the N-th captured line.\n");
+}
+
+static volatile bool do_run = true;
+
+static void sighandler(int signum UNUSED)
+{
+	do_run = false;
+}
+
+struct change {
+	uint64_t ts;
+	uint64_t values;
+};
+
+/*
+ * Changes are stored in a power-of-two sized ring in anonymous memory that
+ * is populated up front so that the sampling loop never page-faults.
+ */
+struct capture {
+	struct change *ring;
+	unsigned long ring_mask;
+	unsigned long head;
+	unsigned long tail;
+	unsigned long trigger;
+	bool triggered;
+	unsigned long pre_trigger;
+	uint64_t trig_mask;
+	uint64_t trig_value;
+	unsigned long num_samples;
+	unsigned long samples_taken;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+static uint64_t now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long parse_ulong(const char *str)
+{
+	unsigned long val;
+	char *end;
+
+	val = strtoul(str, &end, 0);
+	if (*end != '\0')
+		die("invalid number: %s", str);
+
+	return val;
+}
+
+static void parse_trigger(struct capture *cap, char *str)
+{
+	char *end;
+
+	cap->trig_mask = strtoull(str, &end, 0);
+	if (*end != ':')
+		die("invalid trigger: %s", str);
+
+	cap->trig_value = strtoull(end + 1, &end, 0);
+	if (*end != '\0')
+		die("invalid trigger: %s", str);
+}
+
+static void ring_alloc(struct capture *cap, unsigned long size)
+{
+	unsigned long ring_size = 1;
+	void *ring;
+
+	while (ring_size < size)
+		ring_size <<= 1;
+
+	ring = mmap(NULL, ring_size * sizeof(struct change),
+		    PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (ring == MAP_FAILED)
+		die("unable to allocate the sample buffer");
+
+	cap->ring = ring;
+	cap->ring_mask = ring_size - 1;
+}
+
+static bool trigger_hit(struct capture *cap, uint64_t values)
+{
+	return (values & cap->trig_mask) == (cap->trig_value & cap->trig_mask);
+}
+
+static void sample_loop(struct capture *cap, struct gpiod_line_bulk *bulk)
+{
+	int vals[GPIOD_REQUEST_MAX_LINES];
+	uint64_t values, prev = 0;
+	struct change *change;
+	unsigned int i;
+	bool first = true;
+	int status;
+
+	cap->start_ns = now_nsec();
+
+	while (do_run) {
+		status = gpiod_line_get_value_bulk(bulk, vals);
+		if (status < 0)
+			die_perror("error reading GPIO values");
+
+		values = 0;
+		for (i = 0; i < bulk->num_lines; i++) {
+			if (vals[i])
+				values |= 1ULL << i;
+		}
+
+		cap->samples_taken++;
+
+		if (!cap->triggered && trigger_hit(cap, values)) {
+			cap->triggered = true;
+			cap->trigger = cap->head;
+			/* Always store the sample that fired the trigger. */
+			first = true;
+		}
+
+		if (first || values != prev) {
+			change = &cap->ring[cap->head & cap->ring_mask];
+			change->ts = now_nsec();
+			change->values = values;
+			cap->head++;
+
+			/*
+			 * Before the trigger only keep the pre-trigger depth,
+			 * after it stop once the buffer is full.
+			 */
+			if (!cap->triggered) {
+				if (cap->head - cap->tail > cap->pre_trigger)
+					cap->tail++;
+			} else if (cap->head - cap->tail > cap->ring_mask) {
+				break;
+			}
+
+			prev = values;
+			first = false;
+		}
+
+		if (cap->triggered && !--cap->num_samples)
+			break;
+	}
+
+	cap->end_ns = now_nsec();
+}
+
+static void vcd_print_name(FILE *fp, struct gpiod_line *line)
+{
+	const char *name = gpiod_line_name(line);
+
+	if (!name) {
+		fprintf(fp, "line%u", gpiod_line_offset(line));
+		return;
+	}
+
+	/* Whitespace separates tokens in VCD. */
+	for (; *name; name++)
+		fputc(isspace((unsigned char)*name) ? '_' : *name, fp);
+}
+
+/* Identifier codes are single printable characters starting at '!'. */
+static char vcd_id(unsigned int index)
+{
+	return '!' + index;
+}
+
+static void write_vcd(struct capture *cap, struct gpiod_line_bulk *bulk,
+		      const char *chip_name, FILE *fp)
+{
+	uint64_t changed, prev = 0, first_ts;
+	struct change *change;
+	unsigned long idx;
+	unsigned int i;
+	time_t now;
+
+	now = time(NULL);
+
+	fprintf(fp, "$date %s$end\n", ctime(&now));
+	fprintf(fp, "$version gpiocapture (libgpiod) %s $end\n",
+		gpiod_version_string());
+	fprintf(fp, "$timescale 1 ns $end\n");
+	fprintf(fp, "$scope module %s $end\n", chip_name);
+	for (i = 0; i < bulk->num_lines; i++) {
+		fprintf(fp, "$var wire 1 %c ", vcd_id(i));
+		vcd_print_name(fp, bulk->lines[i]);
+		fprintf(fp, " $end\n");
+	}
+	fprintf(fp, "$upscope $end\n");
+	fprintf(fp, "$enddefinitions $end\n");
+
+	if (cap->head == cap->tail)
+		return;
+
+	first_ts = cap->ring[cap->tail & cap->ring_mask].ts;
+
+	for (idx = cap->tail; idx != cap->head; idx++) {
+		change = &cap->ring[idx & cap->ring_mask];
+
+		if (cap->triggered && idx == cap->trigger)
+			fprintf(fp, "$comment trigger $end\n");
+
+		fprintf(fp, "#%llu\n",
+			(unsigned long long)(change->ts - first_ts));
+
+		if (idx == cap->tail) {
+			fprintf(fp, "$dumpvars\n");
+			changed = UINT64_MAX;
+		} else {
+			changed = change->values ^ prev;
+		}
+
+		for (i = 0; i < bulk->num_lines; i++) {
+			if (changed & (1ULL << i))
+				fprintf(fp, "%c%c\n",
+					change->values & (1ULL << i) ? '1' : '0',
+					vcd_id(i));
+		}
+
+		if (idx == cap->tail)
+			fprintf(fp, "$end\n");
+
+		prev = change->values;
+	}
+}
+
+static void print_report(struct capture *cap)
+{
+	double elapsed, rate;
+
+	elapsed = (double)(cap->end_ns - cap->start_ns) / 1000000000.0;
+	rate = elapsed > 0.0 ? cap->samples_taken / elapsed : 0.0;
+
+	fprintf(stderr, "%s: %lu samples in %.6f s (%.0f samples/s, %.3f us/sample)\n",
+		get_progname(), cap->samples_taken, elapsed, rate,
+		rate > 0.0 ? 1000000.0 / rate : 0.0);
+	fprintf(stderr, "%s: %lu changes stored, trigger %s\n",
+		get_progname(), cap->head - cap->tail,
+		cap->triggered ? "hit" : "not hit");
+}
+
+int main(int argc, char **argv)
+{
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	unsigned long ring_size = DEFAULT_RING_SIZE;
+	unsigned int offset, num_lines, i;
+	const char *output = NULL;
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	bool active_low = false;
+	struct capture cap;
+	int optc, opti, status;
+	char *end;
+	FILE *fp;
+
+	set_progname(argv[0]);
+
+	memset(&cap, 0, sizeof(cap));
+	cap.num_samples = DEFAULT_NUM_SAMPLES;
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'l':
+			active_low = true;
+			break;
+		case 'n':
+			cap.num_samples = parse_ulong(optarg);
+			if (!cap.num_samples)
+				die("number of samples must be greater than 0");
+			break;
+		case 't':
+			parse_trigger(&cap, optarg);
+			break;
+		case 'p':
+			cap.pre_trigger = parse_ulong(optarg);
+			break;
+		case 'b':
+			ring_size = parse_ulong(optarg);
+			if (!ring_size)
+				die("buffer size must be greater than 0");
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1)
+		die("gpiochip must be specified");
+
+	ring_alloc(&cap, ring_size);
+	if (cap.pre_trigger > cap.ring_mask)
+		die("pre-trigger depth must be smaller than the buffer size");
+
+	chip = gpiod_chip_open_lookup(argv[0]);
+	if (!chip)
+		die_perror("unable to open %s", argv[0]);
+
+	if (argc > 1) {
+		num_lines = argc - 1;
+		if (num_lines > GPIOD_REQUEST_MAX_LINES)
+			die("at most %d lines can be captured",
+			    GPIOD_REQUEST_MAX_LINES);
+
+		for (i = 0; i < num_lines; i++) {
+			offset = strtoul(argv[i + 1], &end, 10);
+			if (*end != '\0' || offset > INT_MAX)
+				die("invalid GPIO offset: %s", argv[i + 1]);
+
+			line = gpiod_chip_get_line(chip, offset);
+			if (!line)
+				die_perror("unable to retrieve GPIO line from chip");
+
+			gpiod_line_bulk_add(&bulk, line);
+		}
+	} else {
+		num_lines = gpiod_chip_num_lines(chip);
+		if (num_lines > GPIOD_REQUEST_MAX_LINES)
+			num_lines = GPIOD_REQUEST_MAX_LINES;
+
+		for (i = 0; i < num_lines; i++) {
+			line = gpiod_chip_get_line(chip, i);
+			if (!line)
+				die_perror("unable to retrieve GPIO line from chip");
+
+			gpiod_line_bulk_add(&bulk, line);
+		}
+	}
+
+	status = gpiod_line_request_bulk_input(&bulk, "gpiocapture",
+					       active_low);
+	if (status < 0)
+		die_perror("unable to request lines");
+
+	/* Without a trigger the capture starts with the first sample. */
+	if (!cap.trig_mask)
+		cap.triggered = true;
+
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+
+	sample_loop(&cap, &bulk);
+
+	if (output) {
+		fp = fopen(output, "w");
+		if (!fp)
+			die("unable to open %s: %m", output);
+	} else {
+		fp = stdout;
+	}
+
+	write_vcd(&cap, &bulk, gpiod_chip_name(chip), fp);
+	print_report(&cap);
+
+	if (fp != stdout)
+		fclose(fp);
+
+	gpiod_chip_close(chip);
+	munmap(cap.ring, (cap.ring_mask + 1) * sizeof(struct change));
+
+	return EXIT_SUCCESS;
+}
@@ -1,5 +1,5 @@
 /*
- * Monitor events on a GPIO line.
+ * Monitor events on GPIO lines.
  *
  * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
  *
@@ -10,12 +10,22 @@
 
 #include <gpiod.h>
 #include "tools-common.h"
+#include "tools-histogram.h"
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #include <signal.h>
 #include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 static const struct option longopts[] = {
 	{ "help",		no_argument,		NULL,	'h' },
@@ -25,16 +35,30 @@ static const struct option longopts[] = {
 	{ "silent",		no_argument,		NULL,	's' },
 	{ "rising-edge",	no_argument,		NULL,	'r' },
 	{ "falling-edge",	no_argument,		NULL,	'f' },
+	{ "format",		required_argument,	NULL,	'F' },
+	{ "buffer-size",	required_argument,	NULL,	'b' },
+	{ "flush-interval",	required_argument,	NULL,	'i' },
+	{ "overload",		required_argument,	NULL,	'o' },
+	{ "latency",		no_argument,		NULL,	'L' },
+	{ "latency-interval",	required_argument,	NULL,	'I' },
+	{ "clock",		required_argument,	NULL,	'C' },
+	{ "metrics",		required_argument,	NULL,	'm' },
+	{ "metrics-interval",	required_argument,	NULL,	'M' },
+	{ "background",		no_argument,		NULL,	'D' },
 	{ 0 },
 };
 
-static const char *const shortopts = "+hvln:srf";
+static const char *const shortopts = "+hvln:srfF:b:i:o:LI:C:m:M:D";
+
+#define DEFAULT_FORMAT		"event: %E chip: %c offset: %o timestamp: [%8s.%n]"
+#define DEFAULT_BUFFER_SIZE	65536
+#define DEFAULT_FLUSH_INTERVAL	100
+#define DEFAULT_METRICS_INTERVAL	1000
 
 static void print_help(void)
 {
-	printf("Usage: %s [OPTIONS] <chip name/number> <line offset>\n",
-	       get_progname());
-	printf("Wait for events on a GPIO line\n");
+	printf("Usage: %s [OPTIONS] <line> [<line> ...]\n", get_progname());
+	printf("Wait for events on GPIO lines\n");
 	printf("Options:\n");
 	printf("  -h, --help:\t\tdisplay this message and exit\n");
 	printf("  -v, --version:\tdisplay the version and exit\n");
@@ -43,6 +67,51 @@ static void print_help(void)
 	printf("  -s, --silent:\t\tdon't print event info\n");
 	printf("  -r, --rising-edge:\tonly process rising edge events\n");
 	printf("  -f, --falling-edge:\tonly process falling edge events\n");
+	printf("  -F, --format=FMT:\tprint events in the given format\n");
+	printf("  -b, --buffer-size=BYTES:\n");
+	printf("\t\t\tbuffer up to BYTES of output (default: %d)\n",
+	       DEFAULT_BUFFER_SIZE);
+	printf("  -i, --flush-interval=MS:\n");
+	printf("\t\t\twrite buffered output at least every MS milliseconds\n");
+	printf("\t\t\t(default: 0 for terminals, %d otherwise)\n",
+	       DEFAULT_FLUSH_INTERVAL);
+	printf("  -o, --overload=POLICY:\n");
+	printf("\t\t\twhat to do when the output can't keep up: 'block'\n");
+	printf("\t\t\t(default) or 'drop' events and count them\n");
+	printf("  -L, --latency:\t\tmeasure the event delivery latency and print\n");
+	printf("\t\t\tits distribution on exit\n");
+	printf("  -I, --latency-interval=SEC:\n");
+	printf("\t\t\talso print the latency of the last SEC seconds\n");
+	printf("  -C, --clock=CLOCK:\tclock used by the kernel for event timestamps:\n");
+	printf("\t\t\t'realtime' (default), 'monotonic' or 'boottime'\n");
+	printf("  -m, --metrics=DEST:\texport metrics in the Prometheus text format to\n");
+	printf("\t\t\tthe file DEST or, if DEST is unix:PATH, to clients\n");
+	printf("\t\t\tconnecting to the unix socket PATH\n");
+	printf("  -M, --metrics-interval=MS:\n");
+	printf("\t\t\tupdate the metrics every MS milliseconds (default: %d)\n",
+	       DEFAULT_METRICS_INTERVAL);
+	printf("  -D, --background:\tdetach from the controlling terminal once the\n");
+	printf("\t\t\tlines are requested, events are only printed if the\n");
+	printf("\t\t\tstandard output is redirected\n");
+	printf("\n");
+	printf("Format specifiers (a newline is appended to every event):\n");
+	printf("  %%e\tevent type (1 - rising edge, 0 - falling edge)\n");
+	printf("  %%E\tevent name\n");
+	printf("  %%c\tgpiochip name\n");
+	printf("  %%o\tline offset\n");
+	printf("  %%l\tline name\n");
+	printf("  %%s\tseconds part of the event timestamp\n");
+	printf("  %%n\tnanoseconds part of the event timestamp\n");
+	printf("  %%%%\ta percent sign\n");
+	printf("A field width can be given for numbers, for example %%8s.\n");
+	printf("The default format is '%s'.\n", DEFAULT_FORMAT);
+	printf("\n");
+	printf("Lines can be specified as:\n");
+	printf("  <chip> <offset> ...\toffsets on a gpiochip (name, number, path or label)\n");
+	printf("  <chip>:<offset>\ta single line on given gpiochip\n");
+	printf("  <line name>\t\ta line looked up by its name\n");
+	printf("Each line can be suffixed with @rising, @falling or @both to select\n");
+	printf("its edges, overriding --rising-edge and --falling-edge.\n");
 }
 
 static volatile bool do_run = true;
@@ -52,63 +121,1231 @@ static void sighandler(int signum UNUSED)
 	do_run = false;
 }
 
-struct callback_data {
+struct mon_line {
+	struct gpiod_line *line;
+	const char *chip_name;
+	size_t chip_name_len;
+	const char *name;
+	size_t name_len;
 	unsigned int offset;
-	unsigned int num_events_wanted;
-	unsigned int num_events_done;
-	bool silent;
-	bool watch_rising;
-	bool watch_falling;
+	int event_type;
+	/* Number of falling and rising edges read, for the metrics. */
+	uint64_t edges[2];
+};
+
+struct mon_chip {
+	struct gpiod_chip *chip;
+	char *device;
+};
+
+struct monitor {
+	struct mon_line *lines;
+	unsigned int num_lines;
+	struct mon_chip *chips;
+	unsigned int num_chips;
+	int default_event_type;
+};
+
+static void * xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr)
+		die("out of memory");
+
+	return ptr;
+}
+
+static bool is_number(const char *str)
+{
+	if (!*str)
+		return false;
+
+	for (; *str; str++) {
+		if (!isdigit((unsigned char)*str))
+			return false;
+	}
+
+	return true;
+}
+
+static unsigned int parse_offset(const char *str)
+{
+	unsigned long offset;
+	char *end;
+
+	offset = strtoul(str, &end, 10);
+	if (*end != '\0' || offset > INT_MAX)
+		die("invalid GPIO offset: %s", str);
+
+	return offset;
+}
+
+static int parse_edge(const char *str)
+{
+	if (strcmp(str, "rising") == 0)
+		return GPIOD_EVENT_RISING_EDGE;
+	else if (strcmp(str, "falling") == 0)
+		return GPIOD_EVENT_FALLING_EDGE;
+	else if (strcmp(str, "both") == 0)
+		return GPIOD_EVENT_BOTH_EDGES;
+
+	die("invalid edge: %s", str);
+}
+
+static void add_chip(struct monitor *mon, struct gpiod_chip *chip,
+		     const char *device)
+{
+	struct mon_chip *entry;
+
+	mon->chips = xrealloc(mon->chips,
+			      sizeof(*mon->chips) * (mon->num_chips + 1));
+	entry = &mon->chips[mon->num_chips++];
+	entry->chip = chip;
+	entry->device = device ? strdup(device) : NULL;
+}
+
+/* Each gpiochip is only opened once, however many times it's referenced. */
+static struct gpiod_chip * get_chip(struct monitor *mon, const char *device,
+				    bool must_exist)
+{
+	struct gpiod_chip *chip;
+	unsigned int i;
+
+	for (i = 0; i < mon->num_chips; i++) {
+		if (mon->chips[i].device &&
+		    strcmp(mon->chips[i].device, device) == 0)
+			return mon->chips[i].chip;
+	}
+
+	chip = gpiod_chip_open_lookup(device);
+	if (!chip) {
+		if (must_exist)
+			die_perror("unable to open %s", device);
+
+		return NULL;
+	}
+
+	add_chip(mon, chip, device);
+
+	return chip;
+}
+
+static void add_line(struct monitor *mon, struct gpiod_line *line,
+		     int event_type)
+{
+	struct mon_line *entry;
+
+	mon->lines = xrealloc(mon->lines,
+			      sizeof(*mon->lines) * (mon->num_lines + 1));
+	entry = &mon->lines[mon->num_lines++];
+	entry->line = line;
+	entry->chip_name = gpiod_chip_name(gpiod_line_get_chip(line));
+	entry->chip_name_len = strlen(entry->chip_name);
+	entry->name = gpiod_line_name(line);
+	if (!entry->name)
+		entry->name = "unnamed";
+	entry->name_len = strlen(entry->name);
+	entry->offset = gpiod_line_offset(line);
+	entry->event_type = event_type < 0 ? mon->default_event_type
+					   : event_type;
+}
+
+static void add_offset(struct monitor *mon, struct gpiod_chip *chip,
+		       const char *str, int event_type)
+{
+	struct gpiod_line *line;
+
+	line = gpiod_chip_get_line(chip, parse_offset(str));
+	if (!line)
+		die_perror("unable to retrieve GPIO line from chip");
+
+	add_line(mon, line, event_type);
+}
+
+static void parse_lines(struct monitor *mon, int argc, char **argv)
+{
+	struct gpiod_chip *chip, *curr_chip = NULL;
+	bool have_lines = true;
+	struct gpiod_line *line;
+	char *spec, *sep;
+	int event_type, i;
+
+	for (i = 0; i < argc; i++) {
+		spec = strdup(argv[i]);
+		if (!spec)
+			die("out of memory");
+
+		event_type = -1;
+		sep = strrchr(spec, '@');
+		if (sep) {
+			*sep = '\0';
+			event_type = parse_edge(sep + 1);
+		}
+
+		if (curr_chip && is_number(spec)) {
+			add_offset(mon, curr_chip, spec, event_type);
+			have_lines = true;
+			free(spec);
+			continue;
+		}
+
+		if (!have_lines)
+			die("no lines specified for gpiochip %s", argv[i - 1]);
+
+		sep = strchr(spec, ':');
+		if (sep) {
+			*sep = '\0';
+			chip = get_chip(mon, spec, true);
+			add_offset(mon, chip, sep + 1, event_type);
+			curr_chip = NULL;
+		} else {
+			/*
+			 * Anything else is either a gpiochip followed by
+			 * offsets (as printed by gpiofind) or a line name.
+			 */
+			chip = get_chip(mon, spec, false);
+			if (chip) {
+				if (event_type >= 0)
+					die("edge suffix given for gpiochip %s",
+					    spec);
+
+				curr_chip = chip;
+				have_lines = false;
+			} else {
+				line = gpiod_line_find_by_name(spec);
+				if (!line)
+					die("unable to find gpiochip or line %s",
+					    spec);
+
+				add_chip(mon, gpiod_line_get_chip(line), NULL);
+				add_line(mon, line, event_type);
+				curr_chip = NULL;
+			}
+		}
+
+		free(spec);
+	}
+
+	if (!have_lines)
+		die("gpio line offset must be specified");
+}
+
+static void request_lines(struct monitor *mon, bool active_low)
+{
+	struct gpiod_line_evreq_config config;
+	struct mon_line *entry;
+	unsigned int i;
+	int status;
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiomon";
+	config.active_state = active_low ? GPIOD_ACTIVE_STATE_LOW
+					 : GPIOD_ACTIVE_STATE_HIGH;
+
+	for (i = 0; i < mon->num_lines; i++) {
+		entry = &mon->lines[i];
+
+		/* Unwanted edges are filtered out by the kernel. */
+		config.event_type = entry->event_type;
+
+		status = gpiod_line_event_request(entry->line, &config);
+		if (status < 0)
+			die_perror("unable to request events on %s:%u",
+				   entry->chip_name, entry->offset);
+	}
+}
+
+/*
+ * The format string is compiled once into a list of operations so that
+ * printing an event doesn't involve parsing it or going through stdio.
+ */
+enum {
+	FMT_LITERAL,
+	FMT_EVENT,
+	FMT_EVNAME,
+	FMT_CHIP,
+	FMT_OFFSET,
+	FMT_NAME,
+	FMT_SEC,
+	FMT_NSEC,
+};
+
+struct fmt_op {
+	int type;
+	unsigned int width;
+	const char *str;
+	size_t len;
+};
+
+struct fmt_prog {
+	struct fmt_op *ops;
+	unsigned int num_ops;
+	/* Output size of a single event excluding variable-length strings. */
+	size_t max_len;
+};
+
+/* Longest text representation of a 64-bit number. */
+#define FMT_UINT_MAX_LEN	20
+
+static void fmt_add_op(struct fmt_prog *prog, int type, unsigned int width,
+		       const char *str, size_t len)
+{
+	struct fmt_op *op;
+
+	prog->ops = xrealloc(prog->ops,
+			     sizeof(*prog->ops) * (prog->num_ops + 1));
+	op = &prog->ops[prog->num_ops++];
+	op->type = type;
+	op->width = width;
+	op->str = str;
+	op->len = len;
+
+	if (type == FMT_LITERAL)
+		prog->max_len += len;
+	else
+		prog->max_len += width > FMT_UINT_MAX_LEN ? width
+							  : FMT_UINT_MAX_LEN;
+}
+
+static void fmt_compile(struct fmt_prog *prog, const char *fmt)
+{
+	const char *lit = fmt;
+	unsigned int width;
+	int type;
+
+	memset(prog, 0, sizeof(*prog));
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			fmt++;
+			continue;
+		}
+
+		if (fmt > lit)
+			fmt_add_op(prog, FMT_LITERAL, 0, lit, fmt - lit);
+
+		fmt++;
+		width = 0;
+		while (isdigit((unsigned char)*fmt))
+			width = width * 10 + *fmt++ - '0';
+
+		switch (*fmt) {
+		case 'e':
+			type = FMT_EVENT;
+			break;
+		case 'E':
+			type = FMT_EVNAME;
+			break;
+		case 'c':
+			type = FMT_CHIP;
+			break;
+		case 'o':
+			type = FMT_OFFSET;
+			break;
+		case 'l':
+			type = FMT_NAME;
+			break;
+		case 's':
+			type = FMT_SEC;
+			break;
+		case 'n':
+			type = FMT_NSEC;
+			break;
+		case '%':
+			fmt_add_op(prog, FMT_LITERAL, 0, fmt, 1);
+			lit = ++fmt;
+			continue;
+		default:
+			die("invalid format specifier: %%%c", *fmt);
+		}
+
+		fmt_add_op(prog, type, width, NULL, 0);
+		lit = ++fmt;
+	}
+
+	if (fmt > lit)
+		fmt_add_op(prog, FMT_LITERAL, 0, lit, fmt - lit);
+
+	fmt_add_op(prog, FMT_LITERAL, 0, "\n", 1);
+}
+
+static char * fmt_uint(char *buf, unsigned long long val,
+		       unsigned int width, char pad)
+{
+	char tmp[FMT_UINT_MAX_LEN];
+	unsigned int len = 0;
+
+	do {
+		tmp[len++] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	for (; width > len; width--)
+		*buf++ = pad;
+
+	while (len)
+		*buf++ = tmp[--len];
+
+	return buf;
+}
+
+static char * fmt_str(char *buf, const char *str, size_t len)
+{
+	memcpy(buf, str, len);
+
+	return buf + len;
+}
+
+/* The caller must make sure the buffer can hold the longest output. */
+static size_t fmt_event(struct fmt_prog *prog, char *buf,
+			struct mon_line *entry, struct gpiod_line_event *event)
+{
+	bool rising = event->event_type == GPIOD_EVENT_RISING_EDGE;
+	struct fmt_op *op;
+	char *pos = buf;
+	unsigned int i;
+
+	for (i = 0; i < prog->num_ops; i++) {
+		op = &prog->ops[i];
+
+		switch (op->type) {
+		case FMT_LITERAL:
+			pos = fmt_str(pos, op->str, op->len);
+			break;
+		case FMT_EVENT:
+			pos = fmt_uint(pos, rising, op->width, ' ');
+			break;
+		case FMT_EVNAME:
+			pos = rising ? fmt_str(pos, " RISING EDGE", 12)
+				     : fmt_str(pos, "FALLING EDGE", 12);
+			break;
+		case FMT_CHIP:
+			pos = fmt_str(pos, entry->chip_name,
+				      entry->chip_name_len);
+			break;
+		case FMT_OFFSET:
+			pos = fmt_uint(pos, entry->offset, op->width, ' ');
+			break;
+		case FMT_NAME:
+			pos = fmt_str(pos, entry->name, entry->name_len);
+			break;
+		case FMT_SEC:
+			pos = fmt_uint(pos, event->ts.tv_sec, op->width, ' ');
+			break;
+		case FMT_NSEC:
+			pos = fmt_uint(pos, event->ts.tv_nsec, 9, '0');
+			break;
+		}
+	}
+
+	return pos - buf;
+}
+
+enum {
+	OVERLOAD_BLOCK = 0,
+	OVERLOAD_DROP,
+};
+
+/*
+ * Formatted events are collected in a buffer which is written out when
+ * it's full or when the oldest buffered event has waited for the flush
+ * interval. With the drop policy the output is non-blocking and events
+ * that don't fit into the buffer are counted and discarded so that we
+ * never stop reading the kernel FIFOs. Once a write would block, the
+ * output is polled for POLLOUT instead of being retried on a timer.
+ */
+struct outbuf {
+	int fd;
+	char *buf;
+	size_t size;
+	size_t len;
+	uint64_t interval_ns;
+	uint64_t deadline_ns;
+	int policy;
+	bool blocked;
+	unsigned long dropped;
+};
+
+/* Flags of the shared stdout, put back on any exit including die(). */
+static int outbuf_orig_flags = -1;
+
+static void outbuf_restore_flags(void)
+{
+	if (outbuf_orig_flags >= 0)
+		fcntl(STDOUT_FILENO, F_SETFL, outbuf_orig_flags);
+}
+
+static uint64_t monotonic_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void outbuf_flush(struct outbuf *ob)
+{
+	size_t written = 0;
+	ssize_t wr;
+
+	ob->blocked = false;
+
+	while (written < ob->len) {
+		wr = write(ob->fd, ob->buf + written, ob->len - written);
+		if (wr < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				ob->blocked = true;
+				break;
+			}
+
+			die("error writing output: %s", strerror(errno));
+		}
+
+		written += wr;
+	}
+
+	memmove(ob->buf, ob->buf + written, ob->len - written);
+	ob->len -= written;
+
+	if (ob->len)
+		ob->deadline_ns = monotonic_nsec() + ob->interval_ns;
+}
+
+static char * outbuf_reserve(struct outbuf *ob, size_t len)
+{
+	if (ob->size - ob->len < len)
+		outbuf_flush(ob);
+
+	if (ob->size - ob->len < len) {
+		ob->dropped++;
+		return NULL;
+	}
+
+	if (!ob->len)
+		ob->deadline_ns = monotonic_nsec() + ob->interval_ns;
+
+	return ob->buf + ob->len;
+}
+
+static void outbuf_init(struct outbuf *ob, size_t size, long interval_ms,
+			int policy, size_t min_size)
+{
+	int flags;
+
+	memset(ob, 0, sizeof(*ob));
+
+	ob->fd = STDOUT_FILENO;
+	ob->size = size < min_size ? min_size : size;
+	ob->policy = policy;
+
+	if (interval_ms < 0)
+		interval_ms = isatty(ob->fd) ? 0 : DEFAULT_FLUSH_INTERVAL;
+	ob->interval_ns = (uint64_t)interval_ms * 1000000ULL;
+
+	ob->buf = malloc(ob->size);
+	if (!ob->buf)
+		die("out of memory");
+
+	if (policy == OVERLOAD_DROP) {
+		flags = fcntl(ob->fd, F_GETFL);
+		if (flags < 0)
+			die("unable to make the output non-blocking: %s",
+			    strerror(errno));
+
+		outbuf_orig_flags = flags;
+		atexit(outbuf_restore_flags);
+
+		if (fcntl(ob->fd, F_SETFL, flags | O_NONBLOCK) < 0)
+			die("unable to make the output non-blocking: %s",
+			    strerror(errno));
+	}
+}
+
+static void outbuf_finish(struct outbuf *ob)
+{
+	/* Whatever is left gets written out even in the drop mode. */
+	outbuf_restore_flags();
+	outbuf_orig_flags = -1;
+
+	outbuf_flush(ob);
+	free(ob->buf);
+
+	if (ob->policy == OVERLOAD_DROP)
+		fprintf(stderr, "%s: %lu events dropped\n",
+			get_progname(), ob->dropped);
+}
+
+/*
+ * The latency is the difference between the kernel timestamp of the event
+ * and the time at which we read it. It covers the time spent in the kernel
+ * FIFO and waking up the process.
+ */
+struct latency {
+	bool enabled;
+	clockid_t clock;
+	struct histogram total;
+	struct histogram interval;
+	uint64_t interval_ns;
+	uint64_t deadline_ns;
+	/* Events stamped in the future - usually means a wrong clock. */
+	unsigned long negative;
+};
+
+static clockid_t parse_clock(const char *str)
+{
+	if (strcmp(str, "realtime") == 0)
+		return CLOCK_REALTIME;
+	else if (strcmp(str, "monotonic") == 0)
+		return CLOCK_MONOTONIC;
+	else if (strcmp(str, "boottime") == 0)
+		return CLOCK_BOOTTIME;
+
+	die("invalid clock: %s", str);
+}
+
+static void latency_init(struct latency *lat)
+{
+	histogram_reset(&lat->total);
+	histogram_reset(&lat->interval);
+
+	if (lat->interval_ns)
+		lat->deadline_ns = monotonic_nsec() + lat->interval_ns;
+}
+
+/* Returns -1 for events stamped in the future. */
+static int64_t event_latency(clockid_t clock, struct gpiod_line_event *event)
+{
+	struct timespec now;
+	uint64_t now_ns, ts_ns;
+
+	clock_gettime(clock, &now);
+
+	now_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	ts_ns = (uint64_t)event->ts.tv_sec * 1000000000ULL + event->ts.tv_nsec;
+
+	return ts_ns > now_ns ? -1 : (int64_t)(now_ns - ts_ns);
+}
+
+static void latency_add(struct latency *lat, int64_t ns)
+{
+	if (ns < 0) {
+		lat->negative++;
+		return;
+	}
+
+	histogram_add(lat->interval_ns ? &lat->interval : &lat->total, ns);
+}
+
+static void latency_report(struct latency *lat)
+{
+	histogram_print(&lat->interval, stderr, "latency (interval)");
+	histogram_merge(&lat->total, &lat->interval);
+	histogram_reset(&lat->interval);
+
+	lat->deadline_ns += lat->interval_ns;
+}
+
+static void latency_finish(struct latency *lat)
+{
+	histogram_merge(&lat->total, &lat->interval);
+	histogram_print(&lat->total, stderr, "latency");
+
+	if (lat->negative)
+		fprintf(stderr,
+			"%s: %lu events had timestamps in the future - try a different --clock\n",
+			get_progname(), lat->negative);
+}
+
+/*
+ * Metrics are exported in the Prometheus text format. The event loop only
+ * bumps plain counters. The text is rendered from them once per interval
+ * and either written to a file, which is replaced atomically so that a
+ * collector never sees a partial update, or kept in memory and written as
+ * is to every client connecting to the unix socket. A scrape thus costs a
+ * single write however many lines are monitored and however often it
+ * happens.
+ */
+static const struct {
+	uint64_t ns;
+	const char *le;
+} metrics_latency_buckets[] = {
+	{ 1000ULL,		"0.000001" },
+	{ 10000ULL,		"0.00001" },
+	{ 50000ULL,		"0.00005" },
+	{ 100000ULL,		"0.0001" },
+	{ 500000ULL,		"0.0005" },
+	{ 1000000ULL,		"0.001" },
+	{ 5000000ULL,		"0.005" },
+	{ 10000000ULL,		"0.01" },
+	{ 100000000ULL,		"0.1" },
+	{ 1000000000ULL,	"1" },
+};
+
+#define METRICS_NUM_BUCKETS	(sizeof(metrics_latency_buckets) / \
+				 sizeof(*metrics_latency_buckets))
+
+static const char *const metrics_ioctl_names[] = {
+	"lineinfo",
+	"linehandle",
+	"lineevent",
+	"get_values",
+	"set_values",
+};
+
+/*
+ * A client of the metrics socket gets its own copy of the text so that it
+ * can be written out at the client's pace without stalling the events.
+ */
+#define METRICS_MAX_CLIENTS		8
+#define METRICS_CLIENT_TIMEOUT_NS	5000000000ULL
+
+struct metrics_client {
+	int fd;
+	char *text;
+	size_t len;
+	size_t written;
+	uint64_t deadline_ns;
+};
+
+struct metrics {
+	bool enabled;
+	const char *path;
+	char *tmp_path;
+	int listen_fd;
+	uint64_t interval_ns;
+	uint64_t deadline_ns;
+	char *text;
+	size_t text_len;
+	/* Not cumulative, the last one counts latencies above all bounds. */
+	uint64_t latency_buckets[METRICS_NUM_BUCKETS + 1];
+	uint64_t latency_count;
+	uint64_t latency_sum_ns;
+	uint64_t future_timestamps;
+	struct metrics_client clients[METRICS_MAX_CLIENTS];
 };
 
-static int event_callback(int type, const struct timespec *ts, void *data)
+static void metrics_listen(struct metrics *m, const char *path)
+{
+	struct sockaddr_un addr;
+	int status;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		die("socket path too long: %s", path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	m->listen_fd = socket(AF_UNIX,
+			      SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (m->listen_fd < 0)
+		die("unable to create the metrics socket: %s",
+		    strerror(errno));
+
+	unlink(path);
+
+	status = bind(m->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (status < 0)
+		die("unable to bind to %s: %s", path, strerror(errno));
+
+	status = listen(m->listen_fd, 16);
+	if (status < 0)
+		die("unable to listen on %s: %s", path, strerror(errno));
+}
+
+/* Must be called before the lines are requested. */
+static void metrics_init(struct metrics *m, struct monitor *mon,
+			 const char *dest, long interval_ms)
+{
+	unsigned int i;
+	int status;
+
+	m->enabled = true;
+	m->listen_fd = -1;
+	m->interval_ns = (uint64_t)interval_ms * 1000000ULL;
+
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++)
+		m->clients[i].fd = -1;
+
+	if (strncmp(dest, "unix:", 5) == 0) {
+		m->path = dest + 5;
+		metrics_listen(m, m->path);
+	} else {
+		m->path = dest;
+		m->tmp_path = malloc(strlen(dest) + sizeof(".tmp"));
+		if (!m->tmp_path)
+			die("out of memory");
+
+		sprintf(m->tmp_path, "%s.tmp", dest);
+	}
+
+	for (i = 0; i < mon->num_chips; i++) {
+		status = gpiod_chip_enable_stats(mon->chips[i].chip);
+		if (status < 0)
+			die_perror("unable to enable statistics");
+	}
+}
+
+static void metrics_add_latency(struct metrics *m, int64_t ns)
 {
-	struct callback_data *cbdata = data;
-	const char *evname = NULL;
+	unsigned int i;
 
-	switch (type) {
-	case GPIOD_EVENT_CB_RISING_EDGE:
-		if (cbdata->watch_rising) {
-			evname = " RISING EDGE";
-			cbdata->num_events_done++;
+	if (ns < 0) {
+		m->future_timestamps++;
+		return;
+	}
+
+	for (i = 0; i < METRICS_NUM_BUCKETS; i++) {
+		if ((uint64_t)ns <= metrics_latency_buckets[i].ns)
+			break;
+	}
+
+	m->latency_buckets[i]++;
+	m->latency_count++;
+	m->latency_sum_ns += ns;
+}
+
+static void metrics_print_label(FILE *fp, const char *str)
+{
+	for (; *str; str++) {
+		if (*str == '\\' || *str == '"')
+			fputc('\\', fp);
+
+		if (*str == '\n')
+			fputs("\\n", fp);
+		else
+			fputc(*str, fp);
+	}
+}
+
+static void metrics_header(FILE *fp, const char *name, const char *type,
+			   const char *help)
+{
+	fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void metrics_print_lines(FILE *fp, struct monitor *mon)
+{
+	struct mon_line *entry;
+	unsigned int i, edge;
+
+	metrics_header(fp, "gpiomon_events_total", "counter",
+		       "Number of edge events read per line.");
+
+	for (i = 0; i < mon->num_lines; i++) {
+		entry = &mon->lines[i];
+
+		for (edge = 0; edge < 2; edge++) {
+			fprintf(fp, "gpiomon_events_total{chip=\"");
+			metrics_print_label(fp, entry->chip_name);
+			fprintf(fp, "\",offset=\"%u\",line=\"", entry->offset);
+			metrics_print_label(fp, entry->name);
+			fprintf(fp, "\",edge=\"%s\"} %llu\n",
+				edge ? "rising" : "falling",
+				(unsigned long long)entry->edges[edge]);
 		}
-		break;
-	case GPIOD_EVENT_CB_FALLING_EDGE:
-		if (cbdata->watch_falling) {
-			evname = "FALLING_EDGE";
-			cbdata->num_events_done++;
+	}
+}
+
+static void metrics_print_latency(FILE *fp, struct metrics *m)
+{
+	uint64_t count = 0;
+	unsigned int i;
+
+	metrics_header(fp, "gpiomon_event_latency_seconds", "histogram",
+		       "Time from the kernel timestamp of an event until it was read.");
+
+	for (i = 0; i < METRICS_NUM_BUCKETS; i++) {
+		count += m->latency_buckets[i];
+		fprintf(fp, "gpiomon_event_latency_seconds_bucket{le=\"%s\"} %llu\n",
+			metrics_latency_buckets[i].le,
+			(unsigned long long)count);
+	}
+
+	fprintf(fp, "gpiomon_event_latency_seconds_bucket{le=\"+Inf\"} %llu\n",
+		(unsigned long long)m->latency_count);
+	fprintf(fp, "gpiomon_event_latency_seconds_sum %llu.%09llu\n",
+		(unsigned long long)(m->latency_sum_ns / 1000000000ULL),
+		(unsigned long long)(m->latency_sum_ns % 1000000000ULL));
+	fprintf(fp, "gpiomon_event_latency_seconds_count %llu\n",
+		(unsigned long long)m->latency_count);
+
+	metrics_header(fp, "gpiomon_event_future_timestamps_total", "counter",
+		       "Number of events stamped in the future, excluded from the latency.");
+	fprintf(fp, "gpiomon_event_future_timestamps_total %llu\n",
+		(unsigned long long)m->future_timestamps);
+}
+
+/*
+ * Lines found by name each come with their own chip object, statistics of
+ * chip objects for the same chip are added up.
+ */
+static void metrics_chip_stats(struct monitor *mon, unsigned int first,
+			       struct gpiod_stats *stats)
+{
+	const char *name = gpiod_chip_name(mon->chips[first].chip);
+	struct gpiod_stats tmp;
+	unsigned int i, j;
+
+	gpiod_chip_get_stats(mon->chips[first].chip, stats);
+
+	for (i = first + 1; i < mon->num_chips; i++) {
+		if (strcmp(gpiod_chip_name(mon->chips[i].chip), name) != 0)
+			continue;
+
+		gpiod_chip_get_stats(mon->chips[i].chip, &tmp);
+
+		for (j = 0; j < GPIOD_STATS_NUM_IOCTLS; j++) {
+			stats->ioctls[j].count += tmp.ioctls[j].count;
+			stats->ioctls[j].errors += tmp.ioctls[j].errors;
+			stats->ioctls[j].total_ns += tmp.ioctls[j].total_ns;
+		}
+	}
+}
+
+static bool metrics_chip_seen(struct monitor *mon, unsigned int index)
+{
+	const char *name = gpiod_chip_name(mon->chips[index].chip);
+	unsigned int i;
+
+	for (i = 0; i < index; i++) {
+		if (strcmp(gpiod_chip_name(mon->chips[i].chip), name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+enum {
+	METRICS_IOCTL_COUNT = 0,
+	METRICS_IOCTL_ERRORS,
+	METRICS_IOCTL_SECONDS,
+};
+
+static void metrics_print_ioctls(FILE *fp, struct monitor *mon,
+				 struct gpiod_stats *stats, int type,
+				 const char *name, const char *help)
+{
+	struct gpiod_ioctl_stats *ioctl;
+	const char *chip_name;
+	unsigned int i, j;
+
+	metrics_header(fp, name, "counter", help);
+
+	for (i = 0; i < mon->num_chips; i++) {
+		if (metrics_chip_seen(mon, i))
+			continue;
+
+		chip_name = gpiod_chip_name(mon->chips[i].chip);
+
+		for (j = 0; j < GPIOD_STATS_NUM_IOCTLS; j++) {
+			ioctl = &stats[i].ioctls[j];
+
+			fprintf(fp, "%s{chip=\"", name);
+			metrics_print_label(fp, chip_name);
+			fprintf(fp, "\",ioctl=\"%s\"} ", metrics_ioctl_names[j]);
+
+			if (type == METRICS_IOCTL_COUNT)
+				fprintf(fp, "%llu\n", ioctl->count);
+			else if (type == METRICS_IOCTL_ERRORS)
+				fprintf(fp, "%llu\n", ioctl->errors);
+			else
+				fprintf(fp, "%llu.%09llu\n",
+					ioctl->total_ns / 1000000000ULL,
+					ioctl->total_ns % 1000000000ULL);
 		}
-		break;
-	default:
-		break;
 	}
+}
+
+static void metrics_print_chips(FILE *fp, struct monitor *mon)
+{
+	struct gpiod_stats *stats;
+	unsigned int i;
+
+	stats = calloc(mon->num_chips, sizeof(*stats));
+	if (!stats)
+		die("out of memory");
+
+	for (i = 0; i < mon->num_chips; i++) {
+		if (!metrics_chip_seen(mon, i))
+			metrics_chip_stats(mon, i, &stats[i]);
+	}
+
+	metrics_print_ioctls(fp, mon, stats, METRICS_IOCTL_COUNT,
+			     "gpiomon_ioctls_total",
+			     "Number of ioctl() calls made on a chip, including line requests.");
+	metrics_print_ioctls(fp, mon, stats, METRICS_IOCTL_ERRORS,
+			     "gpiomon_ioctl_errors_total",
+			     "Number of ioctl() calls that failed.");
+	metrics_print_ioctls(fp, mon, stats, METRICS_IOCTL_SECONDS,
+			     "gpiomon_ioctl_seconds_total",
+			     "Time spent in ioctl() calls.");
+
+	free(stats);
+}
+
+/*
+ * A failed update is reported and retried on the next interval: a full
+ * disk or a directory that is briefly unavailable must not stop the
+ * monitoring. The previous file stays in place in the meantime.
+ */
+static void metrics_write_file(struct metrics *m)
+{
+	size_t written = 0;
+	ssize_t wr;
+	int fd;
+
+	fd = open(m->tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "%s: unable to open %s: %s\n",
+			get_progname(), m->tmp_path, strerror(errno));
+		return;
+	}
+
+	while (written < m->text_len) {
+		wr = write(fd, m->text + written, m->text_len - written);
+		if (wr < 0) {
+			if (errno == EINTR)
+				continue;
 
-	if (evname && !cbdata->silent)
-		printf("event: %s offset: %u timestamp: [%8ld.%09ld]\n",
-		       evname, cbdata->offset, ts->tv_sec, ts->tv_nsec);
+			fprintf(stderr, "%s: error writing metrics: %s\n",
+				get_progname(), strerror(errno));
+			close(fd);
+			unlink(m->tmp_path);
+			return;
+		}
 
-	if (cbdata->num_events_wanted &&
-	    cbdata->num_events_done >= cbdata->num_events_wanted)
-		do_run = false;
+		written += wr;
+	}
 
-	if (!do_run)
-		return GPIOD_EVENT_CB_STOP;
+	if (close(fd) < 0) {
+		fprintf(stderr, "%s: error writing metrics: %s\n",
+			get_progname(), strerror(errno));
+		unlink(m->tmp_path);
+		return;
+	}
+
+	if (rename(m->tmp_path, m->path) < 0) {
+		fprintf(stderr, "%s: unable to rename %s: %s\n",
+			get_progname(), m->tmp_path, strerror(errno));
+		unlink(m->tmp_path);
+	}
+}
 
-	return GPIOD_EVENT_CB_OK;
+static void metrics_client_close(struct metrics_client *c)
+{
+	close(c->fd);
+	free(c->text);
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+}
+
+/* Writes as much as the socket takes, the client is closed when done. */
+static void metrics_client_write(struct metrics_client *c)
+{
+	ssize_t wr;
+
+	while (c->written < c->len) {
+		wr = write(c->fd, c->text + c->written, c->len - c->written);
+		if (wr < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return;
+
+			break;
+		}
+
+		c->written += wr;
+	}
+
+	metrics_client_close(c);
+}
+
+/* Clients that don't read their metrics in time are disconnected. */
+static void metrics_expire_clients(struct metrics *m)
+{
+	uint64_t now = monotonic_nsec();
+	unsigned int i;
+
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+		if (m->clients[i].fd >= 0 && now >= m->clients[i].deadline_ns)
+			metrics_client_close(&m->clients[i]);
+	}
+}
+
+static void metrics_render(struct metrics *m, struct monitor *mon,
+			   struct outbuf *ob)
+{
+	FILE *fp;
+
+	free(m->text);
+
+	fp = open_memstream(&m->text, &m->text_len);
+	if (!fp)
+		die("out of memory");
+
+	metrics_print_lines(fp, mon);
+	metrics_print_latency(fp, m);
+
+	metrics_header(fp, "gpiomon_events_dropped_total", "counter",
+		       "Number of events not printed because the output couldn't keep up.");
+	fprintf(fp, "gpiomon_events_dropped_total %lu\n", ob->dropped);
+
+	metrics_print_chips(fp, mon);
+
+	if (fclose(fp) != 0)
+		die("out of memory");
+
+	if (m->listen_fd < 0)
+		metrics_write_file(m);
+	else
+		metrics_expire_clients(m);
+
+	m->deadline_ns = monotonic_nsec() + m->interval_ns;
+}
+
+static struct metrics_client *metrics_free_client(struct metrics *m)
+{
+	unsigned int i;
+
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+		if (m->clients[i].fd < 0)
+			return &m->clients[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Fills the listening socket followed by the client slots. New
+ * connections wait in the backlog while all the slots are taken.
+ */
+static void metrics_poll_fds(struct metrics *m, struct pollfd *fds)
+{
+	unsigned int i;
+
+	fds[0].fd = m->listen_fd;
+	fds[0].events = metrics_free_client(m) ? POLLIN : 0;
+
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+		fds[i + 1].fd = m->clients[i].fd;
+		fds[i + 1].events = POLLOUT;
+	}
+}
+
+/* Every client gets the last rendered metrics and is disconnected. */
+static void metrics_serve(struct metrics *m, struct pollfd *fds)
+{
+	struct metrics_client *c;
+	unsigned int i;
+	int fd;
+
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+		if (fds[i + 1].fd >= 0 && fds[i + 1].revents &&
+		    m->clients[i].fd == fds[i + 1].fd)
+			metrics_client_write(&m->clients[i]);
+	}
+
+	if (!fds[0].revents)
+		return;
+
+	while ((c = metrics_free_client(m))) {
+		fd = accept4(m->listen_fd, NULL, NULL,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			break;
+
+		c->text = malloc(m->text_len);
+		if (!c->text) {
+			close(fd);
+			break;
+		}
+
+		memcpy(c->text, m->text, m->text_len);
+		c->fd = fd;
+		c->len = m->text_len;
+		c->written = 0;
+		c->deadline_ns = monotonic_nsec() + METRICS_CLIENT_TIMEOUT_NS;
+
+		metrics_client_write(c);
+	}
+}
+
+static void metrics_finish(struct metrics *m, struct monitor *mon,
+			   struct outbuf *ob)
+{
+	unsigned int i;
+
+	if (m->listen_fd >= 0) {
+		for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+			if (m->clients[i].fd >= 0)
+				metrics_client_close(&m->clients[i]);
+		}
+
+		close(m->listen_fd);
+		unlink(m->path);
+	} else {
+		metrics_render(m, mon, ob);
+	}
+
+	free(m->tmp_path);
+	free(m->text);
+}
+
+static void print_event(struct outbuf *ob, struct fmt_prog *prog,
+			struct mon_line *entry,
+			struct gpiod_line_event *event)
+{
+	size_t max_len;
+	char *buf;
+
+	max_len = prog->max_len + entry->chip_name_len + entry->name_len;
+
+	buf = outbuf_reserve(ob, max_len);
+	if (!buf)
+		return;
+
+	ob->len += fmt_event(prog, buf, entry, event);
+
+	if (ob->len && !ob->blocked && monotonic_nsec() >= ob->deadline_ns)
+		outbuf_flush(ob);
 }
 
 int main(int argc, char **argv)
 {
-	struct callback_data cbdata;
-	bool active_low = false;
-	struct timespec timeout;
-	int optc, opti, status;
-	unsigned int offset;
-	char *device, *end;
+	unsigned int num_events_wanted = 0, num_events_done = 0, i;
+	bool watch_rising = false, watch_falling = false;
+	bool active_low = false, silent = false, daemonize = false;
+	long metrics_interval = DEFAULT_METRICS_INTERVAL;
+	int optc, opti, status, policy = OVERLOAD_BLOCK;
+	const char *metrics_dest = NULL;
+	unsigned int num_fds, out_idx;
+	size_t buffer_size = DEFAULT_BUFFER_SIZE, min_size;
+	struct timespec timeout, *timeoutp;
+	const char *format = DEFAULT_FORMAT;
+	struct gpiod_line_event event;
+	sigset_t sigmask, origmask;
+	long flush_interval = -1;
+	struct metrics metrics;
+	struct fmt_prog prog;
+	struct latency lat;
+	struct monitor mon;
+	struct pollfd *fds;
+	struct outbuf ob;
+	uint64_t now, deadline;
+	int64_t latency;
+	char *end;
 
 	set_progname(argv[0]);
 
-	memset(&cbdata, 0, sizeof(cbdata));
+	memset(&mon, 0, sizeof(mon));
+	memset(&lat, 0, sizeof(lat));
+	memset(&metrics, 0, sizeof(metrics));
+	lat.clock = CLOCK_REALTIME;
 
 	for (;;) {
 		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
@@ -126,18 +1363,63 @@ int main(int argc, char **argv)
 			active_low = true;
 			break;
 		case 'n':
-			cbdata.num_events_wanted = strtoul(optarg, &end, 10);
+			num_events_wanted = strtoul(optarg, &end, 10);
 			if (*end != '\0')
 				die("invalid number: %s", optarg);
 			break;
 		case 's':
-			cbdata.silent = true;
+			silent = true;
 			break;
 		case 'r':
-			cbdata.watch_rising = true;
+			watch_rising = true;
 			break;
 		case 'f':
-			cbdata.watch_falling = true;
+			watch_falling = true;
+			break;
+		case 'F':
+			format = optarg;
+			break;
+		case 'b':
+			buffer_size = strtoul(optarg, &end, 10);
+			if (*end != '\0')
+				die("invalid buffer size: %s", optarg);
+			break;
+		case 'i':
+			flush_interval = strtol(optarg, &end, 10);
+			if (*end != '\0' || flush_interval < 0)
+				die("invalid flush interval: %s", optarg);
+			break;
+		case 'o':
+			if (strcmp(optarg, "block") == 0)
+				policy = OVERLOAD_BLOCK;
+			else if (strcmp(optarg, "drop") == 0)
+				policy = OVERLOAD_DROP;
+			else
+				die("invalid overload policy: %s", optarg);
+			break;
+		case 'L':
+			lat.enabled = true;
+			break;
+		case 'I':
+			lat.interval_ns = strtoul(optarg, &end, 10) *
+					  1000000000ULL;
+			if (*end != '\0' || !lat.interval_ns)
+				die("invalid latency interval: %s", optarg);
+			lat.enabled = true;
+			break;
+		case 'C':
+			lat.clock = parse_clock(optarg);
+			break;
+		case 'm':
+			metrics_dest = optarg;
+			break;
+		case 'M':
+			metrics_interval = strtol(optarg, &end, 10);
+			if (*end != '\0' || metrics_interval <= 0)
+				die("invalid metrics interval: %s", optarg);
+			break;
+		case 'D':
+			daemonize = true;
 			break;
 		case '?':
 			die("try %s --help", get_progname());
@@ -146,35 +1428,186 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (!cbdata.watch_rising && !cbdata.watch_falling)
-		cbdata.watch_rising = cbdata.watch_falling = true;
+	if (watch_rising && !watch_falling)
+		mon.default_event_type = GPIOD_EVENT_RISING_EDGE;
+	else if (watch_falling && !watch_rising)
+		mon.default_event_type = GPIOD_EVENT_FALLING_EDGE;
+	else
+		mon.default_event_type = GPIOD_EVENT_BOTH_EDGES;
 
 	argc -= optind;
 	argv += optind;
 
 	if (argc < 1)
-		die("gpiochip must be specified");
+		die("at least one gpio line must be specified");
 
-	if (argc < 2)
-		die("gpio line offset must be specified");
+	if (daemonize && !silent && isatty(STDOUT_FILENO))
+		die("--background needs --silent or a redirected standard output");
 
-	device = argv[0];
-	offset = strtoul(argv[1], &end, 10);
-	if (*end != '\0' || offset > INT_MAX)
-		die("invalid GPIO offset: %s", argv[1]);
+	fmt_compile(&prog, format);
+	parse_lines(&mon, argc, argv);
+	if (metrics_dest)
+		metrics_init(&metrics, &mon, metrics_dest, metrics_interval);
+	request_lines(&mon, active_low);
+
+	/* The buffer must be able to hold at least one event. */
+	for (i = 0, min_size = 0; i < mon.num_lines; i++) {
+		if (mon.lines[i].chip_name_len + mon.lines[i].name_len > min_size)
+			min_size = mon.lines[i].chip_name_len +
+				   mon.lines[i].name_len;
+	}
+
+	outbuf_init(&ob, buffer_size, flush_interval, policy,
+		    min_size + prog.max_len);
+
+	/*
+	 * The output is polled after the lines, followed by the metrics
+	 * socket and its clients if any. The output slot stays disabled
+	 * until a write would block.
+	 */
+	fds = calloc(mon.num_lines + 2 + METRICS_MAX_CLIENTS, sizeof(*fds));
+	if (!fds)
+		die("out of memory");
+
+	for (i = 0; i < mon.num_lines; i++) {
+		fds[i].fd = gpiod_line_event_get_fd(mon.lines[i].line);
+		fds[i].events = POLLIN | POLLPRI;
+	}
 
-	cbdata.offset = offset;
+	out_idx = mon.num_lines;
+	fds[out_idx].fd = -1;
+	fds[out_idx].events = POLLOUT;
 
-	timeout.tv_sec = 0;
-	timeout.tv_nsec = 500000000;
+	num_fds = out_idx + 1;
+	if (metrics.enabled && metrics.listen_fd >= 0)
+		num_fds += METRICS_MAX_CLIENTS + 1;
+
+	/*
+	 * Keep relative paths of the output and the metrics valid as well as
+	 * the redirected standard output the events are printed to.
+	 */
+	if (daemonize) {
+		status = daemon(1, !silent);
+		if (status < 0)
+			die("unable to daemonize: %s", strerror(errno));
+	}
+
+	/*
+	 * Signals are only unblocked while sleeping in ppoll() so that we
+	 * can wait without a timeout and still never miss a stop request.
+	 */
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGINT);
+	sigaddset(&sigmask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigmask, &origmask);
 
 	signal(SIGINT, sighandler);
 	signal(SIGTERM, sighandler);
 
-	status = gpiod_simple_event_loop("gpiomon", device, offset, active_low,
-					 &timeout, event_callback, &cbdata);
-	if (status < 0)
-		die_perror("error waiting for events");
+	if (lat.enabled)
+		latency_init(&lat);
+	if (metrics.enabled)
+		metrics_render(&metrics, &mon, &ob);
+
+	while (do_run) {
+		/*
+		 * Only wake up on time if there's buffered output or a
+		 * periodic latency report or metrics update is due. Output
+		 * that can't be written right now waits for POLLOUT.
+		 */
+		deadline = UINT64_MAX;
+		if (ob.len && !ob.blocked)
+			deadline = ob.deadline_ns;
+		if (lat.interval_ns && lat.deadline_ns < deadline)
+			deadline = lat.deadline_ns;
+		if (metrics.enabled && metrics.deadline_ns < deadline)
+			deadline = metrics.deadline_ns;
+
+		timeoutp = NULL;
+		if (deadline != UINT64_MAX) {
+			now = monotonic_nsec();
+			if (ob.len && !ob.blocked && now >= ob.deadline_ns) {
+				outbuf_flush(&ob);
+				continue;
+			}
+			if (lat.interval_ns && now >= lat.deadline_ns) {
+				latency_report(&lat);
+				continue;
+			}
+			if (metrics.enabled && now >= metrics.deadline_ns) {
+				metrics_render(&metrics, &mon, &ob);
+				continue;
+			}
+
+			timeout.tv_sec = (deadline - now) / 1000000000ULL;
+			timeout.tv_nsec = (deadline - now) % 1000000000ULL;
+			timeoutp = &timeout;
+		}
+
+		fds[out_idx].fd = ob.len && ob.blocked ? ob.fd : -1;
+		if (num_fds > out_idx + 1)
+			metrics_poll_fds(&metrics, fds + out_idx + 1);
+
+		status = ppoll(fds, num_fds, timeoutp, &origmask);
+		if (status < 0) {
+			if (errno == EINTR)
+				continue;
+
+			die("error waiting for events: %s", strerror(errno));
+		}
+
+		for (i = 0; i < mon.num_lines && do_run; i++) {
+			if (!fds[i].revents)
+				continue;
+
+			status = gpiod_line_event_read_fd(fds[i].fd, &event);
+			if (status < 0)
+				die_perror("error reading line event");
+
+			mon.lines[i].edges[event.event_type ==
+					   GPIOD_EVENT_RISING_EDGE]++;
+
+			if (lat.enabled || metrics.enabled) {
+				latency = event_latency(lat.clock, &event);
+				if (lat.enabled)
+					latency_add(&lat, latency);
+				if (metrics.enabled)
+					metrics_add_latency(&metrics, latency);
+			}
+
+			if (!silent)
+				print_event(&ob, &prog, &mon.lines[i], &event);
+
+			num_events_done++;
+			if (num_events_wanted &&
+			    num_events_done >= num_events_wanted)
+				do_run = false;
+		}
+
+		if (fds[out_idx].fd >= 0 && fds[out_idx].revents)
+			outbuf_flush(&ob);
+
+		if (num_fds > out_idx + 1)
+			metrics_serve(&metrics, fds + out_idx + 1);
+	}
+
+	outbuf_finish(&ob);
+
+	if (metrics.enabled)
+		metrics_finish(&metrics, &mon, &ob);
+
+	if (lat.enabled)
+		latency_finish(&lat);
+
+	for (i = 0; i < mon.num_chips; i++) {
+		gpiod_chip_close(mon.chips[i].chip);
+		free(mon.chips[i].device);
+	}
+
+	free(mon.chips);
+	free(mon.lines);
+	free(prog.ops);
+	free(fds);
 
 	return EXIT_SUCCESS;
 }
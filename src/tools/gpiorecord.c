@@ -0,0 +1,441 @@
+/*
+ * Record events on GPIO lines into a compact binary log.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "tools-common.h"
+#include "record-format.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "active-low",		no_argument,		NULL,	'l' },
+	{ "num-events",		required_argument,	NULL,	'n' },
+	{ "rising-edge",	no_argument,		NULL,	'r' },
+	{ "falling-edge",	no_argument,		NULL,	'f' },
+	{ "flush-interval",	required_argument,	NULL,	'i' },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvln:rfi:";
+
+static void print_help(void)
+{
+	printf("Usage: %s [OPTIONS] <file> <chip name/number> <offset 1> <offset 2> ...\n",
+	       get_progname());
+	printf("Record events on GPIO lines into a binary log\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -l, --active-low:\tset the line active state to low\n");
+	printf("  -n, --num-events=NUM:\texit after recording NUM events\n");
+	printf("  -r, --rising-edge:\tonly record rising edge events\n");
+	printf("  -f, --falling-edge:\tonly record falling edge events\n");
+	printf("  -i, --flush-interval=MS:\n");
+	printf("\t\t\twrite out the partially filled block every MS milliseconds\n");
+	printf("\t\t\t(default: 1000)\n");
+}
+
+static volatile bool do_run = true;
+
+static void sighandler(int signum UNUSED)
+{
+	do_run = false;
+}
+
+struct recorder {
+	int fd;
+	union {
+		uint8_t buf[RECORD_BLOCK_SIZE];
+		struct record_block hdr;
+	} block;
+	uint64_t prev_ns;
+	unsigned int prev_index;
+	/* When the oldest record that isn't in the file yet was added. */
+	uint64_t pending_ns;
+	uint64_t values;
+	/* Lines that already have an event in the current block. */
+	uint64_t seen;
+	/* Records of the current block that are already in the file. */
+	uint32_t written;
+	unsigned long num_events;
+	unsigned long num_blocks;
+};
+
+static uint64_t clock_nsec(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint8_t * block_data(struct recorder *rec)
+{
+	return rec->block.buf + sizeof(struct record_block);
+}
+
+static void write_all(int fd, const void *buf, size_t size, off_t offset)
+{
+	const uint8_t *ptr = buf;
+	ssize_t wr;
+
+	while (size) {
+		wr = pwrite(fd, ptr, size, offset);
+		if (wr < 0) {
+			if (errno == EINTR)
+				continue;
+
+			die("error writing the log: %s", strerror(errno));
+		}
+
+		ptr += wr;
+		size -= wr;
+		offset += wr;
+	}
+}
+
+/*
+ * The current block is rewritten in place until it's full. The records
+ * go out before the header so that a reader never sees a header that
+ * accounts for records that aren't in the file yet.
+ */
+static void block_write(struct recorder *rec)
+{
+	off_t offset = (off_t)(rec->num_blocks + 1) * RECORD_BLOCK_SIZE;
+
+	if (rec->written == rec->block.hdr.num_records)
+		return;
+
+	/* Unused space is zeroed so that the file compresses well. */
+	memset(block_data(rec) + rec->block.hdr.used, 0,
+	       RECORD_BLOCK_DATA - rec->block.hdr.used);
+
+	write_all(rec->fd, block_data(rec), RECORD_BLOCK_DATA,
+		  offset + sizeof(struct record_block));
+	write_all(rec->fd, &rec->block.hdr, sizeof(rec->block.hdr), offset);
+
+	rec->written = rec->block.hdr.num_records;
+}
+
+/* Writes out the current block and moves on to the next one. */
+static void block_close(struct recorder *rec)
+{
+	if (!rec->block.hdr.num_records)
+		return;
+
+	block_write(rec);
+
+	memset(&rec->block.hdr, 0, sizeof(rec->block.hdr));
+	rec->written = 0;
+	rec->num_blocks++;
+}
+
+static void record_append(struct recorder *rec, struct record_event *event)
+{
+	uint8_t tmp[RECORD_MAX_SIZE];
+	int64_t index_delta;
+	size_t len;
+
+	if (!rec->block.hdr.num_records) {
+		rec->block.hdr.first_ns = event->ts_ns;
+		rec->block.hdr.values = rec->values;
+		rec->prev_ns = event->ts_ns;
+		rec->prev_index = 0;
+		rec->seen = 0;
+	}
+
+	index_delta = (int64_t)event->index - rec->prev_index;
+
+	len = record_put_varint(tmp, record_zigzag(event->ts_ns -
+						   rec->prev_ns));
+	len += record_put_varint(tmp + len,
+				 record_zigzag(index_delta) << 1 |
+				 event->rising);
+
+	if (rec->block.hdr.used + len > RECORD_BLOCK_DATA) {
+		block_close(rec);
+		record_append(rec, event);
+		return;
+	}
+
+	/*
+	 * When only one edge is recorded the other one never updates the
+	 * tracked values, but a line is known to be at the opposite level
+	 * right before an edge. Whatever the mode, the first event of a line
+	 * in the block tells its state at the start of the block.
+	 */
+	if (!(rec->seen & (1ULL << event->index))) {
+		rec->seen |= 1ULL << event->index;
+
+		if (event->rising)
+			rec->block.hdr.values &= ~(1ULL << event->index);
+		else
+			rec->block.hdr.values |= 1ULL << event->index;
+	}
+
+	if (rec->written == rec->block.hdr.num_records)
+		rec->pending_ns = clock_nsec(CLOCK_MONOTONIC);
+
+	memcpy(block_data(rec) + rec->block.hdr.used, tmp, len);
+	rec->block.hdr.used += len;
+	rec->block.hdr.num_records++;
+	rec->prev_ns = event->ts_ns;
+	rec->prev_index = event->index;
+	rec->num_events++;
+
+	if (event->rising)
+		rec->values |= 1ULL << event->index;
+	else
+		rec->values &= ~(1ULL << event->index);
+}
+
+static void write_header(struct recorder *rec, struct gpiod_chip *chip,
+			 struct gpiod_line_bulk *bulk)
+{
+	uint8_t buf[RECORD_BLOCK_SIZE];
+	struct record_header *hdr = (struct record_header *)buf;
+	unsigned int i;
+	int value;
+
+	memset(buf, 0, sizeof(buf));
+
+	memcpy(hdr->magic, RECORD_MAGIC, sizeof(hdr->magic));
+	hdr->version = RECORD_VERSION;
+	hdr->num_lines = bulk->num_lines;
+	hdr->start_ns = clock_nsec(CLOCK_REALTIME);
+	strncpy(hdr->chip_name, gpiod_chip_name(chip),
+		sizeof(hdr->chip_name) - 1);
+
+	for (i = 0; i < bulk->num_lines; i++) {
+		hdr->offsets[i] = gpiod_line_offset(bulk->lines[i]);
+
+		value = gpiod_line_get_value(bulk->lines[i]);
+		if (value < 0)
+			die_perror("error reading GPIO values");
+		if (value)
+			hdr->initial_values |= 1ULL << i;
+	}
+
+	rec->values = hdr->initial_values;
+
+	write_all(rec->fd, buf, sizeof(buf), 0);
+}
+
+/* Events read in one go are sorted by time before being appended. */
+static void sort_events(struct record_event *events, unsigned int num)
+{
+	struct record_event tmp;
+	unsigned int i, j;
+
+	for (i = 1; i < num; i++) {
+		tmp = events[i];
+		for (j = i; j > 0 && events[j - 1].ts_ns > tmp.ts_ns; j--)
+			events[j] = events[j - 1];
+		events[j] = tmp;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct record_event events[RECORD_MAX_LINES];
+	struct pollfd fds[RECORD_MAX_LINES];
+	unsigned long num_events_wanted = 0;
+	unsigned int offset, num_lines, i, num;
+	struct gpiod_line_evreq_config config;
+	bool watch_rising = false, watch_falling = false;
+	struct timespec flush_interval = { 1, 0 };
+	struct gpiod_line_event event;
+	bool active_low = false;
+	struct gpiod_chip *chip;
+	struct gpiod_line *line;
+	int optc, opti, status;
+	struct recorder rec;
+	uint64_t flush_ns;
+	unsigned long ms;
+	char *end;
+
+	set_progname(argv[0]);
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'l':
+			active_low = true;
+			break;
+		case 'n':
+			num_events_wanted = strtoul(optarg, &end, 10);
+			if (*end != '\0')
+				die("invalid number: %s", optarg);
+			break;
+		case 'r':
+			watch_rising = true;
+			break;
+		case 'f':
+			watch_falling = true;
+			break;
+		case 'i':
+			ms = strtoul(optarg, &end, 10);
+			if (*end != '\0' || !ms)
+				die("invalid flush interval: %s", optarg);
+			flush_interval.tv_sec = ms / 1000;
+			flush_interval.tv_nsec = (ms % 1000) * 1000000;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1)
+		die("output file must be specified");
+
+	if (argc < 2)
+		die("gpiochip must be specified");
+
+	if (argc < 3)
+		die("at least one gpio line offset must be specified");
+
+	num_lines = argc - 2;
+	if (num_lines > RECORD_MAX_LINES)
+		die("at most %d lines can be recorded", RECORD_MAX_LINES);
+
+	chip = gpiod_chip_open_lookup(argv[1]);
+	if (!chip)
+		die_perror("unable to open %s", argv[1]);
+
+	for (i = 0; i < num_lines; i++) {
+		offset = strtoul(argv[i + 2], &end, 10);
+		if (*end != '\0' || offset > INT_MAX)
+			die("invalid GPIO offset: %s", argv[i + 2]);
+
+		line = gpiod_chip_get_line(chip, offset);
+		if (!line)
+			die_perror("unable to retrieve GPIO line from chip");
+
+		gpiod_line_bulk_add(&bulk, line);
+	}
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiorecord";
+	config.active_state = active_low ? GPIOD_ACTIVE_STATE_LOW
+					 : GPIOD_ACTIVE_STATE_HIGH;
+	if (watch_rising && !watch_falling)
+		config.event_type = GPIOD_EVENT_RISING_EDGE;
+	else if (watch_falling && !watch_rising)
+		config.event_type = GPIOD_EVENT_FALLING_EDGE;
+	else
+		config.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	status = gpiod_line_event_request_bulk(&bulk, &config);
+	if (status < 0)
+		die_perror("unable to request line events");
+
+	memset(fds, 0, sizeof(fds));
+	for (i = 0; i < num_lines; i++) {
+		fds[i].fd = gpiod_line_event_get_fd(bulk.lines[i]);
+		fds[i].events = POLLIN | POLLPRI;
+	}
+
+	flush_ns = (uint64_t)flush_interval.tv_sec * 1000000000ULL +
+		   flush_interval.tv_nsec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.fd = open(argv[0], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (rec.fd < 0)
+		die("unable to open %s: %s", argv[0], strerror(errno));
+
+	write_header(&rec, chip, &bulk);
+
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+
+	while (do_run) {
+		status = ppoll(fds, num_lines, &flush_interval, NULL);
+		if (status < 0) {
+			if (errno == EINTR)
+				continue;
+
+			die("error waiting for events: %s", strerror(errno));
+		} else if (status == 0) {
+			block_write(&rec);
+			continue;
+		}
+
+		/* Drain every line that has something to read. */
+		for (i = 0, num = 0; i < num_lines; i++) {
+			if (!fds[i].revents)
+				continue;
+
+			status = gpiod_line_event_read_fd(fds[i].fd, &event);
+			if (status < 0)
+				die_perror("error reading line event");
+
+			events[num].ts_ns = (uint64_t)event.ts.tv_sec *
+					    1000000000ULL + event.ts.tv_nsec;
+			events[num].index = i;
+			events[num].rising =
+				event.event_type == GPIOD_EVENT_RISING_EDGE;
+			num++;
+		}
+
+		sort_events(events, num);
+
+		for (i = 0; i < num; i++) {
+			record_append(&rec, &events[i]);
+
+			if (num_events_wanted &&
+			    rec.num_events >= num_events_wanted) {
+				do_run = false;
+				break;
+			}
+		}
+
+		/* Don't keep a slow trickle of events in memory forever. */
+		if (rec.written != rec.block.hdr.num_records &&
+		    clock_nsec(CLOCK_MONOTONIC) - rec.pending_ns >= flush_ns)
+			block_write(&rec);
+	}
+
+	block_close(&rec);
+	close(rec.fd);
+
+	fprintf(stderr, "%s: %lu events in %lu blocks\n",
+		get_progname(), rec.num_events, rec.num_blocks);
+
+	gpiod_chip_close(chip);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,419 @@
+/*
+ * Replay events recorded by gpiorecord on GPIO output lines.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include <gpiod.h>
+#include "tools-common.h"
+#include "record-format.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const struct option longopts[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "version",		no_argument,		NULL,	'v' },
+	{ "active-low",		no_argument,		NULL,	'l' },
+	{ "speed",		required_argument,	NULL,	's' },
+	{ "start",		required_argument,	NULL,	'S' },
+	{ "chip",		required_argument,	NULL,	'c' },
+	{ "dump",		no_argument,		NULL,	'd' },
+	{ 0 },
+};
+
+static const char *const shortopts = "+hvls:S:c:d";
+
+static void print_help(void)
+{
+	printf("Usage: %s [OPTIONS] <file>\n", get_progname());
+	printf("Drive GPIO lines with the events stored by gpiorecord\n");
+	printf("Options:\n");
+	printf("  -h, --help:\t\tdisplay this message and exit\n");
+	printf("  -v, --version:\tdisplay the version and exit\n");
+	printf("  -l, --active-low:\tset the line active state to low\n");
+	printf("  -s, --speed=FACTOR:\tscale the replay speed (default: 1.0)\n");
+	printf("  -S, --start=SEC:\tstart SEC seconds after the first event\n");
+	printf("  -c, --chip=CHIP:\tuse CHIP instead of the recorded gpiochip\n");
+	printf("  -d, --dump:\t\tprint the events instead of replaying them\n");
+}
+
+static volatile bool do_run = true;
+
+static void sighandler(int signum UNUSED)
+{
+	do_run = false;
+}
+
+struct log_file {
+	const uint8_t *map;
+	size_t size;
+	const struct record_header *hdr;
+	unsigned long num_blocks;
+};
+
+struct cursor {
+	const struct record_block *block;
+	const uint8_t *data;
+	size_t pos;
+	unsigned int records_left;
+	uint64_t prev_ns;
+	unsigned int prev_index;
+};
+
+static const struct record_block * log_block(struct log_file *log,
+					     unsigned long index)
+{
+	return (const struct record_block *)(log->map +
+					     (index + 1) * RECORD_BLOCK_SIZE);
+}
+
+static void log_open(struct log_file *log, const char *path)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		die("unable to open %s: %s", path, strerror(errno));
+
+	if (fstat(fd, &st) < 0)
+		die("unable to stat %s: %s", path, strerror(errno));
+
+	if (st.st_size < RECORD_BLOCK_SIZE)
+		die("%s: not a gpiorecord log", path);
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		die("unable to map %s: %s", path, strerror(errno));
+
+	close(fd);
+
+	log->map = map;
+	log->size = st.st_size;
+	log->hdr = map;
+	/* A partially written trailing block is ignored. */
+	log->num_blocks = st.st_size / RECORD_BLOCK_SIZE - 1;
+
+	if (memcmp(log->hdr->magic, RECORD_MAGIC, sizeof(log->hdr->magic)))
+		die("%s: not a gpiorecord log", path);
+
+	if (log->hdr->version != RECORD_VERSION)
+		die("%s: unsupported log version %u", path, log->hdr->version);
+
+	if (!log->hdr->num_lines || log->hdr->num_lines > RECORD_MAX_LINES)
+		die("%s: invalid number of lines", path);
+}
+
+/* Find the last block starting at or before given time. */
+static unsigned long log_find_block(struct log_file *log, uint64_t ts_ns)
+{
+	unsigned long lo = 0, hi = log->num_blocks, mid;
+
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+
+		if (log_block(log, mid)->first_ns <= ts_ns)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void cursor_init(struct cursor *cur, struct log_file *log,
+			unsigned long index)
+{
+	cur->block = log_block(log, index);
+	cur->data = (const uint8_t *)cur->block + sizeof(struct record_block);
+	cur->pos = 0;
+	cur->records_left = cur->block->num_records;
+	cur->prev_ns = cur->block->first_ns;
+	cur->prev_index = 0;
+
+	if (cur->block->used > RECORD_BLOCK_DATA)
+		die("corrupted block %lu", index);
+}
+
+static bool cursor_next(struct cursor *cur, unsigned int num_lines,
+			struct record_event *event)
+{
+	uint64_t ts_delta, tmp;
+	int64_t index;
+	size_t len;
+
+	if (!cur->records_left)
+		return false;
+
+	len = record_get_varint(cur->data + cur->pos,
+				cur->block->used - cur->pos, &ts_delta);
+	if (!len)
+		die("truncated record");
+	cur->pos += len;
+
+	len = record_get_varint(cur->data + cur->pos,
+				cur->block->used - cur->pos, &tmp);
+	if (!len)
+		die("truncated record");
+	cur->pos += len;
+
+	index = (int64_t)cur->prev_index + record_unzigzag(tmp >> 1);
+	if (index < 0 || index >= num_lines)
+		die("invalid line index in record");
+
+	event->ts_ns = cur->prev_ns + record_unzigzag(ts_delta);
+	event->index = index;
+	event->rising = tmp & 1;
+
+	cur->prev_ns = event->ts_ns;
+	cur->prev_index = index;
+	cur->records_left--;
+
+	return true;
+}
+
+static uint64_t monotonic_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+		if (!do_run)
+			return;
+	}
+}
+
+static void values_to_array(uint64_t values, int *vals, unsigned int num)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		vals[i] = !!(values & (1ULL << i));
+}
+
+static void dump_event(struct log_file *log, struct record_event *event)
+{
+	printf("event: %s offset: %u timestamp: [%8llu.%09llu]\n",
+	       event->rising ? " RISING EDGE" : "FALLING EDGE",
+	       log->hdr->offsets[event->index],
+	       (unsigned long long)(event->ts_ns / 1000000000ULL),
+	       (unsigned long long)(event->ts_ns % 1000000000ULL));
+}
+
+int main(int argc, char **argv)
+{
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	uint64_t start_ns, values, base_ns, due_ns, prev_due = 0;
+	int vals[RECORD_MAX_LINES], optc, opti, status;
+	const char *chip_name = NULL;
+	unsigned long block, num_events = 0;
+	struct gpiod_chip *chip = NULL;
+	bool active_low = false, dump = false, pending = false;
+	struct record_event event;
+	double speed = 1.0, start = 0.0;
+	struct gpiod_line *line;
+	struct log_file log;
+	struct cursor cur;
+	unsigned int i;
+	char *end;
+
+	set_progname(argv[0]);
+
+	for (;;) {
+		optc = getopt_long(argc, argv, shortopts, longopts, &opti);
+		if (optc < 0)
+			break;
+
+		switch (optc) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'v':
+			print_version();
+			return EXIT_SUCCESS;
+		case 'l':
+			active_low = true;
+			break;
+		case 's':
+			speed = strtod(optarg, &end);
+			if (*end != '\0' || speed <= 0.0)
+				die("invalid speed: %s", optarg);
+			break;
+		case 'S':
+			start = strtod(optarg, &end);
+			if (*end != '\0' || start < 0.0)
+				die("invalid start time: %s", optarg);
+			break;
+		case 'c':
+			chip_name = optarg;
+			break;
+		case 'd':
+			dump = true;
+			break;
+		case '?':
+			die("try %s --help", get_progname());
+		default:
+			abort();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1)
+		die("log file must be specified");
+
+	memset(&log, 0, sizeof(log));
+	log_open(&log, argv[0]);
+
+	/*
+	 * The header only stores the wall clock time at which the recording
+	 * started, while the events carry the kernel's timestamps - which may
+	 * come from a different clock. Seek relative to the first event.
+	 */
+	start_ns = log.num_blocks ? log_block(&log, 0)->first_ns : 0;
+	start_ns += (uint64_t)(start * 1000000000.0);
+
+	/*
+	 * The block header holds the line state before its first event so
+	 * seeking doesn't require decoding anything that precedes it.
+	 */
+	block = log_find_block(&log, start_ns);
+	values = log.num_blocks ? log_block(&log, block)->values
+				: log.hdr->initial_values;
+
+	if (!dump) {
+		if (!chip_name)
+			chip_name = log.hdr->chip_name;
+
+		chip = gpiod_chip_open_lookup(chip_name);
+		if (!chip)
+			die_perror("unable to open %s", chip_name);
+
+		for (i = 0; i < log.hdr->num_lines; i++) {
+			line = gpiod_chip_get_line(chip, log.hdr->offsets[i]);
+			if (!line)
+				die_perror("unable to retrieve GPIO line from chip");
+
+			gpiod_line_bulk_add(&bulk, line);
+		}
+	}
+
+	if (log.num_blocks)
+		cursor_init(&cur, &log, block);
+
+	/* Apply the events from the start of the block up to the seek point. */
+	while (log.num_blocks) {
+		if (!cursor_next(&cur, log.hdr->num_lines, &event)) {
+			if (++block >= log.num_blocks)
+				break;
+
+			cursor_init(&cur, &log, block);
+			continue;
+		}
+
+		if (event.ts_ns >= start_ns) {
+			pending = true;
+			break;
+		}
+
+		if (event.rising)
+			values |= 1ULL << event.index;
+		else
+			values &= ~(1ULL << event.index);
+	}
+
+	if (!dump) {
+		values_to_array(values, vals, log.hdr->num_lines);
+
+		status = gpiod_line_request_bulk_output(&bulk, "gpioreplay",
+							active_low, vals);
+		if (status < 0)
+			die_perror("unable to request lines");
+	}
+
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+
+	base_ns = monotonic_nsec();
+
+	while (do_run && log.num_blocks) {
+		if (!pending && !cursor_next(&cur, log.hdr->num_lines, &event)) {
+			if (++block >= log.num_blocks)
+				break;
+
+			cursor_init(&cur, &log, block);
+			continue;
+		}
+
+		pending = false;
+		num_events++;
+
+		if (dump) {
+			dump_event(&log, &event);
+			continue;
+		}
+
+		due_ns = event.ts_ns > start_ns ? event.ts_ns - start_ns : 0;
+		due_ns = base_ns + (uint64_t)(due_ns / speed);
+
+		/*
+		 * The values are written out once the next event turns out to
+		 * be due later, so events due at the same time are applied
+		 * with a single ioctl().
+		 */
+		if (due_ns != prev_due && num_events > 1) {
+			values_to_array(values, vals, log.hdr->num_lines);
+			status = gpiod_line_set_value_bulk(&bulk, vals);
+			if (status < 0)
+				die_perror("error setting GPIO values");
+		}
+
+		sleep_until(due_ns);
+		prev_due = due_ns;
+
+		if (event.rising)
+			values |= 1ULL << event.index;
+		else
+			values &= ~(1ULL << event.index);
+	}
+
+	if (!dump && num_events) {
+		values_to_array(values, vals, log.hdr->num_lines);
+		status = gpiod_line_set_value_bulk(&bulk, vals);
+		if (status < 0)
+			die_perror("error setting GPIO values");
+	}
+
+	if (chip)
+		gpiod_chip_close(chip);
+
+	munmap((void *)log.map, log.size);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/*
+ * Binary event log format shared by gpiorecord and gpioreplay.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#ifndef __GPIOD_RECORD_FORMAT_H__
+#define __GPIOD_RECORD_FORMAT_H__
+
+/*
+ * The log is a sequence of fixed-size blocks. The first block holds the
+ * file header, every following one starts with a block header and is
+ * filled with variable-length event records. Only the last block is ever
+ * modified: it's rewritten in place as it fills up, records first and
+ * its header last, so a log can be mapped and searched by time while
+ * it's still being written.
+ *
+ * Each record consists of two unsigned LEB128 varints:
+ *
+ *   zigzag(timestamp - previous timestamp)
+ *   zigzag(line index - previous line index) << 1 | rising edge
+ *
+ * The previous timestamp and line index are reset to the block's first
+ * timestamp and 0 at the start of every block and the block header stores
+ * the state of all lines before its first event, so each block can be
+ * decoded and replayed on its own. For a line with events in the block
+ * that state is the opposite of its first edge, otherwise it's the last
+ * one known to the recorder. All fields are stored in host byte
+ * order.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RECORD_MAGIC		"GPIOREC1"
+#define RECORD_VERSION		1
+#define RECORD_BLOCK_SIZE	4096
+#define RECORD_MAX_LINES	64
+/* Two varints of up to 10 bytes each. */
+#define RECORD_MAX_SIZE		20
+
+struct record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_lines;
+	/* CLOCK_REALTIME, not necessarily the clock of the events. */
+	uint64_t start_ns;
+	uint64_t initial_values;
+	char chip_name[32];
+	uint32_t offsets[RECORD_MAX_LINES];
+};
+
+struct record_block {
+	uint64_t first_ns;
+	uint64_t values;
+	uint32_t num_records;
+	uint32_t used;
+};
+
+#define RECORD_BLOCK_DATA	(RECORD_BLOCK_SIZE - sizeof(struct record_block))
+
+struct record_event {
+	uint64_t ts_ns;
+	unsigned int index;
+	bool rising;
+};
+
+static inline uint64_t record_zigzag(int64_t val)
+{
+	return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static inline int64_t record_unzigzag(uint64_t val)
+{
+	return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+static inline size_t record_put_varint(uint8_t *buf, uint64_t val)
+{
+	size_t len = 0;
+
+	while (val >= 0x80) {
+		buf[len++] = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	buf[len++] = val;
+
+	return len;
+}
+
+/* Returns the number of bytes consumed or 0 if the varint is truncated. */
+static inline size_t record_get_varint(const uint8_t *buf, size_t size,
+				       uint64_t *val)
+{
+	unsigned int shift = 0;
+	size_t len = 0;
+
+	*val = 0;
+
+	while (len < size && shift < 64) {
+		*val |= (uint64_t)(buf[len] & 0x7f) << shift;
+		if (!(buf[len++] & 0x80))
+			return len;
+
+		shift += 7;
+	}
+
+	return 0;
+}
+
+#endif /* __GPIOD_RECORD_FORMAT_H__ */
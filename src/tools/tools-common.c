@@ -17,8 +17,6 @@
 #include <stdarg.h>
 #include <libgen.h>
 
-#define NORETURN		__attribute__((noreturn))
-
 static char *progname = "unknown";
 
 void set_progname(char *name)
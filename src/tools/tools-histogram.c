@@ -0,0 +1,124 @@
+/*
+ * Latency histogram for GPIO tools.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "tools-histogram.h"
+
+#include <string.h>
+
+static unsigned int bucket_index(uint64_t val)
+{
+	unsigned int shift;
+
+	if (val < HISTOGRAM_SUB_COUNT)
+		return val;
+
+	/* Keep the HISTOGRAM_SUB_BITS most significant bits. */
+	shift = 63 - __builtin_clzll(val) - (HISTOGRAM_SUB_BITS - 1);
+
+	return HISTOGRAM_SUB_COUNT + (shift - 1) * HISTOGRAM_HALF_COUNT +
+	       (val >> shift) - HISTOGRAM_HALF_COUNT;
+}
+
+/* Highest value that falls into given bucket. */
+static uint64_t bucket_value(unsigned int index)
+{
+	unsigned int shift;
+	uint64_t sub;
+
+	if (index < HISTOGRAM_SUB_COUNT)
+		return index;
+
+	index -= HISTOGRAM_SUB_COUNT;
+	shift = index / HISTOGRAM_HALF_COUNT + 1;
+	sub = index % HISTOGRAM_HALF_COUNT + HISTOGRAM_HALF_COUNT;
+
+	return (sub << shift) + ((1ULL << shift) - 1);
+}
+
+void histogram_reset(struct histogram *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min = UINT64_MAX;
+}
+
+void histogram_add(struct histogram *hist, uint64_t val)
+{
+	hist->counts[bucket_index(val)]++;
+	hist->total++;
+	hist->sum += val;
+
+	if (val < hist->min)
+		hist->min = val;
+	if (val > hist->max)
+		hist->max = val;
+}
+
+void histogram_merge(struct histogram *dst, const struct histogram *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < HISTOGRAM_NUM_BUCKETS; i++)
+		dst->counts[i] += src->counts[i];
+
+	dst->total += src->total;
+	dst->sum += src->sum;
+
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t histogram_percentile(const struct histogram *hist, double pct)
+{
+	uint64_t rank, seen = 0, val;
+	unsigned int i;
+
+	if (!hist->total)
+		return 0;
+
+	rank = (uint64_t)(hist->total * pct / 100.0 + 0.5);
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HISTOGRAM_NUM_BUCKETS; i++) {
+		seen += hist->counts[i];
+		if (seen >= rank) {
+			val = bucket_value(i);
+			/* Never report more than what was actually seen. */
+			return val > hist->max ? hist->max : val;
+		}
+	}
+
+	return hist->max;
+}
+
+void histogram_print(const struct histogram *hist, FILE *fp,
+		     const char *title)
+{
+	static const double pcts[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+	unsigned int i;
+
+	fprintf(fp, "%s: count: %llu", title, (unsigned long long)hist->total);
+
+	if (!hist->total) {
+		fprintf(fp, "\n");
+		return;
+	}
+
+	fprintf(fp, " min: %.3f mean: %.3f", hist->min / 1000.0,
+		(double)hist->sum / hist->total / 1000.0);
+
+	for (i = 0; i < sizeof(pcts) / sizeof(*pcts); i++)
+		fprintf(fp, " p%g: %.3f", pcts[i],
+			histogram_percentile(hist, pcts[i]) / 1000.0);
+
+	fprintf(fp, " max: %.3f (us)\n", hist->max / 1000.0);
+}
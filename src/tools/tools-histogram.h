@@ -0,0 +1,47 @@
+/*
+ * Latency histogram for GPIO tools.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#ifndef __GPIOD_TOOLS_HISTOGRAM_H__
+#define __GPIOD_TOOLS_HISTOGRAM_H__
+
+/*
+ * Log-linear histogram in the spirit of HdrHistogram: values below 128 are
+ * counted exactly, larger ones in buckets covering 1/64 of their power of
+ * two, which keeps the relative error under 1.6% over the whole 64-bit
+ * range in a fixed amount of memory and with constant time recording.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HISTOGRAM_SUB_BITS	7
+#define HISTOGRAM_SUB_COUNT	(1U << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_HALF_COUNT	(HISTOGRAM_SUB_COUNT / 2)
+#define HISTOGRAM_NUM_BUCKETS	(HISTOGRAM_SUB_COUNT + \
+				 (64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_HALF_COUNT)
+
+struct histogram {
+	uint64_t counts[HISTOGRAM_NUM_BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+};
+
+void histogram_reset(struct histogram *hist);
+void histogram_add(struct histogram *hist, uint64_t val);
+void histogram_merge(struct histogram *dst, const struct histogram *src);
+uint64_t histogram_percentile(const struct histogram *hist, double pct);
+
+/* Print count, min, mean, common percentiles and max in microseconds. */
+void histogram_print(const struct histogram *hist, FILE *fp,
+		     const char *title);
+
+#endif /* __GPIOD_TOOLS_HISTOGRAM_H__ */
@@ -15,7 +15,11 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include <libkmod.h>
 #include <libudev.h>
 
@@ -24,6 +28,12 @@
 
 static const char mockup_devpath[] = "/devices/platform/gpio-mockup/gpiochip";
 
+/* The debugfs directory was renamed in linux v4.16. */
+static const char *const mockup_debugfs_dirs[] = {
+	"/sys/kernel/debug/gpio-mockup",
+	"/sys/kernel/debug/gpio-mockup-event",
+};
+
 struct mockup_chip {
 	char *path;
 	char *name;
@@ -33,6 +43,8 @@ struct mockup_chip {
 struct test_context {
 	struct mockup_chip **chips;
 	size_t num_chips;
+	pid_t broker_pid;
+	char broker_path[PATH_MAX];
 	bool test_failed;
 	char *failed_msg;
 };
@@ -391,12 +403,33 @@ static void test_prepare(struct _gu_chip_descr *descr)
 	qsort(ctx->chips, ctx->num_chips, sizeof(*ctx->chips), chipcmp);
 }
 
+#ifdef GU_BROKER_PATH
+static void stop_broker(void)
+{
+	pid_t pid = globals.test_ctx.broker_pid;
+
+	if (!pid)
+		return;
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	unlink(globals.test_ctx.broker_path);
+
+	globals.test_ctx.broker_pid = 0;
+}
+#endif /* GU_BROKER_PATH */
+
 static void test_teardown(void)
 {
 	struct mockup_chip *chip;
 	unsigned int i;
 	int status;
 
+#ifdef GU_BROKER_PATH
+	/* The daemon holds the chips open. */
+	stop_broker();
+#endif /* GU_BROKER_PATH */
+
 	for (i = 0; i < globals.test_ctx.num_chips; i++) {
 		chip = globals.test_ctx.chips[i];
 
@@ -506,6 +539,84 @@ unsigned int gu_chip_num(unsigned int index)
 	return globals.test_ctx.chips[index]->number;
 }
 
+int gu_set_event(unsigned int index, unsigned int offset, int value)
+{
+	char path[PATH_MAX];
+	unsigned int i;
+	ssize_t wr;
+	int fd = -1;
+
+	check_chip_index(index);
+
+	for (i = 0; i < GU_ARRAY_SIZE(mockup_debugfs_dirs); i++) {
+		snprintf(path, sizeof(path), "%s/%s/%u",
+			 mockup_debugfs_dirs[i],
+			 globals.test_ctx.chips[index]->name, offset);
+
+		fd = open(path, O_WRONLY | O_CLOEXEC);
+		if (fd >= 0)
+			break;
+	}
+
+	if (fd < 0)
+		return -1;
+
+	wr = write(fd, value ? "1" : "0", 1);
+	close(fd);
+	if (wr != 1)
+		return -1;
+
+	/* Let the kernel see the level before it changes again. */
+	usleep(10000);
+
+	return 0;
+}
+
+#ifdef GU_BROKER_PATH
+const char * gu_start_broker(void)
+{
+	struct gpiod_broker *broker;
+	unsigned int i;
+	pid_t pid;
+
+	snprintf(globals.test_ctx.broker_path,
+		 sizeof(globals.test_ctx.broker_path),
+		 "/tmp/gpiod-unit-broker.%d.sock", getpid());
+
+	pid = fork();
+	if (pid < 0)
+		return NULL;
+
+	if (pid == 0) {
+		execl(GU_BROKER_PATH, "gpiobroker",
+		      "-s", globals.test_ctx.broker_path, (char *)NULL);
+		_exit(127);
+	}
+
+	globals.test_ctx.broker_pid = pid;
+
+	/* The socket is created once the daemon is ready to serve. */
+	for (i = 0; i < 100; i++) {
+		broker = gpiod_broker_connect(globals.test_ctx.broker_path);
+		if (broker) {
+			gpiod_broker_close(broker);
+			return globals.test_ctx.broker_path;
+		}
+
+		if (waitpid(pid, NULL, WNOHANG) == pid) {
+			globals.test_ctx.broker_pid = 0;
+			return NULL;
+		}
+
+		usleep(10000);
+	}
+
+	stop_broker();
+
+	return NULL;
+}
+#endif /* GU_BROKER_PATH */
+
 void _gu_register_test(struct _gu_test *test)
 {
 	struct _gu_test *tmp;
@@ -91,6 +91,22 @@ const char * gu_chip_path(unsigned int index);
 const char * gu_chip_name(unsigned int index);
 unsigned int gu_chip_num(unsigned int index);
 
+/*
+ * Drive the value of a mockup line through debugfs, which makes the kernel
+ * generate edge events for it as if it was changed from outside. Returns 0
+ * on success and -1 if the debugfs file can't be written.
+ */
+int gu_set_event(unsigned int index, unsigned int offset, int value);
+
+#ifdef GU_BROKER_PATH
+/*
+ * Start the gpiobroker daemon from the build tree on a socket private to
+ * the test. Returns the socket path on success and NULL if the daemon
+ * didn't come up. The daemon is stopped once the test returns.
+ */
+const char * gu_start_broker(void);
+#endif /* GU_BROKER_PATH */
+
 /*
  * Every GU_ASSERT_*() macro expansion can make a test function return, so it
  * would be quite difficult to keep track of every resource allocation. At
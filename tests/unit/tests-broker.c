@@ -0,0 +1,302 @@
+/*
+ * Line broker test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+#include <errno.h>
+
+static const struct gpiod_line_request_config output_config = {
+	.consumer = "gpiod-unit",
+	.direction = GPIOD_DIRECTION_OUTPUT,
+	.active_state = GPIOD_ACTIVE_STATE_HIGH,
+};
+
+static const struct gpiod_line_request_config input_config = {
+	.consumer = "gpiod-unit",
+	.direction = GPIOD_DIRECTION_INPUT,
+	.active_state = GPIOD_ACTIVE_STATE_HIGH,
+};
+
+static void close_broker(struct gpiod_broker **broker)
+{
+	if (*broker)
+		gpiod_broker_close(*broker);
+}
+
+static void broker_request_set_get(void)
+{
+	GU_CLEANUP(close_broker) struct gpiod_broker *broker = NULL;
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	unsigned int offsets[] = { 1, 3, 5 };
+	int vals[] = { 1, 0, 1 }, status;
+	struct gpiod_broker_lines *lines;
+	struct gpiod_line *line;
+	const char *path;
+
+	path = gu_start_broker();
+	GU_ASSERT_NOT_NULL(path);
+
+	broker = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(broker);
+
+	lines = gpiod_broker_request(broker, gu_chip_name(0), offsets, 3,
+				     &output_config, vals);
+	GU_ASSERT_NOT_NULL(lines);
+
+	/* The daemon holds the lines under the consumer of the client. */
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 3);
+	GU_ASSERT_NOT_NULL(line);
+	GU_ASSERT(gpiod_line_is_used_by_kernel(line));
+	GU_ASSERT_STR_EQ(gpiod_line_consumer(line), "gpiod-unit");
+
+	memset(vals, 0, sizeof(vals));
+	status = gpiod_broker_get_value_bulk(lines, vals);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(vals[0], 1);
+	GU_ASSERT_EQ(vals[1], 0);
+	GU_ASSERT_EQ(vals[2], 1);
+
+	vals[0] = 0;
+	vals[1] = 1;
+	vals[2] = 1;
+	status = gpiod_broker_set_value_bulk(lines, vals);
+	GU_ASSERT_RET_OK(status);
+
+	memset(vals, 0, sizeof(vals));
+	status = gpiod_broker_get_value_bulk(lines, vals);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(vals[0], 0);
+	GU_ASSERT_EQ(vals[1], 1);
+	GU_ASSERT_EQ(vals[2], 1);
+
+	/* Single line accessors only work with single line sets. */
+	status = gpiod_broker_get_value(lines);
+	GU_ASSERT_EQ(status, -1);
+	GU_ASSERT_EQ(gpiod_errno(), EINVAL);
+}
+GU_DEFINE_TEST(broker_request_set_get,
+	       "gpiod_broker_request() - set and get values",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void broker_set_async(void)
+{
+	GU_CLEANUP(close_broker) struct gpiod_broker *broker = NULL;
+	struct gpiod_broker_lines *output, *input;
+	unsigned int offset = 2, input_offset = 4;
+	int status, value, i;
+	const char *path;
+
+	path = gu_start_broker();
+	GU_ASSERT_NOT_NULL(path);
+
+	broker = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(broker);
+
+	output = gpiod_broker_request(broker, gu_chip_name(0), &offset, 1,
+				      &output_config, NULL);
+	GU_ASSERT_NOT_NULL(output);
+
+	for (i = 0; i < 5; i++) {
+		value = i % 2;
+		status = gpiod_broker_set_value_bulk_async(output, &value);
+		GU_ASSERT_RET_OK(status);
+	}
+
+	status = gpiod_broker_sync(broker);
+	GU_ASSERT_RET_OK(status);
+
+	/* Queued changes are applied before a later synchronous call. */
+	value = 1;
+	status = gpiod_broker_set_value_bulk_async(output, &value);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(gpiod_broker_get_value(output), 1);
+
+	input = gpiod_broker_request(broker, gu_chip_name(0), &input_offset, 1,
+				     &input_config, NULL);
+	GU_ASSERT_NOT_NULL(input);
+
+	/* The error of a queued change is reported by the next sync. */
+	value = 1;
+	status = gpiod_broker_set_value_bulk_async(input, &value);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_broker_sync(broker);
+	GU_ASSERT_EQ(status, -1);
+	GU_ASSERT_NOTEQ(gpiod_errno(), 0);
+
+	status = gpiod_broker_sync(broker);
+	GU_ASSERT_RET_OK(status);
+}
+GU_DEFINE_TEST(broker_set_async,
+	       "gpiod_broker_set_value_bulk_async() - queue and sync",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void broker_shared_request(void)
+{
+	GU_CLEANUP(close_broker) struct gpiod_broker *first = NULL;
+	GU_CLEANUP(close_broker) struct gpiod_broker *second = NULL;
+	struct gpiod_broker_lines *lines_a, *lines_b;
+	unsigned int offset = 6;
+	int status, value;
+	const char *path;
+
+	path = gu_start_broker();
+	GU_ASSERT_NOT_NULL(path);
+
+	first = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(first);
+	second = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(second);
+
+	value = 1;
+	lines_a = gpiod_broker_request(first, gu_chip_name(0), &offset, 1,
+				       &output_config, &value);
+	GU_ASSERT_NOT_NULL(lines_a);
+
+	/* The lines are shared and keep the value they already have. */
+	value = 0;
+	lines_b = gpiod_broker_request(second, gu_chip_name(0), &offset, 1,
+				       &output_config, &value);
+	GU_ASSERT_NOT_NULL(lines_b);
+	GU_ASSERT_EQ(gpiod_broker_get_value(lines_b), 1);
+
+	status = gpiod_broker_set_value(lines_b, 0);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(gpiod_broker_get_value(lines_a), 0);
+
+	/* The lines stay requested while the other client holds them. */
+	gpiod_broker_release(lines_a);
+	GU_ASSERT_EQ(gpiod_broker_get_value(lines_b), 0);
+}
+GU_DEFINE_TEST(broker_shared_request,
+	       "gpiod_broker_request() - identical requests are shared",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void broker_conflicting_request(void)
+{
+	GU_CLEANUP(close_broker) struct gpiod_broker *first = NULL;
+	GU_CLEANUP(close_broker) struct gpiod_broker *second = NULL;
+	struct gpiod_broker_lines *lines;
+	unsigned int offsets[] = { 0, 1 };
+	const char *path;
+
+	path = gu_start_broker();
+	GU_ASSERT_NOT_NULL(path);
+
+	first = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(first);
+	second = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(second);
+
+	lines = gpiod_broker_request(first, gu_chip_name(0), offsets, 2,
+				     &output_config, NULL);
+	GU_ASSERT_NOT_NULL(lines);
+
+	/* Overlapping lines with a different configuration. */
+	lines = gpiod_broker_request(second, gu_chip_name(0), offsets + 1, 1,
+				     &input_config, NULL);
+	GU_ASSERT_NULL(lines);
+	GU_ASSERT(gpiod_errno() == GPIOD_ELINEBUSY || gpiod_errno() == EBUSY);
+
+	/* Same lines and configuration, but a different set of them. */
+	lines = gpiod_broker_request(second, gu_chip_name(0), offsets, 1,
+				     &output_config, NULL);
+	GU_ASSERT_NULL(lines);
+	GU_ASSERT(gpiod_errno() == GPIOD_ELINEBUSY || gpiod_errno() == EBUSY);
+}
+GU_DEFINE_TEST(broker_conflicting_request,
+	       "gpiod_broker_request() - conflicting requests fail",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void broker_release(void)
+{
+	GU_CLEANUP(close_broker) struct gpiod_broker *broker = NULL;
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_broker_lines *lines;
+	struct gpiod_line *line;
+	unsigned int offset = 7;
+	const char *path;
+	int status;
+
+	path = gu_start_broker();
+	GU_ASSERT_NOT_NULL(path);
+
+	broker = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(broker);
+
+	lines = gpiod_broker_request(broker, gu_chip_name(0), &offset, 1,
+				     &output_config, NULL);
+	GU_ASSERT_NOT_NULL(lines);
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, offset);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_request_output(line, "gpiod-unit", false, 0);
+	GU_ASSERT_EQ(status, -1);
+	GU_ASSERT_EQ(gpiod_errno(), EBUSY);
+
+	/* The release is a round trip, the line is free once it returns. */
+	gpiod_broker_release(lines);
+
+	status = gpiod_line_request_output(line, "gpiod-unit", false, 0);
+	GU_ASSERT_RET_OK(status);
+
+	gpiod_line_release(line);
+}
+GU_DEFINE_TEST(broker_release,
+	       "gpiod_broker_release() - lines are released",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void broker_subscribe(void)
+{
+	GU_CLEANUP(close_broker) struct gpiod_broker *broker = NULL;
+	struct gpiod_line_evreq_config config;
+	struct gpiod_broker_lines *lines;
+	struct gpiod_broker_event event;
+	struct timespec timeout = { 1, 0 };
+	unsigned int offset = 3;
+	const char *path;
+	int status;
+
+	path = gu_start_broker();
+	GU_ASSERT_NOT_NULL(path);
+
+	broker = gpiod_broker_connect(path);
+	GU_ASSERT_NOT_NULL(broker);
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	lines = gpiod_broker_subscribe(broker, gu_chip_name(0), &offset, 1,
+				       &config);
+	GU_ASSERT_NOT_NULL(lines);
+
+	status = gu_set_event(0, offset, 1);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_broker_event_wait(broker, &timeout);
+	GU_ASSERT_EQ(status, 1);
+
+	status = gpiod_broker_event_read(broker, &event);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT(event.lines == lines);
+	GU_ASSERT_EQ(event.offset, offset);
+	GU_ASSERT_EQ(event.event.event_type, GPIOD_EVENT_RISING_EDGE);
+}
+GU_DEFINE_TEST(broker_subscribe,
+	       "gpiod_broker_subscribe() - events are forwarded",
+	       GU_LINES_UNNAMED, { 8 });
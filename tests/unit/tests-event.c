@@ -0,0 +1,323 @@
+/*
+ * Line event test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+#include <errno.h>
+
+static void event_request_polled_bulk(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_line_evreq_config config;
+	struct timespec timeout = { 0, 20000000 };
+	struct gpiod_line *line;
+	int status, vals[4];
+	unsigned int i;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 4; i++)
+		gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, i));
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+	config.line_flags = GPIOD_REQUEST_POLLED;
+
+	status = gpiod_line_event_request_bulk(&bulk, &config);
+	GU_ASSERT_RET_OK(status);
+
+	for (i = 0; i < 4; i++) {
+		line = bulk.lines[i];
+
+		GU_ASSERT(gpiod_line_event_configured(line));
+		GU_ASSERT(gpiod_line_event_is_polled(line));
+		GU_ASSERT_EQ(gpiod_line_event_get_fd(line), -1);
+	}
+
+	status = gpiod_line_get_value_bulk(&bulk, vals);
+	GU_ASSERT_RET_OK(status);
+
+	/* Nothing changes on the mockup lines - the wait must time out. */
+	status = gpiod_line_event_wait_bulk(&bulk, &timeout, &line);
+	GU_ASSERT_EQ(status, 0);
+
+	gpiod_line_event_release_bulk(&bulk);
+
+	for (i = 0; i < 4; i++)
+		GU_ASSERT(gpiod_line_is_free(bulk.lines[i]));
+}
+GU_DEFINE_TEST(event_request_polled_bulk,
+	       "gpiod_line_event_request_bulk() - polled",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void event_polled_edges(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct timespec min = { 0, 1000000 }, max = { 0, 2000000 };
+	struct timespec timeout = { 1, 0 };
+	struct gpiod_line_evreq_config config;
+	struct gpiod_line_event event;
+	struct gpiod_line *line;
+	unsigned int i;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 4; i++)
+		gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, i));
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+	config.line_flags = GPIOD_REQUEST_POLLED;
+
+	status = gpiod_line_event_request_bulk(&bulk, &config);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_event_set_poll_period(bulk.lines[0], &min, &max);
+	GU_ASSERT_RET_OK(status);
+
+	/* The first sample only establishes the initial levels. */
+	status = gpiod_line_get_value(bulk.lines[2]);
+	GU_ASSERT_EQ(status, 0);
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = 10000000;
+	status = gpiod_line_event_wait_bulk(&bulk, &timeout, &line);
+	GU_ASSERT_EQ(status, 0);
+
+	status = gu_set_event(0, 2, 1);
+	GU_ASSERT_RET_OK(status);
+
+	timeout.tv_sec = 1;
+	timeout.tv_nsec = 0;
+	status = gpiod_line_event_wait_bulk(&bulk, &timeout, &line);
+	GU_ASSERT_EQ(status, 1);
+	GU_ASSERT(line == bulk.lines[2]);
+
+	status = gpiod_line_event_read(line, &event);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(event.event_type, GPIOD_EVENT_RISING_EDGE);
+
+	/* Each line reads its own value from the shared line handle. */
+	status = gpiod_line_get_value(bulk.lines[2]);
+	GU_ASSERT_EQ(status, 1);
+	status = gpiod_line_get_value(bulk.lines[0]);
+	GU_ASSERT_EQ(status, 0);
+
+	status = gu_set_event(0, 2, 0);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_event_wait_bulk(&bulk, &timeout, &line);
+	GU_ASSERT_EQ(status, 1);
+	GU_ASSERT(line == bulk.lines[2]);
+
+	status = gpiod_line_event_read(line, &event);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(event.event_type, GPIOD_EVENT_FALLING_EDGE);
+}
+GU_DEFINE_TEST(event_polled_edges,
+	       "gpiod_line_event_wait_bulk() - polled edges",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void event_request_bulk_busy(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_line_evreq_config config;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 1));
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 2));
+
+	status = gpiod_line_request_input(bulk.lines[1], "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+	config.line_flags = GPIOD_REQUEST_POLLED;
+
+	status = gpiod_line_event_request_bulk(&bulk, &config);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_ELINEBUSY);
+	GU_ASSERT(gpiod_line_is_free(bulk.lines[0]));
+}
+GU_DEFINE_TEST(event_request_bulk_busy,
+	       "gpiod_line_event_request_bulk() - line busy",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void event_set_poll_period(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct timespec min = { 0, 100000 }, max = { 0, 1000000 };
+	struct gpiod_line_evreq_config config;
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 3);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_event_set_poll_period(line, &min, &max);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EEVREQUEST);
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_RISING_EDGE;
+	config.line_flags = GPIOD_REQUEST_POLLED;
+
+	status = gpiod_line_event_request(line, &config);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_event_set_poll_period(line, &min, &max);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_event_set_poll_period(line, &max, &min);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), EINVAL);
+}
+GU_DEFINE_TEST(event_set_poll_period,
+	       "gpiod_line_event_set_poll_period() - good and bad",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void event_read_multiple_not_requested(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_event events[GPIOD_EVENT_READ_MAX];
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 2);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_event_read_multiple(line, events,
+						GPIOD_EVENT_READ_MAX);
+	GU_ASSERT_EQ(status, -1);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EEVREQUEST);
+
+	status = gpiod_line_event_read_fd_multiple(-1, events,
+						   GPIOD_EVENT_READ_MAX + 1);
+	GU_ASSERT_EQ(status, -1);
+	GU_ASSERT_EQ(gpiod_errno(), EINVAL);
+}
+GU_DEFINE_TEST(event_read_multiple_not_requested,
+	       "gpiod_line_event_read_multiple() - bad arguments",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void event_cached_value(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_evreq_config config;
+	struct gpiod_stats stats;
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	status = gpiod_chip_enable_stats(chip);
+	GU_ASSERT_RET_OK(status);
+
+	line = gpiod_chip_get_line(chip, 4);
+	GU_ASSERT_NOT_NULL(line);
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_RISING_EDGE;
+	config.line_flags = GPIOD_REQUEST_CACHE_VALUE;
+
+	/* The level can't be tracked from rising edges alone. */
+	status = gpiod_line_event_request(line, &config);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), EINVAL);
+
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	status = gpiod_line_event_request(line, &config);
+	GU_ASSERT_RET_OK(status);
+
+	/* Only the first read asks the kernel. */
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+
+	gpiod_chip_get_stats(chip, &stats);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_GET_VALUES].count, 1);
+
+	GU_ASSERT_EQ(gpiod_line_event_sync_value(line), 0);
+
+	gpiod_chip_get_stats(chip, &stats);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_GET_VALUES].count, 2);
+
+	gpiod_line_event_release(line);
+}
+GU_DEFINE_TEST(event_cached_value,
+	       "gpiod_line_get_value() - value cached from events",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void event_cached_value_overrun(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_evreq_config config;
+	struct gpiod_line_event event;
+	struct gpiod_line *line;
+	int status, i;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 4);
+	GU_ASSERT_NOT_NULL(line);
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+	config.line_flags = GPIOD_REQUEST_CACHE_VALUE;
+
+	status = gpiod_line_event_request(line, &config);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+
+	/* More edges than the kernel FIFO holds, the last one rising. */
+	for (i = 0; i < 21; i++) {
+		status = gu_set_event(0, 4, !(i % 2));
+		GU_ASSERT_RET_OK(status);
+	}
+
+	/*
+	 * The FIFO ends with a falling edge, the newer edges were dropped.
+	 * Reading it one event at a time must still notice that.
+	 */
+	for (i = 0; i < GPIOD_EVENT_READ_MAX; i++) {
+		status = gpiod_line_event_read(line, &event);
+		GU_ASSERT_RET_OK(status);
+	}
+
+	GU_ASSERT_EQ(event.event_type, GPIOD_EVENT_FALLING_EDGE);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 1);
+
+	gpiod_line_event_release(line);
+}
+GU_DEFINE_TEST(event_cached_value_overrun,
+	       "gpiod_line_get_value() - cached value after FIFO overrun",
+	       GU_LINES_UNNAMED, { 8 });
@@ -0,0 +1,226 @@
+/*
+ * Event fan-out test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+#include <errno.h>
+
+#define FANOUT_NAME	"/gpiod-unit-fanout"
+
+static void free_fanout(struct gpiod_fanout **fanout)
+{
+	if (*fanout)
+		gpiod_fanout_free(*fanout);
+}
+
+static void unsubscribe(struct gpiod_fanout_sub **sub)
+{
+	if (*sub)
+		gpiod_fanout_unsubscribe(*sub);
+}
+
+static void fanout_subscribe_wait_timeout(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_fanout) struct gpiod_fanout *fanout = NULL;
+	GU_CLEANUP(unsubscribe) struct gpiod_fanout_sub *sub = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct timespec timeout = { 0, 10000000 };
+	struct gpiod_line_evreq_config evconfig;
+	struct gpiod_fanout_config config;
+	struct gpiod_fanout_event event;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 1));
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 4));
+
+	memset(&evconfig, 0, sizeof(evconfig));
+	evconfig.consumer = "gpiod-unit";
+	evconfig.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	status = gpiod_line_event_request_bulk(&bulk, &evconfig);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = FANOUT_NAME;
+	config.ring_size = 100;
+
+	fanout = gpiod_fanout_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(fanout);
+
+	status = gpiod_fanout_start(fanout);
+	GU_ASSERT_RET_OK(status);
+
+	sub = gpiod_fanout_subscribe(FANOUT_NAME);
+	GU_ASSERT_NOT_NULL(sub);
+
+	GU_ASSERT_EQ(gpiod_fanout_num_lines(sub), 2);
+	GU_ASSERT_EQ(gpiod_fanout_offset(sub, 1), 4);
+	GU_ASSERT_STR_EQ(gpiod_fanout_chip_name(sub), gu_chip_name(0));
+
+	status = gpiod_fanout_wait(sub, &timeout);
+	GU_ASSERT_EQ(status, 0);
+	GU_ASSERT_EQ(gpiod_fanout_read(sub, &event, 1), 0);
+	GU_ASSERT_EQ(gpiod_fanout_lost(sub), 0);
+
+	gpiod_fanout_stop(fanout);
+	GU_ASSERT_EQ(gpiod_fanout_error(fanout), 0);
+
+	gpiod_line_event_release_bulk(&bulk);
+}
+GU_DEFINE_TEST(fanout_subscribe_wait_timeout,
+	       "gpiod_fanout_wait() - timeout",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void fanout_deliver_and_lose(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_fanout) struct gpiod_fanout *fanout = NULL;
+	GU_CLEANUP(unsubscribe) struct gpiod_fanout_sub *sub = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	unsigned int offsets[] = { 1, 4 }, rising[2], falling[2], i, j;
+	struct timespec timeout = { 1, 0 };
+	struct gpiod_line_evreq_config evconfig;
+	struct gpiod_fanout_config config;
+	struct gpiod_fanout_event events[8];
+	int status, num;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 2; i++)
+		gpiod_line_bulk_add(&bulk,
+				    gpiod_chip_get_line(chip, offsets[i]));
+
+	memset(&evconfig, 0, sizeof(evconfig));
+	evconfig.consumer = "gpiod-unit";
+	evconfig.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	status = gpiod_line_event_request_bulk(&bulk, &evconfig);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = FANOUT_NAME;
+	config.ring_size = 4;
+
+	fanout = gpiod_fanout_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(fanout);
+
+	status = gpiod_fanout_start(fanout);
+	GU_ASSERT_RET_OK(status);
+
+	sub = gpiod_fanout_subscribe(FANOUT_NAME);
+	GU_ASSERT_NOT_NULL(sub);
+
+	/* Both edges on both lines - exactly what fits into the ring. */
+	for (i = 0; i < 4; i++) {
+		status = gu_set_event(0, offsets[i % 2], i < 2);
+		GU_ASSERT_RET_OK(status);
+	}
+
+	status = gpiod_fanout_wait(sub, &timeout);
+	GU_ASSERT_EQ(status, 1);
+
+	/* The events of a line are in order, but lines may interleave. */
+	memset(rising, 0, sizeof(rising));
+	memset(falling, 0, sizeof(falling));
+	num = gpiod_fanout_read(sub, events, 8);
+	GU_ASSERT_EQ(num, 4);
+
+	for (i = 0; i < 4; i++) {
+		for (j = 0; j < 2 && events[i].offset != offsets[j]; j++);
+		GU_ASSERT(j < 2);
+
+		if (events[i].event.event_type == GPIOD_EVENT_RISING_EDGE) {
+			GU_ASSERT_EQ(falling[j], 0);
+			rising[j]++;
+		} else {
+			falling[j]++;
+		}
+	}
+
+	for (j = 0; j < 2; j++) {
+		GU_ASSERT_EQ(rising[j], 1);
+		GU_ASSERT_EQ(falling[j], 1);
+	}
+
+	GU_ASSERT_EQ(gpiod_fanout_lost(sub), 0);
+
+	/* Six more events overwrite the two oldest ones in the ring. */
+	for (i = 0; i < 6; i++) {
+		status = gu_set_event(0, offsets[0], !(i % 2));
+		GU_ASSERT_RET_OK(status);
+	}
+
+	status = gpiod_fanout_wait(sub, &timeout);
+	GU_ASSERT_EQ(status, 1);
+
+	num = gpiod_fanout_read(sub, events, 8);
+	GU_ASSERT_EQ(num, 4);
+	GU_ASSERT_EQ(gpiod_fanout_lost(sub), 2);
+
+	/* The newest events survive - the last one is a falling edge. */
+	GU_ASSERT_EQ(events[0].offset, offsets[0]);
+	GU_ASSERT_EQ(events[0].event.event_type, GPIOD_EVENT_RISING_EDGE);
+	GU_ASSERT_EQ(events[3].event.event_type, GPIOD_EVENT_FALLING_EDGE);
+
+	gpiod_fanout_stop(fanout);
+	GU_ASSERT_EQ(gpiod_fanout_error(fanout), 0);
+
+	gpiod_line_event_release_bulk(&bulk);
+}
+GU_DEFINE_TEST(fanout_deliver_and_lose,
+	       "gpiod_fanout_read() - events delivered and lost",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void fanout_events_not_requested(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_fanout) struct gpiod_fanout *fanout = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_fanout_config config;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 0));
+
+	status = gpiod_line_request_bulk_input(&bulk, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = FANOUT_NAME;
+
+	fanout = gpiod_fanout_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(fanout);
+
+	status = gpiod_fanout_start(fanout);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EEVREQUEST);
+}
+GU_DEFINE_TEST(fanout_events_not_requested,
+	       "gpiod_fanout_start() - lines not requested for events",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void fanout_subscribe_missing(void)
+{
+	struct gpiod_fanout_sub *sub;
+
+	sub = gpiod_fanout_subscribe("/gpiod-unit-no-such-fanout");
+	GU_ASSERT_NULL(sub);
+	GU_ASSERT_EQ(gpiod_errno(), ENOENT);
+}
+GU_DEFINE_TEST(fanout_subscribe_missing,
+	       "gpiod_fanout_subscribe() - no such object",
+	       GU_LINES_UNNAMED, { 8 });
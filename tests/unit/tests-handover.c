@@ -0,0 +1,136 @@
+/*
+ * Request handover test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static void close_socket(int *sock)
+{
+	if (*sock >= 0)
+		close(*sock);
+}
+
+static void handover_values_and_events(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *taken = NULL;
+	GU_CLEANUP(close_socket) int sock_out = -1;
+	GU_CLEANUP(close_socket) int sock_in = -1;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_line_evreq_config config;
+	int status, values[3], sv[2];
+	struct gpiod_stats stats;
+	struct gpiod_line *line;
+	unsigned int i;
+
+	status = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv);
+	GU_ASSERT_RET_OK(status);
+	sock_out = sv[0];
+	sock_in = sv[1];
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 3; i++)
+		gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, i + 1));
+
+	values[0] = 1;
+	values[1] = 0;
+	values[2] = 1;
+
+	status = gpiod_line_request_bulk_output(&bulk, "gpiod-unit",
+						false, values);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = "gpiod-unit";
+	config.event_type = GPIOD_EVENT_BOTH_EDGES;
+	config.line_flags = GPIOD_REQUEST_CACHE_VALUE;
+
+	line = gpiod_chip_get_line(chip, 6);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_event_request(line, &config);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_handover_send(sock_out, chip);
+	GU_ASSERT_RET_OK(status);
+
+	/* The lines must survive closing the chip in the old owner. */
+	gpiod_chip_close(chip);
+	chip = NULL;
+
+	taken = gpiod_handover_receive(sock_in);
+	GU_ASSERT_NOT_NULL(taken);
+
+	gpiod_line_bulk_init(&bulk);
+	for (i = 0; i < 3; i++) {
+		line = gpiod_chip_get_line(taken, i + 1);
+		GU_ASSERT_NOT_NULL(line);
+		GU_ASSERT(gpiod_line_is_reserved(line));
+		GU_ASSERT_EQ(gpiod_line_direction(line),
+			     GPIOD_DIRECTION_OUTPUT);
+		gpiod_line_bulk_add(&bulk, line);
+	}
+
+	memset(values, 0, sizeof(values));
+	status = gpiod_line_get_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(values[0], 1);
+	GU_ASSERT_EQ(values[1], 0);
+	GU_ASSERT_EQ(values[2], 1);
+
+	line = gpiod_chip_get_line(taken, 6);
+	GU_ASSERT_NOT_NULL(line);
+	GU_ASSERT(gpiod_line_event_configured(line));
+	GU_ASSERT_STR_EQ(gpiod_line_consumer(line), "gpiod-unit");
+
+	/* The value is still cached - only the first read asks the kernel. */
+	status = gpiod_chip_enable_stats(taken);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+	gpiod_chip_get_stats(taken, &stats);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_GET_VALUES].count, 1);
+
+	gpiod_line_event_release(line);
+}
+GU_DEFINE_TEST(handover_values_and_events,
+	       "gpiod_handover_send() - values and events",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void handover_bad_header(void)
+{
+	GU_CLEANUP(close_socket) int sock_out = -1;
+	GU_CLEANUP(close_socket) int sock_in = -1;
+	struct gpiod_chip *chip;
+	char garbage[128];
+	int status, sv[2];
+	ssize_t wr;
+
+	status = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv);
+	GU_ASSERT_RET_OK(status);
+	sock_out = sv[0];
+	sock_in = sv[1];
+
+	memset(garbage, 0xaa, sizeof(garbage));
+	wr = write(sock_out, garbage, sizeof(garbage));
+	GU_ASSERT_EQ(wr, (ssize_t)sizeof(garbage));
+
+	chip = gpiod_handover_receive(sock_in);
+	GU_ASSERT_NULL(chip);
+	GU_ASSERT_EQ(gpiod_errno(), EPROTO);
+}
+GU_DEFINE_TEST(handover_bad_header,
+	       "gpiod_handover_receive() - invalid header",
+	       GU_LINES_UNNAMED, { 8 });
@@ -248,3 +248,153 @@ static void line_set_value(void)
 GU_DEFINE_TEST(line_set_value,
 	       "gpiod_line_set_value() - good",
 	       GU_LINES_UNNAMED, { 8 });
+
+static void line_set_value_mask(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	int status, values[3] = { 1, 0, 1 };
+	struct gpiod_stats stats;
+	unsigned long long shadow;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	status = gpiod_chip_enable_stats(chip);
+	GU_ASSERT_RET_OK(status);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 1));
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 3));
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 5));
+
+	status = gpiod_line_request_bulk_output(&bulk, "gpiod-unit",
+						false, values);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_get_shadow(bulk.lines[1], &shadow);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(shadow, 0x5);
+
+	/* Only the second line changes, the others keep their values. */
+	status = gpiod_line_set_value_mask(bulk.lines[0], 0x2, 0x7);
+	GU_ASSERT_RET_OK(status);
+	status = gpiod_line_get_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(values[0], 1);
+	GU_ASSERT_EQ(values[1], 1);
+	GU_ASSERT_EQ(values[2], 1);
+
+	status = gpiod_line_update_value(bulk.lines[2], 0);
+	GU_ASSERT_RET_OK(status);
+	status = gpiod_line_get_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(values[0], 1);
+	GU_ASSERT_EQ(values[1], 1);
+	GU_ASSERT_EQ(values[2], 0);
+
+	/* Writes which don't change anything are skipped. */
+	status = gpiod_line_update_value(bulk.lines[2], 0);
+	GU_ASSERT_RET_OK(status);
+	status = gpiod_line_set_value_mask(bulk.lines[0], 0x3, 0x3);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_get_shadow(bulk.lines[0], &shadow);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(shadow, 0x3);
+
+	gpiod_chip_get_stats(chip, &stats);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_SET_VALUES].count, 2);
+
+	gpiod_line_release_bulk(&bulk);
+}
+GU_DEFINE_TEST(line_set_value_mask,
+	       "gpiod_line_set_value_mask() - good",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void line_pulse(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct timespec width = { 0, 1000000 }, measured;
+	struct gpiod_pulse_calib calib;
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 2);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_request_output(line, "gpiod-unit", false, 0);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_pulse_calibrate(line, &calib);
+	GU_ASSERT_RET_OK(status);
+	/* Calibration must not change the line value. */
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+
+	status = gpiod_line_pulse(line, &width, &measured);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(measured.tv_sec, 0);
+	GU_ASSERT(measured.tv_nsec > 500000);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+
+	gpiod_line_release(line);
+}
+GU_DEFINE_TEST(line_pulse,
+	       "gpiod_line_pulse() - good",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void line_pulse_idle_high(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct timespec width = { 0, 1000000 }, measured;
+	unsigned long long shadow;
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 2);
+	GU_ASSERT_NOT_NULL(line);
+
+	/* The pulse goes low and the line ends up high again. */
+	status = gpiod_line_request_output(line, "gpiod-unit", false, 1);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_pulse(line, &width, &measured);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT(measured.tv_nsec > 500000);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 1);
+
+	status = gpiod_line_get_shadow(line, &shadow);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(shadow, 1);
+
+	gpiod_line_release(line);
+}
+GU_DEFINE_TEST(line_pulse_idle_high,
+	       "gpiod_line_pulse() - line idling high",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void line_pulse_not_reserved(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct timespec width = { 0, 1000000 };
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 2);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_pulse(line, &width, NULL);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EREQUEST);
+}
+GU_DEFINE_TEST(line_pulse_not_reserved,
+	       "gpiod_line_pulse() - line not reserved",
+	       GU_LINES_UNNAMED, { 8 });
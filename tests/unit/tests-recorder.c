@@ -0,0 +1,169 @@
+/*
+ * Flight recorder test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static void recorder_request_set_get_release(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	int status, values[2] = { 1, 0 };
+	struct gpiod_line *line0, *line1;
+	struct gpiod_record records[4];
+	unsigned int num;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+	GU_ASSERT_EQ(sscanf(gpiod_chip_name(chip), "gpiochip%u", &num), 1);
+
+	status = gpiod_recorder_enable(64);
+	GU_ASSERT_RET_OK(status);
+
+	line0 = gpiod_chip_get_line(chip, 2);
+	line1 = gpiod_chip_get_line(chip, 3);
+	GU_ASSERT_NOT_NULL(line0);
+	GU_ASSERT_NOT_NULL(line1);
+
+	gpiod_line_bulk_add(&bulk, line0);
+	gpiod_line_bulk_add(&bulk, line1);
+
+	status = gpiod_line_request_bulk_output(&bulk, "gpiod-unit",
+						false, values);
+	GU_ASSERT_RET_OK(status);
+
+	values[0] = 0;
+	values[1] = 1;
+	status = gpiod_line_set_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_get_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+
+	gpiod_line_release_bulk(&bulk);
+	gpiod_recorder_disable();
+
+	status = gpiod_recorder_dump(records, 4);
+	GU_ASSERT_EQ(status, 4);
+
+	GU_ASSERT_EQ(records[0].type, GPIOD_RECORD_REQUEST);
+	GU_ASSERT_EQ(records[0].values, 0x1);
+	GU_ASSERT_EQ(records[1].type, GPIOD_RECORD_SET_VALUES);
+	GU_ASSERT_EQ(records[1].values, 0x2);
+	GU_ASSERT_EQ(records[2].type, GPIOD_RECORD_GET_VALUES);
+	GU_ASSERT_EQ(records[2].values, 0x2);
+	GU_ASSERT_EQ(records[3].type, GPIOD_RECORD_RELEASE);
+
+	GU_ASSERT_EQ(records[0].chip, num);
+	GU_ASSERT_EQ(records[0].offset, 2);
+	GU_ASSERT_EQ(records[0].num_lines, 2);
+	GU_ASSERT_EQ(records[1].error, 0);
+	GU_ASSERT(records[0].timestamp <= records[3].timestamp);
+}
+GU_DEFINE_TEST(recorder_request_set_get_release,
+	       "gpiod_recorder_dump() - request, set, get and release",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void recorder_disabled(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_record before[1], after[1];
+	struct gpiod_line *line;
+	int status, num;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	status = gpiod_recorder_enable(64);
+	GU_ASSERT_RET_OK(status);
+	gpiod_recorder_disable();
+
+	memset(before, 0, sizeof(before));
+	memset(after, 0, sizeof(after));
+	num = gpiod_recorder_dump(before, 1);
+	GU_ASSERT(num >= 0);
+
+	line = gpiod_chip_get_line(chip, 1);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_request_input(line, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_get_value(line);
+	GU_ASSERT_EQ(status, 0);
+
+	gpiod_line_release(line);
+
+	status = gpiod_recorder_dump(after, 1);
+	GU_ASSERT_EQ(status, num);
+	GU_ASSERT_EQ(memcmp(before, after, sizeof(before)), 0);
+}
+GU_DEFINE_TEST(recorder_disabled,
+	       "gpiod_recorder_disable() - nothing recorded",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void recorder_dump_fd(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_recorder_header hdr;
+	struct gpiod_record record;
+	struct gpiod_line *line;
+	int status, fds[2];
+	ssize_t rd;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	status = gpiod_recorder_enable(4);
+	GU_ASSERT_RET_OK(status);
+
+	line = gpiod_chip_get_line(chip, 4);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_request_output(line, "gpiod-unit", false, 1);
+	GU_ASSERT_RET_OK(status);
+
+	gpiod_line_release(line);
+	gpiod_recorder_disable();
+
+	status = pipe(fds);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_recorder_dump_fd(fds[1]);
+	close(fds[1]);
+	if (status < 0)
+		close(fds[0]);
+	GU_ASSERT_RET_OK(status);
+
+	rd = read(fds[0], &hdr, sizeof(hdr));
+	if (rd != (ssize_t)sizeof(hdr))
+		close(fds[0]);
+	GU_ASSERT_EQ(rd, (ssize_t)sizeof(hdr));
+
+	/* The ring holds at least four records, the last one is ours. */
+	do {
+		rd = read(fds[0], &record, sizeof(record));
+	} while (rd == (ssize_t)sizeof(record) &&
+		 record.type != GPIOD_RECORD_RELEASE);
+	close(fds[0]);
+
+	GU_ASSERT_EQ(memcmp(hdr.magic, GPIOD_RECORDER_MAGIC,
+			    sizeof(hdr.magic)), 0);
+	GU_ASSERT_EQ(hdr.version, GPIOD_RECORDER_VERSION);
+	GU_ASSERT_EQ(hdr.record_size, sizeof(struct gpiod_record));
+	GU_ASSERT_EQ(rd, (ssize_t)sizeof(record));
+	GU_ASSERT_EQ(record.offset, 4);
+}
+GU_DEFINE_TEST(recorder_dump_fd,
+	       "gpiod_recorder_dump_fd() - header and records",
+	       GU_LINES_UNNAMED, { 8 });
@@ -0,0 +1,157 @@
+/*
+ * Periodic sampler test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+static void free_sampler(struct gpiod_sampler **sampler)
+{
+	if (*sampler)
+		gpiod_sampler_free(*sampler);
+}
+
+static bool timespec_before(const struct timespec *a,
+			    const struct timespec *b)
+{
+	if (a->tv_sec == b->tv_sec)
+		return a->tv_nsec < b->tv_nsec;
+
+	return a->tv_sec < b->tv_sec;
+}
+
+static void sampler_read_samples(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_sampler) struct gpiod_sampler *sampler = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_sampler_config config;
+	struct gpiod_sampler_stats stats;
+	struct gpiod_sample samples[16];
+	struct timespec timeout = { 1, 0 };
+	int status, num, i;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 4; i++)
+		gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, i));
+
+	status = gpiod_line_request_bulk_input(&bulk, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.period.tv_nsec = 1000000;
+	config.batch_size = 16;
+
+	sampler = gpiod_sampler_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(sampler);
+
+	status = gpiod_sampler_start(sampler);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_sampler_wait(sampler, &timeout);
+	GU_ASSERT_EQ(status, 1);
+
+	num = gpiod_sampler_read(sampler, samples, GU_ARRAY_SIZE(samples));
+	GU_ASSERT_EQ(num, 16);
+
+	for (i = 0; i < num; i++) {
+		GU_ASSERT_EQ(samples[i].values, 0);
+		if (i > 0)
+			GU_ASSERT(timespec_before(&samples[i - 1].ts,
+						  &samples[i].ts));
+	}
+
+	gpiod_sampler_stop(sampler);
+
+	gpiod_sampler_get_stats(sampler, &stats);
+	GU_ASSERT(stats.num_samples >= 16);
+}
+GU_DEFINE_TEST(sampler_read_samples,
+	       "gpiod_sampler_read() - good",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void sampler_restart(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_sampler) struct gpiod_sampler *sampler = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct timespec timeout = { 0, 0 }, delay = { 0, 50000000 };
+	struct gpiod_sampler_config config;
+	struct gpiod_sampler_stats stats;
+	struct gpiod_sample samples[64];
+	int status, num;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 0));
+
+	status = gpiod_line_request_bulk_input(&bulk, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.period.tv_nsec = 1000000;
+	config.batch_size = 1000;
+
+	sampler = gpiod_sampler_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(sampler);
+
+	status = gpiod_sampler_start(sampler);
+	GU_ASSERT_RET_OK(status);
+
+	nanosleep(&delay, NULL);
+	gpiod_sampler_stop(sampler);
+
+	/* The incomplete last batch is signalled once the thread stops. */
+	status = gpiod_sampler_wait(sampler, &timeout);
+	GU_ASSERT_EQ(status, 1);
+
+	num = gpiod_sampler_read(sampler, samples, GU_ARRAY_SIZE(samples));
+	GU_ASSERT(num > 10);
+
+	status = gpiod_sampler_start(sampler);
+	GU_ASSERT_RET_OK(status);
+
+	gpiod_sampler_stop(sampler);
+
+	/* The statistics only cover the last run. */
+	gpiod_sampler_get_stats(sampler, &stats);
+	GU_ASSERT(stats.num_samples < (unsigned long long)num);
+}
+GU_DEFINE_TEST(sampler_restart,
+	       "gpiod_sampler_start() - restart after stop",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void sampler_lines_not_requested(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_sampler) struct gpiod_sampler *sampler = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_sampler_config config;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 0));
+
+	memset(&config, 0, sizeof(config));
+	config.period.tv_nsec = 1000000;
+
+	sampler = gpiod_sampler_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(sampler);
+
+	status = gpiod_sampler_start(sampler);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EREQUEST);
+}
+GU_DEFINE_TEST(sampler_lines_not_requested,
+	       "gpiod_sampler_start() - lines not requested",
+	       GU_LINES_UNNAMED, { 8 });
@@ -0,0 +1,177 @@
+/*
+ * Timed output scheduler test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+#include <errno.h>
+
+static void free_sched(struct gpiod_sched **sched)
+{
+	if (*sched)
+		gpiod_sched_free(*sched);
+}
+
+static void sched_set_bulk(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_sched) struct gpiod_sched *sched = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct timespec delay = { 0, 10000000 };
+	struct timespec timeout = { 1, 0 };
+	int status, vals[4] = { 0, 0, 0, 0 };
+	unsigned int i;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 4; i++)
+		gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, i));
+
+	status = gpiod_line_request_bulk_output(&bulk, "gpiod-unit",
+						false, vals);
+	GU_ASSERT_RET_OK(status);
+
+	sched = gpiod_sched_new(NULL);
+	GU_ASSERT_NOT_NULL(sched);
+
+	GU_ASSERT(gpiod_sched_add(sched, bulk.lines[1], 1, &delay) > 0);
+	GU_ASSERT(gpiod_sched_add(sched, bulk.lines[3], 1, &delay) > 0);
+	GU_ASSERT_EQ(gpiod_sched_num_pending(sched), 2);
+
+	status = gpiod_sched_wait(sched, &timeout);
+	GU_ASSERT_EQ(status, 1);
+
+	status = gpiod_sched_dispatch(sched);
+	GU_ASSERT_EQ(status, 2);
+	GU_ASSERT_EQ(gpiod_sched_num_pending(sched), 0);
+
+	status = gpiod_line_get_value_bulk(&bulk, vals);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(vals[0], 0);
+	GU_ASSERT_EQ(vals[1], 1);
+	GU_ASSERT_EQ(vals[2], 0);
+	GU_ASSERT_EQ(vals[3], 1);
+}
+GU_DEFINE_TEST(sched_set_bulk,
+	       "gpiod_sched_dispatch() - coalesce bulk set",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void sched_many_requests(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chipA = NULL;
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chipB = NULL;
+	GU_CLEANUP(free_sched) struct gpiod_sched *sched = NULL;
+	struct timespec delay = { 0, 10000000 };
+	struct timespec timeout = { 1, 0 };
+	struct gpiod_line *line;
+	unsigned int i;
+	int status;
+
+	chipA = gpiod_chip_open(gu_chip_path(0));
+	chipB = gpiod_chip_open(gu_chip_path(1));
+	GU_ASSERT_NOT_NULL(chipA);
+	GU_ASSERT_NOT_NULL(chipB);
+
+	sched = gpiod_sched_new(NULL);
+	GU_ASSERT_NOT_NULL(sched);
+
+	/* Every line is a separate request, all of them due in one tick. */
+	for (i = 0; i < 80; i++) {
+		line = gpiod_chip_get_line(i < 40 ? chipA : chipB, i % 40);
+		GU_ASSERT_NOT_NULL(line);
+
+		status = gpiod_line_request_output(line, "gpiod-unit",
+						   false, 0);
+		GU_ASSERT_RET_OK(status);
+
+		GU_ASSERT(gpiod_sched_add(sched, line, 1, &delay) > 0);
+	}
+
+	status = gpiod_sched_wait(sched, &timeout);
+	GU_ASSERT_EQ(status, 1);
+
+	status = gpiod_sched_dispatch(sched);
+	GU_ASSERT_EQ(status, 80);
+	GU_ASSERT_EQ(gpiod_sched_num_pending(sched), 0);
+
+	for (i = 0; i < 80; i++) {
+		line = gpiod_chip_get_line(i < 40 ? chipA : chipB, i % 40);
+		GU_ASSERT_EQ(gpiod_line_get_value(line), 1);
+	}
+}
+GU_DEFINE_TEST(sched_many_requests,
+	       "gpiod_sched_dispatch() - more requests than groups",
+	       GU_LINES_UNNAMED, { 40, 40 });
+
+static void sched_cancel(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_sched) struct gpiod_sched *sched = NULL;
+	struct timespec delay = { 0, 10000000 };
+	struct timespec timeout = { 0, 50000000 };
+	struct gpiod_line *line;
+	long id;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 2);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_request_output(line, "gpiod-unit", false, 0);
+	GU_ASSERT_RET_OK(status);
+
+	sched = gpiod_sched_new(NULL);
+	GU_ASSERT_NOT_NULL(sched);
+
+	id = gpiod_sched_add(sched, line, 1, &delay);
+	GU_ASSERT(id > 0);
+
+	status = gpiod_sched_cancel(sched, id);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(gpiod_sched_num_pending(sched), 0);
+
+	status = gpiod_sched_cancel(sched, id);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), ENOENT);
+
+	gpiod_sched_wait(sched, &timeout);
+	status = gpiod_sched_dispatch(sched);
+	GU_ASSERT_EQ(status, 0);
+	GU_ASSERT_EQ(gpiod_line_get_value(line), 0);
+}
+GU_DEFINE_TEST(sched_cancel,
+	       "gpiod_sched_cancel() - good",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void sched_line_not_reserved(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_sched) struct gpiod_sched *sched = NULL;
+	struct gpiod_line *line;
+	long id;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 2);
+	GU_ASSERT_NOT_NULL(line);
+
+	sched = gpiod_sched_new(NULL);
+	GU_ASSERT_NOT_NULL(sched);
+
+	id = gpiod_sched_add(sched, line, 1, NULL);
+	GU_ASSERT_EQ(id, -1);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EREQUEST);
+}
+GU_DEFINE_TEST(sched_line_not_reserved,
+	       "gpiod_sched_add() - line not reserved",
+	       GU_LINES_UNNAMED, { 8 });
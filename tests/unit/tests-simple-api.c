@@ -114,3 +114,46 @@ static void simple_set_value_multiple_max_lines(void)
 GU_DEFINE_TEST(simple_set_value_multiple_max_lines,
 	       "gpiod_simple_set_value_multiple() exceed max lines",
 	       GU_LINES_UNNAMED, { 128 });
+
+struct simple_event_data {
+	int num_timeouts;
+	int num_other;
+};
+
+static int simple_event_loop_timeout_cb(int evtype, unsigned int offset,
+					const struct timespec *ts GU_UNUSED,
+					void *data)
+{
+	struct simple_event_data *evdata = data;
+
+	if (evtype == GPIOD_EVENT_CB_TIMEOUT && offset == 0)
+		evdata->num_timeouts++;
+	else
+		evdata->num_other++;
+
+	return evdata->num_timeouts == 2 ? GPIOD_EVENT_CB_STOP
+					 : GPIOD_EVENT_CB_OK;
+}
+
+static void simple_event_loop_multiple_timeout(void)
+{
+	unsigned int offsets[] = { 1, 3, 5 };
+	struct timespec timeout = { 0, 10000000 };
+	struct simple_event_data evdata;
+	int ret;
+
+	memset(&evdata, 0, sizeof(evdata));
+
+	ret = gpiod_simple_event_loop_multiple("gpiod-unit", gu_chip_name(0),
+					       offsets, 3, false,
+					       GPIOD_EVENT_RISING_EDGE,
+					       &timeout,
+					       simple_event_loop_timeout_cb,
+					       &evdata);
+	GU_ASSERT_RET_OK(ret);
+	GU_ASSERT_EQ(evdata.num_timeouts, 2);
+	GU_ASSERT_EQ(evdata.num_other, 0);
+}
+GU_DEFINE_TEST(simple_event_loop_multiple_timeout,
+	       "gpiod_simple_event_loop_multiple() - timeout",
+	       GU_LINES_UNNAMED, { 8 });
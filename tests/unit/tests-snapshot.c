@@ -0,0 +1,254 @@
+/*
+ * Shared value snapshot test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#define SNAPSHOT_NAME	"/gpiod-unit-snapshot"
+
+static void free_publisher(struct gpiod_publisher **pub)
+{
+	if (*pub)
+		gpiod_publisher_free(*pub);
+}
+
+static void close_reader(struct gpiod_snapshot_reader **reader)
+{
+	if (*reader)
+		gpiod_snapshot_close(*reader);
+}
+
+static void snapshot_read_sampled(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_publisher) struct gpiod_publisher *pub = NULL;
+	GU_CLEANUP(close_reader) struct gpiod_snapshot_reader *reader = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_publisher_config config;
+	struct gpiod_snapshot first, second;
+	unsigned int i;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 4; i++)
+		gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, i + 2));
+
+	status = gpiod_line_request_bulk_input(&bulk, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = SNAPSHOT_NAME;
+	config.period.tv_nsec = 1000000;
+
+	pub = gpiod_publisher_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(pub);
+
+	status = gpiod_publisher_start(pub);
+	GU_ASSERT_RET_OK(status);
+
+	reader = gpiod_snapshot_open(SNAPSHOT_NAME);
+	GU_ASSERT_NOT_NULL(reader);
+
+	GU_ASSERT_EQ(gpiod_snapshot_num_lines(reader), 4);
+	GU_ASSERT_EQ(gpiod_snapshot_offset(reader, 3), 5);
+	GU_ASSERT_STR_EQ(gpiod_snapshot_chip_name(reader), gu_chip_name(0));
+
+	status = gpiod_snapshot_read(reader, &first);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(first.values, 0);
+
+	usleep(10000);
+
+	status = gpiod_snapshot_read(reader, &second);
+	GU_ASSERT_RET_OK(status);
+
+	/* Nothing changed, but the publisher kept sampling. */
+	GU_ASSERT_EQ(second.generation, first.generation);
+	GU_ASSERT(second.heartbeat.tv_sec > first.heartbeat.tv_sec ||
+		  second.heartbeat.tv_nsec > first.heartbeat.tv_nsec);
+	GU_ASSERT_EQ(gpiod_publisher_error(pub), 0);
+}
+GU_DEFINE_TEST(snapshot_read_sampled,
+	       "gpiod_snapshot_read() - sampled",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void snapshot_read_events(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_publisher) struct gpiod_publisher *pub = NULL;
+	GU_CLEANUP(close_reader) struct gpiod_snapshot_reader *reader = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_line_evreq_config evconfig;
+	struct gpiod_publisher_config config;
+	struct gpiod_snapshot first, second;
+	unsigned int i;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	for (i = 0; i < 3; i++)
+		gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, i + 1));
+
+	/* The line past the first one is high from the start. */
+	status = gu_set_event(0, 2, 1);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&evconfig, 0, sizeof(evconfig));
+	evconfig.consumer = "gpiod-unit";
+	evconfig.event_type = GPIOD_EVENT_BOTH_EDGES;
+
+	status = gpiod_line_event_request_bulk(&bulk, &evconfig);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = SNAPSHOT_NAME;
+
+	pub = gpiod_publisher_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(pub);
+
+	status = gpiod_publisher_start(pub);
+	GU_ASSERT_RET_OK(status);
+
+	reader = gpiod_snapshot_open(SNAPSHOT_NAME);
+	GU_ASSERT_NOT_NULL(reader);
+
+	status = gpiod_snapshot_read(reader, &first);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(first.values, 0x2);
+
+	status = gu_set_event(0, 3, 1);
+	GU_ASSERT_RET_OK(status);
+	usleep(10000);
+
+	status = gpiod_snapshot_read(reader, &second);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(second.values, 0x6);
+	GU_ASSERT_EQ(second.generation, first.generation + 1);
+	GU_ASSERT_EQ(gpiod_publisher_error(pub), 0);
+}
+GU_DEFINE_TEST(snapshot_read_events,
+	       "gpiod_snapshot_read() - updated from events",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void snapshot_events_one_edge(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_publisher) struct gpiod_publisher *pub = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_line_evreq_config evconfig;
+	struct gpiod_publisher_config config;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 0));
+
+	memset(&evconfig, 0, sizeof(evconfig));
+	evconfig.consumer = "gpiod-unit";
+	evconfig.event_type = GPIOD_EVENT_RISING_EDGE;
+
+	status = gpiod_line_event_request_bulk(&bulk, &evconfig);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = SNAPSHOT_NAME;
+
+	pub = gpiod_publisher_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(pub);
+
+	/* The level can't be tracked from rising edges alone. */
+	status = gpiod_publisher_start(pub);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), EINVAL);
+}
+GU_DEFINE_TEST(snapshot_events_one_edge,
+	       "gpiod_publisher_start() - events for one edge only",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void snapshot_events_not_requested(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_publisher) struct gpiod_publisher *pub = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_publisher_config config;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 0));
+
+	status = gpiod_line_request_bulk_input(&bulk, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = SNAPSHOT_NAME;
+
+	pub = gpiod_publisher_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(pub);
+
+	/* Without a period the lines need to be requested for events. */
+	status = gpiod_publisher_start(pub);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EEVREQUEST);
+}
+GU_DEFINE_TEST(snapshot_events_not_requested,
+	       "gpiod_publisher_start() - lines not requested for events",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void snapshot_name_taken(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	GU_CLEANUP(free_publisher) struct gpiod_publisher *first = NULL;
+	GU_CLEANUP(free_publisher) struct gpiod_publisher *second = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	struct gpiod_publisher_config config;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, 0));
+
+	status = gpiod_line_request_bulk_input(&bulk, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	memset(&config, 0, sizeof(config));
+	config.name = SNAPSHOT_NAME;
+	config.period.tv_nsec = 1000000;
+
+	first = gpiod_publisher_new(&bulk, &config);
+	GU_ASSERT_NOT_NULL(first);
+
+	second = gpiod_publisher_new(&bulk, &config);
+	GU_ASSERT_NULL(second);
+	GU_ASSERT_EQ(gpiod_errno(), EEXIST);
+}
+GU_DEFINE_TEST(snapshot_name_taken,
+	       "gpiod_publisher_new() - name already taken",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void snapshot_open_missing(void)
+{
+	struct gpiod_snapshot_reader *reader;
+
+	reader = gpiod_snapshot_open("/gpiod-unit-no-such-snapshot");
+	GU_ASSERT_NULL(reader);
+	GU_ASSERT_EQ(gpiod_errno(), ENOENT);
+}
+GU_DEFINE_TEST(snapshot_open_missing,
+	       "gpiod_snapshot_open() - no such object",
+	       GU_LINES_UNNAMED, { 8 });
@@ -0,0 +1,148 @@
+/*
+ * Performance statistics test cases for libgpiod.
+ *
+ * Copyright (C) 2017 Bartosz Golaszewski <bartekgola@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of version 2.1 of the GNU Lesser General Public License
+ * as published by the Free Software Foundation.
+ */
+
+#include "gpiod-unit.h"
+
+static unsigned long long hist_sum(const struct gpiod_ioctl_stats *stats)
+{
+	unsigned long long sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < GPIOD_STATS_HIST_BUCKETS; i++)
+		sum += stats->hist[i];
+
+	return sum;
+}
+
+static void stats_disabled(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_stats stats;
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	line = gpiod_chip_get_line(chip, 2);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_request_input(line, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_get_value(line);
+	GU_ASSERT_EQ(status, 0);
+
+	gpiod_chip_get_stats(chip, &stats);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_GET_VALUES].count, 0);
+
+	status = gpiod_line_get_stats(line, &stats);
+	GU_ASSERT_NOTEQ(status, 0);
+	GU_ASSERT_EQ(gpiod_errno(), GPIOD_EREQUEST);
+}
+GU_DEFINE_TEST(stats_disabled,
+	       "gpiod_chip_get_stats() - disabled",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void stats_count_ioctls(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+	const struct gpiod_ioctl_stats *ioctl;
+	int status, values[2] = { 0, 1 };
+	struct gpiod_line *line0, *line1;
+	struct gpiod_stats stats;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	status = gpiod_chip_enable_stats(chip);
+	GU_ASSERT_RET_OK(status);
+
+	line0 = gpiod_chip_get_line(chip, 1);
+	line1 = gpiod_chip_get_line(chip, 3);
+	GU_ASSERT_NOT_NULL(line0);
+	GU_ASSERT_NOT_NULL(line1);
+
+	gpiod_line_bulk_add(&bulk, line0);
+	gpiod_line_bulk_add(&bulk, line1);
+
+	status = gpiod_line_request_bulk_output(&bulk, "gpiod-unit",
+						false, values);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_set_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+	status = gpiod_line_set_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_get_value_bulk(&bulk, values);
+	GU_ASSERT_RET_OK(status);
+
+	/* Both lines share the statistics of their request. */
+	status = gpiod_line_get_stats(line1, &stats);
+	GU_ASSERT_RET_OK(status);
+
+	ioctl = &stats.ioctls[GPIOD_STATS_IOCTL_SET_VALUES];
+	GU_ASSERT_EQ(ioctl->count, 2);
+	GU_ASSERT_EQ(ioctl->errors, 0);
+	GU_ASSERT_EQ(hist_sum(ioctl), 2);
+	GU_ASSERT(ioctl->max_ns <= ioctl->total_ns);
+
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_GET_VALUES].count, 1);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_LINEHANDLE].count, 1);
+
+	gpiod_line_release_bulk(&bulk);
+
+	gpiod_chip_get_stats(chip, &stats);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_SET_VALUES].count, 2);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_GET_VALUES].count, 1);
+	/* Lines are updated after being requested and released. */
+	GU_ASSERT(stats.ioctls[GPIOD_STATS_IOCTL_LINEINFO].count >= 2);
+}
+GU_DEFINE_TEST(stats_count_ioctls,
+	       "gpiod_chip_get_stats() - count ioctls",
+	       GU_LINES_UNNAMED, { 8 });
+
+static void stats_count_polls(void)
+{
+	GU_CLEANUP(gu_close_chip) struct gpiod_chip *chip = NULL;
+	struct timespec ts = { 0, 10000000 };
+	struct gpiod_stats stats;
+	struct gpiod_line *line;
+	int status;
+
+	chip = gpiod_chip_open(gu_chip_path(0));
+	GU_ASSERT_NOT_NULL(chip);
+
+	status = gpiod_chip_enable_stats(chip);
+	GU_ASSERT_RET_OK(status);
+
+	line = gpiod_chip_get_line(chip, 7);
+	GU_ASSERT_NOT_NULL(line);
+
+	status = gpiod_line_event_request_all(line, "gpiod-unit", false);
+	GU_ASSERT_RET_OK(status);
+
+	status = gpiod_line_event_wait(line, &ts);
+	GU_ASSERT_EQ(status, 0);
+
+	status = gpiod_line_get_stats(line, &stats);
+	GU_ASSERT_RET_OK(status);
+	GU_ASSERT_EQ(stats.ioctls[GPIOD_STATS_IOCTL_LINEEVENT].count, 1);
+	GU_ASSERT_EQ(stats.events_read, 0);
+
+	gpiod_chip_get_stats(chip, &stats);
+	GU_ASSERT_EQ(stats.polls, 1);
+	GU_ASSERT_EQ(stats.poll_timeouts, 1);
+}
+GU_DEFINE_TEST(stats_count_polls,
+	       "gpiod_chip_get_stats() - count polls",
+	       GU_LINES_UNNAMED, { 8 });